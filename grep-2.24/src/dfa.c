@@ -323,7 +323,7 @@ struct dfa
                                    with dfaparse.  */
   bool fast;			/* The DFA is fast.  */
   bool multibyte;		/* MB_CUR_MAX > 1.  */
-  token utf8_anychar_classes[5]; /* To lower ANYCHAR in UTF-8 locales.  */
+  token utf8_anychar_classes[7]; /* To lower ANYCHAR in UTF-8 locales.  */
   mbstate_t mbs;		/* Multibyte conversion state.  */
 
   /* dfaexec implementation.  */
@@ -402,6 +402,15 @@ struct dfa
                                    and trans[-1] is always NULL.  */
   state_num **fails;            /* Transition tables after failing to accept
                                    on a state that potentially could do so.  */
+  state_num **evicted;          /* Transition tables that have been taken
+                                   out of trans or fails, and that are freed
+                                   unless they are used again before the
+                                   clock hand comes back to them.  */
+  int trmax;                    /* Maximum number of transition tables,
+                                   including evicted ones.  */
+  state_num clock;              /* Next state whose table is examined when
+                                   one must be freed.  */
+  struct dfastats stats;        /* Statistics about transition tables.  */
   int *success;                 /* Table of acceptance conditions used in
                                    dfaexec and computed in build_state.  */
   state_num *newlines;          /* Transitions on newlines.  The entry for a
@@ -418,6 +427,10 @@ struct dfa
   int *mb_match_lens;           /* Array of length reduced by ANYCHAR and/or
                                    MBCSET.  Null if mb_follows.elems has not
                                    been allocated.  */
+
+  bool copied;                  /* The fields filled by the scanner, the
+                                   parser and the NFA conversion belong to
+                                   the dfa that this one is a copy of.  */
 };
 
 /* Some macros for user access to dfa internals.  */
@@ -665,6 +678,9 @@ static unsigned char eolbyte;
 /* Cache of char-context values.  */
 static int sbit[NOTCHAR];
 
+/* Maximum number of transition tables that a DFA keeps at once.  */
+static int trmax = 1024;
+
 /* Set of characters considered letters.  */
 static charclass letters;
 
@@ -730,6 +746,14 @@ dfasyntax (reg_syntax_t bits, int fold, unsigned char eol)
     }
 }
 
+/* Entry point to limit the memory used by transition tables.  */
+void
+dfacachesize (size_t size)
+{
+  size_t n = size / (NOTCHAR * sizeof (state_num));
+  trmax = n == 0 ? 1 : n <= INT_MAX ? n : INT_MAX;
+}
+
 /* Set a bit in the charclass for the given wchar_t.  Do nothing if WC
    is represented by a multi-byte sequence.  Even for MB_CUR_MAX == 1,
    this may happen when folding case in weird Turkish locales where
@@ -955,8 +979,56 @@ find_pred (const char *str)
   return NULL;
 }
 
+/* In a UTF-8 locale, the characters matched by the bracket expression
+   being parsed, as a bit vector indexed by code point.  It has room for
+   every value that a 4-byte sequence can denote, so that add_utf8_seqs
+   can treat all lead bytes alike; only code points up to UTF8_MAX are
+   ever set.  */
+enum { UTF8_SET_BITS = 1 << 21, UTF8_MAX = 0x10FFFF };
+static unsigned char *utf8_set;
+
+static void
+utf8_setbit (wint_t wc)
+{
+  if (wc <= UTF8_MAX)
+    utf8_set[wc / CHAR_BIT] |= 1 << wc % CHAR_BIT;
+}
+
+static bool
+utf8_tstbit (unsigned int wc)
+{
+  return utf8_set[wc / CHAR_BIT] >> wc % CHAR_BIT & 1;
+}
+
+/* Add the members of the character class PRED to utf8_set.  Computing
+   a class means asking iswctype about every code point, so remember
+   each class computed.  */
+static void
+utf8_setclass (struct dfa_ctype const *pred)
+{
+  static unsigned char *classes[sizeof prednames / sizeof *prednames];
+  unsigned char *class = classes[pred - prednames];
+  size_t i;
+
+  if (!class)
+    {
+      wctype_t type = wctype (pred->name);
+      wint_t wc;
+
+      class = classes[pred - prednames] = xzalloc ((UTF8_MAX + 1) / CHAR_BIT);
+      for (wc = 0; wc <= UTF8_MAX; wc++)
+        if (iswctype (wc, type))
+          class[wc / CHAR_BIT] |= 1 << wc % CHAR_BIT;
+    }
+
+  for (i = 0; i < (UTF8_MAX + 1) / CHAR_BIT; i++)
+    utf8_set[i] |= class[i];
+}
+
 /* Multibyte character handling sub-routine for lex.
-   Parse a bracket expression and build a struct mb_char_classes.  */
+   Parse a bracket expression and build a struct mb_char_classes.
+   In a UTF-8 locale, build utf8_set instead, so that addtok can
+   expand the bracket expression into single-byte tokens.  */
 static token
 parse_bracket_exp (void)
 {
@@ -983,8 +1055,17 @@ parse_bracket_exp (void)
   struct mb_char_classes *work_mbc;
   size_t chars_al;
 
+  bool utf8 = dfa->multibyte && using_utf8 ();
+
   chars_al = 0;
-  if (dfa->multibyte)
+  if (utf8)
+    {
+      if (!utf8_set)
+        utf8_set = xmalloc (UTF8_SET_BITS / CHAR_BIT);
+      memset (utf8_set, 0, UTF8_SET_BITS / CHAR_BIT);
+      work_mbc = NULL;
+    }
+  else if (dfa->multibyte)
     {
       dfa->mbcsets = maybe_realloc (dfa->mbcsets, dfa->nmbcsets,
                                     &dfa->mbcsets_alloc,
@@ -1007,7 +1088,7 @@ parse_bracket_exp (void)
     {
       FETCH_WC (c, wc, _("unbalanced ["));
       invert = true;
-      known_bracket_exp = using_simple_locale ();
+      known_bracket_exp = utf8 || using_simple_locale ();
     }
   else
     invert = false;
@@ -1060,7 +1141,9 @@ parse_bracket_exp (void)
                   if (!pred)
                     dfaerror (_("invalid character class"));
 
-                  if (dfa->multibyte && !pred->single_byte_only)
+                  if (utf8)
+                    utf8_setclass (pred);
+                  else if (dfa->multibyte && !pred->single_byte_only)
                     known_bracket_exp = false;
                   else
                     for (c2 = 0; c2 < NOTCHAR; ++c2)
@@ -1119,7 +1202,12 @@ parse_bracket_exp (void)
               /* Treat [x-y] as a range if x != y.  */
               if (wc != wc2 || wc == WEOF)
                 {
-                  if (dfa->multibyte)
+                  /* Ranges other than digit ranges depend on the
+                     locale's collation order.  */
+                  if (utf8 && ISASCIIDIGIT (wc) && ISASCIIDIGIT (wc2))
+                    for (; wc <= wc2; wc++)
+                      utf8_setbit (wc);
+                  else if (dfa->multibyte)
                     known_bracket_exp = false;
                   else if (using_simple_locale ())
                     {
@@ -1168,7 +1256,9 @@ parse_bracket_exp (void)
                             : 1);
           folded[0] = wc;
           for (i = 0; i < n; i++)
-            if (!setbit_wc (folded[i], ccl))
+            if (utf8)
+              utf8_setbit (folded[i]);
+            else if (!setbit_wc (folded[i], ccl))
               {
                 work_mbc->chars
                   = maybe_realloc (work_mbc->chars, work_mbc->nchars,
@@ -1185,6 +1275,21 @@ parse_bracket_exp (void)
   if (! known_bracket_exp)
     return BACKREF;
 
+  if (utf8)
+    {
+      if (invert)
+        {
+          size_t i;
+          for (i = 0; i < (UTF8_MAX + 1) / CHAR_BIT; i++)
+            utf8_set[i] = ~utf8_set[i];
+          /* Surrogates have no valid UTF-8 encoding.  */
+          memset (utf8_set + 0xd800 / CHAR_BIT, 0, 0x800 / CHAR_BIT);
+          if (syntax_bits & RE_HAT_LISTS_NOT_NEWLINE)
+            utf8_set['\n' / CHAR_BIT] &= ~(1 << '\n' % CHAR_BIT);
+        }
+      return MBCSET;
+    }
+
   if (dfa->multibyte)
     {
       static charclass zeroclass;
@@ -1465,9 +1570,6 @@ lex (void)
               return lasttok = CSET + charclass_index (ccl);
             }
 
-          /* FIXME: see if optimizing this, as is done with ANYCHAR and
-             add_utf8_anychar, makes sense.  */
-
           /* \s and \S are documented to be equivalent to [[:space:]] and
              [^[:space:]] respectively, so tell the lexer to process those
              strings, each minus its "already processed" '['.  */
@@ -1497,9 +1599,6 @@ lex (void)
               return lasttok = CSET + charclass_index (ccl);
             }
 
-          /* FIXME: see if optimizing this, as is done with ANYCHAR and
-             add_utf8_anychar, makes sense.  */
-
           /* \w and \W are documented to be equivalent to [_[:alnum:]] and
              [^_[:alnum:]] respectively, so tell the lexer to process those
              strings, each minus its "already processed" '['.  */
@@ -1594,13 +1693,16 @@ addtok_mb (token t, int mbprop)
 }
 
 static void addtok_wc (wint_t wc);
+static void add_utf8_set (void);
 
 /* Add the given token to the parse tree, maintaining the depth count and
    updating the maximum depth if necessary.  */
 static void
 addtok (token t)
 {
-  if (dfa->multibyte && t == MBCSET)
+  if (dfa->multibyte && t == MBCSET && using_utf8 ())
+    add_utf8_set ();
+  else if (dfa->multibyte && t == MBCSET)
     {
       bool need_or = false;
       struct mb_char_classes *work_mbc = &dfa->mbcsets[dfa->nmbcsets - 1];
@@ -1667,7 +1769,7 @@ addtok_wc (wint_t wc)
 static void
 add_utf8_anychar (void)
 {
-  static charclass const utf8_classes[5] = {
+  static charclass const utf8_classes[7] = {
     /* 80-bf: non-leading bytes.  */
     {0, 0, 0, 0, CHARCLASS_WORD_MASK, CHARCLASS_WORD_MASK, 0, 0},
 
@@ -1681,13 +1783,19 @@ add_utf8_anychar (void)
     /* e0-ef: 3-byte sequence.  */
     {0, 0, 0, 0, 0, 0, 0, 0xffff},
 
-    /* f0-f7: 4-byte sequence.  */
-    {0, 0, 0, 0, 0, 0, 0, 0xff0000}
+    /* f0-f3: 4-byte sequence.  */
+    {0, 0, 0, 0, 0, 0, 0, 0xf0000},
+
+    /* f4: 4-byte sequence up to U+10FFFF.  */
+    {0, 0, 0, 0, 0, 0, 0, 0x100000},
+
+    /* 80-8f: second byte after f4.  */
+    {0, 0, 0, 0, 0xffff, 0, 0, 0}
   };
   const unsigned int n = sizeof (utf8_classes) / sizeof (utf8_classes[0]);
   unsigned int i;
 
-  /* Define the five character classes that are needed below.  */
+  /* Define the seven character classes that are needed below.  */
   if (dfa->utf8_anychar_classes[0] == 0)
     for (i = 0; i < n; i++)
       {
@@ -1708,14 +1816,24 @@ add_utf8_anychar (void)
      ([0x00-0x7f]
      |[0xc2-0xdf][0x80-0xbf]
      |[0xe0-0xef[0x80-0xbf][0x80-0xbf]
-     |[0xf0-f7][0x80-0xbf][0x80-0xbf][0x80-0xbf])
-
-     which I'll write more concisely "B|CA|DAA|EAAA".  Factor the [0x00-0x7f]
-     and you get "B|(C|(D|EA)A)A".  And since the token buffer is in reverse
-     Polish notation, you get "B C D E A CAT OR A CAT OR A CAT OR".  */
-  for (i = 1; i < n; i++)
+     |[0xf0-f3][0x80-0xbf][0x80-0xbf][0x80-0xbf]
+     |[0xf4][0x80-0x8f][0x80-0xbf][0x80-0xbf])
+
+     which I'll write more concisely "B|CA|DAA|EAAA|FGAA".  Stopping at
+     U+10FFFF, as utf8_setbit does, keeps '.' and [^x] in agreement about
+     which sequences are characters.  Factor the [0x00-0x7f] and you get
+     "B|(C|(D|EA|FG)A)A".  And since the token buffer is in reverse Polish
+     notation, you get "B C D E A CAT F G CAT OR OR A CAT OR A CAT OR".  */
+  for (i = 1; i < 5; i++)
     addtok (dfa->utf8_anychar_classes[i]);
-  while (--i > 1)
+  addtok (dfa->utf8_anychar_classes[0]);
+  addtok (CAT);
+  addtok (dfa->utf8_anychar_classes[5]);
+  addtok (dfa->utf8_anychar_classes[6]);
+  addtok (CAT);
+  addtok (OR);
+  addtok (OR);
+  for (i = 0; i < 2; i++)
     {
       addtok (dfa->utf8_anychar_classes[0]);
       addtok (CAT);
@@ -1723,6 +1841,125 @@ add_utf8_anychar (void)
     }
 }
 
+/* Return true if the code points [A, A + N) and [B, B + N) are
+   members of utf8_set in the same pattern.  N is 1 or a multiple of
+   CHAR_BIT, and A and B are multiples of N.  */
+static bool
+utf8_equal (unsigned int a, unsigned int b, unsigned int n)
+{
+  if (n == 1)
+    return utf8_tstbit (a) == utf8_tstbit (b);
+  return memcmp (utf8_set + a / CHAR_BIT, utf8_set + b / CHAR_BIT,
+                 n / CHAR_BIT) == 0;
+}
+
+/* Return true if none of the code points [A, A + N) are in utf8_set.  */
+static bool
+utf8_empty (unsigned int a, unsigned int n)
+{
+  unsigned char const *p, *lim;
+
+  if (n == 1)
+    return !utf8_tstbit (a);
+  for (p = utf8_set + a / CHAR_BIT, lim = p + n / CHAR_BIT; p < lim; p++)
+    if (*p)
+      return false;
+  return true;
+}
+
+/* Add tokens matching the sequences of a byte LEAD + I followed by K
+   continuation bytes, for 0 <= I < NBYTES, that encode the members of
+   utf8_set.  Such a sequence denotes a code point in [BASE + I * 64**K,
+   BASE + (I + 1) * 64**K).  Lead bytes whose continuations match the
+   same code points share a single CSET, which keeps the tokens for a
+   large set like [^a] or [[:alpha:]] small.  Return true if any tokens
+   were added.  */
+static bool
+add_utf8_seqs (unsigned int base, int k, int lead, int nbytes)
+{
+  unsigned int span = 1u << 6 * k;
+  bool done[64] = { false };
+  bool added = false;
+  int i, j;
+
+  for (i = 0; i < nbytes; i++)
+    if (!done[i] && !utf8_empty (base + i * span, span))
+      {
+        charclass ccl;
+        zeroset (ccl);
+        for (j = i; j < nbytes; j++)
+          if (!done[j] && utf8_equal (base + i * span, base + j * span, span))
+            {
+              setbit (lead + j, ccl);
+              done[j] = true;
+            }
+        addtok (CSET + charclass_index (ccl));
+        if (k)
+          {
+            add_utf8_seqs (base + i * span, k - 1, 0x80, 64);
+            addtok (CAT);
+          }
+        if (added)
+          addtok (OR);
+        added = true;
+      }
+
+  return added;
+}
+
+/* Add tokens matching the UTF-8 encodings of the members of utf8_set,
+   the set of characters of a bracket expression.  This extends what
+   add_utf8_anychar does for the period to any set of characters, so
+   that the bracket expression can be matched a byte at a time.
+   utf8_set is clobbered.  */
+static void
+add_utf8_set (void)
+{
+  static charclass zeroclass;
+  charclass ccl;
+  bool added;
+  int c;
+
+  /* Single bytes.  Clear each length's code points from utf8_set once
+     its tokens are added, as the longer sequences would otherwise cover
+     them again with overlong encodings.  */
+  zeroset (ccl);
+  for (c = 0; c < 0x80; c++)
+    if (utf8_tstbit (c))
+      setbit (c, ccl);
+  added = !equal (ccl, zeroclass);
+  if (added)
+    addtok (CSET + charclass_index (ccl));
+  memset (utf8_set, 0, 0x80 / CHAR_BIT);
+
+  if (add_utf8_seqs (0, 1, 0xc0, 32))
+    {
+      if (added)
+        addtok (OR);
+      added = true;
+    }
+  memset (utf8_set, 0, 0x800 / CHAR_BIT);
+
+  if (add_utf8_seqs (0, 2, 0xe0, 16))
+    {
+      if (added)
+        addtok (OR);
+      added = true;
+    }
+  memset (utf8_set, 0, 0x10000 / CHAR_BIT);
+
+  if (add_utf8_seqs (0, 3, 0xf0, 8))
+    {
+      if (added)
+        addtok (OR);
+      added = true;
+    }
+
+  /* An empty set matches nothing.  */
+  if (!added)
+    addtok (CSET + charclass_index (zeroclass));
+}
+
 /* The grammar understood by the parser is as follows.
 
    regexp:
@@ -2859,12 +3096,14 @@ realloc_trans_if_necessary (struct dfa *d, state_num new_state)
       d->trans = realtrans + 1;
       d->tralloc = newalloc = newalloc1 - 1;
       d->fails = xnrealloc (d->fails, newalloc, sizeof *d->fails);
+      d->evicted = xnrealloc (d->evicted, newalloc, sizeof *d->evicted);
       d->success = xnrealloc (d->success, newalloc, sizeof *d->success);
       d->newlines = xnrealloc (d->newlines, newalloc, sizeof *d->newlines);
       for (; oldalloc < newalloc; oldalloc++)
         {
           d->trans[oldalloc] = NULL;
           d->fails[oldalloc] = NULL;
+          d->evicted[oldalloc] = NULL;
         }
     }
 }
@@ -2876,29 +3115,76 @@ realloc_trans_if_necessary (struct dfa *d, state_num new_state)
    If it has no table at all, then d->trans[state] is NULL.
    TODO: Improve this comment, get rid of the unnecessary redundancy.  */
 
+/* Free a transition table of D to make room for one for state S.
+   Use the clock algorithm, which approximates freeing the least
+   recently used table without slowing down dfaexec: sweep the states
+   in turn, evicting each table still in use, and free the first table
+   that was evicted on the previous sweep and has not been used since.
+   A table that is used after being evicted is put back by build_state
+   at little cost.  Do not touch the initial D->min_trcount states,
+   since they are always used.  If there is no table to free, let the
+   number of tables exceed the limit.  */
+static void
+free_trans (struct dfa *d, state_num s)
+{
+  state_num n;
+
+  for (n = 2 * d->tralloc; 0 < n; n--)
+    {
+      state_num i = d->clock;
+      d->clock = i + 1 < d->tralloc ? i + 1 : 0;
+      if (i < d->min_trcount || i == s)
+        continue;
+
+      if (d->evicted[i])
+        {
+          free (d->evicted[i]);
+          d->evicted[i] = NULL;
+          d->trcount--;
+          d->stats.freed++;
+          return;
+        }
+
+      if (d->trans[i])
+        {
+          d->evicted[i] = d->trans[i];
+          d->trans[i] = NULL;
+        }
+      else if (d->fails[i])
+        {
+          d->evicted[i] = d->fails[i];
+          d->fails[i] = NULL;
+        }
+    }
+}
+
 static void
 build_state (state_num s, struct dfa *d)
 {
   state_num *trans;             /* The new transition table.  */
   state_num i, maxstate;
 
-  /* Set an upper limit on the number of transition tables that will ever
-     exist at once.  1024 is arbitrary.  The idea is that the frequently
-     used transition tables will be quickly rebuilt, whereas the ones that
-     were only needed once or twice will be cleared away.  However, do not
-     clear the initial D->min_trcount states, since they are always used.  */
-  if (d->trcount >= 1024)
+  /* If the table for S was evicted but not yet freed, reuse it.  */
+  if (d->evicted[s])
     {
-      for (i = d->min_trcount; i < d->tralloc; ++i)
-        {
-          free (d->trans[i]);
-          free (d->fails[i]);
-          d->trans[i] = d->fails[i] = NULL;
-        }
-      d->trcount = d->min_trcount;
+      if (ACCEPTING (s, *d))
+        d->fails[s] = d->evicted[s];
+      else
+        d->trans[s] = d->evicted[s];
+      d->evicted[s] = NULL;
+      d->stats.reused++;
+      return;
     }
 
+  /* Set an upper limit on the number of transition tables that exist at
+     once, so that patterns with many states do not use too much memory.
+     The frequently used tables stay, whereas the ones that were only
+     needed once or twice are cleared away.  */
+  if (d->trcount >= d->trmax)
+    free_trans (d, s);
+
   ++d->trcount;
+  d->stats.built++;
 
   /* Set up the success bits for this state.  */
   d->success[s] = 0;
@@ -3472,11 +3758,20 @@ void
 dfainit (struct dfa *d)
 {
   memset (d, 0, sizeof *d);
+  d->trmax = trmax;
   d->multibyte = MB_CUR_MAX > 1;
   d->dfaexec = d->multibyte ? dfaexec_mb : dfaexec_sb;
   d->fast = !d->multibyte;
 }
 
+void
+dfastats (struct dfa const *d, struct dfastats *stats)
+{
+  *stats = d->stats;
+  stats->states = d->sindex;
+  stats->tables = d->trcount;
+}
+
 /* Return true if every construct in D is supported by this DFA matcher.  */
 static bool _GL_ATTRIBUTE_PURE
 dfa_supported (struct dfa const *d)
@@ -3562,6 +3857,8 @@ dfassbuild (struct dfa *d)
   sup->tralloc = 0;
   sup->trans = NULL;
   sup->fails = NULL;
+  sup->evicted = NULL;
+  memset (&sup->stats, 0, sizeof sup->stats);
   sup->success = NULL;
   sup->newlines = NULL;
 
@@ -3647,17 +3944,75 @@ dfacomp (char const *s, size_t len, struct dfa *d, int searchflag)
     }
 }
 
+/* Return a copy of D that shares the compiled pattern of D but has
+   states and transition tables of its own, so that the copy and D can
+   search in different threads at the same time.  The copy must be
+   freed before D.  */
+struct dfa *
+dfacopy (struct dfa const *d)
+{
+  struct dfa *dup = dfaalloc ();
+  state_num i;
+
+  *dup = *d;
+  dup->copied = true;
+  memset (&dup->mbs, 0, sizeof dup->mbs);
+  if (d->superset)
+    dup->superset = dfacopy (d->superset);
+
+  dup->states = xnmalloc (d->sindex, sizeof *dup->states);
+  dup->salloc = d->sindex;
+  for (i = 0; i < d->sindex; i++)
+    {
+      dup->states[i] = d->states[i];
+      alloc_position_set (&dup->states[i].elems, d->states[i].elems.nelem);
+      copy (&d->states[i].elems, &dup->states[i].elems);
+      if (d->states[i].mbps.nelem)
+        {
+          alloc_position_set (&dup->states[i].mbps,
+                              d->states[i].mbps.nelem);
+          copy (&d->states[i].mbps, &dup->states[i].mbps);
+        }
+      else
+        {
+          dup->states[i].mbps.elems = NULL;
+          dup->states[i].mbps.nelem = 0;
+        }
+    }
+
+  dup->tralloc = 0;
+  dup->trcount = 0;
+  dup->trans = NULL;
+  dup->fails = NULL;
+  dup->evicted = NULL;
+  dup->clock = 0;
+  memset (&dup->stats, 0, sizeof dup->stats);
+  dup->success = NULL;
+  dup->newlines = NULL;
+  memset (&dup->mb_follows, 0, sizeof dup->mb_follows);
+  dup->mb_match_lens = NULL;
+  return dup;
+}
+
 /* Free the storage held by the components of a dfa.  */
 void
 dfafree (struct dfa *d)
 {
   size_t i;
 
-  free (d->charclasses);
-  free (d->tokens);
+  if (!d->copied)
+    {
+      free (d->charclasses);
+      free (d->tokens);
+    }
 
-  if (d->multibyte)
+  if (d->multibyte && !d->copied)
     free_mbdata (d);
+  else if (d->multibyte)
+    {
+      free (d->mb_follows.elems);
+      free (d->mb_match_lens);
+    }
 
   for (i = 0; i < d->sindex; ++i)
     {
@@ -3666,7 +4021,7 @@ dfafree (struct dfa *d)
     }
   free (d->states);
 
-  if (d->follows)
+  if (d->follows && !d->copied)
     {
       for (i = 0; i < d->tindex; ++i)
         free (d->follows[i].elems);
@@ -3679,10 +4034,12 @@ dfafree (struct dfa *d)
         {
           free (d->trans[i]);
           free (d->fails[i]);
+          free (d->evicted[i]);
         }
 
       free (d->trans - 1);
       free (d->fails);
+      free (d->evicted);
       free (d->newlines);
       free (d->success);
     }
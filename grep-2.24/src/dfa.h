@@ -37,6 +37,20 @@ struct dfamust
 /* The dfa structure. It is completely opaque. */
 struct dfa;
 
+/* Statistics about the transition tables that a struct dfa builds
+   while searching.  Each time dfaexec needs the table of a state that
+   it does not have, it either reuses a table that was evicted but not
+   yet freed, or builds one; so REUSED / (REUSED + BUILT) is the hit
+   rate of the cache of tables.  */
+struct dfastats
+{
+  size_t states;		/* Number of states.  */
+  size_t tables;		/* Number of transition tables held.  */
+  size_t built;			/* Number of tables built.  */
+  size_t reused;		/* Number of evicted tables reused.  */
+  size_t freed;			/* Number of tables freed to make room.  */
+};
+
 /* Entry points. */
 
 /* Allocate a struct dfa.  The struct dfa is completely opaque.
@@ -55,11 +69,22 @@ extern void dfamustfree (struct dfamust *);
    third specifies the line terminator. */
 extern void dfasyntax (reg_syntax_t, int, unsigned char);
 
+/* dfacachesize() sets the number of bytes of transition tables that
+   each struct dfa compiled afterwards may hold at once.  When the limit
+   is reached, tables that have not been used recently are freed.  */
+extern void dfacachesize (size_t);
+
 /* Compile the given string of the given length into the given struct dfa.
    Final argument is a flag specifying whether to build a searching or an
    exact matcher. */
 extern void dfacomp (char const *, size_t, struct dfa *, int);
 
+/* Return a copy of the given struct dfa that shares its compiled pattern
+   but has transition tables of its own, so that the two can be used in
+   different threads at once.  Free the copy with dfafree() and free()
+   before the original.  */
+extern struct dfa *dfacopy (struct dfa const *);
+
 /* Search through a buffer looking for a match to the given struct dfa.
    Find the first occurrence of a string matching the regexp in the
    buffer, and the shortest possible version thereof.  Return a pointer to
@@ -81,6 +106,9 @@ extern char *dfaexec (struct dfa *d, char const *begin, char *end,
    superset is available.  */
 extern struct dfa *dfasuperset (struct dfa const *d) _GL_ATTRIBUTE_PURE;
 
+/* Store into *STATS the statistics of the transition tables of D.  */
+extern void dfastats (struct dfa const *, struct dfastats *);
+
 /* The DFA is likely to be fast.  */
 extern bool dfaisfast (struct dfa const *) _GL_ATTRIBUTE_PURE;
 
@@ -29,32 +29,36 @@ wordchar (wint_t wc)
   return wc == L'_' || iswalnum (wc);
 }
 
-/* KWset compiled pattern.  For Ecompile and Gcompile, we compile
-   a list of strings, at least one of which is known to occur in
-   any string matching the regexp. */
-static kwset_t kwset;
-
-/* DFA compiled regexp. */
-static struct dfa *dfa;
-
 /* The Regex compiled patterns.  */
-static struct patterns
+struct patterns
 {
   /* Regex compiled regexp. */
   struct re_pattern_buffer regexbuf;
   struct re_registers regs; /* This is here on account of a BRAIN-DEAD
                                Q@#%!# library interface in regex.c.  */
-} patterns0;
+};
+
+struct dfa_comp
+{
+  /* KWset compiled pattern.  For Ecompile and Gcompile, we compile
+     a list of strings, at least one of which is known to occur in
+     any string matching the regexp. */
+  kwset_t kwset;
+
+  /* DFA compiled regexp. */
+  struct dfa *dfa;
 
-static struct patterns *patterns;
-static size_t pcount;
+  /* The Regex compiled patterns.  */
+  struct patterns *patterns;
+  size_t pcount;
 
-/* Number of compiled fixed strings known to exactly match the regexp.
-   If kwsexec returns < kwset_exact_matches, then we don't need to
-   call the regexp matcher at all. */
-static size_t kwset_exact_matches;
+  /* Number of compiled fixed strings known to exactly match the regexp.
+     If kwsexec returns < kwset_exact_matches, then we don't need to
+     call the regexp matcher at all. */
+  size_t kwset_exact_matches;
 
-static bool begline;
+  bool begline;
+};
 
 void
 dfaerror (char const *mesg)
@@ -84,46 +88,47 @@ dfawarn (char const *mesg)
    to find those strings, and thus quickly filter out impossible
    matches. */
 static void
-kwsmusts (void)
+kwsmusts (struct dfa_comp *dc)
 {
-  struct dfamust *dm = dfamust (dfa);
+  struct dfamust *dm = dfamust (dc->dfa);
   if (!dm)
     return;
-  kwsinit (&kwset);
+  kwsinit (&dc->kwset);
   if (dm->exact)
     {
       /* Prepare a substring whose presence implies a match.
          The kwset matcher will return the index of the matching
          string that it chooses. */
-      ++kwset_exact_matches;
+      ++dc->kwset_exact_matches;
       size_t old_len = strlen (dm->must);
       size_t new_len = old_len + dm->begline + dm->endline;
       char *must = xmalloc (new_len);
       char *mp = must;
       *mp = eolbyte;
       mp += dm->begline;
-      begline |= dm->begline;
+      dc->begline |= dm->begline;
       memcpy (mp, dm->must, old_len);
       if (dm->endline)
         mp[old_len] = eolbyte;
-      kwsincr (kwset, must, new_len);
+      kwsincr (dc->kwset, must, new_len);
       free (must);
     }
   else
     {
       /* Otherwise, filtering with this substring should help reduce the
          search space, but we'll still have to use the regexp matcher.  */
-      kwsincr (kwset, dm->must, strlen (dm->must));
+      kwsincr (dc->kwset, dm->must, strlen (dm->must));
     }
-  kwsprep (kwset);
+  kwsprep (dc->kwset);
   dfamustfree (dm);
 }
 
-void
+void *
 GEAcompile (char const *pattern, size_t size, reg_syntax_t syntax_bits)
 {
   size_t total = size;
   char *motif;
+  struct dfa_comp *dc = xzalloc (sizeof *dc);
 
   if (match_icase)
     syntax_bits |= RE_ICASE;
@@ -151,14 +156,15 @@ GEAcompile (char const *pattern, size_t size, reg_syntax_t syntax_bits)
           total = 0;
         }
 
-      patterns = xnrealloc (patterns, pcount + 1, sizeof *patterns);
-      patterns[pcount] = patterns0;
+      dc->patterns = xnrealloc (dc->patterns, dc->pcount + 1,
+                                sizeof *dc->patterns);
+      memset (&dc->patterns[dc->pcount], 0, sizeof *dc->patterns);
 
-      char const *err = re_compile_pattern (p, len,
-                                            &(patterns[pcount].regexbuf));
+      struct re_pattern_buffer *regexbuf = &dc->patterns[dc->pcount].regexbuf;
+      char const *err = re_compile_pattern (p, len, regexbuf);
       if (err)
         error (EXIT_TROUBLE, 0, "%s", err);
-      pcount++;
+      dc->pcount++;
       p = sep;
     }
   while (p);
@@ -194,15 +200,38 @@ GEAcompile (char const *pattern, size_t size, reg_syntax_t syntax_bits)
   else
     motif = NULL;
 
-  dfa = dfaalloc ();
-  dfacomp (pattern, size, dfa, 1);
-  kwsmusts ();
+  dc->dfa = dfaalloc ();
+  dfacomp (pattern, size, dc->dfa, 1);
+  kwsmusts (dc);
 
   free(motif);
+
+  return dc;
+}
+
+/* Return a copy of the compiled pattern VDC for another thread.  The
+   copy shares the keyword set, which kwsexec does not modify, and the
+   compiled regexps, which the regex matcher locks while searching with
+   them.  It has DFAs and regex registers of its own.  */
+void *
+EGcopy (void *vdc)
+{
+  struct dfa_comp *dc = vdc;
+  struct dfa_comp *dup = xmemdup (dc, sizeof *dc);
+
+  dup->dfa = dfacopy (dc->dfa);
+  dup->patterns = xnmalloc (dc->pcount, sizeof *dup->patterns);
+  for (size_t i = 0; i < dc->pcount; i++)
+    {
+      dup->patterns[i].regexbuf = dc->patterns[i].regexbuf;
+      dup->patterns[i].regexbuf.regs_allocated = REGS_UNALLOCATED;
+      memset (&dup->patterns[i].regs, 0, sizeof dup->patterns[i].regs);
+    }
+  return dup;
 }
 
 size_t
-EGexecute (char *buf, size_t size, size_t *match_size,
+EGexecute (void *vdc, char *buf, size_t size, size_t *match_size,
            char const *start_ptr)
 {
   char const *buflim, *beg, *end, *ptr, *match, *best_match, *mb_start;
@@ -211,8 +240,10 @@ EGexecute (char *buf, size_t size, size_t *match_size,
   size_t len, best_len;
   struct kwsmatch kwsm;
   size_t i;
-  struct dfa *superset = dfasuperset (dfa);
-  bool dfafast = dfaisfast (dfa);
+  struct dfa_comp *dc = vdc;
+  struct dfa *superset = dfasuperset (dc->dfa);
+  bool dfafast = dfaisfast (dc->dfa);
+  bool kwset_candidate = false;
 
   mb_start = buf;
   buflim = buf + size;
@@ -220,6 +251,7 @@ EGexecute (char *buf, size_t size, size_t *match_size,
   for (beg = end = buf; end < buflim; beg = end)
     {
       end = buflim;
+      kwset_candidate = false;
 
       if (!start_ptr)
         {
@@ -229,15 +261,17 @@ EGexecute (char *buf, size_t size, size_t *match_size,
           int backref = 0;
 
           /* Try matching with KWset, if it's defined.  */
-          if (kwset)
+          if (dc->kwset)
             {
               char const *prev_beg;
 
               /* Find a possible match using the KWset matcher.  */
-              size_t offset = kwsexec (kwset, beg - begline,
-                                       buflim - beg + begline, &kwsm);
+              size_t offset = kwsexec (dc->kwset, beg - dc->begline,
+                                       buflim - beg + dc->begline, &kwsm);
               if (offset == (size_t) -1)
                 goto failure;
+              grep_stats.kwset_candidates++;
+              kwset_candidate = true;
               match = beg + offset;
               prev_beg = beg;
 
@@ -252,7 +286,7 @@ EGexecute (char *buf, size_t size, size_t *match_size,
                  PREV_BEG is less than 64 or (MATCH - PREV_BEG), this is the
                  greater of the latter two values; this temporarily prefers
                  the DFA to KWset.  */
-              exact_kwset_match = kwsm.index < kwset_exact_matches;
+              exact_kwset_match = kwsm.index < dc->kwset_exact_matches;
               end = ((exact_kwset_match || !dfafast
                       || MAX (16, match - beg) < (match - prev_beg) >> 2)
                      ? match
@@ -295,7 +329,10 @@ EGexecute (char *buf, size_t size, size_t *match_size,
                   dfa_beg = beg;
                 }
               if (next_beg == NULL || next_beg == end)
-                continue;
+                {
+                  grep_stats.superset_rejects++;
+                  continue;
+                }
 
               /* Narrow down to the line we've found.  */
               end = memchr (next_beg, eol, buflim - next_beg);
@@ -303,7 +340,8 @@ EGexecute (char *buf, size_t size, size_t *match_size,
             }
 
           /* Try matching with DFA.  */
-          next_beg = dfaexec (dfa, dfa_beg, (char *) end, 0, &count, &backref);
+          next_beg = dfaexec (dc->dfa, dfa_beg, (char *) end, 0, &count,
+                              &backref);
 
           /* If there's no match, or if we've matched the sentinel,
              we're done.  */
@@ -337,21 +375,22 @@ EGexecute (char *buf, size_t size, size_t *match_size,
         xalloc_die ();
 
       /* Run the possible match through Regex.  */
+      grep_stats.regex_fallbacks++;
       best_match = end;
       best_len = 0;
-      for (i = 0; i < pcount; i++)
+      for (i = 0; i < dc->pcount; i++)
         {
-          patterns[i].regexbuf.not_eol = 0;
-          patterns[i].regexbuf.newline_anchor = eolbyte == '\n';
-          start = re_search (&(patterns[i].regexbuf),
+          dc->patterns[i].regexbuf.not_eol = 0;
+          dc->patterns[i].regexbuf.newline_anchor = eolbyte == '\n';
+          start = re_search (&dc->patterns[i].regexbuf,
                              beg, end - beg - 1,
                              ptr - beg, end - ptr - 1,
-                             &(patterns[i].regs));
+                             &dc->patterns[i].regs);
           if (start < -1)
             xalloc_die ();
           else if (0 <= start)
             {
-              len = patterns[i].regs.end[0] - start;
+              len = dc->patterns[i].regs.end[0] - start;
               match = beg + start;
               if (match > best_match)
                 continue;
@@ -382,11 +421,11 @@ EGexecute (char *buf, size_t size, size_t *match_size,
                       {
                         /* Try a shorter length anchored at the same place. */
                         --len;
-                        patterns[i].regexbuf.not_eol = 1;
-                        shorter_len = re_match (&(patterns[i].regexbuf),
+                        dc->patterns[i].regexbuf.not_eol = 1;
+                        shorter_len = re_match (&dc->patterns[i].regexbuf,
                                                 beg, match + len - ptr,
                                                 match - beg,
-                                                &(patterns[i].regs));
+                                                &dc->patterns[i].regs);
                         if (shorter_len < -1)
                           xalloc_die ();
                       }
@@ -398,18 +437,18 @@ EGexecute (char *buf, size_t size, size_t *match_size,
                         if (match == end - 1)
                           break;
                         match++;
-                        patterns[i].regexbuf.not_eol = 0;
-                        start = re_search (&(patterns[i].regexbuf),
+                        dc->patterns[i].regexbuf.not_eol = 0;
+                        start = re_search (&dc->patterns[i].regexbuf,
                                            beg, end - beg - 1,
                                            match - beg, end - match - 1,
-                                           &(patterns[i].regs));
+                                           &dc->patterns[i].regs);
                         if (start < 0)
                           {
                             if (start < -1)
                               xalloc_die ();
                             break;
                           }
-                        len = patterns[i].regs.end[0] - start;
+                        len = dc->patterns[i].regs.end[0] - start;
                         match = beg + start;
                       }
                   } /* while (match <= best_match) */
@@ -445,7 +484,28 @@ EGexecute (char *buf, size_t size, size_t *match_size,
  success:
   len = end - beg;
  success_in_len:;
+  grep_stats.kwset_matches += kwset_candidate;
   size_t off = beg - buf;
   *match_size = len;
   return off;
 }
+
+/* Store into *STATS the statistics of the DFA of VDC, including
+   those of its superset DFA if any.  */
+void
+EGdfastats (void *vdc, struct dfastats *stats)
+{
+  struct dfa_comp *dc = vdc;
+  struct dfa *superset = dfasuperset (dc->dfa);
+  dfastats (dc->dfa, stats);
+  if (superset)
+    {
+      struct dfastats ss;
+      dfastats (superset, &ss);
+      stats->states += ss.states;
+      stats->tables += ss.tables;
+      stats->built += ss.built;
+      stats->reused += ss.reused;
+      stats->freed += ss.freed;
+    }
+}
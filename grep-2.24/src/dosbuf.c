@@ -41,13 +41,15 @@ struct dos_map {
 
 static int       dos_report_unix_offset = 0;
 
-static File_type dos_file_type     = UNKNOWN;
 static File_type dos_use_file_type = UNKNOWN;
-static off_t     dos_stripped_crs  = 0;
-static struct dos_map *dos_pos_map;
-static int       dos_pos_map_size  = 0;
-static int       dos_pos_map_used  = 0;
-static int       inp_map_idx = 0, out_map_idx = 1;
+
+/* The state of the file being searched; each thread has its own.  */
+static THREAD_LOCAL File_type dos_file_type     = UNKNOWN;
+static THREAD_LOCAL off_t     dos_stripped_crs  = 0;
+static THREAD_LOCAL struct dos_map *dos_pos_map;
+static THREAD_LOCAL int       dos_pos_map_size  = 0;
+static THREAD_LOCAL int       dos_pos_map_used  = 0;
+static THREAD_LOCAL int       inp_map_idx = 0, out_map_idx = 1;
 
 /* Set default DOS file type to binary.  */
 static void
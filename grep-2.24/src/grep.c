@@ -26,8 +26,30 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <sys/time.h>
 #include "system.h"
 
+#if GREP_THREADS
+# include <pthread.h>
+#endif
+
+#if HAVE_SYS_MMAN_H && HAVE_MAP_ANONYMOUS
+# include <sys/mman.h>
+# define GREP_MMAP 1
+#else
+# define GREP_MMAP 0
+#endif
+
+/* GREP_DECOMPRESS is nonzero if grep can run a decompressor in a
+   child process.  */
+#if defined _WIN32 && ! defined __CYGWIN__
+# define GREP_DECOMPRESS 0
+#else
+# include <signal.h>
+# include <sys/wait.h>
+# define GREP_DECOMPRESS 1
+#endif
+
 #include "argmatch.h"
 #include "c-ctype.h"
 #include "closeout.h"
@@ -45,6 +67,7 @@
 #include "quote.h"
 #include "safe-read.h"
 #include "search.h"
+#include "unistd-safer.h"
 #include "version-etc.h"
 #include "xalloc.h"
 #include "xstrtol.h"
@@ -83,8 +106,8 @@ static bool align_tabs;
 #if HAVE_ASAN
 /* Record the starting address and length of the sole poisoned region,
    so that we can unpoison it later, just before each following read.  */
-static void const *poison_buf;
-static size_t poison_len;
+static THREAD_LOCAL void const *poison_buf;
+static THREAD_LOCAL size_t poison_len;
 
 static void
 clear_asan_poison (void)
@@ -225,18 +248,33 @@ static const char *context_line_color  = "";	/* default color pair */
 static const char *sgr_start = "\33[%sm\33[K";
 static const char *sgr_end   = "\33[m\33[K";
 
-/* SGR utility functions.  */
+/* Where to write normal output.  This is stdout, except in worker
+   threads, which buffer the output of each file until it is its turn.  */
+static THREAD_LOCAL FILE *out_stream;
+
+/* SGR utility functions.  Buffered output can carry only the SGR
+   sequences themselves, so bypass any other colorizing method.  */
 static void
 pr_sgr_start (char const *s)
 {
   if (*s)
-    print_start_colorize (sgr_start, s);
+    {
+      if (out_stream == stdout)
+        print_start_colorize (sgr_start, s);
+      else
+        fprintf (out_stream, sgr_start, s);
+    }
 }
 static void
 pr_sgr_end (char const *s)
 {
   if (*s)
-    print_end_colorize (sgr_end);
+    {
+      if (out_stream == stdout)
+        print_end_colorize (sgr_end);
+      else
+        fputs (sgr_end, out_stream);
+    }
 }
 static void
 pr_sgr_start_if (char const *s)
@@ -307,13 +345,20 @@ enum
 {
   BINARY_FILES_OPTION = CHAR_MAX + 1,
   COLOR_OPTION,
+  DECOMPRESS_OPTION,
+  DFA_CACHE_OPTION,
   EXCLUDE_DIRECTORY_OPTION,
   EXCLUDE_OPTION,
   EXCLUDE_FROM_OPTION,
   GROUP_SEPARATOR_OPTION,
   INCLUDE_OPTION,
   LINE_BUFFERED_OPTION,
-  LABEL_OPTION
+  LABEL_OPTION,
+  MMAP_OPTION,
+  PATTERN_CACHE_OPTION,
+  PATTERN_ID_OPTION,
+  STATS_OPTION,
+  THREADS_OPTION
 };
 
 /* Long options equivalences. */
@@ -332,6 +377,8 @@ static struct option const long_options[] =
   {"color", optional_argument, NULL, COLOR_OPTION},
   {"colour", optional_argument, NULL, COLOR_OPTION},
   {"count", no_argument, NULL, 'c'},
+  {"decompress", no_argument, NULL, DECOMPRESS_OPTION},
+  {"dfa-cache", required_argument, NULL, DFA_CACHE_OPTION},
   {"devices", required_argument, NULL, 'D'},
   {"directories", required_argument, NULL, 'd'},
   {"exclude", required_argument, NULL, EXCLUDE_OPTION},
@@ -350,6 +397,7 @@ static struct option const long_options[] =
   {"line-number", no_argument, NULL, 'n'},
   {"line-regexp", no_argument, NULL, 'x'},
   {"max-count", required_argument, NULL, 'm'},
+  {"mmap", no_argument, NULL, MMAP_OPTION},
 
   {"no-filename", no_argument, NULL, 'h'},
   {"no-group-separator", no_argument, NULL, GROUP_SEPARATOR_OPTION},
@@ -357,13 +405,17 @@ static struct option const long_options[] =
   {"null", no_argument, NULL, 'Z'},
   {"null-data", no_argument, NULL, 'z'},
   {"only-matching", no_argument, NULL, 'o'},
+  {"pattern-cache", required_argument, NULL, PATTERN_CACHE_OPTION},
+  {"pattern-id", no_argument, NULL, PATTERN_ID_OPTION},
   {"quiet", no_argument, NULL, 'q'},
+  {"stats", required_argument, NULL, STATS_OPTION},
   {"recursive", no_argument, NULL, 'r'},
   {"dereference-recursive", no_argument, NULL, 'R'},
   {"regexp", required_argument, NULL, 'e'},
   {"invert-match", no_argument, NULL, 'v'},
   {"silent", no_argument, NULL, 'q'},
   {"text", no_argument, NULL, 'a'},
+  {"threads", required_argument, NULL, THREADS_OPTION},
   {"binary", no_argument, NULL, 'U'},
   {"unix-byte-offsets", no_argument, NULL, 'u'},
   {"version", no_argument, NULL, 'V'},
@@ -377,12 +429,13 @@ bool match_icase;
 bool match_words;
 bool match_lines;
 char eolbyte;
+char const *pattern_cache_dir;
 
 static char const *matcher;
 
 /* For error messages. */
 /* The input file name, or (if standard input) "-" or a --label argument.  */
-static char const *filename;
+static THREAD_LOCAL char const *filename;
 /* Omit leading "./" from file names in diagnostics.  */
 static bool omit_dot_slash;
 static bool errseen;
@@ -390,7 +443,11 @@ static bool write_error_seen;
 
 /* True if output from the current input file has been suppressed
    because an output line had an encoding error.  */
-static bool encoding_error_output;
+static THREAD_LOCAL bool encoding_error_output;
+
+/* Number of threads that search files; 1 means the main thread does
+   all the work.  */
+static size_t num_threads = 1;
 
 enum directories_type
   {
@@ -461,18 +518,81 @@ enum { SEEK_HOLE = SEEK_SET };
 #endif
 
 /* Functions we'll use to search. */
-typedef void (*compile_fp_t) (char const *, size_t);
-typedef size_t (*execute_fp_t) (char *, size_t, size_t *, char const *);
+typedef void *(*compile_fp_t) (char const *, size_t);
+typedef size_t (*execute_fp_t) (void *, char *, size_t, size_t *,
+                                char const *);
+typedef void *(*copy_fp_t) (void *);
 static compile_fp_t compile;
 static execute_fp_t execute;
+static copy_fp_t copy;
+
+/* The compiled pattern that this thread passes to EXECUTE.  */
+static THREAD_LOCAL void *compiled_pattern;
+
+#if GREP_THREADS
+/* A file handed to a worker, and the results of searching it.  */
+struct search_job
+{
+  struct search_job *next;	/* Next job in queuing order.  */
+  int desc;			/* The file to search, or -1 if the job
+				   only holds diagnostics of the main
+				   thread.  */
+  struct stat st;		/* Its status.  */
+  char *filename;		/* Its name for output and diagnostics.  */
+  int out_file;			/* OUT_FILE when the job was queued.  */
+
+  char *out;			/* Buffered output.  */
+  size_t outlen;
+  FILE *err_stream;		/* Buffered diagnostics, if any.  */
+  char *err;
+  size_t errlen;
+  bool errseen;			/* An error occurred.  */
+  bool status;			/* True if there was no match.  */
+  bool leading_sep;		/* Output starts a new context group.  */
+  bool used;			/* Some output went through prtext.  */
+  bool done;			/* The worker is through with the job.  */
+};
 
-/* Like error, but suppress the diagnostic if requested.  */
+/* The job that a worker thread is currently running, or NULL.  */
+static THREAD_LOCAL struct search_job *current_job;
+static bool defer_error (char const *, int, bool);
+#endif
+
+/* Output the diagnostic MESG, followed by the description of ERRNUM
+   if it is nonzero, unless diagnostics are suppressed.  If SEEN, it
+   reports an error.  With --threads, the diagnostic goes out after
+   the output of the files queued before it, where a single-threaded
+   search puts it.  */
 static void
-suppressible_error (char const *mesg, int errnum)
+diagnose (char const *mesg, int errnum, bool seen)
 {
+#if GREP_THREADS
+  if (defer_error (mesg, errnum, seen))
+    return;
+#endif
   if (! suppress_errors)
     error (0, errnum, "%s", mesg);
-  errseen = true;
+  errseen |= seen;
+}
+
+/* Like error, but suppress the diagnostic if requested.  */
+static void
+suppressible_error (char const *mesg, int errnum)
+{
+  diagnose (mesg, errnum, true);
+}
+
+/* Output the diagnostic FORMAT, which has a single %s for ARG1 and
+   may have another for ARG2, like diagnose.  */
+static void
+diagnose_format (char const *format, char const *arg1, char const *arg2,
+                 bool seen)
+{
+  char *mesg = xmalloc (strlen (format) + strlen (arg1)
+                        + (arg2 ? strlen (arg2) : 0));
+  sprintf (mesg, format, arg1, arg2);
+  diagnose (mesg, 0, seen);
+  free (mesg);
 }
 
 /* If there has already been a write error, don't bother closing
@@ -677,23 +797,59 @@ skipped_file (char const *name, bool command_line, bool is_dir)
 
 /* Hairy buffering mechanism for grep.  The intent is to keep
    all reads aligned on a page boundary and multiples of the
-   page size, unless a read yields a partial page.  */
+   page size, unless a read yields a partial page.  Each searching
+   thread has a buffer of its own.  */
 
-static char *buffer;		/* Base of buffer. */
-static size_t bufalloc;		/* Allocated buffer size, counting slop. */
 #define INITIAL_BUFSIZE 32768	/* Initial buffer size, not counting slop. */
-static int bufdesc;		/* File descriptor. */
-static char *bufbeg;		/* Beginning of user-visible stuff. */
-static char *buflim;		/* Limit of user-visible stuff. */
 static size_t pagesize;		/* alignment of memory pages */
-static off_t bufoffset;		/* Read offset; defined on regular files.  */
-static off_t after_last_match;	/* Pointer after last matching line that
-                                   would have been output if we were
-                                   outputting characters. */
-static bool skip_nuls;		/* Skip '\0' in data.  */
 static bool skip_empty_lines;	/* Skip empty lines in data.  */
-static bool seek_data_failed;	/* lseek with SEEK_DATA failed.  */
-static uintmax_t totalnl;	/* Total newline count before lastnl. */
+static bool use_mmap;		/* Map regular files instead of reading.  */
+static bool decompress;		/* Search compressed files uncompressed.  */
+static bool show_stats;		/* Print statistics on exit.  */
+
+THREAD_LOCAL struct grep_stats grep_stats;
+
+/* Return the number of microseconds since *START.  */
+static uintmax_t
+usec_since (struct timeval const *start)
+{
+  struct timeval now;
+  gettimeofday (&now, NULL);
+  return ((now.tv_sec - start->tv_sec) * (uintmax_t) 1000000
+          + now.tv_usec - start->tv_usec);
+}
+
+/* Base of buffer, and its allocated size, counting slop.  */
+static THREAD_LOCAL char *buffer;
+static THREAD_LOCAL size_t bufalloc;
+
+/* File descriptor.  */
+static THREAD_LOCAL int bufdesc;
+
+/* Beginning and limit of user-visible stuff.  */
+static THREAD_LOCAL char *bufbeg;
+static THREAD_LOCAL char *buflim;
+
+/* Read offset; defined on regular files.  */
+static THREAD_LOCAL off_t bufoffset;
+
+/* Pointer after last matching line that would have been output if
+   we were outputting characters.  */
+static THREAD_LOCAL off_t after_last_match;
+
+/* Skip '\0' in data.  */
+static THREAD_LOCAL bool skip_nuls;
+
+/* lseek with SEEK_DATA failed.  */
+static THREAD_LOCAL bool seek_data_failed;
+
+/* Total newline count before lastnl.  */
+static THREAD_LOCAL uintmax_t totalnl;
+
+/* If nonnull, the private mapping that holds the whole file in place
+   of BUFFER, and the size of the mapping.  */
+static THREAD_LOCAL char *bufmap;
+static THREAD_LOCAL size_t bufmapsize;
 
 /* Return VAL aligned to the next multiple of ALIGNMENT.  VAL can be
    an integer or a pointer.  Both args must be free of side effects.  */
@@ -723,16 +879,26 @@ all_zeros (char const *buf, size_t size)
   return true;
 }
 
+/* Release the mapping of the file last searched, if any.  */
+static void
+unmap_buffer (void)
+{
+#if GREP_MMAP
+  if (bufmap)
+    {
+      munmap (bufmap, bufmapsize);
+      bufmap = NULL;
+    }
+#endif
+}
+
 /* Reset the buffer for a new file, returning false if we should skip it.
    Initialize on the first time through. */
 static bool
 reset (int fd, struct stat const *st)
 {
-  if (! pagesize)
+  if (! buffer)
     {
-      pagesize = getpagesize ();
-      if (pagesize == 0 || 2 * pagesize + 1 <= pagesize)
-        abort ();
       bufalloc = (ALIGN_TO (INITIAL_BUFSIZE, pagesize)
                   + pagesize + sizeof (uword));
       buffer = xmalloc (bufalloc);
@@ -759,6 +925,72 @@ reset (int fd, struct stat const *st)
   return true;
 }
 
+/* Like fillbuf, but get the new stuff by mapping the whole file into
+   memory, so that it is searched in place rather than copied into the
+   buffer.  The mapping is private and writable, so that the sentinels
+   and other changes that grep makes to the buffer contents copy only
+   the pages they touch.  Return false if the new stuff must instead be
+   read into the buffer, as the file is not suitable for mapping or it
+   has grown since it was mapped.  */
+static bool
+fillmap (size_t save, struct stat const *st)
+{
+#if GREP_MMAP
+  if (bufmap)
+    {
+      /* Everything up to BUFOFFSET is mapped.  Read anything after it
+         as usual; if there is nothing, this is end of file.  */
+      struct stat st1;
+      if (fstat (bufdesc, &st1) == 0 && bufoffset < st1.st_size
+          && lseek (bufdesc, bufoffset, SEEK_SET) == bufoffset)
+        return false;
+      bufbeg = buflim - save;
+      return true;
+    }
+
+  /* Map only files that do not fit in the initial buffer, that are to
+     be read from the start, and whose size is trustworthy.  */
+  if (! (use_mmap && bufdesc != STDIN_FILENO && bufoffset == 0
+         && usable_st_size (st) && INITIAL_BUFSIZE < st->st_size
+         && st->st_size <= SIZE_MAX - 3 * pagesize))
+    return false;
+
+  /* Map the file after a page that holds the leading eolbyte sentinel,
+     and before a page that has room for the trailing sentinels and
+     the uword that matchers may read past the end.  Reserve the
+     whole area with an anonymous mapping first, so that the file is
+     mapped just after the leading page and the trailing page does not
+     extend the file mapping past end of file.  */
+  size_t filesize = st->st_size;
+  size_t mapsize = ALIGN_TO (filesize, pagesize) + 2 * pagesize;
+  char *map = mmap (NULL, mapsize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED)
+    return false;
+  if (mmap (map + pagesize, filesize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_FIXED, bufdesc, 0)
+      == MAP_FAILED)
+    {
+      munmap (map, mapsize);
+      return false;
+    }
+# ifdef MADV_SEQUENTIAL
+  madvise (map + pagesize, filesize, MADV_SEQUENTIAL);
+# endif
+
+  bufmap = map;
+  bufmapsize = mapsize;
+  bufbeg = map + pagesize;
+  bufbeg[-1] = eolbyte;
+  bufoffset = filesize;
+  grep_stats.bytes_read += filesize;
+  buflim = bufbeg + undossify_input (bufbeg, filesize);
+  return true;
+#else
+  return false;
+#endif
+}
+
 /* Read new stuff into the buffer, saving the specified
    amount of old stuff.  When we're done, 'bufbeg' points
    to the beginning of the buffer contents, and 'buflim'
@@ -770,12 +1002,23 @@ fillbuf (size_t save, struct stat const *st)
   bool cc = true;
   char *readbuf;
   size_t readsize;
+  struct timeval read_start;
+
+  grep_stats.refills++;
+  if (show_stats)
+    gettimeofday (&read_start, NULL);
+
+  if (fillmap (save, st))
+    {
+      if (show_stats)
+        grep_stats.read_usec += usec_since (&read_start);
+      return true;
+    }
 
-  /* Offset from start of buffer to start of old stuff
-     that we want to save.  */
-  size_t saved_offset = buflim - save - buffer;
+  /* Start of old stuff that we want to save.  */
+  char *saved = buflim - save;
 
-  if (pagesize <= buffer + bufalloc - sizeof (uword) - buflim)
+  if (!bufmap && pagesize <= buffer + bufalloc - sizeof (uword) - buflim)
     {
       readbuf = buflim;
       bufbeg = buflim - save;
@@ -818,13 +1061,14 @@ fillbuf (size_t save, struct stat const *st)
       newbuf = bufalloc < newalloc ? xmalloc (bufalloc = newalloc) : buffer;
       readbuf = ALIGN_TO (newbuf + 1 + save, pagesize);
       bufbeg = readbuf - save;
-      memmove (bufbeg, buffer + saved_offset, save);
+      memmove (bufbeg, saved, save);
       bufbeg[-1] = eolbyte;
       if (newbuf != buffer)
         {
           free (buffer);
           buffer = newbuf;
         }
+      unmap_buffer ();
     }
 
   clear_asan_poison ();
@@ -841,6 +1085,7 @@ fillbuf (size_t save, struct stat const *st)
           cc = false;
         }
       bufoffset += fillsize;
+      grep_stats.bytes_read += fillsize;
 
       if (fillsize == 0 || !skip_nuls || !all_zeros (readbuf, fillsize))
         break;
@@ -877,6 +1122,8 @@ fillbuf (size_t save, struct stat const *st)
   asan_poison (buflim + sizeof (uword),
                bufalloc - (buflim - buffer) - sizeof (uword));
 
+  if (show_stats)
+    grep_stats.read_usec += usec_since (&read_start);
   return cc;
 }
 
@@ -889,11 +1136,12 @@ static enum
 } binary_files;		/* How to handle binary files.  */
 
 static int filename_mask;	/* If zero, output nulls after filenames.  */
-static bool out_quiet;		/* Suppress all normal output. */
+static THREAD_LOCAL bool out_quiet;	/* Suppress all normal output. */
 static bool out_invert;		/* Print nonmatching stuff. */
-static int out_file;		/* Print filenames. */
+static THREAD_LOCAL int out_file;	/* Print filenames. */
 static bool out_line;		/* Print line numbers. */
 static bool out_byte;		/* Print byte offsets. */
+static bool out_pattern_id;	/* Print the number of the matching -P pattern. */
 static intmax_t out_before;	/* Lines of leading context. */
 static intmax_t out_after;	/* Lines of trailing context. */
 static bool count_matches;	/* Count matching lines.  */
@@ -903,35 +1151,84 @@ static intmax_t max_count;	/* Stop after outputting this many
                                    lines from an input file.  */
 static bool line_buffered;	/* Use line buffering.  */
 static char *label = NULL;      /* Fake filename for stdin */
+static bool exit_on_match;	/* Exit on first match.  */
 
 
-/* Internal variables to keep track of byte count, context, etc. */
-static uintmax_t totalcc;	/* Total character count before bufbeg. */
-static char const *lastnl;	/* Pointer after last newline counted. */
-static char *lastout;		/* Pointer after last character output;
-                                   NULL if no character has been output
-                                   or if it's conceptually before bufbeg. */
-static intmax_t outleft;	/* Maximum number of lines to be output.  */
-static intmax_t pending;	/* Pending lines of output.
-                                   Always kept 0 if out_quiet is true.  */
-static bool done_on_match;	/* Stop scanning file on first match.  */
-static bool exit_on_match;	/* Exit on first match.  */
+/* Internal variables to keep track of byte count, context, etc.
+   Each searching thread has its own.  */
+
+/* Total character count before bufbeg.  */
+static THREAD_LOCAL uintmax_t totalcc;
+
+/* Pointer after last newline counted.  */
+static THREAD_LOCAL char const *lastnl;
+
+/* Pointer after last character output; NULL if no character has been
+   output or if it's conceptually before bufbeg.  */
+static THREAD_LOCAL char *lastout;
+
+/* Maximum number of lines to be output.  */
+static THREAD_LOCAL intmax_t outleft;
+
+/* Pending lines of output.  Always kept 0 if out_quiet is true.  */
+static THREAD_LOCAL intmax_t pending;
+
+/* Whether anything has gone through prtext, so that SEP_STR_GROUP is
+   not printed before any output.  */
+static THREAD_LOCAL bool used_output;
+
+/* Stop scanning file on first match.  */
+static THREAD_LOCAL bool done_on_match;
 
 #include "dosbuf.c"
 
-static void
-nlscan (char const *lim)
+/* Return the number of EOL bytes from BEG up to LIM.  Lines are
+   often short, so rather than calling memchr once per line, look at a
+   uword at a time, turning each EOL byte into a 1 in the corresponding
+   byte of a per-byte counter.  */
+static size_t _GL_ATTRIBUTE_PURE
+count_eols (char const *beg, char const *lim, char eol)
 {
-  size_t newlines = 0;
-  char const *beg;
-  for (beg = lastnl; beg < lim; beg++)
+  uword uword_max = -1;
+  uword ones = uword_max / UCHAR_MAX;
+  uword highs = ones << (CHAR_BIT - 1);
+  uword eols = ones * to_uchar (eol);
+  size_t n = 0;
+  char const *p;
+
+  for (p = beg; p < lim && (uintptr_t) p % sizeof (uword) != 0; p++)
+    n += *p == eol;
+
+  uword const *s = CAST_ALIGNED (uword const *, p);
+  uword const *slim = s + (lim - p) / sizeof (uword);
+  while (s < slim)
     {
-      beg = memchr (beg, eolbyte, lim - beg);
-      if (!beg)
-        break;
-      newlines++;
+      /* Each byte of COUNTS counts to at most UCHAR_MAX.  */
+      uword counts = 0;
+      uword const *chunklim = s + MIN (slim - s, UCHAR_MAX);
+      for (; s < chunklim; s++)
+        {
+          /* A byte of X is zero where *S has EOL.  Set the high bit of
+             each byte of X that is zero, without carries between
+             bytes.  */
+          uword x = *s ^ eols;
+          uword zeros = ~(((x & ~highs) + ~highs) | x) & highs;
+          counts += zeros >> (CHAR_BIT - 1);
+        }
+      for (; counts; counts >>= CHAR_BIT)
+        n += counts & UCHAR_MAX;
     }
-  totalnl = add_count (totalnl, newlines);
+
+  for (p = (char const *) s; p < lim; p++)
+    n += *p == eol;
+  return n;
+}
+
+static void
+nlscan (char const *lim)
+{
+  if (lastnl < lim)
+    totalnl = add_count (totalnl, count_eols (lastnl, lim, eolbyte));
   lastnl = lim;
 }
 
@@ -940,7 +1237,7 @@ static void
 print_filename (void)
 {
   pr_sgr_start_if (filename_color);
-  fputs (filename, stdout);
+  fputs (filename, out_stream);
   pr_sgr_end_if (filename_color);
 }
 
@@ -949,7 +1246,7 @@ static void
 print_sep (char sep)
 {
   pr_sgr_start_if (sep_color);
-  fputc (sep, stdout);
+  fputc (sep, out_stream);
   pr_sgr_end_if (sep_color);
 }
 
@@ -976,11 +1273,11 @@ print_offset (uintmax_t pos, int min_width, const char *color)
       *--p = ' ';
 
   pr_sgr_start_if (color);
-  fwrite (p, 1, buf + sizeof buf - p, stdout);
+  fwrite (p, 1, buf + sizeof buf - p, out_stream);
   pr_sgr_end_if (color);
 }
 
-/* Print a whole line head (filename, line, byte).  The output data
+/* Print a whole line head (filename, line, byte, pattern).  The output data
    starts at BEG and contains LEN bytes; it is followed by at least
    sizeof (uword) bytes, the first of which may be temporarily modified.
    The output data comes from what is perhaps a larger input line that
@@ -1013,7 +1310,7 @@ print_line_head (char *beg, size_t len, char const *lim, char sep)
       if (filename_mask)
         pending_sep = true;
       else
-        fputc (0, stdout);
+        fputc (0, out_stream);
     }
 
   if (out_line)
@@ -1040,6 +1337,14 @@ print_line_head (char *beg, size_t len, char const *lim, char sep)
       pending_sep = true;
     }
 
+  if (out_pattern_id && sep == SEP_CHAR_SELECTED && !out_invert)
+    {
+      if (pending_sep)
+        print_sep (sep);
+      print_offset (Ppattern_id (compiled_pattern), 0, "");
+      pending_sep = true;
+    }
+
   if (pending_sep)
     {
       /* This assumes sep is one column wide.
@@ -1047,7 +1352,7 @@ print_line_head (char *beg, size_t len, char const *lim, char sep)
          (and its combining and wide characters)
          filenames and you're wasting your efforts.  */
       if (align_tabs)
-        fputs ("\t\b", stdout);
+        fputs ("\t\b", out_stream);
 
       print_sep (sep);
     }
@@ -1067,7 +1372,8 @@ print_line_middle (char *beg, char *lim,
 
   for (cur = beg;
        (cur < lim
-        && ((match_offset = execute (beg, lim - beg, &match_size, cur))
+        && ((match_offset = execute (compiled_pattern, beg, lim - beg,
+                                     &match_size, cur))
             != (size_t) -1));
        cur = b + match_size)
     {
@@ -1104,14 +1410,14 @@ print_line_middle (char *beg, char *lim,
                   cur = mid;
                   mid = NULL;
                 }
-              fwrite (cur, sizeof (char), b - cur, stdout);
+              fwrite (cur, sizeof (char), b - cur, out_stream);
             }
 
           pr_sgr_start_if (match_color);
-          fwrite (b, sizeof (char), match_size, stdout);
+          fwrite (b, sizeof (char), match_size, out_stream);
           pr_sgr_end_if (match_color);
           if (only_matching)
-            fputs ("\n", stdout);
+            fputs ("\n", out_stream);
         }
     }
 
@@ -1136,7 +1442,7 @@ print_line_tail (char *beg, const char *lim, const char *line_color)
   if (tail_size > 0)
     {
       pr_sgr_start (line_color);
-      fwrite (beg, 1, tail_size, stdout);
+      fwrite (beg, 1, tail_size, out_stream);
       beg += tail_size;
       pr_sgr_end (line_color);
     }
@@ -1188,12 +1494,12 @@ prline (char *beg, char *lim, char sep)
     }
 
   if (!only_matching && lim > beg)
-    fwrite (beg, 1, lim - beg, stdout);
+    fwrite (beg, 1, lim - beg, out_stream);
 
   if (line_buffered)
-    fflush (stdout);
+    fflush (out_stream);
 
-  if (ferror (stdout))
+  if (ferror (out_stream))
     {
       write_error_seen = true;
       error (EXIT_TROUBLE, 0, _("write error"));
@@ -1215,7 +1521,7 @@ prpending (char const *lim)
       size_t match_size;
       --pending;
       if (outleft
-          || ((execute (lastout, nl + 1 - lastout,
+          || ((execute (compiled_pattern, lastout, nl + 1 - lastout,
                         &match_size, NULL) == (size_t) -1)
               == !out_invert))
         prline (lastout, nl + 1, SEP_CHAR_REJECTED);
@@ -1224,11 +1530,20 @@ prpending (char const *lim)
     }
 }
 
+/* Print the separator between groups of context lines.  */
+static void
+print_group_separator (void)
+{
+  pr_sgr_start_if (sep_color);
+  fputs (group_separator, out_stream);
+  pr_sgr_end_if (sep_color);
+  fputc ('\n', out_stream);
+}
+
 /* Output the lines between BEG and LIM.  Deal with context.  */
 static void
 prtext (char *beg, char *lim)
 {
-  static bool used;	/* Avoid printing SEP_STR_GROUP before any output.  */
   char eol = eolbyte;
 
   if (!out_quiet && pending > 0)
@@ -1248,14 +1563,18 @@ prtext (char *beg, char *lim)
           while (p[-1] != eol);
 
       /* Print the group separator unless the output is adjacent to
-         the previous output in the file.  */
-      if ((0 <= out_before || 0 <= out_after) && used
+         the previous output in the file.  A worker does not know
+         whether earlier files had output, so it leaves the first
+         separator of its file to whoever emits the buffered output.  */
+      if ((0 <= out_before || 0 <= out_after)
           && p != lastout && group_separator)
         {
-          pr_sgr_start_if (sep_color);
-          fputs (group_separator, stdout);
-          pr_sgr_end_if (sep_color);
-          fputc ('\n', stdout);
+          if (used_output)
+            print_group_separator ();
+#if GREP_THREADS
+          else if (current_job)
+            current_job->leading_sep = true;
+#endif
         }
 
       while (p < beg)
@@ -1268,7 +1587,13 @@ prtext (char *beg, char *lim)
     }
 
   intmax_t n;
-  if (out_invert)
+  if (out_invert && out_quiet && !done_on_match
+      && (n = count_eols (p, lim, eol)) <= outleft)
+    {
+      /* Just count the lines, e.g., for -c.  */
+      p = lim;
+    }
+  else if (out_invert)
     {
       /* One or more lines are output.  */
       for (n = 0; p < lim && n < outleft; n++)
@@ -1291,7 +1616,7 @@ prtext (char *beg, char *lim)
 
   after_last_match = bufoffset - (buflim - p);
   pending = out_quiet ? 0 : MAX (0, out_after);
-  used = true;
+  used_output = true;
   outleft -= n;
 }
 
@@ -1328,7 +1653,8 @@ grepbuf (char *beg, char const *lim)
   for (char *p = beg; p < lim; p = endp)
     {
       size_t match_size;
-      size_t match_offset = execute (p, lim - p, &match_size, NULL);
+      size_t match_offset = execute (compiled_pattern, p, lim - p,
+                                     &match_size, NULL);
       if (match_offset == (size_t) -1)
         {
           if (!out_invert)
@@ -1498,9 +1824,9 @@ grep (int fd, struct stat const *st)
   if (!out_quiet && (encoding_error_output
                      || (0 <= nlines_first_null && nlines_first_null < nlines)))
     {
-      printf (_("Binary file %s matches\n"), filename);
+      fprintf (out_stream, _("Binary file %s matches\n"), filename);
       if (line_buffered)
-        fflush (stdout);
+        fflush (out_stream);
     }
   return nlines;
 }
@@ -1546,9 +1872,8 @@ grepdirent (FTS *fts, FTSENT *ent, bool command_line)
       break;
 
     case FTS_DC:
-      if (!suppress_errors)
-        error (0, 0, _("warning: %s: %s"), filename,
-               _("recursive directory loop"));
+      diagnose_format (_("warning: %s: %s"), filename,
+                       _("recursive directory loop"), false);
       return true;
 
     case FTS_DNR:
@@ -1629,11 +1954,639 @@ grepfile (int dirdesc, char const *name, bool follow, bool command_line)
   return grepdesc (desc, command_line);
 }
 
+#if GREP_DECOMPRESS
+
+/* The programs that grep --decompress runs, by the magic number that
+   starts the data they decompress.  WARNING_STATUS is an exit status
+   that means the program succeeded but warned, or 0 if none does.  */
+static struct decompressor
+{
+  char const magic[8];
+  int magiclen;
+  char const *program;
+  int warning_status;
+} const decompressors[] =
+  {
+    { "\x1f\x8b", 2, "gzip", 2 },
+    { "\x1f\x9d", 2, "gzip", 2 },
+    { "BZh", 3, "bzip2", 0 },
+    { "\xfd" "7zXZ", 6, "xz", 2 },
+    { "\x28\xb5\x2f\xfd", 4, "zstd", 0 },
+  };
+
+/* The size to ask for the pipe from a decompressor, so that it can
+   run further ahead of the search.  */
+enum { DECOMPRESS_PIPE_SIZE = 1024 * 1024 };
+
+/* Serialize the creation of pipes and the forking of decompressors,
+   so that no decompressor inherits a pipe meant for another one.  */
+# if GREP_THREADS
+static pthread_mutex_t decompress_lock = PTHREAD_MUTEX_INITIALIZER;
+# endif
+
+/* Return the decompressor for the regular file DESC, which is at
+   offset 0, or NULL if DESC does not look compressed.  */
+static struct decompressor const *
+find_decompressor (int desc)
+{
+  char magic[sizeof decompressors[0].magic];
+  ssize_t n = pread (desc, magic, sizeof magic, 0);
+  for (size_t i = 0; i < sizeof decompressors / sizeof *decompressors; i++)
+    if (decompressors[i].magiclen <= n
+        && memcmp (magic, decompressors[i].magic,
+                   decompressors[i].magiclen) == 0)
+      return &decompressors[i];
+  return NULL;
+}
+
+/* Start DC's program decompressing DESC, and return the end of a pipe
+   from which to read its output, or -1 (after reporting an error) if
+   it cannot be started.  Store the program's process ID in *PID.
+   The program runs alongside the search, so that decompressing one
+   part of the file overlaps searching the part before it.  */
+static int
+start_decompressor (int desc, struct decompressor const *dc, pid_t *pid)
+{
+  int fd[2];
+  int e = 0;
+
+# if GREP_THREADS
+  pthread_mutex_lock (&decompress_lock);
+# endif
+  if (pipe_safer (fd) != 0)
+    e = errno;
+  else
+    {
+      fcntl (fd[0], F_SETFD, FD_CLOEXEC);
+      fcntl (fd[1], F_SETFD, FD_CLOEXEC);
+      *pid = fork ();
+      if (*pid == 0)
+        {
+          if (dup2 (desc, STDIN_FILENO) < 0
+              || dup2 (fd[1], STDOUT_FILENO) < 0)
+            _exit (EXIT_TROUBLE);
+          if (suppress_errors)
+            {
+              int null = open ("/dev/null", O_WRONLY);
+              if (0 <= null)
+                dup2 (null, STDERR_FILENO);
+            }
+          execlp (dc->program, dc->program, "-d", "-c", (char *) NULL);
+          _exit (errno == ENOENT ? 127 : 126);
+        }
+      if (*pid < 0)
+        {
+          e = errno;
+          close (fd[0]);
+        }
+      close (fd[1]);
+    }
+# if GREP_THREADS
+  pthread_mutex_unlock (&decompress_lock);
+# endif
+
+  if (e)
+    {
+      suppressible_error (filename, e);
+      return -1;
+    }
+
+# ifdef F_SETPIPE_SZ
+  fcntl (fd[0], F_SETPIPE_SZ, DECOMPRESS_PIPE_SIZE);
+# endif
+  return fd[0];
+}
+
+/* Wait for DC's program, whose process ID is PID, and report an error
+   if it failed.  A program killed by SIGPIPE did not fail; it merely
+   outran a search that needed no more input.  Return true if it
+   succeeded.  */
 static bool
-grepdesc (int desc, bool command_line)
+finish_decompressor (pid_t pid, struct decompressor const *dc)
+{
+  int wstatus;
+  while (waitpid (pid, &wstatus, 0) < 0)
+    if (errno != EINTR)
+      {
+        suppressible_error (dc->program, errno);
+        return false;
+      }
+
+  if (WIFSIGNALED (wstatus) && WTERMSIG (wstatus) == SIGPIPE)
+    return true;
+  if (WIFEXITED (wstatus))
+    switch (WEXITSTATUS (wstatus))
+      {
+      case 0:
+        return true;
+      case 126:
+      case 127:
+        suppressible_error (dc->program,
+                            WEXITSTATUS (wstatus) == 127 ? ENOENT : EACCES);
+        return false;
+      default:
+        if (WEXITSTATUS (wstatus) == dc->warning_status)
+          return true;
+        break;
+      }
+  suppressible_error (filename, EIO);
+  return false;
+}
+
+#endif /* GREP_DECOMPRESS */
+
+/* Search DESC, whose status is *ST, print any count or file name that
+   the options call for, and close DESC unless it is standard input.
+   Return true if there was no match.  */
+static bool
+search_desc (int desc, struct stat const *st)
 {
   intmax_t count;
   bool status = true;
+
+#if GREP_DECOMPRESS
+  /* Search the output of a decompressor instead of DESC, as a pipe.  */
+  struct decompressor const *dc = NULL;
+  pid_t pid;
+  struct stat pipe_st;
+  if (decompress && desc != STDIN_FILENO && S_ISREG (st->st_mode)
+      && (dc = find_decompressor (desc)))
+    {
+      int pipe_desc = start_decompressor (desc, dc, &pid);
+      if (close (desc) != 0)
+        suppressible_error (filename, errno);
+      if (pipe_desc < 0)
+        return true;
+      desc = pipe_desc;
+      if (fstat (desc, &pipe_st) != 0)
+        {
+          suppressible_error (filename, errno);
+          pipe_st.st_mode = S_IFIFO;
+        }
+      st = &pipe_st;
+    }
+#endif
+
+  count = grep (desc, st);
+  unmap_buffer ();
+  if (count < 0)
+    status = count + 2;
+  else
+    {
+      if (count_matches)
+        {
+          if (out_file)
+            {
+              print_filename ();
+              if (filename_mask)
+                print_sep (SEP_CHAR_SELECTED);
+              else
+                fputc (0, out_stream);
+            }
+          fprintf (out_stream, "%" PRIdMAX "\n", count);
+          if (line_buffered)
+            fflush (out_stream);
+        }
+
+      status = !count;
+      if (list_files == 1 - 2 * status)
+        {
+          print_filename ();
+          fputc ('\n' & filename_mask, out_stream);
+          if (line_buffered)
+            fflush (out_stream);
+        }
+
+      if (desc == STDIN_FILENO)
+        {
+          off_t required_offset = outleft ? bufoffset : after_last_match;
+          if (required_offset != bufoffset
+              && lseek (desc, required_offset, SEEK_SET) < 0
+              && S_ISREG (st->st_mode))
+            suppressible_error (filename, errno);
+        }
+    }
+
+  if (desc != STDIN_FILENO && close (desc) != 0)
+    suppressible_error (filename, errno);
+#if GREP_DECOMPRESS
+  if (dc)
+    finish_decompressor (pid, dc);
+#endif
+  return status;
+}
+
+/* The statistics of the threads that have finished searching files,
+   for --stats.  */
+static struct grep_stats total_stats;
+#if GREP_THREADS
+static pthread_mutex_t total_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Add the calling thread's statistics to the totals, and clear them.  */
+static void
+add_stats (void)
+{
+#if GREP_THREADS
+  pthread_mutex_lock (&total_stats_lock);
+#endif
+  total_stats.bytes_read += grep_stats.bytes_read;
+  total_stats.refills += grep_stats.refills;
+  total_stats.read_usec += grep_stats.read_usec;
+  total_stats.kwset_candidates += grep_stats.kwset_candidates;
+  total_stats.kwset_matches += grep_stats.kwset_matches;
+  total_stats.superset_rejects += grep_stats.superset_rejects;
+  total_stats.regex_fallbacks += grep_stats.regex_fallbacks;
+#if GREP_THREADS
+  pthread_mutex_unlock (&total_stats_lock);
+#endif
+  memset (&grep_stats, 0, sizeof grep_stats);
+}
+
+#if GREP_THREADS
+
+/* Multithreaded search.  The main thread walks the file hierarchy,
+   opens each file and queues it as a job.  Worker threads search the
+   files, each with its own buffer and copy of the compiled pattern,
+   which shares what does not change while searching with the others.
+   They buffer their output.  The main thread then emits the output of
+   the jobs in the order they were queued, so that the output is the
+   same as that of a single-threaded search.  */
+
+/* The jobs queued to a worker.  A worker takes jobs from the head of
+   its own deque; when that is empty it steals from the head of the
+   other workers' deques, as the oldest job is the one whose output
+   the main thread is waiting for.  */
+struct job_deque
+{
+  pthread_mutex_t lock;
+  struct search_job **slot;	/* Circular buffer of jobs.  */
+  size_t head;
+  size_t count;
+};
+
+struct search_worker
+{
+  pthread_t thread;
+  void *compiled_pattern;	/* This worker's copy of the pattern.  */
+  struct job_deque jobs;
+};
+
+static struct
+{
+  /* The workers; the pool is in use if NWORKERS is nonzero.  */
+  struct search_worker *workers;
+  size_t nworkers;
+
+  /* The maximum number of jobs in flight, which bounds the number of
+     open files and the memory held by buffered output.  Each deque
+     has this many slots.  */
+  size_t max_jobs;
+
+  /* LOCK protects UNCLAIMED and the DONE member of each job.
+     UNCLAIMED counts the jobs queued but not yet claimed by a worker.  */
+  pthread_mutex_t lock;
+  pthread_cond_t job_queued;
+  pthread_cond_t job_done;
+  size_t unclaimed;
+
+  /* The following are used only by the main thread.  */
+  struct search_job *head;	/* Oldest job not yet emitted.  */
+  struct search_job *tail;	/* Newest job.  */
+  size_t njobs;			/* Number of jobs not yet emitted.  */
+  size_t next_deque;		/* Deque to queue the next job to.  */
+  bool status;			/* Status of the jobs emitted so far.  */
+
+  /* Per-thread option values as set up by the main thread.  */
+  bool done_on_match;
+  bool out_quiet;
+} pool;
+
+/* Record the diagnostic that diagnose would print for MESG and
+   ERRNUM, so that it is output along with the current job.  In the
+   main thread, record it in a job of its own queued after the jobs
+   not yet emitted, if any.  Return true if the diagnostic is
+   recorded.  */
+static bool
+defer_error (char const *mesg, int errnum, bool seen)
+{
+  struct search_job *job = current_job;
+  if (!job)
+    {
+      if (!pool.head)
+        return false;
+      job = pool.tail;
+      if (0 <= job->desc)
+        {
+          job = xzalloc (sizeof *job);
+          job->desc = -1;
+          job->status = true;
+          job->done = true;
+          pool.tail->next = job;
+          pool.tail = job;
+          pool.njobs++;
+        }
+    }
+  job->errseen |= seen;
+  if (suppress_errors)
+    return true;
+  if (!job->err_stream)
+    {
+      job->err_stream = open_memstream (&job->err, &job->errlen);
+      if (!job->err_stream)
+        xalloc_die ();
+    }
+  fprintf (job->err_stream, "%s: %s", program_name, mesg);
+  if (errnum)
+    fprintf (job->err_stream, ": %s", strerror (errnum));
+  putc ('\n', job->err_stream);
+  return true;
+}
+
+/* Append JOB to the deque D, which has room for it.  */
+static void
+push_job (struct job_deque *d, struct search_job *job)
+{
+  pthread_mutex_lock (&d->lock);
+  d->slot[(d->head + d->count++) % pool.max_jobs] = job;
+  pthread_mutex_unlock (&d->lock);
+}
+
+/* Remove and return the job at the head of D, or NULL if D is empty.  */
+static struct search_job *
+pop_job (struct job_deque *d)
+{
+  struct search_job *job = NULL;
+  pthread_mutex_lock (&d->lock);
+  if (d->count)
+    {
+      job = d->slot[d->head];
+      d->head = (d->head + 1) % pool.max_jobs;
+      d->count--;
+    }
+  pthread_mutex_unlock (&d->lock);
+  return job;
+}
+
+/* Search the file of JOB in the calling worker thread.  */
+static void
+run_job (struct search_job *job)
+{
+  current_job = job;
+  filename = job->filename;
+  out_file = job->out_file;
+  used_output = false;
+  out_stream = open_memstream (&job->out, &job->outlen);
+  if (!out_stream)
+    xalloc_die ();
+
+  job->status = search_desc (job->desc, &job->st);
+  if (show_stats)
+    add_stats ();
+
+  job->used = used_output;
+  if (fclose (out_stream) != 0
+      || (job->err_stream && fclose (job->err_stream) != 0))
+    xalloc_die ();
+  current_job = NULL;
+}
+
+static void *
+worker_main (void *arg)
+{
+  struct search_worker *self = arg;
+  size_t n = pool.nworkers;
+  size_t i = self - pool.workers;
+
+  compiled_pattern = self->compiled_pattern;
+  done_on_match = pool.done_on_match;
+  out_quiet = pool.out_quiet;
+
+  while (true)
+    {
+      pthread_mutex_lock (&pool.lock);
+      while (!pool.unclaimed)
+        pthread_cond_wait (&pool.job_queued, &pool.lock);
+      pool.unclaimed--;
+      pthread_mutex_unlock (&pool.lock);
+
+      /* Having claimed a job, find one.  Some deque must have it, as
+         jobs are queued before they are counted as unclaimed.  */
+      struct search_job *job;
+      for (size_t j = 0; ! (job = pop_job (&pool.workers[(i + j) % n].jobs));
+           j++)
+        continue;
+
+      run_job (job);
+
+      pthread_mutex_lock (&pool.lock);
+      job->done = true;
+      pthread_cond_broadcast (&pool.job_done);
+      pthread_mutex_unlock (&pool.lock);
+    }
+
+  return NULL;
+}
+
+/* Start up to N workers, each with a copy of the compiled pattern of
+   the main thread.  If no thread can be created, search in the main
+   thread.  */
+static void
+start_workers (size_t n)
+{
+  size_t fd_room = MAX (1, getdtablesize () / 2);
+
+  pool.workers = xnmalloc (n, sizeof *pool.workers);
+  pool.max_jobs = MIN (16 * n, fd_room);
+  pool.status = true;
+  pool.done_on_match = done_on_match;
+  pool.out_quiet = out_quiet;
+  pthread_mutex_init (&pool.lock, NULL);
+  pthread_cond_init (&pool.job_queued, NULL);
+  pthread_cond_init (&pool.job_done, NULL);
+
+  /* Copy the pattern for all the workers before starting any, as the
+     main thread's copy must not be in use while it is copied.  */
+  for (size_t i = 0; i < n; i++)
+    {
+      struct search_worker *w = &pool.workers[i];
+      w->compiled_pattern = copy (compiled_pattern);
+      pthread_mutex_init (&w->jobs.lock, NULL);
+      w->jobs.slot = xnmalloc (pool.max_jobs, sizeof *w->jobs.slot);
+      w->jobs.head = w->jobs.count = 0;
+    }
+
+  /* Workers read NWORKERS, so set it before starting them.  The
+     deque of a worker that cannot be started is drained by the other
+     workers stealing from it.  */
+  pool.nworkers = n;
+  size_t started = 0;
+  for (size_t i = 0; i < n; i++)
+    started += pthread_create (&pool.workers[i].thread, NULL, worker_main,
+                               &pool.workers[i]) == 0;
+  if (!started)
+    pool.nworkers = 0;
+}
+
+/* Output the results of the oldest job, waiting for it if need be.  */
+static void
+emit_job (void)
+{
+  struct search_job *job = pool.head;
+
+  pthread_mutex_lock (&pool.lock);
+  while (!job->done)
+    pthread_cond_wait (&pool.job_done, &pool.lock);
+  pthread_mutex_unlock (&pool.lock);
+
+  pool.head = job->next;
+  if (!pool.head)
+    pool.tail = NULL;
+  pool.njobs--;
+
+  /* Workers close the diagnostics of their jobs, the main thread
+     those of its own.  */
+  if (job->desc < 0 && job->err_stream && fclose (job->err_stream) != 0)
+    xalloc_die ();
+
+  if (job->leading_sep && used_output)
+    print_group_separator ();
+  used_output |= job->used;
+  fwrite (job->out, 1, job->outlen, stdout);
+  if (line_buffered)
+    fflush (stdout);
+  if (ferror (stdout))
+    {
+      write_error_seen = true;
+      error (EXIT_TROUBLE, 0, _("write error"));
+    }
+  if (job->errlen)
+    {
+      fflush (stdout);
+      fwrite (job->err, 1, job->errlen, stderr);
+    }
+  errseen |= job->errseen;
+  pool.status &= job->status;
+
+  free (job->out);
+  free (job->err);
+  free (job->filename);
+  free (job);
+}
+
+/* Queue the file DESC, whose status is *ST, for searching.  */
+static void
+submit_job (int desc, struct stat const *st)
+{
+  while (pool.max_jobs <= pool.njobs)
+    emit_job ();
+
+  struct search_job *job = xzalloc (sizeof *job);
+  job->desc = desc;
+  job->st = *st;
+  job->filename = xstrdup (filename);
+  job->out_file = out_file;
+  if (pool.tail)
+    pool.tail->next = job;
+  else
+    pool.head = job;
+  pool.tail = job;
+  pool.njobs++;
+
+  push_job (&pool.workers[pool.next_deque++ % pool.nworkers].jobs, job);
+  pthread_mutex_lock (&pool.lock);
+  pool.unclaimed++;
+  pthread_cond_signal (&pool.job_queued);
+  pthread_mutex_unlock (&pool.lock);
+}
+
+/* Emit the results of all queued jobs.  Return true if none of the
+   jobs emitted since the last call had a match.  */
+static bool
+finish_jobs (void)
+{
+  if (! pool.nworkers)
+    return true;
+  while (pool.head)
+    emit_job ();
+  bool status = pool.status;
+  pool.status = true;
+  return status;
+}
+
+#else
+
+static bool finish_jobs (void) { return true; }
+
+#endif /* GREP_THREADS */
+
+/* When grep started, how long it took to compile the patterns, and
+   when it started searching.  */
+static struct timeval start_time;
+static uintmax_t compile_usec;
+static struct timeval search_start_time;
+
+/* Print a JSON member NAME with the number of seconds in USEC.  */
+static void
+print_stats_seconds (char const *name, uintmax_t usec)
+{
+  fprintf (stderr, "\"%s\": %" PRIuMAX ".%06d", name,
+           usec / 1000000, (int) (usec % 1000000));
+}
+
+/* Print the statistics for --stats=json to standard error, as one
+   line holding a JSON object.  */
+static void
+print_stats (void)
+{
+  add_stats ();
+
+  struct dfastats ds = { 0 };
+  if (execute == EGexecute)
+    {
+      EGdfastats (compiled_pattern, &ds);
+#if GREP_THREADS
+      for (size_t i = 0; i < pool.nworkers; i++)
+        {
+          struct dfastats ws;
+          EGdfastats (pool.workers[i].compiled_pattern, &ws);
+          ds.states = MAX (ds.states, ws.states);
+          ds.built += ws.built;
+          ds.reused += ws.reused;
+          ds.freed += ws.freed;
+        }
+#endif
+    }
+
+  uintmax_t search_usec = usec_since (&search_start_time);
+  uintmax_t total_usec = usec_since (&start_time);
+  fprintf (stderr,
+           "{\"bytes_read\": %" PRIuMAX ", \"refills\": %" PRIuMAX ", "
+           "\"kwset_candidates\": %" PRIuMAX ", "
+           "\"kwset_matches\": %" PRIuMAX ", "
+           "\"dfa_states\": %" PRIuMAX ", \"dfa_built\": %" PRIuMAX ", "
+           "\"dfa_reused\": %" PRIuMAX ", \"dfa_freed\": %" PRIuMAX ", "
+           "\"superset_rejects\": %" PRIuMAX ", "
+           "\"regex_fallbacks\": %" PRIuMAX ", \"time\": {",
+           total_stats.bytes_read, total_stats.refills,
+           total_stats.kwset_candidates, total_stats.kwset_matches,
+           (uintmax_t) ds.states, (uintmax_t) ds.built,
+           (uintmax_t) ds.reused, (uintmax_t) ds.freed,
+           total_stats.superset_rejects, total_stats.regex_fallbacks);
+  print_stats_seconds ("compile", compile_usec);
+  fputs (", ", stderr);
+  print_stats_seconds ("read", total_stats.read_usec);
+  fputs (", ", stderr);
+  print_stats_seconds ("search", search_usec);
+  fputs (", ", stderr);
+  print_stats_seconds ("total", total_usec);
+  fputs ("}}\n", stderr);
+}
+
+static bool
+grepdesc (int desc, bool command_line)
+{
+  bool status = true;
   struct stat st;
 
   /* Get the file status, possibly for the second time.  This catches
@@ -1716,9 +2669,8 @@ grepdesc (int desc, bool command_line)
       && S_ISREG (out_stat.st_mode) && out_stat.st_ino
       && SAME_INODE (st, out_stat))
     {
-      if (! suppress_errors)
-        error (0, 0, _("input file %s is also the output"), quote (filename));
-      errseen = true;
+      diagnose_format (_("input file %s is also the output"),
+                       quote (filename), NULL, true);
       goto closeout;
     }
 
@@ -1729,44 +2681,15 @@ grepdesc (int desc, bool command_line)
     SET_BINARY (desc);
 #endif
 
-  count = grep (desc, &st);
-  if (count < 0)
-    status = count + 2;
-  else
+#if GREP_THREADS
+  if (pool.nworkers && desc != STDIN_FILENO)
     {
-      if (count_matches)
-        {
-          if (out_file)
-            {
-              print_filename ();
-              if (filename_mask)
-                print_sep (SEP_CHAR_SELECTED);
-              else
-                fputc (0, stdout);
-            }
-          printf ("%" PRIdMAX "\n", count);
-          if (line_buffered)
-            fflush (stdout);
-        }
-
-      status = !count;
-      if (list_files == 1 - 2 * status)
-        {
-          print_filename ();
-          fputc ('\n' & filename_mask, stdout);
-          if (line_buffered)
-            fflush (stdout);
-        }
-
-      if (desc == STDIN_FILENO)
-        {
-          off_t required_offset = outleft ? bufoffset : after_last_match;
-          if (required_offset != bufoffset
-              && lseek (desc, required_offset, SEEK_SET) < 0
-              && S_ISREG (st.st_mode))
-            suppressible_error (filename, errno);
-        }
+      submit_job (desc, &st);
+      return true;
     }
+#endif
+
+  return search_desc (desc, &st);
 
  closeout:
   if (desc != STDIN_FILENO && close (desc) != 0)
@@ -1779,8 +2702,11 @@ grep_command_line_arg (char const *arg)
 {
   if (STREQ (arg, "-"))
     {
+      /* Standard input is searched in the main thread, after the
+         output of any earlier files.  */
+      bool status = finish_jobs ();
       filename = label ? label : _("(standard input)");
-      return grepdesc (STDIN_FILENO, true);
+      return grepdesc (STDIN_FILENO, true) && status;
     }
   else
     {
@@ -1827,6 +2753,9 @@ Regexp selection and interpretation:\n"), program_name);
 Miscellaneous:\n\
   -s, --no-messages         suppress error messages\n\
   -v, --invert-match        select non-matching lines\n\
+      --dfa-cache=SIZE      use at most SIZE bytes for DFA transition tables\n\
+      --pattern-cache=DIR   keep compiled fixed strings in DIR for reuse\n\
+      --stats=json          print search statistics to standard error\n\
   -V, --version             display version information and exit\n\
       --help                display this help text and exit\n"));
       printf (_("\
@@ -1835,6 +2764,7 @@ Output control:\n\
   -m, --max-count=NUM       stop after NUM matches\n\
   -b, --byte-offset         print the byte offset with output lines\n\
   -n, --line-number         print line number with output lines\n\
+      --pattern-id          print the number of the -P pattern that matched\n\
       --line-buffered       flush output on every line\n\
   -H, --with-filename       print the file name for each match\n\
   -h, --no-filename         suppress the file name prefix on output\n\
@@ -1855,6 +2785,11 @@ Output control:\n\
                             ACTION is 'read' or 'skip'\n\
   -r, --recursive           like --directories=recurse\n\
   -R, --dereference-recursive  likewise, but follow all symlinks\n\
+      --threads=NUM         search files in NUM threads; 0 means one per\n\
+                            processor\n\
+      --mmap                map regular files into memory instead of\n\
+                            reading them\n\
+      --decompress          search compressed files as if uncompressed\n\
 "));
       printf (_("\
       --include=FILE_PATTERN  search only files that match FILE_PATTERN\n\
@@ -1900,34 +2835,34 @@ if any error occurs and -q is not given, the exit status is 2.\n"));
 
 /* Pattern compilers and matchers.  */
 
-static void
+static void *
 Gcompile (char const *pattern, size_t size)
 {
-  GEAcompile (pattern, size, RE_SYNTAX_GREP);
+  return GEAcompile (pattern, size, RE_SYNTAX_GREP);
 }
 
-static void
+static void *
 Ecompile (char const *pattern, size_t size)
 {
-  GEAcompile (pattern, size, RE_SYNTAX_EGREP);
+  return GEAcompile (pattern, size, RE_SYNTAX_EGREP);
 }
 
-static void
+static void *
 Acompile (char const *pattern, size_t size)
 {
-  GEAcompile (pattern, size, RE_SYNTAX_AWK);
+  return GEAcompile (pattern, size, RE_SYNTAX_AWK);
 }
 
-static void
+static void *
 GAcompile (char const *pattern, size_t size)
 {
-  GEAcompile (pattern, size, RE_SYNTAX_GNU_AWK);
+  return GEAcompile (pattern, size, RE_SYNTAX_GNU_AWK);
 }
 
-static void
+static void *
 PAcompile (char const *pattern, size_t size)
 {
-  GEAcompile (pattern, size, RE_SYNTAX_POSIX_AWK);
+  return GEAcompile (pattern, size, RE_SYNTAX_POSIX_AWK);
 }
 
 struct matcher
@@ -1935,16 +2870,17 @@ struct matcher
   char const name[16];
   compile_fp_t compile;
   execute_fp_t execute;
+  copy_fp_t copy;
 };
 static struct matcher const matchers[] = {
-  { "grep",      Gcompile, EGexecute },
-  { "egrep",     Ecompile, EGexecute },
-  { "fgrep",     Fcompile,  Fexecute },
-  { "awk",       Acompile, EGexecute },
-  { "gawk",     GAcompile, EGexecute },
-  { "posixawk", PAcompile, EGexecute },
-  { "perl",      Pcompile,  Pexecute },
-  { "", NULL, NULL },
+  { "grep",      Gcompile, EGexecute, EGcopy },
+  { "egrep",     Ecompile, EGexecute, EGcopy },
+  { "fgrep",     Fcompile,  Fexecute,  Fcopy },
+  { "awk",       Acompile, EGexecute, EGcopy },
+  { "gawk",     GAcompile, EGexecute, EGcopy },
+  { "posixawk", PAcompile, EGexecute, EGcopy },
+  { "perl",      Pcompile,  Pexecute,  Pcopy },
+  { "", NULL, NULL, NULL },
 };
 
 /* Set the matcher to M if available.  Exit in case of conflicts or if
@@ -1963,6 +2899,7 @@ setmatcher (char const *m)
         matcher = p->name;
         compile = p->compile;
         execute = p->execute;
+        copy = p->copy;
         return;
       }
 
@@ -2244,6 +3181,7 @@ main (int argc, char **argv)
 
   exit_failure = EXIT_TROUBLE;
   atexit (clean_up_stdout);
+  gettimeofday (&start_time, NULL);
 
   last_recursive = 0;
 
@@ -2254,6 +3192,7 @@ main (int argc, char **argv)
 
   compile = matchers[0].compile;
   execute = matchers[0].execute;
+  copy = matchers[0].copy;
 
   while (prev_optind = optind,
          (opt = get_nondigit_option (argc, argv, &default_context)) != -1)
@@ -2527,10 +3466,72 @@ main (int argc, char **argv)
         line_buffered = true;
         break;
 
+      case MMAP_OPTION:
+        use_mmap = GREP_MMAP;
+        break;
+
+      case DECOMPRESS_OPTION:
+        decompress = GREP_DECOMPRESS;
+        break;
+
+      case DFA_CACHE_OPTION:
+        {
+          intmax_t size;
+          switch (xstrtoimax (optarg, NULL, 10, &size, "kKMG"))
+            {
+            case LONGINT_OK:
+            case LONGINT_OVERFLOW:
+              if (0 <= size)
+                break;
+              /* Fall through.  */
+            default:
+              error (EXIT_TROUBLE, 0, _("invalid DFA cache size"));
+            }
+          dfacachesize (MIN (size, SIZE_MAX));
+        }
+        break;
+
       case LABEL_OPTION:
         label = optarg;
         break;
 
+      case PATTERN_CACHE_OPTION:
+        pattern_cache_dir = optarg;
+        break;
+
+      case PATTERN_ID_OPTION:
+        out_pattern_id = true;
+        break;
+
+      case STATS_OPTION:
+        if (STREQ (optarg, "json"))
+          show_stats = true;
+        else
+          error (EXIT_TROUBLE, 0, _("unknown stats format"));
+        break;
+
+      case THREADS_OPTION:
+        {
+          intmax_t n;
+          switch (xstrtoimax (optarg, 0, 10, &n, ""))
+            {
+            case LONGINT_OK:
+            case LONGINT_OVERFLOW:
+              if (0 <= n)
+                break;
+              /* Fall through.  */
+            default:
+              error (EXIT_TROUBLE, 0, _("invalid number of threads"));
+            }
+          if (n == 0)
+            {
+              long int nproc = sysconf (_SC_NPROCESSORS_ONLN);
+              n = 0 < nproc ? nproc : 1;
+            }
+          num_threads = MIN (n, 1024);
+        }
+        break;
+
       case 0:
         /* long options */
         break;
@@ -2582,6 +3583,9 @@ main (int argc, char **argv)
   if (show_help)
     usage (EXIT_SUCCESS);
 
+  if (out_pattern_id && compile != Pcompile)
+    error (EXIT_TROUBLE, 0, _("--pattern-id requires -P"));
+
   struct stat tmp_stat;
   if (fstat (STDOUT_FILENO, &tmp_stat) == 0 && S_ISREG (tmp_stat.st_mode))
     out_stat = tmp_stat;
@@ -2629,15 +3633,35 @@ main (int argc, char **argv)
       matcher = "grep";
       compile = Gcompile;
       execute = EGexecute;
+      copy = EGcopy;
     }
 
-  compile (keys, keycc);
+  pagesize = getpagesize ();
+  if (pagesize == 0 || 2 * pagesize + 1 <= pagesize)
+    abort ();
+  out_stream = stdout;
+
+  struct timeval compile_start;
+  gettimeofday (&compile_start, NULL);
+  compiled_pattern = compile (keys, keycc);
+#if GREP_THREADS
+  /* Search in several threads only if there may be several files, and
+     not with -q, whose early exit the workers cannot handle.  */
+  if (1 < num_threads && !exit_on_match
+      && (directories == RECURSE_DIRECTORIES || 1 < argc - optind))
+    start_workers (num_threads);
+#endif
   free (keys);
   /* We need one byte prior and one after.  */
   char eolbytes[3] = { 0, eolbyte, 0 };
   size_t match_size;
-  skip_empty_lines = ((execute (eolbytes + 1, 1, &match_size, NULL) == 0)
+  skip_empty_lines = ((execute (compiled_pattern, eolbytes + 1, 1,
+                                 &match_size, NULL) == 0)
                       == out_invert);
+  compile_usec = usec_since (&compile_start);
+  gettimeofday (&search_start_time, NULL);
+  if (show_stats)
+    atexit (print_stats);
 
   if ((argc - optind > 1 && !no_filenames) || with_filenames)
     out_file = 1;
@@ -2676,6 +3700,7 @@ main (int argc, char **argv)
   do
     status &= grep_command_line_arg (*files++);
   while (*files != NULL);
+  status &= finish_jobs ();
 
   /* We register via atexit() to test stdout.  */
   return errseen ? EXIT_TROUBLE : status;
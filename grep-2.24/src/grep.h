@@ -21,6 +21,7 @@
 #define GREP_GREP_H 1
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /* The following flags are exported from grep for the matchers
    to look at. */
@@ -28,7 +29,22 @@ extern bool match_icase;	/* -i */
 extern bool match_words;	/* -w */
 extern bool match_lines;	/* -x */
 extern char eolbyte;		/* -z */
+extern char const *pattern_cache_dir; /* --pattern-cache */
 
 extern bool buf_has_encoding_errors (char *, size_t);
 
+/* Counts for --stats.  Each searching thread keeps its own counts,
+   which are added to the totals when it finishes a file.  */
+struct grep_stats
+{
+  uintmax_t bytes_read;		/* Bytes of input read or mapped.  */
+  uintmax_t refills;		/* Times the buffer was refilled.  */
+  uintmax_t read_usec;		/* Microseconds spent refilling it.  */
+  uintmax_t kwset_candidates;	/* Possible matches found by a kwset.  */
+  uintmax_t kwset_matches;	/* Those that turned out to match.  */
+  uintmax_t superset_rejects;	/* Lines rejected by a superset DFA.  */
+  uintmax_t regex_fallbacks;	/* Lines handed to the regex matcher.  */
+};
+extern THREAD_LOCAL struct grep_stats grep_stats;
+
 #endif
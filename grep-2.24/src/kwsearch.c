@@ -21,6 +21,12 @@
 #include <config.h>
 #include "search.h"
 
+#include <sys/stat.h>
+#if HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#include "safe-read.h"
+
 /* Whether -w considers WC to be a word constituent.  */
 static bool
 wordchar (wint_t wc)
@@ -28,15 +34,172 @@ wordchar (wint_t wc)
   return wc == L'_' || iswalnum (wc);
 }
 
-/* KWset compiled pattern.  For Ecompile and Gcompile, we compile
-   a list of strings, at least one of which is known to occur in
-   any string matching the regexp. */
-static kwset_t kwset;
+/* With --pattern-cache, a compiled keyword set is kept in a file of
+   the cache directory, named after a hash of its key.  The key is
+   everything that the keyword set depends on: the options that
+   Fcompile and kwsinit look at, the case-folding table if kwsinit uses
+   one, and the patterns.  The file holds CACHE_MAGIC, the size of the
+   key, the key itself, and the keyword set as written by kwsdump.  As
+   the whole key is compared, a file is used only for exactly the same
+   key, and a change to any part of it makes grep write a new file.  */
+
+static char const cache_magic[] = "GNU grep kwset cache\n";
+enum { CACHE_MAGIC_SIZE = sizeof cache_magic - 1 };
+
+/* Return the key of the keyword set that Fcompile builds from
+   PATTERN, of size SIZE, and store its size in *KEYSIZE.  */
+static char *
+cache_key (char const *pattern, size_t size, size_t *keysize)
+{
+  bool fold = match_icase && MB_CUR_MAX == 1;
+  size_t n = 3 + (fold ? UCHAR_MAX + 1 : 0);
+  char *key = xmalloc (n + size);
+  char *p = key;
+  int i;
+
+  *p++ = match_lines;
+  *p++ = eolbyte;
+  *p++ = fold;
+  if (fold)
+    for (i = 0; i <= UCHAR_MAX; i++)
+      *p++ = toupper (i);
+  memcpy (p, pattern, size);
+  *keysize = n + size;
+  return key;
+}
 
-void
+/* Return the name of the cache file for KEY, of size KEYSIZE.  */
+static char *
+cache_file (char const *key, size_t keysize)
+{
+  /* A 64-bit FNV-1a hash.  */
+  uint_least64_t h = 0xcbf29ce484222325;
+  size_t i;
+  for (i = 0; i < keysize; i++)
+    h = ((h ^ to_uchar (key[i])) * 0x100000001b3) & 0xffffffffffffffff;
+
+  char *file = xmalloc (strlen (pattern_cache_dir) + sizeof "/kwset-" + 16);
+  sprintf (file, "%s/kwset-%016llx", pattern_cache_dir,
+           (unsigned long long int) h);
+  return file;
+}
+
+/* Return the keyword set cached in FILE for KEY, of size KEYSIZE, or
+   NULL if there is none.  */
+static kwset_t
+cache_load (char const *file, char const *key, size_t keysize)
+{
+  int fd = open (file, O_RDONLY | O_BINARY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  size_t size;
+  char *data = NULL;
+  bool mapped = false;
+  if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode)
+      && CACHE_MAGIC_SIZE + sizeof (uint64_t) + keysize <= st.st_size
+      && st.st_size <= SIZE_MAX)
+    {
+      size = st.st_size;
+#if HAVE_SYS_MMAN_H
+      data = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      mapped = data != MAP_FAILED;
+      if (!mapped)
+        data = NULL;
+#endif
+      if (!data)
+        {
+          data = xmalloc (size);
+          if (safe_read (fd, data, size) != size)
+            {
+              free (data);
+              data = NULL;
+            }
+        }
+    }
+  close (fd);
+  if (!data)
+    return NULL;
+
+  kwset_t kwset = NULL;
+  uint64_t stored_keysize;
+  char const *p = data + CACHE_MAGIC_SIZE;
+  memcpy (&stored_keysize, p, sizeof stored_keysize);
+  p += sizeof stored_keysize;
+  if (memcmp (data, cache_magic, CACHE_MAGIC_SIZE) == 0
+      && stored_keysize == keysize && memcmp (p, key, keysize) == 0)
+    {
+      p += keysize;
+      kwsinit (&kwset);
+      if (!kwsload (kwset, p, data + size - p))
+        {
+          kwsfree (kwset);
+          kwset = NULL;
+        }
+    }
+
+#if HAVE_SYS_MMAN_H
+  if (mapped)
+    munmap (data, size);
+  else
+#endif
+    free (data);
+  return kwset;
+}
+
+/* Save KWSET in FILE as the keyword set for KEY, of size KEYSIZE.
+   Write a temporary file and rename it, so that a grep running at the
+   same time never sees a partial file.  The cache only saves time, so
+   silently give up on any error.  */
+static void
+cache_save (kwset_t kwset, char const *file, char const *key, size_t keysize)
+{
+  char *tmp = xmalloc (strlen (file) + sizeof ".XXXXXX");
+  sprintf (tmp, "%s.XXXXXX", file);
+  int fd = mkstemp (tmp);
+  if (0 <= fd)
+    {
+      uint64_t size = keysize;
+      FILE *stream = fdopen (fd, "wb");
+      bool ok = (stream
+                 && fwrite (cache_magic, 1, CACHE_MAGIC_SIZE, stream) != 0
+                 && fwrite (&size, sizeof size, 1, stream) != 0
+                 && fwrite (key, 1, keysize, stream) == keysize
+                 && kwsdump (kwset, stream));
+      if (stream)
+        ok &= fclose (stream) == 0;
+      else
+        close (fd);
+      if (! (ok && rename (tmp, file) == 0))
+        unlink (tmp);
+    }
+  free (tmp);
+}
+
+/* Compile the newline-separated fixed strings PATTERN, of size SIZE,
+   and return the resulting KWset as the matcher's state.  */
+void *
 Fcompile (char const *pattern, size_t size)
 {
   size_t total = size;
+  kwset_t kwset;
+  char *key = NULL;
+  size_t keysize;
+  char *file = NULL;
+
+  if (pattern_cache_dir)
+    {
+      key = cache_key (pattern, size, &keysize);
+      file = cache_file (key, keysize);
+      kwset = cache_load (file, key, keysize);
+      if (kwset)
+        {
+          free (key);
+          free (file);
+          return kwset;
+        }
+    }
 
   kwsinit (&kwset);
 
@@ -75,12 +238,29 @@ Fcompile (char const *pattern, size_t size)
   while (p);
 
   kwsprep (kwset);
+
+  if (pattern_cache_dir)
+    {
+      cache_save (kwset, file, key, keysize);
+      free (key);
+      free (file);
+    }
+  return kwset;
+}
+
+/* Return the compiled pattern VKWSET for another thread, which can
+   share it as kwsexec does not modify it.  */
+void *
+Fcopy (void *vkwset)
+{
+  return vkwset;
 }
 
 size_t
-Fexecute (char *buf, size_t size, size_t *match_size,
+Fexecute (void *vkwset, char *buf, size_t size, size_t *match_size,
           char const *start_ptr)
 {
+  kwset_t kwset = vkwset;
   char const *beg, *try, *end, *mb_start;
   size_t len;
   char eol = eolbyte;
@@ -93,6 +273,7 @@ Fexecute (char *buf, size_t size, size_t *match_size,
                                buf + size - beg + match_lines, &kwsmatch);
       if (offset == (size_t) -1)
         goto failure;
+      grep_stats.kwset_candidates++;
       len = kwsmatch.size[0] - 2 * match_lines;
       if (!match_lines && MB_CUR_MAX > 1 && !using_utf8 ()
           && mb_goback (&mb_start, beg + offset, buf + size) != 0)
@@ -157,6 +338,7 @@ Fexecute (char *buf, size_t size, size_t *match_size,
   beg = beg ? beg + 1 : buf;
   len = end - beg;
  success_in_beg_and_len:;
+  grep_stats.kwset_matches++;
   size_t off = beg - buf;
 
   *match_size = len;
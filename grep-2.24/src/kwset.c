@@ -78,6 +78,7 @@ struct trie
   int depth;			/* Depth of this node from the root. */
   int shift;			/* Shift function for search failures. */
   int maxshift;			/* Max shift of self and descendants. */
+  int index;			/* Number of this node in level order. */
 };
 
 /* Structure returned opaquely to the caller, containing everything. */
@@ -86,6 +87,7 @@ struct kwset
   struct obstack obstack;	/* Obstack for node allocation. */
   ptrdiff_t words;		/* Number of words in the trie. */
   struct trie *trie;		/* The trie itself. */
+  int ntries;			/* Number of trie nodes, once prepared. */
   int mind;			/* Minimum depth of an accepting node. */
   int maxd;			/* Maximum depth of any node. */
   unsigned char delta[NCHAR];	/* Delta table for rapid search. */
@@ -111,8 +113,29 @@ struct kwset
      more such matches; e.g., Greek has three sigma characters that
      all match when case-folding.  */
   int gc1help;
+
+  /* If there are many keywords, a filter that quickly rules out most
+     of the positions where no keyword can start, as the Commentz-Walter
+     search shifts poorly when many keywords share its delta table.
+     Bit H of FILTER is set if H is the hash of the first FILTERLEN
+     bytes of some keyword, translated via TRANS if TRANS is nonnull.
+     FILTERSHIFT is 64 minus the number of bits in a hash.  */
+  unsigned char *filter;
+  int filterlen;
+  int filtershift;
+
+  /* While the keyword set is being built, the first bytes of each
+     keyword, packed as for the filter, and the number allocated.  */
+  uint64_t *heads;
+  size_t headsalloc;
 };
 
+/* Use a filter if there are at least this many keywords.  */
+enum { FILTER_MIN_WORDS = 64 };
+
+/* The maximum number of bytes of a keyword that its filter hash uses.  */
+enum { FILTER_MAXLEN = sizeof (uint64_t) };
+
 /* Use TRANS to transliterate C.  A null TRANS does no transliteration.  */
 static inline char
 tr (char const *trans, char c)
@@ -141,6 +164,9 @@ kwsalloc (char const *trans)
   kwset->maxd = -1;
   kwset->target = NULL;
   kwset->trans = trans;
+  kwset->filter = NULL;
+  kwset->heads = NULL;
+  kwset->headsalloc = 0;
 
   return kwset;
 }
@@ -156,6 +182,16 @@ kwsincr (kwset_t kwset, char const *text, size_t len)
   struct trie *trie = kwset->trie;
   char const *trans = kwset->trans;
 
+  /* Remember the first bytes of the keyword, in case it is needed for
+     a filter.  */
+  if (kwset->headsalloc <= kwset->words)
+    kwset->heads = x2nrealloc (kwset->heads, &kwset->headsalloc,
+                               sizeof *kwset->heads);
+  uint64_t head = 0;
+  for (size_t i = 0; i < len && i < FILTER_MAXLEN; i++)
+    head |= (uint64_t) U(tr (trans, text[i])) << (CHAR_BIT * i);
+  kwset->heads[kwset->words] = head;
+
   text += len;
 
   /* Descend the trie (built of reversed keywords) character-by-character,
@@ -387,6 +423,43 @@ treenext (struct tree const *tree, struct trie *next[])
   next[tree->label] = tree->trie;
 }
 
+/* Return the hash of HEAD, the packed first bytes of a keyword or of
+   a possible match, for the filter of KWSET.  */
+static inline size_t
+filterhash (kwset_t kwset, uint64_t head)
+{
+  return (head * UINT64_C (0x9e3779b97f4a7c15)) >> kwset->filtershift;
+}
+
+/* Build the filter for KWSET, whose keywords are all nonempty.  */
+static void
+filterprep (kwset_t kwset)
+{
+  int filterlen = MIN (kwset->mind, FILTER_MAXLEN);
+  uint64_t mask = (filterlen == FILTER_MAXLEN
+                   ? UINT64_MAX
+                   : ((uint64_t) 1 << (CHAR_BIT * filterlen)) - 1);
+
+  /* Use about 64 bits per keyword, so that few positions pass the
+     filter by accident, but keep the filter small enough to stay
+     in cache.  */
+  int bits = 16;
+  while (bits < 26 && ((size_t) 1 << bits) / 64 < kwset->words)
+    bits++;
+
+  size_t filtersize = ((size_t) 1 << bits) / CHAR_BIT;
+  kwset->filter = obstack_alloc (&kwset->obstack, filtersize);
+  memset (kwset->filter, 0, filtersize);
+  kwset->filterlen = filterlen;
+  kwset->filtershift = 64 - bits;
+
+  for (ptrdiff_t i = 0; i < kwset->words; i++)
+    {
+      size_t h = filterhash (kwset, kwset->heads[i] & mask);
+      kwset->filter[h / CHAR_BIT] |= 1 << (h % CHAR_BIT);
+    }
+}
+
 /* Compute the shift for each trie node, as well as the delta
    table and next cache for the given keyword set. */
 void
@@ -405,11 +478,13 @@ kwsprep (kwset_t kwset)
   /* Traverse the nodes of the trie in level order, simultaneously
      computing the delta table, failure function, and shift function.  */
   struct trie *curr, *last;
+  int index = 0;
   for (curr = last = kwset->trie; curr; curr = curr->next)
     {
       /* Enqueue the immediate descendants in the level order queue.  */
       enqueue (curr->links, &last);
 
+      curr->index = index++;
       curr->shift = kwset->mind;
       curr->maxshift = kwset->mind;
 
@@ -439,6 +514,8 @@ kwsprep (kwset_t kwset)
         }
     }
 
+  kwset->ntries = index;
+
   /* Traverse the trie in level order again, fixing up all nodes whose
      shift exceeds their inherited maxshift.  */
   for (curr = kwset->trie->next; curr; curr = curr->next)
@@ -510,6 +587,11 @@ kwsprep (kwset_t kwset)
   if (trans)
     for (i = 0; i < NCHAR; ++i)
       kwset->delta[i] = delta[U(trans[i])];
+
+  if (FILTER_MIN_WORDS <= kwset->words && 0 < kwset->mind)
+    filterprep (kwset);
+  free (kwset->heads);
+  kwset->heads = NULL;
 }
 
 /* Delta2 portion of a Boyer-Moore search.  *TP is the string text
@@ -835,6 +917,61 @@ cwexec (kwset_t kwset, char const *text, size_t len, struct kwsmatch *kwsmatch)
   return mch - text;
 }
 
+/* Search for multiple strings, using the filter of KWSET to skip the
+   positions where no keyword can start, and cwexec to check the
+   positions that pass the filter (inlinable version).  */
+static inline size_t _GL_ARG_NONNULL ((4))
+filterexec_trans (kwset_t kwset, char const *text, size_t len,
+                  struct kwsmatch *kwsmatch)
+{
+  char const *trans = kwset->trans;
+  unsigned char const *filter = kwset->filter;
+  int filterlen = kwset->filterlen;
+  int shift = CHAR_BIT * (filterlen - 1);
+
+  if (len < kwset->mind)
+    return -1;
+
+  /* Keep the first bytes of the text at the current position packed in
+     HEAD, by shifting each new byte in at the top.  */
+  char const *last = text + len - kwset->mind;
+  uint64_t head = 0;
+  for (int i = 0; i < filterlen - 1; i++)
+    head |= (uint64_t) U(tr (trans, text[i])) << (CHAR_BIT * (i + 1));
+
+  for (char const *p = text; p <= last; p++)
+    {
+      head = (head >> CHAR_BIT
+              | (uint64_t) U(tr (trans, p[filterlen - 1])) << shift);
+      size_t h = filterhash (kwset, head);
+      if (filter[h / CHAR_BIT] >> (h % CHAR_BIT) & 1)
+        {
+          /* Every keyword that starts here ends within MAXD bytes, so
+             cwexec finds the longest of them at offset zero.  */
+          size_t n = MIN (text + len - p, kwset->maxd);
+          if (cwexec (kwset, p, n, kwsmatch) == 0)
+            {
+              kwsmatch->offset[0] = p - text;
+              return p - text;
+            }
+        }
+    }
+
+  return -1;
+}
+
+/* Multiple string search with a filter.  */
+static size_t _GL_ARG_NONNULL ((4))
+filterexec (kwset_t kwset, char const *text, size_t len,
+            struct kwsmatch *kwsmatch)
+{
+  /* Help the compiler inline filterexec_trans in two ways, depending
+     on whether kwset->trans is null.  */
+  return (kwset->trans
+          ? filterexec_trans (kwset, text, len, kwsmatch)
+          : filterexec_trans (kwset, text, len, kwsmatch));
+}
+
 /* Search TEXT for a match of any member of KWSET.
    Return the offset (into TEXT) of the first byte of the matching substring,
    or (size_t) -1 if no match is found.  Upon a match, store details in
@@ -855,14 +992,349 @@ kwsexec (kwset_t kwset, char const *text, size_t size,
         }
       return ret;
     }
+  else if (kwset->filter)
+    return filterexec (kwset, text, size, kwsmatch);
   else
     return cwexec (kwset, text, size, kwsmatch);
 }
 
+/* A prepared keyword set, as written by kwsdump.  Pointers to trie
+   and tree nodes are stored as their index in the arrays that follow
+   the header, or -1 for a null pointer.  All integers are in the
+   native byte order, as the image is meant to be read back only on
+   the machine that wrote it.  */
+struct kwsimage
+{
+  char magic[8];		/* KWSIMAGE_MAGIC.  */
+  uint32_t order;		/* KWSIMAGE_ORDER, to detect byte order.  */
+  int32_t mind;
+  int32_t maxd;
+  int32_t gc1help;
+  int32_t filterlen;
+  int32_t filtershift;		/* 0 if there is no filter.  */
+  int64_t words;
+  int64_t ntries;		/* Trie nodes, in level order.  */
+  int64_t ntrees;		/* Tree nodes, one per trie node but the root.  */
+  int32_t next[NCHAR];
+  unsigned char delta[NCHAR];
+  char gc1;
+  char gc2;
+  char pad[6];
+};
+
+struct kwsimage_tree
+{
+  int32_t llink;
+  int32_t rlink;
+  int32_t trie;
+  unsigned char label;
+  signed char balance;
+  char pad[2];
+};
+
+struct kwsimage_trie
+{
+  int64_t accepting;
+  int32_t links;
+  int32_t parent;
+  int32_t fail;
+  int32_t depth;
+  int32_t shift;
+  int32_t maxshift;
+};
+
+/* The image is followed by NTREES tree nodes, NTRIES trie nodes, and
+   then, if there is only one word, its MIND bytes and MIND - 1 shifts,
+   and finally the filter, if any.  */
+
+#define KWSIMAGE_MAGIC "kwset\0\0\1"
+enum { KWSIMAGE_ORDER = 0x01020304 };
+
+/* Return the size of the filter of a keyword set whose FILTERSHIFT is
+   as given, or 0 if it has no filter.  */
+static size_t
+filtersize (int filtershift)
+{
+  return filtershift ? ((size_t) 1 << (64 - filtershift)) / CHAR_BIT : 0;
+}
+
+/* Store in IMAGE the nodes of TREE, so that each node follows its
+   subtrees, and return the index of its root.  *N is the number of
+   nodes stored so far.  */
+static int32_t
+dumptree (struct tree const *tree, struct kwsimage_tree *image, int32_t *n)
+{
+  if (!tree)
+    return -1;
+  int32_t llink = dumptree (tree->llink, image, n);
+  int32_t rlink = dumptree (tree->rlink, image, n);
+  struct kwsimage_tree *t = &image[*n];
+  memset (t, 0, sizeof *t);
+  t->llink = llink;
+  t->rlink = rlink;
+  t->trie = tree->trie->index;
+  t->label = tree->label;
+  t->balance = tree->balance;
+  return (*n)++;
+}
+
+/* Write the prepared keyword set KWSET to STREAM, so that kwsload can
+   read it back without building it again.  Return false if there is a
+   write error.  */
+bool
+kwsdump (kwset_t kwset, FILE *stream)
+{
+  struct kwsimage header;
+  struct trie const *curr;
+  int32_t ntries = kwset->ntries;
+  int i;
+
+  memset (&header, 0, sizeof header);
+  memcpy (header.magic, KWSIMAGE_MAGIC, sizeof header.magic);
+  header.order = KWSIMAGE_ORDER;
+  header.mind = kwset->mind;
+  header.maxd = kwset->maxd;
+  header.gc1help = kwset->words == 1 ? kwset->gc1help : 0;
+  header.filterlen = kwset->filter ? kwset->filterlen : 0;
+  header.filtershift = kwset->filter ? kwset->filtershift : 0;
+  header.words = kwset->words;
+  header.ntries = ntries;
+  header.ntrees = ntries - 1;
+  for (i = 0; i < NCHAR; i++)
+    header.next[i] = kwset->next[i] ? kwset->next[i]->index : -1;
+  memcpy (header.delta, kwset->delta, NCHAR);
+  header.gc1 = kwset->words == 1 ? kwset->gc1 : 0;
+  header.gc2 = kwset->words == 1 && 1 < kwset->mind ? kwset->gc2 : 0;
+
+  struct kwsimage_tree *trees = xnmalloc (ntries, sizeof *trees);
+  struct kwsimage_trie *tries = xnmalloc (ntries, sizeof *tries);
+  int32_t ntrees = 0;
+  for (curr = kwset->trie; curr; curr = curr->next)
+    {
+      struct kwsimage_trie *t = &tries[curr->index];
+      memset (t, 0, sizeof *t);
+      t->accepting = curr->accepting;
+      t->links = dumptree (curr->links, trees, &ntrees);
+      t->parent = curr->parent ? curr->parent->index : -1;
+      t->fail = curr->fail ? curr->fail->index : -1;
+      t->depth = curr->depth;
+      t->shift = curr->shift;
+      t->maxshift = curr->maxshift;
+    }
+
+  fwrite (&header, sizeof header, 1, stream);
+  fwrite (trees, sizeof *trees, ntrees, stream);
+  fwrite (tries, sizeof *tries, ntries, stream);
+  free (trees);
+  free (tries);
+  if (kwset->words == 1)
+    {
+      fwrite (kwset->target, 1, kwset->mind, stream);
+      if (1 < kwset->mind)
+        fwrite (kwset->shift, sizeof *kwset->shift, kwset->mind - 1, stream);
+    }
+  if (kwset->filter)
+    fwrite (kwset->filter, 1, filtersize (kwset->filtershift), stream);
+
+  return !ferror (stream);
+}
+
+/* Return true if I is the index of a node in an array of N nodes,
+   or -1 if NULLABLE.  */
+static bool
+valid_index (int32_t i, int64_t n, bool nullable)
+{
+  return (nullable && i == -1) || (0 <= i && i < n);
+}
+
+/* Return true if SHIFT is a possible shift of a keyword set whose
+   shortest keyword has MIND bytes: kwsprep makes every shift at least
+   1, and at most MIND, unless there is an empty keyword.  */
+static bool
+valid_shift (int64_t shift, int32_t mind)
+{
+  return MIN (1, mind) <= shift && shift <= mind;
+}
+
+/* Replace the contents of KWSET, which must have just been allocated,
+   by the keyword set in IMAGE, of size SIZE, which kwsdump wrote.
+   Return false, leaving KWSET as it was, if IMAGE is not such a
+   keyword set.  KWSET must have the same translation table as the
+   keyword set that was written.
+
+   The searches trust the shifts, depths and links of a keyword set,
+   so check each of them against what kwsprep can produce: shifts that
+   are out of range would move the search outside its buffer, and links
+   that do not follow the trie could make it loop or report a match
+   longer than the text.  */
+bool
+kwsload (kwset_t kwset, void const *image, size_t size)
+{
+  char const *p = image;
+  struct kwsimage header;
+  int64_t i;
+
+  if (size < sizeof header)
+    return false;
+  memcpy (&header, p, sizeof header);
+  p += sizeof header;
+  if (memcmp (header.magic, KWSIMAGE_MAGIC, sizeof header.magic) != 0
+      || header.order != KWSIMAGE_ORDER
+      || header.ntries < 1 || INT32_MAX < header.ntries
+      || SIZE_MAX / 64 < header.ntries
+      || header.ntrees != header.ntries - 1
+      || header.words < 1 || header.mind < 0 || header.maxd < header.mind
+      || header.filtershift < 0 || 64 <= header.filtershift
+      || header.filterlen < 0 || FILTER_MAXLEN < header.filterlen
+      || (header.filtershift
+          && header.filterlen != MIN (header.mind, FILTER_MAXLEN))
+      || (header.words == 1 && 0 <= header.gc1help && !kwset->trans))
+    return false;
+
+  size_t ntries = header.ntries;
+  size_t nbytes = (sizeof (struct kwsimage_tree) * (ntries - 1)
+                   + sizeof (struct kwsimage_trie) * ntries
+                   + filtersize (header.filtershift));
+  if (header.words == 1)
+    nbytes += (header.mind
+               + sizeof *kwset->shift * (header.mind ? header.mind - 1 : 0));
+  if (size - sizeof header != nbytes)
+    return false;
+  /* A byte's delta is zero exactly when some keyword ends with it.  */
+  for (i = 0; i < NCHAR; i++)
+    if (! (valid_index (header.next[i], ntries, true)
+           && header.next[i] != 0
+           && header.delta[i] <= header.mind
+           && (header.delta[i] != 0 || header.next[i] != -1
+               || header.mind == 0)))
+      return false;
+
+  char const *treeimage = p;
+  char const *trieimage = (treeimage
+                           + sizeof (struct kwsimage_tree) * (ntries - 1));
+  p = trieimage + sizeof (struct kwsimage_trie) * ntries;
+  if (header.words == 1)
+    for (i = 0; i + 1 < header.mind; i++)
+      {
+        int shift;
+        memcpy (&shift, p + header.mind + i * sizeof shift, sizeof shift);
+        if (! valid_shift (shift, header.mind))
+          return false;
+      }
+
+  struct tree *trees = obstack_alloc (&kwset->obstack,
+                                      (ntries - 1) * sizeof *trees);
+  struct trie *tries = obstack_alloc (&kwset->obstack,
+                                      ntries * sizeof *tries);
+  for (i = 0; i < ntries - 1; i++)
+    {
+      struct kwsimage_tree t;
+      memcpy (&t, treeimage + i * sizeof t, sizeof t);
+      if (! (valid_index (t.llink, i, true)
+             && valid_index (t.rlink, i, true)
+             && valid_index (t.trie, ntries, false)))
+        goto malformed;
+      trees[i].llink = t.llink < 0 ? NULL : &trees[t.llink];
+      trees[i].rlink = t.rlink < 0 ? NULL : &trees[t.rlink];
+      trees[i].trie = &tries[t.trie];
+      trees[i].label = t.label;
+      trees[i].balance = t.balance;
+    }
+  int32_t mind = INT32_MAX, maxd = 0;
+  for (i = 0; i < ntries; i++)
+    {
+      struct kwsimage_trie t;
+      memcpy (&t, trieimage + i * sizeof t, sizeof t);
+      if (! (valid_index (t.links, ntries - 1, true)
+             && (i == 0 ? t.parent == -1 : valid_index (t.parent, i, false))
+             && valid_index (t.fail, ntries, true)
+             && t.depth == (i == 0 ? 0 : tries[t.parent].depth + 1)
+             && valid_shift (t.shift, header.mind)
+             && valid_shift (t.maxshift, header.mind)))
+        goto malformed;
+      if (t.accepting && t.depth < mind)
+        mind = t.depth;
+      if (maxd < t.depth)
+        maxd = t.depth;
+      tries[i].accepting = t.accepting;
+      tries[i].links = t.links < 0 ? NULL : &trees[t.links];
+      tries[i].parent = t.parent < 0 ? NULL : &tries[t.parent];
+      tries[i].next = i + 1 < ntries ? &tries[i + 1] : NULL;
+      tries[i].fail = t.fail < 0 ? NULL : &tries[t.fail];
+      tries[i].depth = t.depth;
+      tries[i].shift = t.shift;
+      tries[i].maxshift = t.maxshift;
+      tries[i].index = i;
+    }
+  if (mind != header.mind || maxd != header.maxd)
+    goto malformed;
+
+  /* The tree nodes of each trie follow those of the tries before it,
+     and lead to its children; NEXT leads to the children of the root.  */
+  int64_t first = 0;
+  for (i = 0; i < ntries; i++)
+    if (tries[i].links)
+      {
+        int64_t j, last = tries[i].links - trees;
+        if (last < first)
+          goto malformed;
+        for (j = first; j <= last; j++)
+          if (trees[j].trie->parent != &tries[i]
+              || (trees[j].llink && trees[j].llink < &trees[first])
+              || (trees[j].rlink && trees[j].rlink < &trees[first]))
+            goto malformed;
+        first = last + 1;
+      }
+  if (first != ntries - 1)
+    goto malformed;
+  for (i = 0; i < NCHAR; i++)
+    if (0 < header.next[i] && tries[header.next[i]].parent != tries)
+      goto malformed;
+
+  kwset->words = header.words;
+  kwset->trie = tries;
+  kwset->ntries = ntries;
+  kwset->mind = header.mind;
+  kwset->maxd = header.maxd;
+  memcpy (kwset->delta, header.delta, NCHAR);
+  for (i = 0; i < NCHAR; i++)
+    kwset->next[i] = header.next[i] < 0 ? NULL : &tries[header.next[i]];
+  if (header.words == 1)
+    {
+      kwset->target = obstack_copy (&kwset->obstack, p, header.mind);
+      p += header.mind;
+      if (1 < header.mind)
+        {
+          size_t shiftsize = sizeof *kwset->shift * (header.mind - 1);
+          kwset->shift = obstack_alloc (&kwset->obstack, shiftsize);
+          memcpy (kwset->shift, p, shiftsize);
+          p += shiftsize;
+        }
+      kwset->gc1 = header.gc1;
+      kwset->gc2 = header.gc2;
+      kwset->gc1help = header.gc1help;
+    }
+  if (header.filtershift)
+    {
+      kwset->filter = obstack_copy (&kwset->obstack, p,
+                                    filtersize (header.filtershift));
+      kwset->filterlen = header.filterlen;
+      kwset->filtershift = header.filtershift;
+    }
+  free (kwset->heads);
+  kwset->heads = NULL;
+  return true;
+
+ malformed:
+  obstack_free (&kwset->obstack, trees);
+  return false;
+}
+
 /* Free the components of the given keyword set. */
 void
 kwsfree (kwset_t kwset)
 {
   obstack_free (&kwset->obstack, NULL);
+  free (kwset->heads);
   free (kwset);
 }
@@ -21,7 +21,9 @@
    The author may be reached (Email) at the address mike@ai.mit.edu,
    or (US mail) as Mike Haertel c/o Free Software Foundation. */
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 struct kwsmatch
 {
@@ -56,5 +58,15 @@ extern void kwsprep (kwset_t);
 extern size_t kwsexec (kwset_t, char const *, size_t, struct kwsmatch *)
   _GL_ARG_NONNULL ((4));
 
+/* Write a prepared keyword set to the given stream, in a form that
+   kwsload can read back.  Return false if this fails.  */
+extern bool kwsdump (kwset_t, FILE *);
+
+/* Fill a newly allocated keyword set from the given image of the
+   given size, as written by kwsdump for a keyword set with the same
+   translation table.  Return false, leaving the keyword set as it
+   was, if the image is malformed.  */
+extern bool kwsload (kwset_t, void const *, size_t);
+
 /* Deallocate the given keyword set and all its associated storage. */
 extern void kwsfree (kwset_t);
@@ -20,6 +20,7 @@
 
 #include <config.h>
 #include "search.h"
+#include "c-ctype.h"
 
 #if HAVE_LIBPCRE
 # include <pcre.h>
@@ -28,48 +29,116 @@
    in pcre_exec.  */
 enum { NSUB = 300 };
 
-/* Compiled internal form of a Perl regular expression.  */
-static pcre *cre;
-
-/* Additional information about the pattern.  */
-static pcre_extra *extra;
-
 # ifndef PCRE_STUDY_JIT_COMPILE
 #  define PCRE_STUDY_JIT_COMPILE 0
 # endif
 
+struct pcre_comp
+{
+  /* Compiled internal form of a Perl regular expression.  */
+  pcre *cre;
+
+  /* Additional information about the pattern.  */
+  pcre_extra *extra;
+
+# if PCRE_STUDY_JIT_COMPILE
+  /* The JIT stack and its maximum size.  */
+  pcre_jit_stack *jit_stack;
+  int jit_stack_size;
+# endif
+
+  /* Table, indexed by ! (flag & PCRE_NOTBOL), of whether the empty
+     string matches when that flag is used.  */
+  int empty_match[2];
+};
+
+/* Where the literal strings of the patterns occur in the text from a
+   search's start to LIM.  NEXT[I] is the first occurrence at or after
+   the start of pattern I's string, or NULL if it has none before LIM.
+   When a search returns a match ending at RESUME, grep usually looks
+   for the next match right there, so the next search from RESUME to
+   LIM starts from these occurrences and looks again only for the
+   strings whose occurrence it has passed.  Otherwise LIM is NULL.  */
+struct literal_hits
+{
+  char const *lim;
+  char const *resume;
+  char const **next;
+};
+
+/* The compiled patterns.  Several patterns are compiled separately
+   rather than as one alternation, which PCRE's JIT handles poorly
+   when it is large.  To avoid running every pattern over the input,
+   KWSET holds the literal strings that some of the patterns' matches
+   must start with, and a pattern with such a string is run only if
+   the string occurs in the text to be searched.  */
+struct pcre_patterns
+{
+  struct pcre_comp *comp;
+  size_t ncomp;
+
+  /* The literal strings, if there are several patterns and any of
+     them has one.  LITERAL[K] is the pattern whose string is keyword
+     number K, and PREFIX[K] is the longest other keyword that is a
+     prefix of keyword K, or -1; when kwsexec finds keyword K, these
+     keywords occur at the same place.  */
+  kwset_t kwset;
+  size_t nliterals;
+  size_t *literal;
+  ptrdiff_t *prefix;
+
+  /* HAS_LITERAL says which patterns have a literal string, and HITS
+     where those strings occur: HITS[0] for searches of whole lines and
+     HITS[1] for searches from a START_PTR, as grep alternates between
+     the two when it prints matches.  */
+  bool *has_literal;
+  struct literal_hits hits[2];
+
+  /* The index of the pattern that last matched.  */
+  size_t matched;
+};
+
 # if PCRE_STUDY_JIT_COMPILE
-/* Maximum size of the JIT stack.  */
-static int jit_stack_size;
+/* The JIT stack of the pattern that the calling thread is matching.
+   Threads share the compiled patterns, so rather than having a stack
+   assigned, each pattern asks for it with jit_stack_callback.  */
+static THREAD_LOCAL pcre_jit_stack *current_jit_stack;
+
+static pcre_jit_stack *
+jit_stack_callback (void *data)
+{
+  return current_jit_stack;
+}
 # endif
 
-/* Match the already-compiled PCRE pattern against the data in SUBJECT,
-   of size SEARCH_BYTES and starting with offset SEARCH_OFFSET, with
-   options OPTIONS, and storing resulting matches into SUB.  Return
+/* Match the already-compiled PCRE pattern PC against the data in
+   SUBJECT, of size SEARCH_BYTES and starting with offset SEARCH_OFFSET,
+   with options OPTIONS, and storing resulting matches into SUB.  Return
    the (nonnegative) match location or a (negative) error number.  */
 static int
-jit_exec (char const *subject, int search_bytes, int search_offset,
-          int options, int *sub)
+jit_exec (struct pcre_comp *pc, char const *subject, int search_bytes,
+          int search_offset, int options, int *sub)
 {
   while (true)
     {
-      int e = pcre_exec (cre, extra, subject, search_bytes, search_offset,
-                         options, sub, NSUB);
+# if PCRE_STUDY_JIT_COMPILE
+      current_jit_stack = pc->jit_stack;
+# endif
+      int e = pcre_exec (pc->cre, pc->extra, subject, search_bytes,
+                         search_offset, options, sub, NSUB);
 
 # if PCRE_STUDY_JIT_COMPILE
       if (e == PCRE_ERROR_JIT_STACKLIMIT
-          && 0 < jit_stack_size && jit_stack_size <= INT_MAX / 2)
+          && 0 < pc->jit_stack_size && pc->jit_stack_size <= INT_MAX / 2)
         {
-          int old_size = jit_stack_size;
-          int new_size = jit_stack_size = old_size * 2;
-          static pcre_jit_stack *jit_stack;
-          if (jit_stack)
-            pcre_jit_stack_free (jit_stack);
-          jit_stack = pcre_jit_stack_alloc (old_size, new_size);
-          if (!jit_stack)
+          int old_size = pc->jit_stack_size;
+          int new_size = pc->jit_stack_size = old_size * 2;
+          if (pc->jit_stack)
+            pcre_jit_stack_free (pc->jit_stack);
+          pc->jit_stack = pcre_jit_stack_alloc (old_size, new_size);
+          if (!pc->jit_stack)
             error (EXIT_TROUBLE, 0,
                    _("failed to allocate memory for the PCRE JIT stack"));
-          pcre_assign_jit_stack (extra, NULL, jit_stack);
           continue;
         }
 # endif
@@ -81,21 +150,13 @@ jit_exec (char const *subject, int search_bytes, int search_offset,
 #endif
 
 #if HAVE_LIBPCRE
-/* Table, indexed by ! (flag & PCRE_NOTBOL), of whether the empty
-   string matches when that flag is used.  */
-static int empty_match[2];
-
 static bool multibyte_locale;
-#endif
 
-void
-Pcompile (char const *pattern, size_t size)
+/* Compile into PC the Perl regular expression PATTERN, of size SIZE,
+   with pcre_compile options FLAGS.  */
+static void
+pcompile1 (struct pcre_comp *pc, char const *pattern, size_t size, int flags)
 {
-#if !HAVE_LIBPCRE
-  error (EXIT_TROUBLE, 0, "%s",
-         _("support for the -P option is not compiled into "
-           "this --disable-perl-regexp binary"));
-#else
   int e;
   char const *ep;
   static char const wprefix[] = "(?<!\\w)(?:";
@@ -105,29 +166,15 @@ Pcompile (char const *pattern, size_t size)
   int fix_len_max = MAX (sizeof wprefix - 1 + sizeof wsuffix - 1,
                          sizeof xprefix - 1 + sizeof xsuffix - 1);
   char *re = xnmalloc (4, size + (fix_len_max + 4 - 1) / 4);
-  int flags = (PCRE_MULTILINE
-               | (match_icase ? PCRE_CASELESS : 0));
   char const *patlim = pattern + size;
   char *n = re;
   char const *p;
   char const *pnul;
 
-  if (1 < MB_CUR_MAX)
-    {
-      if (! using_utf8 ())
-        error (EXIT_TROUBLE, 0,
-               _("-P supports only unibyte and UTF-8 locales"));
-      multibyte_locale = true;
-      flags |= PCRE_UTF8;
-    }
-
-  /* FIXME: Remove these restrictions.  */
-  if (memchr (pattern, '\n', size))
-    error (EXIT_TROUBLE, 0, _("the -P option only supports a single pattern"));
   if (! eolbyte)
     {
       bool escaped = false;
-      for (p = pattern; *p; p++)
+      for (p = pattern; p < patlim && *p; p++)
         if (escaped)
           escaped = false;
         else
@@ -169,41 +216,290 @@ Pcompile (char const *pattern, size_t size)
   if (match_lines)
     strcpy (n, xsuffix);
 
-  cre = pcre_compile (re, flags, &ep, &e, pcre_maketables ());
-  if (!cre)
+  pc->cre = pcre_compile (re, flags, &ep, &e, pcre_maketables ());
+  if (!pc->cre)
     error (EXIT_TROUBLE, 0, "%s", ep);
 
-  extra = pcre_study (cre, PCRE_STUDY_JIT_COMPILE, &ep);
+  pc->extra = pcre_study (pc->cre, PCRE_STUDY_JIT_COMPILE, &ep);
   if (ep)
     error (EXIT_TROUBLE, 0, "%s", ep);
 
 # if PCRE_STUDY_JIT_COMPILE
-  if (pcre_fullinfo (cre, extra, PCRE_INFO_JIT, &e))
+  if (pcre_fullinfo (pc->cre, pc->extra, PCRE_INFO_JIT, &e))
     error (EXIT_TROUBLE, 0, _("internal error (should never happen)"));
 
-  /* The PCRE documentation says that a 32 KiB stack is the default.  */
+  /* The PCRE documentation says that a 32 KiB stack is the default,
+     which it uses while the callback returns NULL.  */
   if (e)
-    jit_stack_size = 32 << 10;
+    {
+      pc->jit_stack_size = 32 << 10;
+      pcre_assign_jit_stack (pc->extra, jit_stack_callback, NULL);
+    }
 # endif
 
   free (re);
 
   int sub[NSUB];
-  empty_match[false] = pcre_exec (cre, extra, "", 0, 0,
-                                  PCRE_NOTBOL, sub, NSUB);
-  empty_match[true] = pcre_exec (cre, extra, "", 0, 0, 0, sub, NSUB);
+  pc->empty_match[false] = pcre_exec (pc->cre, pc->extra, "", 0, 0,
+                                      PCRE_NOTBOL, sub, NSUB);
+  pc->empty_match[true] = pcre_exec (pc->cre, pc->extra, "", 0, 0, 0,
+                                     sub, NSUB);
+}
+
+/* Return the length of a literal string that every match of the Perl
+   regular expression PATTERN, of size SIZE, starts with, and store
+   the string's start in *LITERAL.  Return 0 if there is no such string
+   that is easy to find.  Look only at a leading run of ASCII
+   characters that are never special, and give up on alternations and
+   on (?...) constructs, which may change the meaning of what follows.  */
+static size_t
+literal_prefix (char const *pattern, size_t size, char const **literal)
+{
+  static char const plain[] = " !\"#%&',-/:;<=>@_`~";
+  char const *patlim = pattern + size;
+  char const *p;
+
+  if (memchr (pattern, '|', size))
+    return 0;
+  for (p = pattern; p + 1 < patlim; p++)
+    if (p[0] == '(' && p[1] == '?')
+      return 0;
+
+  p = pattern;
+  if (p < patlim && *p == '^')
+    p++;
+  *literal = p;
+  while (p < patlim && *p && (c_isalnum (*p) || strchr (plain, *p)))
+    p++;
+
+  /* A quantifier applies to the last character, which may then be
+     absent or repeated.  */
+  if (*literal < p && p < patlim && (*p == '?' || *p == '*' || *p == '{'))
+    p--;
+  return p - *literal;
+}
+
+/* A literal string of a pattern, for sorting.  */
+struct literal
+{
+  char const *str;		/* As translated by the keyword set.  */
+  size_t len;
+  size_t keyword;
+};
+
+static int
+literal_cmp (void const *a, void const *b)
+{
+  struct literal const *la = a;
+  struct literal const *lb = b;
+  int cmp = memcmp (la->str, lb->str, MIN (la->len, lb->len));
+  return cmp ? cmp : (la->len > lb->len) - (la->len < lb->len);
+}
+
+/* Build the keyword set of the literal strings of the patterns of PP,
+   which are in PATTERN, of size SIZE.  */
+static void
+literals_prep (struct pcre_patterns *pp, char const *pattern, size_t size)
+{
+  /* In a multibyte locale, a caseless match of an ASCII letter may be
+     a non-ASCII character, which kwset does not know.  */
+  if (match_icase && multibyte_locale)
+    return;
+
+  struct literal *lits = xnmalloc (pp->ncomp, sizeof *lits);
+  char const *patlim = pattern + size;
+  char const *p = pattern;
+  size_t i, n = 0;
+
+  kwsinit (&pp->kwset);
+  pp->literal = xnmalloc (pp->ncomp, sizeof *pp->literal);
+  pp->has_literal = xcalloc (pp->ncomp, sizeof *pp->has_literal);
+  for (i = 0; i < pp->ncomp; i++)
+    {
+      char const *sep = memchr (p, '\n', patlim - p);
+      char const *end = sep ? sep : patlim;
+      char const *lit;
+      size_t len = literal_prefix (p, end - p, &lit);
+      if (len)
+        {
+          /* Translate the string as kwsinit's table does.  */
+          char *str = xmemdup (lit, len);
+          if (match_icase)
+            for (size_t j = 0; j < len; j++)
+              str[j] = toupper (to_uchar (str[j]));
+          kwsincr (pp->kwset, lit, len);
+          lits[n].str = str;
+          lits[n].len = len;
+          lits[n].keyword = n;
+          pp->literal[n++] = i;
+          pp->has_literal[i] = true;
+        }
+      p = end + 1;
+    }
+
+  if (n)
+    {
+      kwsprep (pp->kwset);
+      pp->nliterals = n;
+
+      /* In sorted order, the keywords that are prefixes of a keyword
+         come before it, and are on a stack of keywords each of which
+         is a prefix of the next.  */
+      pp->prefix = xnmalloc (n, sizeof *pp->prefix);
+      qsort (lits, n, sizeof *lits, literal_cmp);
+      size_t *stack = xnmalloc (n, sizeof *stack);
+      size_t depth = 0;
+      for (i = 0; i < n; i++)
+        {
+          while (depth
+                 && ! (lits[stack[depth - 1]].len <= lits[i].len
+                       && memcmp (lits[stack[depth - 1]].str, lits[i].str,
+                                  lits[stack[depth - 1]].len) == 0))
+            depth--;
+          pp->prefix[lits[i].keyword]
+            = depth ? lits[stack[depth - 1]].keyword : -1;
+          stack[depth++] = i;
+        }
+      free (stack);
+      for (i = 0; i < 2; i++)
+        pp->hits[i].next = xnmalloc (pp->ncomp, sizeof *pp->hits[i].next);
+    }
+  else
+    {
+      kwsfree (pp->kwset);
+      pp->kwset = NULL;
+    }
+
+  for (i = 0; i < n; i++)
+    free ((char *) lits[i].str);
+  free (lits);
+}
+
+/* Set H->next for the text from BEG to LIM.  If the last search that
+   used H ended at BEG, look again only for the strings it has passed.  */
+static void
+literals_find (struct pcre_patterns *pp, struct literal_hits *h,
+               char const *beg, char const *lim)
+{
+  size_t i, unseen = 0;
+  struct kwsmatch kwsmatch;
+  bool resume = h->lim == lim && h->resume == beg;
+
+  /* LIM marks the strings being looked for.  */
+  for (i = 0; i < pp->ncomp; i++)
+    if (pp->has_literal[i] && (!resume || (h->next[i] && h->next[i] < beg)))
+      {
+        h->next[i] = lim;
+        unseen++;
+      }
+    else if (!resume)
+      h->next[i] = NULL;
+
+  for (char const *p = beg; unseen && p < lim; p++)
+    {
+      size_t offset = kwsexec (pp->kwset, p, lim - p, &kwsmatch);
+      if (offset == (size_t) -1)
+        break;
+      p += offset;
+      for (ptrdiff_t k = kwsmatch.index; 0 <= k; k = pp->prefix[k])
+        {
+          char const **next = &h->next[pp->literal[k]];
+          if (*next == lim)
+            {
+              *next = p;
+              unseen--;
+            }
+        }
+    }
+
+  if (unseen)
+    for (i = 0; i < pp->ncomp; i++)
+      if (h->next[i] == lim)
+        h->next[i] = NULL;
+
+  h->lim = lim;
+}
+#endif
+
+void *
+Pcompile (char const *pattern, size_t size)
+{
+#if !HAVE_LIBPCRE
+  error (EXIT_TROUBLE, 0, "%s",
+         _("support for the -P option is not compiled into "
+           "this --disable-perl-regexp binary"));
+  return NULL;
+#else
+  int flags = (PCRE_MULTILINE
+               | (match_icase ? PCRE_CASELESS : 0));
+  char const *patlim = pattern + size;
+  char const *p;
+  struct pcre_patterns *pp = xzalloc (sizeof *pp);
+
+  if (1 < MB_CUR_MAX)
+    {
+      if (! using_utf8 ())
+        error (EXIT_TROUBLE, 0,
+               _("-P supports only unibyte and UTF-8 locales"));
+      multibyte_locale = true;
+      flags |= PCRE_UTF8;
+    }
+
+  pp->ncomp = 1;
+  for (p = pattern; (p = memchr (p, '\n', patlim - p)); p++)
+    pp->ncomp++;
+  pp->comp = xcalloc (pp->ncomp, sizeof *pp->comp);
+
+  p = pattern;
+  for (size_t i = 0; i < pp->ncomp; i++)
+    {
+      char const *sep = memchr (p, '\n', patlim - p);
+      char const *end = sep ? sep : patlim;
+      pcompile1 (&pp->comp[i], p, end - p, flags);
+      p = end + 1;
+    }
+
+  if (1 < pp->ncomp)
+    literals_prep (pp, pattern, size);
+
+  return pp;
 #endif /* HAVE_LIBPCRE */
 }
 
-size_t
-Pexecute (char *buf, size_t size, size_t *match_size,
-          char const *start_ptr)
+/* Return a copy of the compiled patterns VPP for another thread.  The
+   copy shares the compiled regular expressions and the keyword set,
+   and has JIT stacks and literal hits of its own.  */
+void *
+Pcopy (void *vpp)
 {
 #if !HAVE_LIBPCRE
-  /* We can't get here, because Pcompile would have been called earlier.  */
-  error (EXIT_TROUBLE, 0, _("internal error"));
-  return -1;
+  return vpp;
 #else
+  struct pcre_patterns *pp = vpp;
+  struct pcre_patterns *dup = xmemdup (pp, sizeof *pp);
+
+  dup->comp = xmemdup (pp->comp, pp->ncomp * sizeof *pp->comp);
+# if PCRE_STUDY_JIT_COMPILE
+  for (size_t i = 0; i < pp->ncomp; i++)
+    dup->comp[i].jit_stack = NULL;
+# endif
+  for (int i = 0; i < 2; i++)
+    if (pp->hits[i].next)
+      {
+        dup->hits[i].lim = NULL;
+        dup->hits[i].next = xnmalloc (pp->ncomp, sizeof *dup->hits[i].next);
+      }
+  return dup;
+#endif /* HAVE_LIBPCRE */
+}
+
+#if HAVE_LIBPCRE
+/* Like Pexecute, but for the single pattern PC.  MULTILINE says
+   whether BUF may be searched several lines at a time.  */
+static size_t
+pexecute1 (struct pcre_comp *pc, char *buf, size_t size, size_t *match_size,
+           char const *start_ptr, bool multiline)
+{
   int sub[NSUB];
   char const *p = start_ptr ? start_ptr : buf;
   bool bol = p[-1] == eolbyte;
@@ -216,17 +512,6 @@ Pexecute (char *buf, size_t size, size_t *match_size,
      error.  */
   char const *subject = buf;
 
-  /* If the input is unibyte or is free of encoding errors a multiline search is
-     typically more efficient.  Otherwise, a single-line search is
-     typically faster, so that pcre_exec doesn't waste time validating
-     the entire input buffer.  */
-  bool multiline = true;
-  if (multibyte_locale)
-    {
-      multiline = ! buf_has_encoding_errors (buf, size - 1);
-      buf[size - 1] = eolbyte;
-    }
-
   for (; p < buf + size; p = line_start = line_end + 1)
     {
       bool too_big;
@@ -266,7 +551,7 @@ Pexecute (char *buf, size_t size, size_t *match_size,
           if (p == line_end)
             {
               sub[0] = sub[1] = search_offset;
-              e = empty_match[bol];
+              e = pc->empty_match[bol];
               break;
             }
 
@@ -276,7 +561,7 @@ Pexecute (char *buf, size_t size, size_t *match_size,
           if (multiline)
             options |= PCRE_NO_UTF8_CHECK;
 
-          e = jit_exec (subject, line_end - subject, search_offset,
+          e = jit_exec (pc, subject, line_end - subject, search_offset,
                         options, sub);
           if (e != PCRE_ERROR_BADUTF8)
             {
@@ -305,10 +590,10 @@ Pexecute (char *buf, size_t size, size_t *match_size,
                      This optimization is valid if VALID_BYTES is zero,
                      which means SEARCH_OFFSET is also zero.  */
                   sub[1] = 0;
-                  e = empty_match[bol];
+                  e = pc->empty_match[bol];
                 }
               else
-                e = jit_exec (subject, valid_bytes, search_offset,
+                e = jit_exec (pc, subject, valid_bytes, search_offset,
                               options | PCRE_NO_UTF8_CHECK | PCRE_NOTEOL, sub);
 
               if (e != PCRE_ERROR_NOMATCH)
@@ -383,5 +668,83 @@ Pexecute (char *buf, size_t size, size_t *match_size,
       *match_size = end - beg;
       return beg - buf;
     }
+}
+#endif
+
+size_t
+Pexecute (void *vpp, char *buf, size_t size, size_t *match_size,
+          char const *start_ptr)
+{
+#if !HAVE_LIBPCRE
+  /* We can't get here, because Pcompile would have been called earlier.  */
+  error (EXIT_TROUBLE, 0, _("internal error"));
+  return -1;
+#else
+  struct pcre_patterns *pp = vpp;
+
+  /* If the input is unibyte or is free of encoding errors a multiline search is
+     typically more efficient.  Otherwise, a single-line search is
+     typically faster, so that pcre_exec doesn't waste time validating
+     the entire input buffer.  */
+  bool multiline = true;
+  if (multibyte_locale)
+    {
+      multiline = ! buf_has_encoding_errors (buf, size - 1);
+      buf[size - 1] = eolbyte;
+    }
+
+  if (pp->ncomp == 1)
+    {
+      pp->matched = 0;
+      return pexecute1 (&pp->comp[0], buf, size, match_size, start_ptr,
+                        multiline);
+    }
+
+  char const *beg = start_ptr ? start_ptr : buf;
+  struct literal_hits *h = &pp->hits[!!start_ptr];
+  if (pp->kwset)
+    literals_find (pp, h, beg, buf + size);
+
+  /* Find the earliest match of any pattern, preferring the first
+     pattern on a tie.  Without START_PTR a match is reported as its
+     whole line, so once a line matches, later patterns need only be
+     run up to the end of that line.  */
+  size_t best = -1;
+  size_t lim = size;
+  for (size_t i = 0; i < pp->ncomp; i++)
+    {
+      if (pp->kwset && pp->has_literal[i]
+          && (!h->next[i] || (!start_ptr && lim <= h->next[i] - buf)))
+        continue;
+
+      size_t len;
+      size_t off = pexecute1 (&pp->comp[i], buf, lim, &len, start_ptr,
+                              multiline);
+      if (off < best)
+        {
+          best = off;
+          *match_size = len;
+          pp->matched = i;
+          if (!start_ptr)
+            lim = off + len;
+        }
+    }
+
+  if (pp->kwset)
+    h->resume = best == (size_t) -1 ? NULL : buf + best + *match_size;
+  return best;
+#endif
+}
+
+/* Return the number, counting from 1, of the pattern of VPP that
+   matched in the last call to Pexecute that found a match.  */
+size_t
+Ppattern_id (void *vpp)
+{
+#if HAVE_LIBPCRE
+  struct pcre_patterns *pp = vpp;
+  return pp->matched + 1;
+#else
+  return 0;
 #endif
 }
@@ -55,17 +55,28 @@ extern ptrdiff_t mb_goback (char const **, char const *, char const *);
 extern wint_t mb_prev_wc (char const *, char const *, char const *);
 extern wint_t mb_next_wc (char const *, char const *);
 
+/* Each compiler returns an opaque pointer to the state of the compiled
+   pattern; pass it as the first argument of the matching executor.
+   The copier of a matcher returns a state for another thread, which
+   shares what the executor only reads with the state it is given, so
+   that threads searching with copies of one state do not interfere.  */
+
 /* dfasearch.c */
-extern void GEAcompile (char const *, size_t, reg_syntax_t);
-extern size_t EGexecute (char *, size_t, size_t *, char const *);
+extern void *GEAcompile (char const *, size_t, reg_syntax_t);
+extern void *EGcopy (void *);
+extern size_t EGexecute (void *, char *, size_t, size_t *, char const *);
+extern void EGdfastats (void *, struct dfastats *);
 
 /* kwsearch.c */
-extern void Fcompile (char const *, size_t);
-extern size_t Fexecute (char *, size_t, size_t *, char const *);
+extern void *Fcompile (char const *, size_t);
+extern void *Fcopy (void *);
+extern size_t Fexecute (void *, char *, size_t, size_t *, char const *);
 
 /* pcresearch.c */
-extern void Pcompile (char const *, size_t);
-extern size_t Pexecute (char *, size_t, size_t *, char const *);
+extern void *Pcompile (char const *, size_t);
+extern void *Pcopy (void *);
+extern size_t Pexecute (void *, char *, size_t, size_t *, char const *);
+extern size_t Ppattern_id (void *);
 
 /* Return the number of bytes in the character at the start of S, which
    is of size N.  N must be positive.  MBS is the conversion state.
@@ -50,6 +50,24 @@ enum { EXIT_TROUBLE = 2 };
 
 #include "unlocked-io.h"
 
+/* GREP_THREADS is nonzero if grep can search files in several threads.
+   THREAD_LOCAL marks the static variables that hold the state of one
+   search, so that each searching thread has its own copy.  Threads
+   share compiled regular expressions, which the regex of the C library
+   locks while searching with them but the replacement regex, used if
+   re_search is defined, does not.  */
+#if USE_POSIX_THREADS && !defined re_search
+# define GREP_THREADS 1
+# if 201112 <= __STDC_VERSION__
+#  define THREAD_LOCAL _Thread_local
+# else
+#  define THREAD_LOCAL __thread
+# endif
+#else
+# define GREP_THREADS 0
+# define THREAD_LOCAL
+#endif
+
 _GL_INLINE_HEADER_BEGIN
 #ifndef SYSTEM_INLINE
 # define SYSTEM_INLINE _GL_INLINE
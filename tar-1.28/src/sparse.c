@@ -208,16 +208,69 @@ sparse_add_map (struct tar_stat_info *st, struct sp_array const *sp)
   st->sparse_map_avail = avail + 1;
 }
 
-/* Scan the sparse file and create its map */
+/* Scan the blocks of FILE from *POFFSET up to END, or up to its end,
+   adding the regions of data they hold to its map; SP is the region
+   under way.  Set *PCOUNT to the result of the read that ended the
+   scan before END, or to 0.  */
 static bool
-sparse_scan_file (struct tar_sparse_file *file)
+sparse_scan_blocks (struct tar_sparse_file *file, struct sp_array *sp,
+		    off_t *poffset, off_t end, size_t *pcount)
 {
   struct tar_stat_info *st = file->stat_info;
-  int fd = file->fd;
   char buffer[BLOCKSIZE];
   size_t count = 0;
+  off_t offset = *poffset;
+
+  while (offset < end
+	 && (count = blocking_read (file->fd, buffer,
+				    (end - offset < BLOCKSIZE
+				     ? end - offset : BLOCKSIZE))) != 0
+	 && count != SAFE_READ_ERROR)
+    {
+      /* Analyze the block.  */
+      if (zero_block_p (buffer, count))
+	{
+	  if (sp->numbytes)
+	    {
+	      sparse_add_map (st, sp);
+	      sp->numbytes = 0;
+	      if (!tar_sparse_scan (file, scan_block, NULL))
+		return false;
+	    }
+	}
+      else
+	{
+	  if (sp->numbytes == 0)
+	    sp->offset = offset;
+	  sp->numbytes += count;
+	  st->archive_file_size += count;
+	  if (!tar_sparse_scan (file, scan_block, buffer))
+	    return false;
+	}
+
+      offset += count;
+    }
+
+  *poffset = offset;
+  *pcount = offset < end ? count : 0;
+  return true;
+}
+
+/* Scan the sparse file and create its map.  Where the system tells
+   the data of a file from its holes, only the data are read: a hole
+   reads as zeros, so the blocks it covers would end up out of the
+   map anyway.  The data found are still read block by block, and the
+   map is the same as if the whole file were.  */
+static bool
+sparse_scan_file (struct tar_sparse_file *file)
+{
+  struct tar_stat_info *st = file->stat_info;
+  size_t count = 0;
   off_t offset = 0;
   struct sp_array sp = {0, 0};
+#ifdef SEEK_HOLE
+  bool seek_data = true;
+#endif
 
   st->archive_file_size = 0;
 
@@ -228,31 +281,55 @@ sparse_scan_file (struct tar_sparse_file *file)
       if (!tar_sparse_scan (file, scan_begin, NULL))
 	return false;
 
-      while ((count = blocking_read (fd, buffer, sizeof buffer)) != 0
-	     && count != SAFE_READ_ERROR)
+      for (;;)
 	{
-	  /* Analyze the block.  */
-	  if (zero_block_p (buffer, count))
+	  off_t end = TYPE_MAXIMUM (off_t);
+
+#ifdef SEEK_HOLE
+	  if (seek_data)
 	    {
-	      if (sp.numbytes)
+	      /* Skip to the block where the next data begin, and scan
+		 up to the block where they end.  */
+	      off_t data = lseek (file->fd, offset, SEEK_DATA);
+	      if (data < 0 && errno == ENXIO)
+		data = end = st->stat.st_size;
+	      else if (data >= 0)
+		end = lseek (file->fd, data, SEEK_HOLE);
+
+	      if (data < 0 || end < 0)
 		{
-		  sparse_add_map (st, &sp);
-		  sp.numbytes = 0;
-		  if (!tar_sparse_scan (file, scan_block, NULL))
-		    return false;
+		  /* Not supported here; scan the rest of the file.  */
+		  seek_data = false;
+		  end = TYPE_MAXIMUM (off_t);
 		}
-	    }
-	  else
-	    {
-	      if (sp.numbytes == 0)
-		sp.offset = offset;
-	      sp.numbytes += count;
-	      st->archive_file_size += count;
-	      if (!tar_sparse_scan (file, scan_block, buffer))
+	      else
+		{
+		  data -= data % BLOCKSIZE;
+		  if (end % BLOCKSIZE)
+		    end += BLOCKSIZE - end % BLOCKSIZE;
+		  if (data > offset)
+		    {
+		      if (sp.numbytes)
+			{
+			  sparse_add_map (st, &sp);
+			  sp.numbytes = 0;
+			  if (!tar_sparse_scan (file, scan_block, NULL))
+			    return false;
+			}
+		      offset = data;
+		    }
+		  if (offset >= st->stat.st_size)
+		    break;
+		}
+	      if (!lseek_or_error (file, offset))
 		return false;
 	    }
+#endif
 
-	  offset += count;
+	  if (!sparse_scan_blocks (file, &sp, &offset, end, &count))
+	    return false;
+	  if (offset < end)
+	    break;
 	}
     }
 
@@ -54,6 +54,9 @@ as that of the covered work.  */
 #include <errno.h>
 #include <string.h>
 #include <sys/time.h>
+#ifdef HAVE_SPLICE
+# include <fcntl.h>
+#endif
 
 #ifdef ENABLE_IRI
 #include <idn-free.h>
@@ -63,6 +66,7 @@ as that of the covered work.  */
 #include "host.h"
 #include "connect.h"
 #include "hash.h"
+#include "timing.h"
 
 #include <stdint.h>
 
@@ -267,6 +271,7 @@ connect_to_ip (const ip_address *ip, int port, const char *print)
   struct sockaddr_storage ss;
   struct sockaddr *sa = (struct sockaddr *)&ss;
   int sock;
+  bool connected;
 
   /* If PRINT is non-NULL, print the "Connecting to..." line, with
      PRINT being the host name we're connecting to.  */
@@ -352,8 +357,11 @@ connect_to_ip (const ip_address *ip, int port, const char *print)
     }
 
   /* Connect the socket to the remote endpoint.  */
-  if (connect_with_timeout (sock, sa, sockaddr_size (sa),
-                            opt.connect_timeout) < 0)
+  timing_phase_begin (TIMING_CONNECT);
+  connected = connect_with_timeout (sock, sa, sockaddr_size (sa),
+                                    opt.connect_timeout) == 0;
+  timing_phase_end (TIMING_CONNECT);
+  if (!connected)
     goto err;
 
   /* Success. */
@@ -388,8 +396,11 @@ connect_to_host (const char *host, int port)
 {
   int i, start, end;
   int sock;
+  struct address_list *al;
 
-  struct address_list *al = lookup_host (host, 0);
+  timing_phase_begin (TIMING_DNS);
+  al = lookup_host (host, 0);
+  timing_phase_end (TIMING_DNS);
 
  retry:
   if (!al)
@@ -426,7 +437,9 @@ connect_to_host (const char *host, int port)
       /* We connected to AL before, but cannot do so now.  That might
          indicate that our DNS cache entry for HOST has expired.  */
       address_list_release (al);
+      timing_phase_begin (TIMING_DNS);
       al = lookup_host (host, LH_REFRESH);
+      timing_phase_end (TIMING_DNS);
       goto retry;
     }
   address_list_release (al);
@@ -941,6 +954,33 @@ fd_peek (int fd, char *buf, int bufsize, double timeout)
     return sock_peek (fd, buf, bufsize);
 }
 
+#ifdef HAVE_SPLICE
+/* Like fd_read, except that the data is moved to the pipe PIPE_FD
+   without being copied to user space.  Return values and timeout
+   semantics are the same as those of fd_read.  This only works on
+   plain sockets: if FD has a transport of its own, such as SSL, -1 is
+   returned with errno set to EINVAL.  */
+
+int
+fd_splice (int fd, int pipe_fd, int bufsize, double timeout)
+{
+  struct transport_info *info;
+  int res;
+  LAZY_RETRIEVE_INFO (info);
+  if (info && info->imp->reader)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (!poll_internal (fd, info, WAIT_FOR_READ, timeout))
+    return -1;
+  do
+    res = splice (fd, NULL, pipe_fd, NULL, bufsize, SPLICE_F_MOVE);
+  while (res == -1 && errno == EINTR);
+  return res;
+}
+#endif /* HAVE_SPLICE */
+
 /* Write the entire contents of BUF to FD.  If TIMEOUT is non-zero,
    the operation aborts if no data is received after that many
    seconds.  If TIMEOUT is -1, the value of opt.timeout is used for
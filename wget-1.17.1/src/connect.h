@@ -77,6 +77,9 @@ void *fd_transport_context (int);
 int fd_read (int, char *, int, double);
 int fd_write (int, char *, int, double);
 int fd_peek (int, char *, int, double);
+#ifdef HAVE_SPLICE
+int fd_splice (int, int, int, double);
+#endif
 const char *fd_errstr (int);
 void fd_close (int);
 
@@ -36,6 +36,10 @@ as that of the covered work.  */
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#if !defined(WINDOWS) && !defined(MSDOS)
+# define PARALLEL_CONVERSION
+# include <sys/wait.h>
+#endif
 #include "convert.h"
 #include "url.h"
 #include "recur.h"
@@ -47,6 +51,7 @@ as that of the covered work.  */
 #include "css-url.h"
 #include "iri.h"
 #include "xstrndup.h"
+#include "exits.h"
 
 static struct hash_table *dl_file_url_map;
 struct hash_table *dl_url_file_map;
@@ -58,11 +63,295 @@ struct hash_table *downloaded_css_set;
 
 static void convert_links (const char *, struct urlpos *);
 
+/* Decide how each of LINKS is to be converted, according to whether
+   the URL it points to has been downloaded.  */
+
+static void
+decide_conversions (struct urlpos *links)
+{
+  struct urlpos *cur_url;
+
+  for (cur_url = links; cur_url; cur_url = cur_url->next)
+    {
+      char *local_name;
+      struct url *u;
+      struct iri *pi;
+
+      if (cur_url->link_base_p)
+        {
+          /* Base references have been resolved by our parser, so
+             we turn the base URL into an empty string.  (Perhaps
+             we should remove the tag entirely?)  */
+          cur_url->convert = CO_NULLIFY_BASE;
+          continue;
+        }
+
+      /* We decide the direction of conversion according to whether
+         a URL was downloaded.  Downloaded URLs will be converted
+         ABS2REL, whereas non-downloaded will be converted REL2ABS.  */
+
+      pi = iri_new ();
+      set_uri_encoding (pi, opt.locale, true);
+
+      u = url_parse (cur_url->url->url, NULL, pi, true);
+      if (!u)
+          continue;
+
+      local_name = hash_table_get (dl_url_file_map, u->url);
+
+      /* Decide on the conversion type.  */
+      xfree (cur_url->local_name);
+      if (local_name)
+        {
+          /* We've downloaded this URL.  Convert it to relative
+             form.  We do this even if the URL already is in
+             relative form, because our directory structure may
+             not be identical to that on the server (think `-nd',
+             `--cut-dirs', etc.). If --convert-file-only was passed,
+             we only convert the basename portion of the URL.  */
+          cur_url->convert = (opt.convert_file_only ? CO_CONVERT_BASENAME_ONLY : CO_CONVERT_TO_RELATIVE);
+          cur_url->local_name = xstrdup (local_name);
+          DEBUGP (("will convert url %s to local %s\n", u->url, local_name));
+        }
+      else
+        {
+          /* We haven't downloaded this URL.  If it's not already
+             complete (including a full host name), convert it to
+             that form, so it can be reached while browsing this
+             HTML locally.  */
+          if (!cur_url->link_complete_p)
+            cur_url->convert = CO_CONVERT_TO_COMPLETE;
+          DEBUGP (("will convert url %s to complete\n", u->url));
+        }
+
+      url_free (u);
+      iri_free (pi);
+    }
+}
+
+/* Incremental conversion.
+
+   Converting the links of every file at the end of the retrieval
+   means reading and parsing every file once more, which takes as long
+   as the retrieval on a large mirror.  When a recursive retrieval is
+   all that Wget does (see convert_incremental), the links of a file
+   can rather be converted as soon as the fate of the URLs they point
+   to is known, using the positions of the links found when the file
+   was parsed for recursion.  retrieve_tree tells, for each file it
+   parses, the URLs that are yet to be processed, see convert_hold,
+   and the processing of each URL, see convert_url_done.  Files that
+   are still waiting at the end are converted with the others.  */
+
+bool convert_incremental;
+
+/* A file whose links are kept for conversion.  */
+struct held_file {
+  char *file;
+  bool is_css;
+  struct urlpos *links;
+  int waiting;                  /* number of URLs not processed yet */
+  wgint size;                   /* memory taken by LINKS */
+};
+
+/* The files waiting for a URL.  */
+struct held_list {
+  struct held_file *held;
+  struct held_list *next;
+};
+
+static struct hash_table *held_files;     /* file name -> held_file */
+static struct hash_table *held_targets;   /* URL -> held_list */
+static wgint held_memory;
+
+/* Files that no longer wait, to be converted by convert_url_done.  */
+static struct held_file **ready;
+static int ready_count, ready_alloc;
+
+/* Files whose links have been converted incrementally.  */
+static struct hash_table *converted_early;
+
+static void
+held_file_free (struct held_file *held)
+{
+  held_memory -= held->size;
+  free_urlpos (held->links);
+  xfree (held->file);
+  xfree (held);
+}
+
+/* Keep LINKS, the links of FILE, and convert them once the URLs in the
+   string set WAITS have been processed.  This takes over LINKS.  */
+
+void
+convert_hold (const char *file, bool is_css, struct urlpos *links,
+              struct hash_table *waits)
+{
+  struct held_file *held;
+  struct urlpos *link;
+  hash_table_iterator iter;
+  wgint size = 0;
+  struct hash_table *set = is_css ? downloaded_css_set : downloaded_html_set;
+  struct hash_table *other = is_css ? downloaded_html_set : downloaded_css_set;
+
+  for (link = links; link; link = link->next)
+    size += (sizeof *link + sizeof (struct url)
+             + 3 * strlen (link->url->url));
+
+  /* Only convert here the files that convert_all_links would convert
+     once, and no more of them than --frontier-memory allows to
+     wait.  */
+  if (!set || !string_set_contains (set, file)
+      || (other && string_set_contains (other, file))
+      || (held_files && hash_table_contains (held_files, file))
+      || (converted_early && string_set_contains (converted_early, file))
+      || (opt.frontier_memory && held_memory + size > opt.frontier_memory))
+    {
+      free_urlpos (links);
+      return;
+    }
+
+  if (!held_files)
+    {
+      held_files = make_string_hash_table (0);
+      held_targets = make_string_hash_table (0);
+    }
+
+  held = xnew0 (struct held_file);
+  held->file = xstrdup (file);
+  held->is_css = is_css;
+  held->links = links;
+  held->size = size;
+  held_memory += size;
+  hash_table_put (held_files, held->file, held);
+
+  for (hash_table_iterate (waits, &iter); hash_table_iter_next (&iter); )
+    {
+      struct held_list *node = xnew (struct held_list);
+      char *key;
+
+      node->held = held;
+      if (hash_table_get_pair (held_targets, iter.key, &key, &node->next))
+        hash_table_put (held_targets, key, node);
+      else
+        {
+          node->next = NULL;
+          hash_table_put (held_targets, xstrdup (iter.key), node);
+        }
+      ++held->waiting;
+    }
+
+  if (!held->waiting)
+    {
+      DO_REALLOC (ready, ready_alloc, ready_count + 1, struct held_file *);
+      ready[ready_count++] = held;
+    }
+}
+
+/* Note that URL has been processed by retrieve_tree, and convert the
+   links of the files that no longer wait for anything.  */
+
+void
+convert_url_done (const char *url)
+{
+  struct held_list *node, *next;
+  char *key;
+  int i;
+
+  if (!held_files)
+    return;
+
+  if (hash_table_get_pair (held_targets, url, &key, &node))
+    {
+      hash_table_remove (held_targets, key);
+      xfree (key);
+      for (; node; node = next)
+        {
+          next = node->next;
+          if (--node->held->waiting == 0)
+            {
+              DO_REALLOC (ready, ready_alloc, ready_count + 1,
+                          struct held_file *);
+              ready[ready_count++] = node->held;
+            }
+          xfree (node);
+        }
+    }
+
+  for (i = 0; i < ready_count; i++)
+    {
+      struct held_file *held = ready[i];
+
+      hash_table_remove (held_files, held->file);
+      /* The file may have been deleted since it was held.  */
+      if (hash_table_contains (dl_file_url_map, held->file))
+        {
+          decide_conversions (held->links);
+          convert_links (held->file, held->links);
+          if (!converted_early)
+            converted_early = make_string_hash_table (0);
+          string_set_add (converted_early, held->file);
+        }
+      held_file_free (held);
+    }
+  ready_count = 0;
+}
+
+/* Return true if the links of FILE have been converted already, so
+   that it can no longer be parsed for the links it had.  */
+
+bool
+convert_done_p (const char *file)
+{
+  return converted_early && string_set_contains (converted_early, file);
+}
+
+/* Free what is held for incremental conversion.  */
+
+static void
+convert_held_free (void)
+{
+  hash_table_iterator iter;
+
+  if (!held_files)
+    return;
+  for (hash_table_iterate (held_targets, &iter);
+       hash_table_iter_next (&iter); )
+    {
+      struct held_list *node, *next;
+
+      for (node = iter.value; node; node = next)
+        {
+          next = node->next;
+          xfree (node);
+        }
+      xfree (iter.key);
+    }
+  hash_table_destroy (held_targets);
+  held_targets = NULL;
+  for (hash_table_iterate (held_files, &iter); hash_table_iter_next (&iter); )
+    held_file_free (iter.value);
+  hash_table_destroy (held_files);
+  held_files = NULL;
+  xfree (ready);
+  ready_count = ready_alloc = 0;
+}
+
+/* A file whose links convert_all_links converts.  */
+struct conversion {
+  char *file;
+  char *url;
+  bool is_css;
+  struct urlpos *links;         /* the links, if they have been held */
+};
+
+/* Add the files of DOWNLOADED_SET whose links are still to be
+   converted to CONVERSIONS.  */
 
 static void
 convert_links_in_hashtable (struct hash_table *downloaded_set,
                             int is_css,
-                            int *file_count)
+                            struct conversion **conversions,
+                            int *count, int *alloc)
 {
   int i;
 
@@ -79,10 +368,14 @@ convert_links_in_hashtable (struct hash_table *downloaded_set,
 
   for (i = 0; i < cnt; i++)
     {
-      struct urlpos *urls, *cur_url;
+      struct conversion *c;
+      struct held_file *held;
       char *url;
       char *file = file_array[i];
 
+      if (converted_early && string_set_contains (converted_early, file))
+        continue;
+
       /* Determine the URL of the file.  get_urls_{html,css} will need
          it.  */
       url = hash_table_get (dl_file_url_map, file);
@@ -92,80 +385,121 @@ convert_links_in_hashtable (struct hash_table *downloaded_set,
           continue;
         }
 
-      DEBUGP (("Scanning %s (from %s)\n", file, url));
+      DO_REALLOC (*conversions, *alloc, *count + 1, struct conversion);
+      c = *conversions + (*count)++;
+      c->file = file;
+      c->url = url;
+      c->is_css = is_css;
+      c->links = NULL;
+
+      held = held_files ? hash_table_get (held_files, file) : NULL;
+      if (held && held->is_css == is_css)
+        {
+          c->links = held->links;
+          held->links = NULL;
+        }
+    }
+}
+
+/* Convert the links of the file of C.  */
+
+static void
+convert_one (struct conversion *c)
+{
+  if (!c->links)
+    {
+      DEBUGP (("Scanning %s (from %s)\n", c->file, c->url));
 
       /* Parse the file...  */
-      urls = is_css ? get_urls_css_file (file, url) :
-                      get_urls_html (file, url, NULL, NULL);
+      c->links = c->is_css ? get_urls_css_file (c->file, c->url) :
+                             get_urls_html (c->file, c->url, NULL, NULL);
 
       /* We don't respect meta_disallow_follow here because, even if
          the file is not followed, we might still want to convert the
          links that have been followed from other files.  */
+    }
 
-      for (cur_url = urls; cur_url; cur_url = cur_url->next)
-        {
-          char *local_name;
-          struct url *u;
-          struct iri *pi;
+  decide_conversions (c->links);
 
-          if (cur_url->link_base_p)
-            {
-              /* Base references have been resolved by our parser, so
-                 we turn the base URL into an empty string.  (Perhaps
-                 we should remove the tag entirely?)  */
-              cur_url->convert = CO_NULLIFY_BASE;
-              continue;
-            }
+  /* Convert the links in the file.  */
+  convert_links (c->file, c->links);
+}
 
-          /* We decide the direction of conversion according to whether
-             a URL was downloaded.  Downloaded URLs will be converted
-             ABS2REL, whereas non-downloaded will be converted REL2ABS.  */
+/* Convert the links of the COUNT files of CONVERSIONS.  With
+   --parallel, the files are shared among that many child processes,
+   whose log messages are copied to the log in order when they are
+   done.  */
 
-          pi = iri_new ();
-          set_uri_encoding (pi, opt.locale, true);
+static void
+convert_conversions (struct conversion *conversions, int count)
+{
+  int i;
+#ifdef PARALLEL_CONVERSION
+  int procs = MIN (opt.parallel, count), k;
+  pid_t *pids;
+  FILE **logs;
 
-          u = url_parse (cur_url->url->url, NULL, pi, true);
-          if (!u)
-              continue;
+  if (procs > 1)
+    {
+      pids = xnew_array (pid_t, procs);
+      logs = xnew_array (FILE *, procs);
+      logflush ();
+      for (k = 0; k < procs; k++)
+        {
+          pids[k] = -1;
+          logs[k] = tmpfile ();
+          if (logs[k])
+            pids[k] = fork ();
+          if (pids[k] == 0)
+            {
+              log_set_fp (logs[k]);
+              for (i = k; i < count; i += procs)
+                convert_one (conversions + i);
+              fflush (logs[k]);
+              _exit (WGET_EXIT_SUCCESS);
+            }
+          if (pids[k] > 0)
+            DEBUGP (("Started process %ld to convert links.\n",
+                     (long) pids[k]));
+        }
 
-          local_name = hash_table_get (dl_url_file_map, u->url);
+      for (k = 0; k < procs; k++)
+        {
+          char buf[4096];
+          size_t n;
+          int status;
 
-          /* Decide on the conversion type.  */
-          if (local_name)
+          if (pids[k] < 0)
             {
-              /* We've downloaded this URL.  Convert it to relative
-                 form.  We do this even if the URL already is in
-                 relative form, because our directory structure may
-                 not be identical to that on the server (think `-nd',
-                 `--cut-dirs', etc.). If --convert-file-only was passed,
-                 we only convert the basename portion of the URL.  */
-              cur_url->convert = (opt.convert_file_only ? CO_CONVERT_BASENAME_ONLY : CO_CONVERT_TO_RELATIVE);
-              cur_url->local_name = xstrdup (local_name);
-              DEBUGP (("will convert url %s to local %s\n", u->url, local_name));
+              /* Out of processes or files; do it ourselves.  */
+              for (i = k; i < count; i += procs)
+                convert_one (conversions + i);
+              if (logs[k])
+                fclose (logs[k]);
+              continue;
             }
-          else
+          while (waitpid (pids[k], &status, 0) < 0 && errno == EINTR)
+            ;
+          rewind (logs[k]);
+          while ((n = fread (buf, 1, sizeof buf - 1, logs[k])) > 0)
             {
-              /* We haven't downloaded this URL.  If it's not already
-                 complete (including a full host name), convert it to
-                 that form, so it can be reached while browsing this
-                 HTML locally.  */
-              if (!cur_url->link_complete_p)
-                cur_url->convert = CO_CONVERT_TO_COMPLETE;
-              cur_url->local_name = NULL;
-              DEBUGP (("will convert url %s to complete\n", u->url));
+              buf[n] = '\0';
+              logputs (LOG_ALWAYS, buf);
             }
-
-          url_free (u);
-          iri_free (pi);
+          fclose (logs[k]);
+          if (!WIFEXITED (status) || WEXITSTATUS (status) != WGET_EXIT_SUCCESS)
+            logprintf (LOG_NOTQUIET,
+                       _("Process %ld converting links failed.\n"),
+                       (long) pids[k]);
         }
-
-      /* Convert the links in the file.  */
-      convert_links (file, urls);
-      ++*file_count;
-
-      /* Free the data.  */
-      free_urlpos (urls);
+      xfree (pids);
+      xfree (logs);
+      return;
     }
+#endif /* PARALLEL_CONVERSION */
+
+  for (i = 0; i < count; i++)
+    convert_one (conversions + i);
 }
 
 /* This function is called when the retrieval is done to convert the
@@ -181,22 +515,40 @@ convert_links_in_hashtable (struct hash_table *downloaded_set,
 
    All the downloaded HTMLs are kept in downloaded_html_files, and
    downloaded URLs in urls_downloaded.  All the information is
-   extracted from these two lists.  */
+   extracted from these two lists.  Files whose links have been
+   converted incrementally are left alone.  */
 
 void
 convert_all_links (void)
 {
   double secs;
   int file_count = 0;
+  struct conversion *conversions = NULL;
+  int count = 0, alloc = 0, i;
 
   struct ptimer *timer = ptimer_new ();
 
-  convert_links_in_hashtable (downloaded_html_set, 0, &file_count);
-  convert_links_in_hashtable (downloaded_css_set, 1, &file_count);
+  convert_links_in_hashtable (downloaded_html_set, 0,
+                              &conversions, &count, &alloc);
+  convert_links_in_hashtable (downloaded_css_set, 1,
+                              &conversions, &count, &alloc);
+  convert_held_free ();
+
+  convert_conversions (conversions, count);
+  for (i = 0; i < count; i++)
+    free_urlpos (conversions[i].links);
+  xfree (conversions);
+  file_count = count;
 
   secs = ptimer_measure (timer);
-  logprintf (LOG_VERBOSE, _("Converted links in %d files in %s seconds.\n"),
-             file_count, print_decimal (secs));
+  if (converted_early)
+    logprintf (LOG_VERBOSE, _("Converted links in %d files in %s seconds, \
+and in %d files during the retrieval.\n"),
+               file_count, print_decimal (secs),
+               hash_table_count (converted_early));
+  else
+    logprintf (LOG_VERBOSE, _("Converted links in %d files in %s seconds.\n"),
+               file_count, print_decimal (secs));
 
   ptimer_destroy (timer);
 }
@@ -867,6 +1219,7 @@ register_download (const char *url, const char *file)
 {
   char *old_file, *old_url;
 
+  parallel_record ('d', url, file, NULL);
   ENSURE_TABLES_EXIST;
 
   /* With some forms of retrieval, it is possible, although not likely
@@ -947,6 +1300,7 @@ register_redirection (const char *from, const char *to)
 {
   char *file;
 
+  parallel_record ('r', from, to, NULL);
   ENSURE_TABLES_EXIST;
 
   file = hash_table_get (dl_url_file_map, to);
@@ -978,6 +1332,7 @@ register_delete_file (const char *file)
 void
 register_html (const char *file)
 {
+  parallel_record ('h', file, NULL);
   if (!downloaded_html_set)
     downloaded_html_set = make_string_hash_table (0);
   string_set_add (downloaded_html_set, file);
@@ -988,6 +1343,7 @@ register_html (const char *file)
 void
 register_css (const char *file)
 {
+  parallel_record ('c', file, NULL);
   if (!downloaded_css_set)
     downloaded_css_set = make_string_hash_table (0);
   string_set_add (downloaded_css_set, file);
@@ -1017,6 +1373,9 @@ convert_cleanup (void)
   downloaded_files_free ();
   if (converted_files)
     string_set_free (converted_files);
+  convert_held_free ();
+  if (converted_early)
+    string_set_free (converted_early);
 }
 
 /* Book-keeping code for downloaded files that enables extension
@@ -1087,6 +1446,7 @@ downloaded_file (downloaded_file_t mode, const char *file)
       return *ptr;
     }
 
+  parallel_record ('f', number_to_static_string (mode), file, NULL);
   if (!downloaded_files_hash)
     downloaded_files_hash = make_string_hash_table (0);
 
@@ -109,6 +109,11 @@ void register_delete_file (const char *);
 void convert_all_links (void);
 void convert_cleanup (void);
 
+extern bool convert_incremental;
+void convert_hold (const char *, bool, struct urlpos *, struct hash_table *);
+void convert_url_done (const char *);
+bool convert_done_p (const char *);
+
 char *html_quote_string (const char *);
 
 #endif /* CONVERT_H */
@@ -742,6 +742,129 @@ cmp_pointer (const void *ptr1, const void *ptr2)
   return ptr1 == ptr2;
 }
 
+/*
+ * Sets of string fingerprints.
+ *
+ */
+
+/* A fingerprint set remembers whether a string has been added to it,
+   without keeping the string.  Only a 64-bit hash ("fingerprint") of
+   each string is stored, in a flat open-addressing table, so a set of
+   millions of URLs costs a few dozen megabytes instead of the
+   gigabytes the URLs themselves would take, and a lookup touches a
+   single cache line in most cases.
+
+   The price is that two different strings with the same fingerprint
+   are taken for the same string.  With 64 bits, the chance of that
+   happening at all in a set of ten million strings is around one in
+   a hundred thousand.  */
+
+struct fingerprint_set {
+  uint64_t *slots;              /* the table; 0 marks an empty slot */
+  int size;                     /* number of slots, a power of two */
+  int count;                    /* number of fingerprints stored */
+};
+
+/* The 64-bit FNV-1a hash of S, followed by the finalizer of
+   MurmurHash3 so that the low bits, which select the slot, depend on
+   all the characters.  */
+
+static uint64_t
+fingerprint (const char *s)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  for (; *s; s++)
+    {
+      h ^= (unsigned char) *s;
+      h *= 1099511628211ULL;
+    }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h ? h : 1;
+}
+
+/* Return the slot of SET where FP is stored, or the empty slot where
+   it would be stored.  */
+
+static uint64_t *
+fingerprint_slot (const struct fingerprint_set *set, uint64_t fp)
+{
+  int mask = set->size - 1;
+  int i = fp & mask;
+
+  while (set->slots[i] && set->slots[i] != fp)
+    i = (i + 1) & mask;
+  return set->slots + i;
+}
+
+/* Create an empty fingerprint set.  */
+
+struct fingerprint_set *
+fingerprint_set_new (void)
+{
+  struct fingerprint_set *set = xnew0 (struct fingerprint_set);
+  set->size = 256;
+  set->slots = xcalloc (set->size, sizeof (uint64_t));
+  return set;
+}
+
+/* Add S to SET.  */
+
+void
+fingerprint_set_add (struct fingerprint_set *set, const char *s)
+{
+  uint64_t fp = fingerprint (s);
+  uint64_t *slot = fingerprint_slot (set, fp);
+
+  if (*slot)
+    return;
+  *slot = fp;
+
+  /* Keep the table at most three quarters full, so that probe
+     sequences stay short.  */
+  if (++set->count > set->size / 4 * 3)
+    {
+      uint64_t *old = set->slots;
+      int i, old_size = set->size;
+
+      set->size *= 2;
+      set->slots = xcalloc (set->size, sizeof (uint64_t));
+      for (i = 0; i < old_size; i++)
+        if (old[i])
+          *fingerprint_slot (set, old[i]) = old[i];
+      xfree (old);
+    }
+}
+
+/* Return 1 if S has been added to SET, 0 otherwise.  */
+
+int
+fingerprint_set_contains (const struct fingerprint_set *set, const char *s)
+{
+  return *fingerprint_slot (set, fingerprint (s)) != 0;
+}
+
+/* Return the number of strings in SET.  */
+
+int
+fingerprint_set_count (const struct fingerprint_set *set)
+{
+  return set->count;
+}
+
+/* Free SET.  */
+
+void
+fingerprint_set_free (struct fingerprint_set *set)
+{
+  xfree (set->slots);
+  xfree (set);
+}
+
 #ifdef TEST
 
 #include <stdio.h>
@@ -63,4 +63,12 @@ struct hash_table *make_nocase_string_hash_table (int);
 
 unsigned long hash_pointer (const void *);
 
+struct fingerprint_set;
+
+struct fingerprint_set *fingerprint_set_new (void);
+void fingerprint_set_add (struct fingerprint_set *, const char *);
+int fingerprint_set_contains (const struct fingerprint_set *, const char *);
+int fingerprint_set_count (const struct fingerprint_set *);
+void fingerprint_set_free (struct fingerprint_set *);
+
 #endif /* HASH_H */
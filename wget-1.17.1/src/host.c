@@ -56,6 +56,15 @@ as that of the covered work.  */
 #endif /* WINDOWS */
 
 #include <errno.h>
+#include <time.h>
+
+#if !defined(WINDOWS) && !defined(MSDOS)
+# define DNS_PREFETCH
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/file.h>
+# include <sys/select.h>
+#endif
 
 #ifdef ENABLE_IRI
 #include <idn-free.h>
@@ -89,6 +98,9 @@ struct address_list {
 
   int refcount;                 /* reference count; when it drops to
                                    0, the entry is freed. */
+
+  time_t expires;               /* when the cached entry goes stale, or 0
+                                   if it doesn't. */
 };
 
 /* Get the bounds of the address list.  */
@@ -297,6 +309,18 @@ address_list_from_ipv4_addresses (char **vec)
 
 #endif /* not ENABLE_IPV6 */
 
+/* Create an address_list from COUNT addresses, for the cache.  */
+
+static struct address_list *
+address_list_from_addresses (const ip_address *addresses, int count)
+{
+  struct address_list *al = xnew0 (struct address_list);
+  al->addresses = xnew_array (ip_address, count);
+  memcpy (al->addresses, addresses, count * sizeof (ip_address));
+  al->count = count;
+  return al;
+}
+
 static void
 address_list_delete (struct address_list *al)
 {
@@ -584,8 +608,9 @@ is_valid_ipv6_address (const char *str, const char *end)
 
 /* Simple host cache, used by lookup_host to speed up resolving.  The
    cache doesn't handle TTL because Wget is a fairly short-lived
-   application.  Refreshing is attempted when connect fails, though --
-   see connect_to_host.  */
+   application, except for the entries kept in the --dns-cache-file
+   between runs.  Refreshing is attempted when connect fails, though
+   -- see connect_to_host.  */
 
 /* Mapping between known hosts and to lists of their addresses. */
 static struct hash_table *host_name_addresses_map;
@@ -594,13 +619,23 @@ static struct hash_table *host_name_addresses_map;
 /* Return the host's resolved addresses from the cache, if
    available.  */
 
+static void cache_remove (const char *);
+static void cache_load (void);
+
 static struct address_list *
 cache_query (const char *host)
 {
   struct address_list *al;
+  cache_load ();
   if (!host_name_addresses_map)
     return NULL;
   al = hash_table_get (host_name_addresses_map, host);
+  if (al && al->expires && al->expires <= time (NULL))
+    {
+      DEBUGP (("Cached addresses of %s have expired.\n", host));
+      cache_remove (host);
+      return NULL;
+    }
   if (al)
     {
       DEBUGP (("Found %s in host_name_addresses_map (%p)\n", host, (void *) al));
@@ -619,6 +654,8 @@ cache_store (const char *host, struct address_list *al)
   if (!host_name_addresses_map)
     host_name_addresses_map = make_nocase_string_hash_table (0);
 
+  if (opt.dns_cache_file && !al->expires)
+    al->expires = time (NULL) + opt.dns_cache_ttl;
   ++al->refcount;
   hash_table_put (host_name_addresses_map, xstrdup_lower (host), al);
 
@@ -639,14 +676,385 @@ static void
 cache_remove (const char *host)
 {
   struct address_list *al;
+  char *key;
   if (!host_name_addresses_map)
     return;
-  al = hash_table_get (host_name_addresses_map, host);
-  if (al)
+  if (hash_table_get_pair (host_name_addresses_map, host, &key, &al))
     {
-      address_list_release (al);
       hash_table_remove (host_name_addresses_map, host);
+      xfree (key);
+      address_list_release (al);
+    }
+}
+
+/* --dns-cache-file support.  The cache entries are kept in a text file
+   between runs, one host per line, with the time the entry expires
+   and its addresses.  getaddrinfo doesn't tell how long the DNS
+   records may be kept, so each entry expires --dns-cache-ttl seconds
+   after it was looked up.  */
+
+/* Whether the cache file has been read.  */
+static bool cache_loaded;
+
+/* Store to ADDR the address written as STR.  */
+
+static bool
+parse_address (const char *str, ip_address *addr)
+{
+  xzero (*addr);
+#ifdef ENABLE_IPV6
+  if (inet_pton (AF_INET, str, &addr->data.d4) == 1)
+    addr->family = AF_INET;
+  else if (inet_pton (AF_INET6, str, &addr->data.d6) == 1)
+    addr->family = AF_INET6;
+  else
+    return false;
+#else
+  addr->data.d4.s_addr = inet_addr (str);
+  if (addr->data.d4.s_addr == (in_addr_t) -1)
+    return false;
+  addr->family = AF_INET;
+#endif
+  return true;
+}
+
+/* Add to the cache the entries of the cache file FP that have not
+   expired, unless the cache already has the host.  */
+
+static void
+cache_read_file (FILE *fp)
+{
+  char *line = NULL;
+  size_t len = 0;
+  time_t now = time (NULL);
+  ip_address *addresses = NULL;
+  int size = 0;
+
+  while (getline (&line, &len, fp) > 0)
+    {
+      char host[256], *p, *addr;
+      unsigned long expires;
+      int count = 0, n;
+
+      if (line[0] == '#'
+          || sscanf (line, "%255s %lu %n", host, &expires, &n) != 2
+          || (time_t) expires <= now
+          || (host_name_addresses_map
+              && hash_table_contains (host_name_addresses_map, host)))
+        continue;
+
+      for (addr = strtok_r (line + n, ", \t\r\n", &p); addr;
+           addr = strtok_r (NULL, ", \t\r\n", &p))
+        {
+          if (count == size)
+            {
+              size = size ? 2 * size : 8;
+              addresses = xrealloc (addresses, size * sizeof (ip_address));
+            }
+          if (parse_address (addr, &addresses[count]))
+            ++count;
+        }
+      if (count)
+        {
+          struct address_list *al = address_list_from_addresses (addresses,
+                                                                 count);
+          al->expires = expires;
+          cache_store (host, al);
+        }
+    }
+  xfree (line);
+  xfree (addresses);
+}
+
+/* Read the cache file the first time the cache is used.  */
+
+static void
+cache_load (void)
+{
+  FILE *fp;
+
+  if (cache_loaded || !opt.dns_cache_file)
+    return;
+  cache_loaded = true;
+  fp = fopen (opt.dns_cache_file, "r");
+  if (!fp)
+    return;
+  DEBUGP (("Reading DNS cache from %s\n", opt.dns_cache_file));
+  cache_read_file (fp);
+  fclose (fp);
+}
+
+/* Write the entries of the cache that have not expired to the cache
+   file, along with those other Wget processes wrote there since.  */
+
+void
+host_save_cache (void)
+{
+  hash_table_iterator iter;
+  time_t now = time (NULL);
+  FILE *fp;
+
+  if (!opt.dns_cache_file || !host_name_addresses_map)
+    return;
+  fp = fopen (opt.dns_cache_file, "a+");
+  if (!fp)
+    {
+      logprintf (LOG_NOTQUIET, "%s: %s\n", opt.dns_cache_file,
+                 strerror (errno));
+      return;
+    }
+  DEBUGP (("Saving DNS cache to %s\n", opt.dns_cache_file));
+#ifdef DNS_PREFETCH
+  /* Lock the file so that runs finishing at the same time don't lose
+     each other's entries.  */
+  flock (fileno (fp), LOCK_EX);
+#endif
+  fseeko (fp, 0, SEEK_SET);
+  cache_read_file (fp);
+  fseeko (fp, 0, SEEK_SET);
+  if (ftruncate (fileno (fp), 0) < 0)
+    {
+      fclose (fp);
+      return;
+    }
+
+  fputs ("# DNS cache for GNU Wget.\n", fp);
+  fputs ("# <hostname>\t<expires>\t<address>[,<address>...]\n", fp);
+  for (hash_table_iterate (host_name_addresses_map, &iter);
+       hash_table_iter_next (&iter);)
+    {
+      const char *host = iter.key;
+      struct address_list *al = iter.value;
+      int i;
+
+      if (!al->expires || al->expires <= now)
+        continue;
+      fprintf (fp, "%s\t%lu\t", host, (unsigned long) al->expires);
+      for (i = 0; i < al->count; i++)
+        fprintf (fp, "%s%s", i ? "," : "", print_address (al->addresses + i));
+      fputc ('\n', fp);
+    }
+  /* fclose unlocks the file.  */
+  if (fclose (fp) == EOF)
+    logprintf (LOG_NOTQUIET, _("Could not write the DNS cache to %s.\n"),
+               quote (opt.dns_cache_file));
+}
+
+#ifdef DNS_PREFETCH
+/* --dns-prefetch support.  The hosts of the URLs queued for retrieval
+   are looked up ahead of time by a pool of resolver processes, so that
+   spanning hosts doesn't stall on every new host name.  The parent
+   writes host names to the resolvers' request pipe, and they write
+   the addresses to the answer pipe, both in records small enough to
+   be written atomically.  The answers go to the cache, from which
+   lookup_host returns them.  */
+
+/* No more addresses than this are passed back for a host.  */
+#define RESOLVER_MAX_ADDRESSES 16
+
+struct resolver_answer {
+  char host[256];
+  int count;                    /* 0 if HOST could not be resolved */
+  ip_address addresses[RESOLVER_MAX_ADDRESSES];
+};
+
+/* The process that started the resolvers, and the only one to talk to
+   them; processes forked by it later leave them alone.  */
+static pid_t resolver_owner;
+
+/* The write end of the request pipe and the read end of the answer
+   pipe, or -1.  */
+static int resolver_requests = -1;
+static int resolver_answers = -1;
+
+/* The host names asked for and not answered yet.  */
+static struct hash_table *resolver_pending;
+
+/* Answer the requests read from REQUESTS until it is closed, writing
+   the answers to ANSWERS.  This runs in a resolver process, and does
+   not return.  */
+
+static void
+resolver_run (int requests, int answers)
+{
+  struct resolver_answer answer;
+
+  while (read (requests, answer.host, sizeof (answer.host))
+         == sizeof (answer.host))
+    {
+      struct address_list *al;
+
+      answer.host[sizeof (answer.host) - 1] = '\0';
+      al = lookup_host (answer.host, LH_SILENT);
+      answer.count = 0;
+      if (al)
+        {
+          answer.count = MIN (al->count, RESOLVER_MAX_ADDRESSES);
+          memcpy (answer.addresses, al->addresses,
+                  answer.count * sizeof (ip_address));
+          address_list_release (al);
+        }
+      if (write (answers, &answer, sizeof (answer)) != sizeof (answer))
+        break;
     }
+  _exit (0);
+}
+
+/* Start the resolver processes.  Return false if they can't be
+   started.  */
+
+static bool
+resolvers_start (void)
+{
+  int requests[2], answers[2], i;
+
+  if (pipe (requests) < 0)
+    return false;
+  if (pipe (answers) < 0)
+    {
+      close (requests[0]);
+      close (requests[1]);
+      return false;
+    }
+  logflush ();
+  for (i = 0; i < opt.dns_prefetch; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        {
+          close (requests[1]);
+          close (answers[0]);
+          resolver_run (requests[0], answers[1]);
+        }
+      if (pid < 0)
+        break;
+    }
+  close (requests[0]);
+  close (answers[1]);
+  if (i == 0)
+    {
+      close (requests[1]);
+      close (answers[0]);
+      return false;
+    }
+  DEBUGP (("Started %d resolver processes.\n", i));
+
+  /* Neither asking nor checking for answers should block.  */
+  fcntl (requests[1], F_SETFL, fcntl (requests[1], F_GETFL) | O_NONBLOCK);
+  fcntl (answers[0], F_SETFL, fcntl (answers[0], F_GETFL) | O_NONBLOCK);
+  resolver_requests = requests[1];
+  resolver_answers = answers[0];
+  resolver_owner = getpid ();
+  resolver_pending = make_nocase_string_hash_table (0);
+  return true;
+}
+
+/* Read the answers that have arrived, and cache them.  */
+
+static void
+resolvers_read_answers (void)
+{
+  struct resolver_answer answer;
+
+  while (read (resolver_answers, &answer, sizeof (answer))
+         == sizeof (answer))
+    {
+      char *key;
+
+      answer.host[sizeof (answer.host) - 1] = '\0';
+      if (!hash_table_get_pair (resolver_pending, answer.host, &key, NULL))
+        continue;
+      hash_table_remove (resolver_pending, answer.host);
+      xfree (key);
+      if (answer.count > 0 && answer.count <= RESOLVER_MAX_ADDRESSES
+          && !(host_name_addresses_map
+               && hash_table_contains (host_name_addresses_map,
+                                       answer.host)))
+        cache_store (answer.host,
+                     address_list_from_addresses (answer.addresses,
+                                                  answer.count));
+    }
+}
+
+/* Whether this process can use the resolvers.  */
+
+static bool
+resolvers_usable (void)
+{
+  return resolver_requests != -1 && resolver_owner == getpid ();
+}
+
+/* Wait for the answer for HOST, if it was asked for.  */
+
+static void
+resolvers_wait (const char *host)
+{
+  if (!resolvers_usable ())
+    return;
+  resolvers_read_answers ();
+  while (hash_table_contains (resolver_pending, host))
+    {
+      struct timeval tv, *tvp = NULL;
+      fd_set set;
+
+      FD_ZERO (&set);
+      FD_SET (resolver_answers, &set);
+      if (opt.dns_timeout)
+        {
+          tv.tv_sec = opt.dns_timeout;
+          tv.tv_usec = 1000000 * (opt.dns_timeout - tv.tv_sec);
+          tvp = &tv;
+        }
+      if (select (resolver_answers + 1, &set, NULL, NULL, tvp) <= 0)
+        break;
+      resolvers_read_answers ();
+    }
+}
+#endif /* DNS_PREFETCH */
+
+/* Have HOST looked up in the background, if --dns-prefetch is given,
+   so that lookup_host finds it in the cache when it is needed.  */
+
+void
+host_prefetch (const char *host)
+{
+#ifdef DNS_PREFETCH
+  const char *end = host + strlen (host);
+
+  if (!opt.dns_prefetch || !opt.dns_cache || end - host >= 256
+      || is_valid_ipv4_address (host, end)
+#ifdef ENABLE_IPV6
+      || is_valid_ipv6_address (host, end)
+#endif
+      )
+    return;
+  if (resolver_requests == -1 && !resolver_owner)
+    {
+      if (!resolvers_start ())
+        resolver_owner = -1;    /* don't try again */
+    }
+  if (!resolvers_usable ())
+    return;
+
+  resolvers_read_answers ();
+  if (!hash_table_contains (resolver_pending, host))
+    {
+      struct address_list *al = cache_query (host);
+      char request[256];
+
+      if (al)
+        {
+          address_list_release (al);
+          return;
+        }
+      xzero (request);
+      strcpy (request, host);
+      /* If the pipe is full, the host will be looked up when needed.  */
+      if (write (resolver_requests, request, sizeof (request))
+          == sizeof (request))
+        hash_table_put (resolver_pending, xstrdup_lower (host), NULL);
+    }
+#endif /* DNS_PREFETCH */
 }
 
 /* Look up HOST in DNS and return a list of IP addresses.
@@ -725,6 +1133,9 @@ lookup_host (const char *host, int flags)
     {
       if (!(flags & LH_REFRESH))
         {
+#ifdef DNS_PREFETCH
+          resolvers_wait (host);
+#endif
           al = cache_query (host);
           if (al)
             return al;
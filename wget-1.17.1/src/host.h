@@ -103,6 +103,8 @@ bool is_valid_ip_address (const char *name);
 bool accept_domain (struct url *);
 bool sufmatch (const char **, const char *);
 
+void host_prefetch (const char *);
+void host_save_cache (void);
 void host_cleanup (void);
 
 #endif /* HOST_H */
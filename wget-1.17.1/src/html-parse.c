@@ -272,18 +272,29 @@ struct pool {
    to "<foo", but "&lt,foo" to "<,foo".  */
 #define SKIP_SEMI(p, inc) (p += inc, p < end && *p == ';' ? ++p : p)
 
+/* A tag on the tag stack.  As the stack can outlive the text the tags
+   were found in, see map_html_portion, the tag name is copied after
+   the item and the contents are located by their position in the
+   document.  */
+
 struct tagstack_item {
-  const char *tagname_begin;
-  const char *tagname_end;
-  const char *contents_begin;
+  const char *tagname;
+  int tagname_length;
+  int contents_begin;           /* -1 if not known */
   struct tagstack_item *prev;
   struct tagstack_item *next;
 };
 
 static struct tagstack_item *
-tagstack_push (struct tagstack_item **head, struct tagstack_item **tail)
+tagstack_push (struct tagstack_item **head, struct tagstack_item **tail,
+               const char *tagname_begin, const char *tagname_end)
 {
-  struct tagstack_item *ts = xmalloc(sizeof(struct tagstack_item));
+  int len = tagname_end - tagname_begin;
+  struct tagstack_item *ts = xmalloc(sizeof(struct tagstack_item) + len);
+  memcpy (ts + 1, tagname_begin, len);
+  ts->tagname = (const char *) (ts + 1);
+  ts->tagname_length = len;
+  ts->contents_begin = -1;
   if (*head == NULL)
     {
       *head = *tail = ts;
@@ -350,9 +361,9 @@ tagstack_find (struct tagstack_item *tail, const char *tagname_begin,
   int len = tagname_end - tagname_begin;
   while (tail)
     {
-      if (len == (tail->tagname_end - tail->tagname_begin))
+      if (len == tail->tagname_length)
         {
-          if (0 == strncasecmp (tail->tagname_begin, tagname_begin, len))
+          if (0 == strncasecmp (tail->tagname, tagname_begin, len))
             return tail;
         }
       tail = tail->prev;
@@ -558,7 +569,9 @@ static int comment_backout_count;
 
    Whitespace is allowed between and after the comments, but not
    before the first comment.  Additionally, this function attempts to
-   handle double quotes in SGML declarations correctly.  */
+   handle double quotes in SGML declarations correctly.
+
+   If the declaration doesn't end before END, NULL is returned.  */
 
 static const char *
 advance_declaration (const char *beg, const char *end)
@@ -593,7 +606,7 @@ advance_declaration (const char *beg, const char *end)
   while (state != AC_S_DONE && state != AC_S_BACKOUT)
     {
       if (p == end)
-        state = AC_S_BACKOUT;
+        return NULL;
       switch (state)
         {
         case AC_S_DONE:
@@ -833,13 +846,43 @@ map_html_tags (const char *text, int size,
                int flags,
                const struct hash_table *allowed_tags,
                const struct hash_table *allowed_attributes)
+{
+  struct map_html_state state;
+
+  if (!size)
+    return;
+
+  xzero (state);
+  map_html_portion (&state, text, size, mapfun, maparg,
+                    flags & ~MHT_PARTIAL, allowed_tags, allowed_attributes);
+}
+
+/* Like map_html_tags, but map over a document that is given a portion
+   at a time.  TEXT holds SIZE characters of the document from position
+   STATE->offset on, and the mapping starts at STATE->resume.
+
+   With MHT_PARTIAL in FLAGS, more of the document is to come: a tag,
+   comment or declaration that runs into the end of TEXT is left
+   alone, and STATE->resume is set to where it begins, for the next
+   call.  The tags that remain open are kept in STATE.  The contents
+   of an element are passed to MAPFUN only if TEXT begins at or before
+   them, so the caller has to keep the contents it wants.
+
+   Without MHT_PARTIAL, the document ends with TEXT.  */
+
+void
+map_html_portion (struct map_html_state *state, const char *text, int size,
+                  void (*mapfun) (struct taginfo *, void *), void *maparg,
+                  int flags,
+                  const struct hash_table *allowed_tags,
+                  const struct hash_table *allowed_attributes)
 {
   /* storage for strings passed to MAPFUN callback; if 256 bytes is
      too little, POOL_APPEND allocates more with malloc. */
   char pool_initial_storage[256];
   struct pool pool;
 
-  const char *p = text;
+  const char *p = text + (state->resume - state->offset);
   const char *end = text + size;
 
   struct attr_pair attr_pair_initial_storage[8];
@@ -847,18 +890,16 @@ map_html_tags (const char *text, int size,
   bool attr_pair_resized = false;
   struct attr_pair *pairs = attr_pair_initial_storage;
 
-  struct tagstack_item *head = NULL;
-  struct tagstack_item *tail = NULL;
-
-  if (!size)
-    return;
+  /* The beginning of the tag being looked at, NULL between tags, and
+     whether it has been pushed on the tag stack.  */
+  const char *tag_start_position = NULL;
+  bool tag_pushed = false;
 
   POOL_INIT (&pool, pool_initial_storage, countof (pool_initial_storage));
 
   {
     int nattrs, end_tag;
     const char *tag_name_begin, *tag_name_end;
-    const char *tag_start_position;
     bool uninteresting_tag;
 
   look_for_tag:
@@ -866,6 +907,8 @@ map_html_tags (const char *text, int size,
 
     nattrs = 0;
     end_tag = 0;
+    tag_start_position = NULL;
+    tag_pushed = false;
 
     /* Find beginning of tag.  We use memchr() instead of the usual
        looping with ADVANCE() for speed. */
@@ -891,6 +934,8 @@ map_html_tags (const char *text, int size,
             const char *comment_end = find_comment_end (p + 3, end);
             if (comment_end)
               p = comment_end;
+            else if (flags & MHT_PARTIAL)
+              goto finish;
           }
         else
           {
@@ -898,10 +943,24 @@ map_html_tags (const char *text, int size,
                declaration.  Real declarations are much less likely to
                be misused the way comments are, so advance over them
                properly regardless of strictness.  */
-            p = advance_declaration (p, end);
+            const char *decl_end = advance_declaration (p, end);
+            if (decl_end)
+              p = decl_end;
+            else if (flags & MHT_PARTIAL)
+              goto finish;
+            else
+              {
+#ifdef STANDALONE
+                ++comment_backout_count;
+#endif
+                p = p + 1;
+              }
           }
         if (p == end)
-          goto finish;
+          {
+            tag_start_position = NULL;
+            goto finish;
+          }
         goto look_for_tag;
       }
     else if (*p == '/')
@@ -919,13 +978,9 @@ map_html_tags (const char *text, int size,
 
     if (!end_tag)
       {
-        struct tagstack_item *ts = tagstack_push (&head, &tail);
-        if (ts)
-          {
-            ts->tagname_begin  = tag_name_begin;
-            ts->tagname_end    = tag_name_end;
-            ts->contents_begin = NULL;
-          }
+        tagstack_push (&state->head, &state->tail,
+                       tag_name_begin, tag_name_end);
+        tag_pushed = true;
       }
 
     if (end_tag && *p != '>' && *p != '<')
@@ -1090,13 +1145,14 @@ map_html_tags (const char *text, int size,
         ++nattrs;
       }
 
-    if (!end_tag && tail && (tail->tagname_begin == tag_name_begin))
+    if (tag_pushed)
       {
-        tail->contents_begin = p+1;
+        state->tail->contents_begin = state->offset + (p + 1 - text);
       }
 
     if (uninteresting_tag)
       {
+        tag_start_position = NULL;
         ADVANCE (p);
         goto look_for_tag;
       }
@@ -1128,19 +1184,21 @@ map_html_tags (const char *text, int size,
 
       if (end_tag)
         {
-          ts = tagstack_find (tail, tag_name_begin, tag_name_end);
+          ts = tagstack_find (state->tail, tag_name_begin, tag_name_end);
           if (ts)
             {
-              if (ts->contents_begin)
+              if (ts->contents_begin >= state->offset)
                 {
-                  taginfo.contents_begin = ts->contents_begin;
+                  taginfo.contents_begin = (text + ts->contents_begin
+                                            - state->offset);
                   taginfo.contents_end   = tag_start_position;
                 }
-              tagstack_pop (&head, &tail, ts);
+              tagstack_pop (&state->head, &state->tail, ts);
             }
         }
 
       mapfun (&taginfo, maparg);
+      tag_start_position = NULL;
       if (*p != '<')
         ADVANCE (p);
     }
@@ -1160,8 +1218,26 @@ map_html_tags (const char *text, int size,
   POOL_FREE (&pool);
   if (attr_pair_resized)
     xfree (pairs);
-  /* pop any tag stack that's left */
-  tagstack_pop (&head, &tail, head);
+  if (!(flags & MHT_PARTIAL))
+    {
+      /* pop any tag stack that's left */
+      tagstack_pop (&state->head, &state->tail, state->head);
+      return;
+    }
+  /* Leave the tag that runs into the end for the next call.  */
+  if (tag_start_position && tag_pushed)
+    tagstack_pop (&state->head, &state->tail, state->tail);
+  state->resume = state->offset + ((tag_start_position
+                                    ? tag_start_position : end) - text);
+}
+
+/* Forget the open tags of a document given to map_html_portion that
+   won't be finished.  */
+
+void
+map_html_state_free (struct map_html_state *state)
+{
+  tagstack_pop (&state->head, &state->tail, state->head);
 }
 
 #undef ADVANCE
@@ -63,9 +63,23 @@ struct hash_table;              /* forward declaration */
 #define MHT_STRICT_COMMENTS  1  /* use strict comment interpretation */
 #define MHT_TRIM_VALUES      2  /* trim attribute values, e.g. interpret
                                    <a href=" foo "> as "foo" */
+#define MHT_PARTIAL          4  /* more text follows; stop at a tag
+                                   that isn't complete */
+
+/* The state of map_html_portion between portions of a document.  */
+struct map_html_state {
+  int offset;                   /* position of the text in the document */
+  int resume;                   /* where to resume mapping */
+  struct tagstack_item *head;   /* tags not closed yet */
+  struct tagstack_item *tail;
+};
 
 void map_html_tags (const char *, int,
                     void (*) (struct taginfo *, void *), void *, int,
                     const struct hash_table *, const struct hash_table *);
+void map_html_portion (struct map_html_state *, const char *, int,
+                       void (*) (struct taginfo *, void *), void *, int,
+                       const struct hash_table *, const struct hash_table *);
+void map_html_state_free (struct map_html_state *);
 
 #endif /* HTML_PARSE_H */
@@ -349,7 +349,7 @@ append_url (const char *link_uri, int position, int size,
 
   newel = xnew0 (struct urlpos);
   newel->url = url;
-  newel->pos = position;
+  newel->pos = position = ctx->text_offset + position;
   newel->size = size;
 
   /* A URL is relative if the host is not named, and the name does not
@@ -359,9 +359,12 @@ append_url (const char *link_uri, int position, int size,
   else if (link_has_scheme)
     newel->link_complete_p = 1;
 
-  /* Append the new URL maintaining the order by position.  */
+  /* Append the new URL maintaining the order by position.  Links
+     mostly come in order, so try the end of the list first.  */
   if (ctx->head == NULL)
-    ctx->head = newel;
+    ctx->head = ctx->tail = newel;
+  else if (position > ctx->tail->pos)
+    ctx->tail = ctx->tail->next = newel;
   else
     {
       struct urlpos *it, *prev = NULL;
@@ -681,6 +684,7 @@ static void
 collect_tags_mapper (struct taginfo *tag, void *arg)
 {
   struct map_context *ctx = (struct map_context *)arg;
+  int position = ctx->text_offset + (tag->start_position - ctx->text);
 
   /* Find the tag in our table of tags.  This must not fail because
      map_html_tags only returns tags found in interesting_tags.
@@ -691,6 +695,16 @@ collect_tags_mapper (struct taginfo *tag, void *arg)
   */
   struct known_tag *t = hash_table_get (interesting_tags, tag->name);
 
+  /* Track the open <style> elements, whose contents a document parsed
+     as it arrives has to keep.  */
+  if (0 == c_strcasecmp (tag->name, "style"))
+    {
+      if (!tag->end_tag_p && !ctx->style_depth++)
+        ctx->style_start = position;
+      else if (tag->end_tag_p && ctx->style_depth)
+        --ctx->style_depth;
+    }
+
   if (t != NULL)
     t->handler (t->tagid, tag, ctx);
 
@@ -706,37 +720,32 @@ collect_tags_mapper (struct taginfo *tag, void *arg)
   }
 }
 
-/* Analyze HTML tags FILE and construct a list of URLs referenced from
-   it.  It merges relative links in FILE with URL.  It is aware of
-   <base href=...> and does the right thing.  */
+/* Prepare CTX for mapping over the HTML document FILE, retrieved from
+   URL.  */
 
-struct urlpos *
-get_urls_html (const char *file, const char *url, bool *meta_disallow_follow,
-               struct iri *iri)
+static void
+init_map_context (struct map_context *ctx, const char *file,
+                  const char *url)
 {
-  struct file_memory *fm;
-  struct map_context ctx;
-  int flags;
-
-  /* Load the file. */
-  fm = wget_read_file (file);
-  if (!fm)
-    {
-      logprintf (LOG_NOTQUIET, "%s: %s\n", file, strerror (errno));
-      return NULL;
-    }
-  DEBUGP (("Loaded %s (size %s).\n", file, number_to_static_string (fm->length)));
-
-  ctx.text = fm->content;
-  ctx.head = NULL;
-  ctx.base = NULL;
-  ctx.parent_base = url ? url : opt.base_href;
-  ctx.document_file = file;
-  ctx.nofollow = false;
+  ctx->text = NULL;
+  ctx->text_offset = 0;
+  ctx->head = ctx->tail = NULL;
+  ctx->base = NULL;
+  ctx->parent_base = url ? url : opt.base_href;
+  ctx->document_file = file;
+  ctx->nofollow = false;
+  ctx->style_depth = 0;
+  ctx->style_start = 0;
 
   if (!interesting_tags)
     init_interesting ();
+}
+
+/* Return the flags to pass to map_html_tags.  */
 
+static int
+map_flags (void)
+{
   /* Specify MHT_TRIM_VALUES because of buggy HTML generators that
      generate <a href=" foo"> instead of <a href="foo"> (browsers
      ignore spaces as well.)  If you really mean space, use &32; or
@@ -744,26 +753,217 @@ get_urls_html (const char *file, const char *url, bool *meta_disallow_follow,
      e.g. in <img src="foo.[newline]html">.  Such newlines are also
      ignored by IE and Mozilla and are presumably introduced by
      writing HTML with editors that force word wrap.  */
-  flags = MHT_TRIM_VALUES;
+  int flags = MHT_TRIM_VALUES;
   if (opt.strict_comments)
     flags |= MHT_STRICT_COMMENTS;
+  return flags;
+}
 
-  /* the NULL here used to be interesting_tags */
-  map_html_tags (fm->content, fm->length, collect_tags_mapper, &ctx, flags,
-                 NULL, interesting_attributes);
+/* Return the links CTX has collected from FILE, and pass on what the
+   document said about itself to META_DISALLOW_FOLLOW and IRI.  */
 
+static struct urlpos *
+finish_map_context (struct map_context *ctx, const char *file,
+                    bool *meta_disallow_follow, struct iri *iri)
+{
   /* Meta charset is only valid if there was no HTTP header Content-Type charset. */
   /* This is true for HTTP 1.0 and 1.1. */
   if (iri && !iri->content_encoding && meta_charset)
     set_content_encoding (iri, meta_charset);
 
-  DEBUGP (("no-follow in %s: %d\n", file, ctx.nofollow));
+  DEBUGP (("no-follow in %s: %d\n", file, ctx->nofollow));
   if (meta_disallow_follow)
-    *meta_disallow_follow = ctx.nofollow;
+    *meta_disallow_follow = ctx->nofollow;
+
+  xfree (ctx->base);
+  return ctx->head;
+}
+
+/* Support for collecting the links of an HTML document while it is
+   being downloaded.
+
+   fd_read_body passes each portion of the body to html_stream_feed
+   as it arrives.  The text is mapped over up to the first tag that
+   isn't complete yet, and only the rest is kept for the next portion,
+   together with any <style> element whose end hasn't arrived, as its
+   contents are parsed as a whole.  When the body is complete,
+   get_urls_html hands out the collected links instead of reading the
+   file back.  */
+
+struct html_stream {
+  char *file;                   /* the file the document is saved to */
+  char *url;                    /* the URL it was retrieved from */
+  struct map_context ctx;
+  struct map_html_state state;
+
+  char *text;                   /* the text kept, from ctx.text_offset */
+  int size, alloc;
+  int pending;                  /* what was left unmapped last time */
+  int fresh;                    /* what has arrived since */
+  wgint length;                 /* the length of the document so far */
+  bool done;                    /* whether the whole document is in */
+};
+
+/* The document being downloaded, or the last one downloaded.  */
+static struct html_stream *stream;
+
+static void
+html_stream_free (void)
+{
+  if (!stream)
+    return;
+  xfree (stream->ctx.base);
+  free_urlpos (stream->ctx.head);
+  map_html_state_free (&stream->state);
+  xfree (stream->text);
+  xfree (stream->file);
+  xfree (stream->url);
+  xfree (stream);
+}
+
+/* Map over the text STREAM holds.  With MHT_PARTIAL in FLAGS, more
+   is to come, so drop only what won't be needed again.  */
+
+static void
+html_stream_map (int flags)
+{
+  struct map_context *ctx = &stream->ctx;
+  int keep;
+
+  ctx->text = stream->text;
+  stream->state.offset = ctx->text_offset;
+  map_html_portion (&stream->state, stream->text, stream->size,
+                    collect_tags_mapper, ctx, map_flags () | flags, NULL,
+                    interesting_attributes);
+  ctx->text = NULL;
+  if (!(flags & MHT_PARTIAL))
+    return;
+
+  keep = stream->state.resume;
+  if (ctx->style_depth && ctx->style_start < keep)
+    keep = ctx->style_start;
+  keep -= ctx->text_offset;
+  if (keep)
+    {
+      memmove (stream->text, stream->text + keep, stream->size - keep);
+      stream->size -= keep;
+      ctx->text_offset += keep;
+    }
+  stream->pending = ctx->text_offset + stream->size - stream->state.resume;
+  stream->fresh = 0;
+}
+
+/* Start collecting the links of the HTML document that is about to be
+   downloaded from URL to FILE.  */
 
-  xfree (ctx.base);
+void
+html_stream_begin (const char *file, const char *url)
+{
+  html_stream_free ();
+  stream = xnew0 (struct html_stream);
+  stream->file = xstrdup (file);
+  stream->url = xstrdup (url);
+  init_map_context (&stream->ctx, stream->file, stream->url);
+}
+
+/* Return whether links are being collected from a document.  */
+
+bool
+html_stream_active (void)
+{
+  return stream && !stream->done;
+}
+
+/* Map over the SIZE bytes in BUF, the next portion of the document.  */
+
+void
+html_stream_feed (const char *buf, int size)
+{
+  if (!html_stream_active ())
+    return;
+
+  if (stream->size + size > stream->alloc)
+    {
+      stream->alloc = MAX (stream->alloc * 2, stream->size + size);
+      stream->text = xrealloc (stream->text, stream->alloc);
+    }
+  memcpy (stream->text + stream->size, buf, size);
+  stream->size += size;
+  stream->length += size;
+  stream->fresh += size;
+
+  /* A tag or comment that goes on and on would be looked at again for
+     every portion.  Wait until as much has arrived as was left
+     unmapped, which keeps the work linear.  */
+  if (stream->fresh >= stream->pending)
+    html_stream_map (MHT_PARTIAL);
+}
+
+/* Finish the document.  If the download failed, or COMPLETE is false,
+   forget about it.  */
+
+void
+html_stream_end (bool complete)
+{
+  if (!html_stream_active ())
+    return;
+  if (!complete)
+    {
+      html_stream_free ();
+      return;
+    }
+  html_stream_map (0);
+  stream->done = true;
+  xfree (stream->text);
+  stream->size = stream->alloc = 0;
+}
+
+/* Analyze HTML tags FILE and construct a list of URLs referenced from
+   it.  It merges relative links in FILE with URL.  It is aware of
+   <base href=...> and does the right thing.  */
+
+struct urlpos *
+get_urls_html (const char *file, const char *url, bool *meta_disallow_follow,
+               struct iri *iri)
+{
+  struct file_memory *fm;
+  struct map_context ctx;
+  struct urlpos *head;
+
+  /* If the links of FILE were collected while it was downloaded, use
+     them.  */
+  if (stream && stream->done && url
+      && !strcmp (stream->file, file) && !strcmp (stream->url, url)
+      && file_size (file) == stream->length)
+    {
+      DEBUGP (("Collected the links of %s while downloading it.\n", file));
+      head = finish_map_context (&stream->ctx, file, meta_disallow_follow,
+                                 iri);
+      stream->ctx.head = NULL;
+      stream->ctx.base = NULL;
+      html_stream_free ();
+      return head;
+    }
+
+  /* Load the file. */
+  fm = wget_read_file (file);
+  if (!fm)
+    {
+      logprintf (LOG_NOTQUIET, "%s: %s\n", file, strerror (errno));
+      return NULL;
+    }
+  DEBUGP (("Loaded %s (size %s).\n", file, number_to_static_string (fm->length)));
+
+  init_map_context (&ctx, file, url);
+  ctx.text = fm->content;
+
+  /* the NULL here used to be interesting_tags */
+  map_html_tags (fm->content, fm->length, collect_tags_mapper, &ctx,
+                 map_flags (), NULL, interesting_attributes);
+
+  head = finish_map_context (&ctx, file, meta_disallow_follow, iri);
   wget_read_file_free (fm);
-  return ctx.head;
+  return head;
 }
 
 /* This doesn't really have anything to do with HTML, but it's similar
@@ -869,4 +1069,5 @@ cleanup_html_url (void)
     hash_table_destroy (interesting_tags);
   if (interesting_attributes)
     hash_table_destroy (interesting_attributes);
+  html_stream_free ();
 }
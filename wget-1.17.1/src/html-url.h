@@ -33,6 +33,7 @@ as that of the covered work.  */
 
 struct map_context {
   char *text;                   /* HTML text. */
+  int text_offset;              /* Where TEXT is in the document. */
   char *base;                   /* Base URI of the document, possibly
                                    changed through <base href=...>. */
   const char *parent_base;      /* Base of the current document. */
@@ -41,10 +42,18 @@ struct map_context {
                                    <meta name=robots> tag. */
 
   struct urlpos *head;          /* List of URLs that is being built. */
+  struct urlpos *tail;          /* Its last element. */
+
+  int style_depth;              /* Number of open <style> elements. */
+  int style_start;              /* Position of the first one. */
 };
 
 struct urlpos *get_urls_file (const char *);
 struct urlpos *get_urls_html (const char *, const char *, bool *, struct iri *);
+void html_stream_begin (const char *, const char *);
+bool html_stream_active (void);
+void html_stream_feed (const char *, int);
+void html_stream_end (bool);
 struct urlpos *append_url (const char *, int, int, struct map_context *);
 void free_urlpos (struct urlpos *);
 void cleanup_html_url (void);
@@ -39,6 +39,12 @@ as that of the covered work.  */
 #include <errno.h>
 #include <time.h>
 #include <locale.h>
+#if !defined(WINDOWS) && !defined(MSDOS)
+# include <fcntl.h>
+# include <signal.h>
+# include <sys/select.h>
+# include <sys/wait.h>
+#endif
 
 #include "hash.h"
 #include "http.h"
@@ -47,6 +53,7 @@ as that of the covered work.  */
 #include "url.h"
 #include "host.h"
 #include "retr.h"
+#include "recur.h"
 #include "connect.h"
 #include "netrc.h"
 #ifdef HAVE_SSL
@@ -58,10 +65,14 @@ as that of the covered work.  */
 #include "cookies.h"
 #include "md5.h"
 #include "convert.h"
+#include "html-url.h"
 #include "spider.h"
+#include "timing.h"
 #include "warc.h"
 #include "c-strcase.h"
 #include "version.h"
+#include "progress.h"
+#include "ptimer.h"
 #ifdef HAVE_METALINK
 # include "metalink.h"
 # include "xstrndup.h"
@@ -315,15 +326,14 @@ request_remove_header (struct request *req, const char *name)
   p += A_len;                                   \
 } while (0)
 
-/* Construct the request and write it to FD using fd_write.
-   If warc_tmp is set to a file pointer, the request string will
-   also be written to that file. */
+/* Construct the text of the request and return it in a freshly
+   allocated string.  */
 
-static int
-request_send (const struct request *req, int fd, FILE *warc_tmp)
+static char *
+request_to_string (const struct request *req)
 {
   char *request_string, *p;
-  int i, size, write_error;
+  int i, size;
 
   /* Count the request size. */
   size = 0;
@@ -341,7 +351,7 @@ request_send (const struct request *req, int fd, FILE *warc_tmp)
   /* "\r\n\0" */
   size += 3;
 
-  p = request_string = alloca_array (char, size);
+  p = request_string = xmalloc (size);
 
   /* Generate the request. */
 
@@ -363,21 +373,37 @@ request_send (const struct request *req, int fd, FILE *warc_tmp)
 
 #undef APPEND
 
+  return request_string;
+}
+
+/* Construct the request and write it to FD using fd_write.
+   If warc_tmp is set to a file pointer, the request string will
+   also be written to that file. */
+
+static int
+request_send (const struct request *req, int fd, FILE *warc_tmp)
+{
+  char *request_string = request_to_string (req);
+  int size = strlen (request_string);
+  int write_error;
+
   DEBUGP (("\n---request begin---\n%s---request end---\n", request_string));
 
   /* Send the request to the server. */
 
-  write_error = fd_write (fd, request_string, size - 1, -1);
+  write_error = fd_write (fd, request_string, size, -1);
   if (write_error < 0)
     logprintf (LOG_VERBOSE, _("Failed writing HTTP request: %s.\n"),
                fd_errstr (fd));
   else if (warc_tmp != NULL)
     {
       /* Write a copy of the data to the WARC record. */
-      int warc_tmp_written = fwrite (request_string, 1, size - 1, warc_tmp);
-      if (warc_tmp_written != size - 1)
-        return -2;
+      int warc_tmp_written = warc_tempfile_write (warc_tmp, request_string,
+                                                  size);
+      if (warc_tmp_written != size)
+        write_error = -2;
     }
+  xfree (request_string);
   return write_error;
 }
 
@@ -489,7 +515,8 @@ body_file_send (int sock, const char *file_name, wgint promised_size, FILE *warc
       if (warc_tmp != NULL)
         {
           /* Write a copy of the data to the WARC record. */
-          int warc_tmp_written = fwrite (chunk, 1, towrite, warc_tmp);
+          int warc_tmp_written = warc_tempfile_write (warc_tmp, chunk,
+                                                      towrite);
           if (warc_tmp_written != towrite)
             {
               fclose (fp);
@@ -1318,20 +1345,22 @@ parse_strict_transport_security (const char *header, time_t *max_age, bool *incl
 }
 #endif
 
-/* Persistent connections.  Currently, we cache the most recently used
-   connection as persistent, provided that the HTTP server agrees to
-   make it such.  The persistence data is stored in the variables
-   below.  Ideally, it should be possible to cache an arbitrary fixed
-   number of these connections.  */
+/* Persistent connections.  We cache up to MAX_PERSISTENT_CONNECTIONS
+   connections that the HTTP server agreed to keep alive, so that a
+   crawl alternating between several hosts doesn't have to reconnect
+   (and redo the SSL handshake) every time it switches hosts.  A
+   connection that has not been used for PERSISTENT_IDLE_TIMEOUT
+   seconds is closed, as the server has most likely given up on it
+   already.  */
 
-/* Whether a persistent connection is active. */
-static bool pconn_active;
+#define MAX_PERSISTENT_CONNECTIONS 8
+#define PERSISTENT_IDLE_TIMEOUT 30
 
-static struct {
+struct pconn {
   /* The socket of the connection.  */
   int socket;
 
-  /* Host and port of the currently active persistent connection. */
+  /* Host and port of the connection. */
   char *host;
   int port;
 
@@ -1344,24 +1373,86 @@ static struct {
      useful optimization.)  */
   bool authorized;
 
+  /* When the connection was last used, and how many times it has
+     been reused.  */
+  time_t last_used;
+  int reuses;
+
+  /* Whether the server speaks HTTP/1.1, and so will answer requests
+     sent ahead with --pipeline.  */
+  bool http11;
+
+  /* The requests sent ahead whose responses have not been read yet,
+     oldest first.  */
+  char **pipelined;
+  int pipelined_count, pipelined_alloc;
+
 #ifdef ENABLE_NTLM
-  /* NTLM data of the current connection.  */
+  /* NTLM data of the connection.  */
   struct ntlmdata ntlm;
 #endif
-} pconn;
+};
+
+/* The cached connections, least recently registered first.  */
+static struct pconn *pconns[MAX_PERSISTENT_CONNECTIONS];
+static int pconn_count;
+
+/* The cached connection the current request is using, if any. */
+static struct pconn *pconn;
+
+#ifdef ENABLE_NTLM
+/* NTLM data used when the current connection is not cached.  */
+static struct ntlmdata ntlm_uncached;
+#endif
 
-/* Mark the persistent connection as invalid and free the resources it
-   uses.  This is used by the CLOSE_* macros after they forcefully
+/* Remove PC from the cache and free it, closing its socket if CLOSE
+   is true.  */
+
+static void
+forget_persistent (struct pconn *pc, bool close)
+{
+  int i;
+
+  for (i = 0; i < pconn_count; i++)
+    if (pconns[i] == pc)
+      break;
+  assert (i < pconn_count);
+  memmove (pconns + i, pconns + i + 1,
+           (pconn_count - i - 1) * sizeof (pconns[0]));
+  --pconn_count;
+
+  if (close)
+    fd_close (pc->socket);
+  if (pconn == pc)
+    pconn = NULL;
+  for (i = 0; i < pc->pipelined_count; i++)
+    xfree (pc->pipelined[i]);
+  xfree (pc->pipelined);
+  xfree (pc->host);
+  xfree (pc);
+}
+
+/* Mark the persistent connection PC as invalid and free the resources
+   it uses.  This is used by the CLOSE_* macros after they forcefully
    close a registered persistent connection.  */
 
 static void
-invalidate_persistent (void)
+invalidate_persistent (struct pconn *pc)
+{
+  DEBUGP (("Disabling further reuse of socket %d (reused %d times).\n",
+           pc->socket, pc->reuses));
+  forget_persistent (pc, true);
+}
+
+/* Forget about the persistent connections without closing them.  A
+   --parallel worker calls this because the connections belong to the
+   main process, which may still be using them.  */
+
+void
+http_forget_persistent (void)
 {
-  DEBUGP (("Disabling further reuse of socket %d.\n", pconn.socket));
-  pconn_active = false;
-  fd_close (pconn.socket);
-  xfree (pconn.host);
-  xzero (pconn);
+  while (pconn_count)
+    forget_persistent (pconns[0], false);
 }
 
 /* Register FD, which should be a TCP/IP connection to HOST:PORT, as
@@ -1370,111 +1461,150 @@ invalidate_persistent (void)
    response has been received and the server has promised that the
    connection will remain alive.
 
-   If a previous connection was persistent, it is closed. */
+   If the cache is full, the connection that has been idle the longest
+   is closed. */
 
 static void
 register_persistent (const char *host, int port, int fd, bool ssl)
 {
-  if (pconn_active)
+  struct pconn *pc;
+  int i;
+
+  for (i = 0; i < pconn_count; i++)
+    if (pconns[i]->socket == fd)
+      {
+        /* The connection FD is already registered. */
+        pconn = pconns[i];
+        pconn->last_used = time (NULL);
+        return;
+      }
+
+  if (pconn_count == MAX_PERSISTENT_CONNECTIONS)
     {
-      if (pconn.socket == fd)
-        {
-          /* The connection FD is already registered. */
-          return;
-        }
-      else
-        {
-          /* The old persistent connection is still active; close it
-             first.  This situation arises whenever a persistent
-             connection exists, but we then connect to a different
-             host, and try to register a persistent connection to that
-             one.  */
-          invalidate_persistent ();
-        }
+      struct pconn *oldest = pconns[0];
+      for (i = 1; i < pconn_count; i++)
+        if (pconns[i]->last_used < oldest->last_used)
+          oldest = pconns[i];
+      invalidate_persistent (oldest);
     }
 
-  pconn_active = true;
-  pconn.socket = fd;
-  pconn.host = xstrdup (host);
-  pconn.port = port;
-  pconn.ssl = ssl;
-  pconn.authorized = false;
+  pc = xnew0 (struct pconn);
+  pc->socket = fd;
+  pc->host = xstrdup (host);
+  pc->port = port;
+  pc->ssl = ssl;
+  pc->last_used = time (NULL);
+#ifdef ENABLE_NTLM
+  /* Carry over the NTLM handshake done on this connection so far.  */
+  pc->ntlm = ntlm_uncached;
+  xzero (ntlm_uncached);
+#endif
+  pconns[pconn_count++] = pc;
+  pconn = pc;
 
-  DEBUGP (("Registered socket %d for persistent reuse.\n", fd));
+  DEBUGP (("Registered socket %d for persistent reuse (%d cached).\n",
+           fd, pconn_count));
 }
 
-/* Return true if a persistent connection is available for connecting
-   to HOST:PORT.  */
+/* Return a persistent connection suitable for connecting to
+   HOST:PORT, or NULL if there is none.  */
 
-static bool
+static struct pconn *
 persistent_available_p (const char *host, int port, bool ssl,
                         bool *host_lookup_failed)
 {
-  /* First, check whether a persistent connection is active at all.  */
-  if (!pconn_active)
-    return false;
+  struct pconn *pc = NULL;
+  time_t now = time (NULL);
+  int i;
 
-  /* If we want SSL and the last connection wasn't or vice versa,
-     don't use it.  Checking for host and port is not enough because
-     HTTP and HTTPS can apparently coexist on the same port.  */
-  if (ssl != pconn.ssl)
-    return false;
+  /* Close the connections that have been idle for too long.  */
+  for (i = 0; i < pconn_count; )
+    if (now - pconns[i]->last_used > PERSISTENT_IDLE_TIMEOUT)
+      {
+        DEBUGP (("Socket %d has been idle for %lds.\n",
+                 pconns[i]->socket, (long) (now - pconns[i]->last_used)));
+        invalidate_persistent (pconns[i]);
+      }
+    else
+      ++i;
+
+  /* If we want SSL and the connection isn't or vice versa, don't use
+     it.  Checking for host and port is not enough because HTTP and
+     HTTPS can apparently coexist on the same port.  */
+  for (i = 0; i < pconn_count; i++)
+    if (pconns[i]->ssl == ssl && pconns[i]->port == port
+        && 0 == strcasecmp (host, pconns[i]->host))
+      {
+        pc = pconns[i];
+        break;
+      }
 
-  /* If we're not connecting to the same port, we're not interested. */
-  if (port != pconn.port)
-    return false;
+  if (!pc && !ssl)
+    {
+      /* Check if one of the connections is talking to HOST under
+         another name.  This happens often when both sites are virtual
+         hosts distinguished only by name and served by the same
+         network interface, and hence the same web server (possibly
+         set up by the ISP and serving many different web sites).
+         This admittedly unconventional optimization does not
+         contradict HTTP and works well with popular server software.
 
-  /* If the host is the same, we're in business.  If not, there is
-     still hope -- read below.  */
-  if (0 != strcasecmp (host, pconn.host))
-    {
-      /* Check if pconn.socket is talking to HOST under another name.
-         This happens often when both sites are virtual hosts
-         distinguished only by name and served by the same network
-         interface, and hence the same web server (possibly set up by
-         the ISP and serving many different web sites).  This
-         admittedly unconventional optimization does not contradict
-         HTTP and works well with popular server software.  */
-
-      bool found;
-      ip_address ip;
-      struct address_list *al;
-
-      if (ssl)
-        /* Don't try to talk to two different SSL sites over the same
-           secure connection!  (Besides, it's not clear that
-           name-based virtual hosting is even possible with SSL.)  */
-        return false;
+         Don't try to talk to two different SSL sites over the same
+         secure connection!  (Besides, it's not clear that name-based
+         virtual hosting is even possible with SSL.)  */
 
-      /* If pconn.socket's peer is one of the IP addresses HOST
-         resolves to, pconn.socket is for all intents and purposes
-         already talking to HOST.  */
+      struct address_list *al = NULL;
 
-      if (!socket_ip_address (pconn.socket, &ip, ENDPOINT_PEER))
+      for (i = 0; i < pconn_count && !pc; )
         {
-          /* Can't get the peer's address -- something must be very
-             wrong with the connection.  */
-          invalidate_persistent ();
-          return false;
-        }
-      al = lookup_host (host, 0);
-      if (!al)
-        {
-          *host_lookup_failed = true;
-          return false;
-        }
+          ip_address ip;
 
-      found = address_list_contains (al, &ip);
-      address_list_release (al);
+          if (pconns[i]->ssl || pconns[i]->port != port)
+            {
+              ++i;
+              continue;
+            }
 
-      if (!found)
-        return false;
+          if (!socket_ip_address (pconns[i]->socket, &ip, ENDPOINT_PEER))
+            {
+              /* Can't get the peer's address -- something must be
+                 very wrong with the connection.  */
+              invalidate_persistent (pconns[i]);
+              continue;
+            }
 
-      /* The persistent connection's peer address was found among the
-         addresses HOST resolved to; therefore, pconn.sock is in fact
-         already talking to HOST -- no need to reconnect.  */
+          if (!al)
+            {
+              al = lookup_host (host, 0);
+              if (!al)
+                {
+                  *host_lookup_failed = true;
+                  return NULL;
+                }
+            }
+
+          /* If the connection's peer is one of the IP addresses HOST
+             resolves to, the connection is for all intents and
+             purposes already talking to HOST.  */
+          if (address_list_contains (al, &ip))
+            pc = pconns[i];
+          ++i;
+        }
+
+      if (al)
+        address_list_release (al);
     }
 
+  if (!pc)
+    return NULL;
+
+  /* The responses to requests sent ahead are still to be read, so the
+     test below would fail.  If the server has closed the connection
+     in the meantime, gethttp will notice and send the request
+     again.  */
+  if (pc->pipelined_count)
+    return pc;
+
   /* Finally, check whether the connection is still open.  This is
      important because most servers implement liberal (short) timeout
      on persistent connections.  Wget can of course always reconnect
@@ -1488,16 +1618,16 @@ persistent_available_p (const char *host, int port, bool ssl,
      body in response to HEAD, or if it sends more than conent-length
      data, we won't reuse the corrupted connection.)  */
 
-  if (!test_socket_open (pconn.socket))
+  if (!test_socket_open (pc->socket))
     {
       /* Oops, the socket is no longer open.  Now that we know that,
          let's invalidate the persistent connection before returning
-         0.  */
-      invalidate_persistent ();
-      return false;
+         NULL.  */
+      invalidate_persistent (pc);
+      return NULL;
     }
 
-  return true;
+  return pc;
 }
 
 /* The idea behind these two CLOSE macros is to distinguish between
@@ -1518,17 +1648,19 @@ persistent_available_p (const char *host, int port, bool ssl,
 #define CLOSE_FINISH(fd) do {                   \
   if (!keep_alive)                              \
     {                                           \
-      if (pconn_active && (fd) == pconn.socket) \
-        invalidate_persistent ();               \
+      if (pconn && (fd) == pconn->socket)       \
+        invalidate_persistent (pconn);          \
       else                                      \
           fd_close (fd);                        \
       fd = -1;                                  \
     }                                           \
+  else if (pconn && (fd) == pconn->socket)      \
+    pconn->last_used = time (NULL);             \
 } while (0)
 
 #define CLOSE_INVALIDATE(fd) do {               \
-  if (pconn_active && (fd) == pconn.socket)     \
-    invalidate_persistent ();                   \
+  if (pconn && (fd) == pconn->socket)           \
+    invalidate_persistent (pconn);              \
   else                                          \
     fd_close (fd);                              \
   fd = -1;                                      \
@@ -1561,6 +1693,7 @@ struct http_stat
   wgint orig_file_size;         /* size of file to compare for time-stamping */
   time_t orig_file_tstamp;      /* time-stamp of file to compare for
                                  * time-stamping */
+  bool decompress;              /* true if the body is to be inflated */
 #ifdef HAVE_METALINK
   metalink_t *metalink;
 #endif
@@ -1622,7 +1755,7 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
                     char *url, char *warc_timestamp_str, char *warc_request_uuid,
                     ip_address *warc_ip, char *type, int statcode, char *head)
 {
-  int warc_payload_offset = 0;
+  off_t warc_payload_offset = 0;
   FILE *warc_tmp = NULL;
   int warcerr = 0;
   int flags = 0;
@@ -1639,10 +1772,11 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
         {
           /* We should keep the response headers for the WARC record.  */
           int head_len = strlen (head);
-          int warc_tmp_written = fwrite (head, 1, head_len, warc_tmp);
+          int warc_tmp_written = warc_tempfile_write (warc_tmp, head,
+                                                      head_len);
           if (warc_tmp_written != head_len)
             warcerr = WARC_TMP_FWRITEERR;
-          warc_payload_offset = head_len;
+          warc_payload_offset = warc_tempfile_payload (warc_tmp);
         }
 
       if (warcerr != 0)
@@ -1673,6 +1807,10 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
     flags |= rb_skip_startpos;
   if (chunked_transfer_encoding)
     flags |= rb_chunked_transfer_encoding;
+  if (fp != NULL && !(flags & rb_skip_startpos) && html_stream_active ())
+    flags |= rb_collect_links;
+  if (fp != NULL && !(flags & rb_skip_startpos) && hs->decompress)
+    flags |= rb_decompress;
 
   hs->len = hs->restval;
   hs->rd_size = 0;
@@ -1701,6 +1839,10 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
             return WARC_ERR;
         }
 
+      /* Only now is the length of the decompressed body known.  */
+      if (flags & rb_decompress)
+        hs->contlen = hs->len;
+
       return RETRFINISHED;
     }
 
@@ -1717,6 +1859,14 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
       /* Error while writing to warc_tmp. */
       return WARC_TMP_FWRITEERR;
     }
+  else if (hs->res == -4)
+    {
+      /* The body was cut short or corrupted; a retry asks for the
+         rest of it uncompressed.  */
+      hs->res = -1;
+      hs->rderrmsg = xstrdup (_("Cannot decompress the body"));
+      return RETRFINISHED;
+    }
   else
     {
       /* A read error! */
@@ -1867,7 +2017,13 @@ initialize_request (struct url *u, struct http_stat *hs, int *dt, struct url *pr
                         rel_value);
   SET_USER_AGENT (req);
   request_set_header (req, "Accept", "*/*", rel_none);
-  request_set_header (req, "Accept-Encoding", "identity", rel_none);
+#ifdef HAVE_LIBZ
+  /* A compressed body can't be resumed at a byte of the file.  */
+  if (opt.compression == compression_auto && !hs->restval)
+    request_set_header (req, "Accept-Encoding", "gzip, deflate", rel_none);
+  else
+#endif
+    request_set_header (req, "Accept-Encoding", "identity", rel_none);
 
   /* Find the username and password for authentication. */
   *user = u->user;
@@ -1950,6 +2106,149 @@ initialize_request (struct url *u, struct http_stat *hs, int *dt, struct url *pr
   return req;
 }
 
+/* Add the cookies for U and the user headers to REQ.  */
+
+static void
+request_set_cookie_and_user_headers (struct request *req,
+                                     const struct url *u)
+{
+  if (opt.cookies)
+    request_set_header (req, "Cookie",
+                        cookie_header (wget_cookie_jar,
+                                       u->host, u->port, u->path,
+#ifdef HAVE_SSL
+                                       u->scheme == SCHEME_HTTPS
+#else
+                                       0
+#endif
+                                       ),
+                        rel_value);
+
+  /* Add the user headers. */
+  if (opt.user_headers)
+    {
+      int i;
+      for (i = 0; opt.user_headers[i]; i++)
+        request_set_user_header (req, opt.user_headers[i]);
+    }
+}
+
+/* --pipeline support.  Once a persistent connection to an HTTP/1.1
+   server is known to work, the requests for the URLs to be retrieved
+   next from the same server are written right after the current one,
+   so the server can answer them without waiting for a round trip
+   each.  gethttp then reads the responses in order, provided that it
+   builds the very same requests as the ones sent ahead.  If it does
+   not, or if the server closes the connection early, the connection
+   is dropped and the request is sent again on a new one.  */
+
+static http_upcoming_fn upcoming;
+
+/* Set the function that tells which URLs will be retrieved next, or
+   disable pipelining if FN is NULL.  */
+
+void
+http_set_upcoming (http_upcoming_fn fn)
+{
+  upcoming = fn;
+}
+
+/* Return the request that gethttp would send to retrieve URL with
+   REFERER as referer, or NULL if it may not be sent ahead on PC.
+   Whether to use a proxy only depends on the scheme and the host, so
+   URL goes through no proxy if the connection doesn't.  */
+
+static char *
+pipeline_request (const struct pconn *pc, const char *url,
+                  const char *referer)
+{
+  struct url *u;
+  struct request *req;
+  struct http_stat hs;
+  char *user, *passwd;
+  char *text = NULL;
+  bool basic_auth_finished = false;
+  wgint body_data_size = 0;
+  int dt = opt.allow_cache ? 0 : SEND_NOCACHE;
+  bool ssl = false;
+  uerr_t err;
+
+  u = url_parse (url, NULL, NULL, true);
+  if (!u)
+    return NULL;
+#ifdef HAVE_SSL
+  ssl = u->scheme == SCHEME_HTTPS;
+#endif
+  if ((u->scheme != SCHEME_HTTP && !ssl) || ssl != pc->ssl
+      || u->port != pc->port || 0 != strcasecmp (u->host, pc->host))
+    {
+      url_free (u);
+      return NULL;
+    }
+  xzero (hs);
+  hs.referer = referer ? referer : opt.referer;
+  req = initialize_request (u, &hs, &dt, NULL, false, &basic_auth_finished,
+                            &body_data_size, &user, &passwd, &err);
+  /* Authentication may need a round trip of its own.  */
+  if (req && !(user && passwd))
+    {
+      request_set_cookie_and_user_headers (req, u);
+      text = request_to_string (req);
+    }
+  request_free (&req);
+  url_free (u);
+  return text;
+}
+
+/* Send requests ahead on PC for the URLs to be retrieved next, until
+   opt.pipeline of them are waiting for a response.  */
+
+static void
+pipeline_fill (struct pconn *pc)
+{
+  const char *url, *referer;
+  char *text;
+
+  if (!upcoming || !pc->http11)
+    return;
+  /* These make the next request depend on the outcome of this one, or
+     need to see the request as it is sent.  */
+  if (opt.spider || opt.timestamping || opt.always_rest || opt.start_pos >= 0
+      || opt.method || opt.warc_filename
+#ifdef HAVE_METALINK
+      || opt.metalink_over_http
+#endif
+      )
+    return;
+
+  while (pc->pipelined_count < opt.pipeline
+         && (url = upcoming (pc->pipelined_count, &referer)) != NULL
+         && (text = pipeline_request (pc, url, referer)) != NULL)
+    {
+      if (fd_write (pc->socket, text, strlen (text), -1) < 0)
+        {
+          xfree (text);
+          break;
+        }
+      DEBUGP (("\n---request sent ahead---\n%s---request end---\n", text));
+      DO_REALLOC (pc->pipelined, pc->pipelined_alloc,
+                  pc->pipelined_count + 1, char *);
+      pc->pipelined[pc->pipelined_count++] = text;
+    }
+}
+
+/* Remove the oldest request sent ahead on PC, whose response is about
+   to be read.  */
+
+static void
+pipeline_shift (struct pconn *pc)
+{
+  xfree (pc->pipelined[0]);
+  memmove (pc->pipelined, pc->pipelined + 1,
+           (pc->pipelined_count - 1) * sizeof (pc->pipelined[0]));
+  --pc->pipelined_count;
+}
+
 static void
 initialize_proxy_configuration (struct url *u, struct request *req,
                                 struct url *proxy, char **proxyauth)
@@ -1992,6 +2291,7 @@ establish_connection (struct url *u, struct url **conn_ref,
 {
   bool host_lookup_failed = false;
   int sock = *sock_ref;
+  struct pconn *pc;
   struct request *req = *req_ref;
   struct url *conn = *conn_ref;
   struct response *resp;
@@ -2010,29 +2310,50 @@ establish_connection (struct url *u, struct url **conn_ref,
         relevant = u;
 #endif
 
-      if (persistent_available_p (relevant->host, relevant->port,
+      pc = persistent_available_p (relevant->host, relevant->port,
 #ifdef HAVE_SSL
-                                  relevant->scheme == SCHEME_HTTPS,
+                                   relevant->scheme == SCHEME_HTTPS,
 #else
-                                  0,
+                                   0,
 #endif
-                                  &host_lookup_failed))
+                                   &host_lookup_failed);
+      if (pc && pc->pipelined_count)
+        {
+          /* The response waiting on the connection is only ours if
+             the request sent ahead is the one we are about to send.  */
+          char *text = request_to_string (req);
+          bool same = !strcmp (text, pc->pipelined[0]);
+          xfree (text);
+          if (!same)
+            {
+              DEBUGP (("The request sent ahead on fd %d differs.\n",
+                       pc->socket));
+              invalidate_persistent (pc);
+              pc = NULL;
+            }
+        }
+      if (pc)
         {
-          int family = socket_family (pconn.socket, ENDPOINT_PEER);
-          sock = pconn.socket;
-          *using_ssl = pconn.ssl;
+          int family = socket_family (pc->socket, ENDPOINT_PEER);
+          pconn = pc;
+          sock = pconn->socket;
+          *using_ssl = pconn->ssl;
 #if ENABLE_IPV6
           if (family == AF_INET6)
              logprintf (LOG_VERBOSE, _("Reusing existing connection to [%s]:%d.\n"),
-                        quotearg_style (escape_quoting_style, pconn.host),
-                         pconn.port);
+                        quotearg_style (escape_quoting_style, pconn->host),
+                         pconn->port);
           else
 #endif
              logprintf (LOG_VERBOSE, _("Reusing existing connection to %s:%d.\n"),
-                        quotearg_style (escape_quoting_style, pconn.host),
-                        pconn.port);
-          DEBUGP (("Reusing fd %d.\n", sock));
-          if (pconn.authorized)
+                        quotearg_style (escape_quoting_style, pconn->host),
+                        pconn->port);
+          ++pconn->reuses;
+          timing_request_reused ();
+          DEBUGP (("Reusing fd %d (reused %d times, idle for %lds).\n",
+                   sock, pconn->reuses,
+                   (long) (time (NULL) - pconn->last_used)));
+          if (pconn->authorized)
             /* If the connection is already authorized, the "Basic"
                authorization added by code above is unnecessary and
                only hurts us.  */
@@ -2053,6 +2374,8 @@ establish_connection (struct url *u, struct url **conn_ref,
 
   if (sock < 0)
     {
+      /* A new connection is not cached until register_persistent.  */
+      pconn = NULL;
       sock = connect_to_host (conn->host, conn->port);
       if (sock == E_HOST)
         return HOSTERR;
@@ -2141,7 +2464,12 @@ establish_connection (struct url *u, struct url **conn_ref,
 
       if (conn->scheme == SCHEME_HTTPS)
         {
-          if (!ssl_connect_wget (sock, u->host, NULL))
+          bool handshake_ok;
+
+          timing_phase_begin (TIMING_TLS);
+          handshake_ok = ssl_connect_wget (sock, u->host, NULL);
+          timing_phase_end (TIMING_TLS);
+          if (!handshake_ok)
             {
               CLOSE_INVALIDATE (sock);
               return CONSSLERR;
@@ -2902,6 +3230,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
   char *proxyauth;
   int statcode;
   int write_error;
+  bool sent_ahead = false;
   wgint contlen, contrange;
   struct url *conn;
   FILE *fp;
@@ -2996,6 +3325,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
   hs->contlen = -1;
   hs->res = -1;
   hs->rderrmsg = NULL;
+  hs->decompress = false;
   hs->newloc = NULL;
   xfree(hs->remote_time);
   hs->error = NULL;
@@ -3019,25 +3349,11 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
      without authorization header fails.  (Expected to happen at least
      for the Digest authorization scheme.)  */
 
-  if (opt.cookies)
-    request_set_header (req, "Cookie",
-                        cookie_header (wget_cookie_jar,
-                                       u->host, u->port, u->path,
-#ifdef HAVE_SSL
-                                       u->scheme == SCHEME_HTTPS
-#else
-                                       0
-#endif
-                                       ),
-                        rel_value);
+  /* Each attempt is a request of its own for --timing-log.  */
+  timing_request_end ();
+  timing_request_begin (u->url);
 
-  /* Add the user headers. */
-  if (opt.user_headers)
-    {
-      int i;
-      for (i = 0; opt.user_headers[i]; i++)
-        request_set_user_header (req, opt.user_headers[i]);
-    }
+  request_set_cookie_and_user_headers (req, u);
 
   proxyauth = NULL;
   if (proxy)
@@ -3079,8 +3395,17 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
         }
     }
 
-  /* Send the request to server.  */
-  write_error = request_send (req, sock, warc_tmp);
+  /* Send the request to server, unless it was sent ahead.  */
+  timing_phase_begin (TIMING_FIRST_BYTE);
+  if (pconn && pconn->socket == sock && pconn->pipelined_count)
+    {
+      DEBUGP (("Request was sent ahead on fd %d.\n", sock));
+      pipeline_shift (pconn);
+      sent_ahead = true;
+      write_error = 0;
+    }
+  else
+    write_error = request_send (req, sock, warc_tmp);
 
   if (write_error >= 0)
     {
@@ -3093,10 +3418,11 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
               int warc_tmp_written;
 
               /* Remember end of headers / start of payload. */
-              warc_payload_offset = ftello (warc_tmp);
+              warc_payload_offset = warc_tempfile_payload (warc_tmp);
 
               /* Write a copy of the data to the WARC record. */
-              warc_tmp_written = fwrite (opt.body_data, 1, body_data_size, warc_tmp);
+              warc_tmp_written = warc_tempfile_write (warc_tmp, opt.body_data,
+                                                      body_data_size);
               if (warc_tmp_written != body_data_size)
                 write_error = -2;
             }
@@ -3105,7 +3431,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
         {
           if (warc_tmp != NULL)
             /* Remember end of headers / start of payload */
-            warc_payload_offset = ftello (warc_tmp);
+            warc_payload_offset = warc_tempfile_payload (warc_tmp);
 
           write_error = body_file_send (sock, opt.body_file, body_data_size, warc_tmp);
         }
@@ -3124,6 +3450,8 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
         retval = WRITEFAILED;
       goto cleanup;
     }
+  if (opt.pipeline && pconn && pconn->socket == sock && !proxy)
+    pipeline_fill (pconn);
   logprintf (LOG_VERBOSE, _("%s request sent, awaiting response... "),
              proxy ? "Proxy" : "HTTP");
   contlen = -1;
@@ -3162,6 +3490,15 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
         head = read_http_response_head (sock);
         if (!head)
           {
+            if (sent_ahead)
+              {
+                /* The server closed the connection before getting to
+                   the request sent ahead.  Send it again.  */
+                DEBUGP (("No response to the request sent ahead.\n"));
+                CLOSE_INVALIDATE (sock);
+                sent_ahead = false;
+                goto retry_with_auth;
+              }
             if (errno == 0)
               {
                 logputs (LOG_NOTQUIET, _("No data received.\n"));
@@ -3210,6 +3547,8 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
       }
     while (_repeat);
   }
+  timing_phase_end (TIMING_FIRST_BYTE);
+  timing_request_status (statcode);
 
   xfree(hs->message);
   hs->message = xstrdup (message);
@@ -3277,13 +3616,18 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
           char *set_cookie; BOUNDED_TO_ALLOCA (scbeg, scend, set_cookie);
           cookie_handle_set_cookie (wget_cookie_jar, u->host, u->port,
                                     u->path, set_cookie);
+          parallel_record ('k', u->host, number_to_static_string (u->port),
+                           u->path, set_cookie, NULL);
         }
     }
 
   if (keep_alive)
-    /* The server has promised that it will not close the connection
-       when we're done.  This means that we can register it.  */
-    register_persistent (conn->host, conn->port, sock, using_ssl);
+    {
+      /* The server has promised that it will not close the connection
+         when we're done.  This means that we can register it.  */
+      register_persistent (conn->host, conn->port, sock, using_ssl);
+      pconn->http11 = 0 == strncmp (head, "HTTP/1.1", 8);
+    }
 
 #ifdef HAVE_METALINK
   /* We need to check for the Metalink data in the very first response
@@ -3335,7 +3679,8 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
             CLOSE_INVALIDATE (sock);
         }
 
-      pconn.authorized = false;
+      if (pconn)
+        pconn->authorized = false;
 
       {
         auth_err = check_auth (u, user, passwd, resp, req,
@@ -3360,8 +3705,8 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
   else /* statcode != HTTP_STATUS_UNAUTHORIZED */
     {
       /* Kludge: if NTLM is used, mark the TCP connection as authorized. */
-      if (ntlm_seen)
-        pconn.authorized = true;
+      if (ntlm_seen && pconn)
+        pconn->authorized = true;
     }
 
   if (statcode == HTTP_STATUS_GATEWAY_TIMEOUT)
@@ -3455,6 +3800,27 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
         }
     }
 
+#ifdef HAVE_LIBZ
+  /* Inflate a body sent compressed because we asked for that, unless
+     it is a compressed file to begin with, that some servers describe
+     as compressed content.  */
+  if (opt.compression == compression_auto && !hs->restval && !contrange
+      && resp_header_copy (resp, "Content-Encoding", hdrval, sizeof (hdrval)))
+    {
+      const char *ext = hs->local_file ? strrchr (hs->local_file, '.') : NULL;
+
+      if ((0 == c_strcasecmp (hdrval, "gzip")
+           || 0 == c_strcasecmp (hdrval, "x-gzip")
+           || 0 == c_strcasecmp (hdrval, "deflate"))
+          && !(type && (0 == c_strcasecmp (type, "application/gzip")
+                        || 0 == c_strcasecmp (type, "application/x-gzip")))
+          && !(ext && (0 == c_strcasecmp (ext, ".gz")
+                       || 0 == c_strcasecmp (ext, ".tgz")
+                       || 0 == c_strcasecmp (ext, ".svgz"))))
+        hs->decompress = true;
+    }
+#endif
+
   /* 20x responses are counted among successful by default.  */
   if (H_20X (statcode))
     *dt |= RETROKF;
@@ -3603,7 +3969,8 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
           /* Check if the local file is up-to-date based on Last-Modified header
              and content length.  */
           if (tmr != (time_t) - 1 && tmr <= hs->orig_file_tstamp
-              && (contlen == -1 || contlen == hs->orig_file_size))
+              && (contlen == -1 || hs->decompress
+                  || contlen == hs->orig_file_size))
             {
               logprintf (LOG_VERBOSE,
                          _("Server ignored If-Modified-Since header for file %s.\n"
@@ -3650,7 +4017,8 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
       retval = RANGEERR;
       goto cleanup;
     }
-  if (contlen == -1)
+  /* The length of the decompressed body is unknown.  */
+  if (contlen == -1 || hs->decompress)
     hs->contlen = -1;
   else
     hs->contlen = contlen + contrange;
@@ -3750,11 +4118,18 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
       goto cleanup;
     }
 
+  /* Recursion will want the links of an HTML page; find them while
+     it arrives rather than reading the file back afterwards.  */
+  if ((opt.recursive || opt.page_requisites) && (*dt & TEXTHTML)
+      && hs->restval == 0 && !output_stream && opt.parallel <= 1)
+    html_stream_begin (hs->local_file, u->url);
+
   err = read_response_body (hs, sock, fp, contlen, contrange,
                             chunked_transfer_encoding,
                             u->url, warc_timestamp_str,
                             warc_request_uuid, warc_ip, type,
                             statcode, head);
+  html_stream_end (err == RETRFINISHED && hs->res >= 0);
 
   if (hs->res >= 0)
     CLOSE_FINISH (sock);
@@ -3776,6 +4151,622 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
   return retval;
 }
 
+#ifdef SEGMENTED_RETRIEVAL
+/* --segments support.  A large file is retrieved as several byte
+   ranges at the same time, each by a child process with a connection
+   of its own, so that the transfer is not limited by what a single
+   TCP connection achieves on a long fat link.  The children write
+   their ranges in place to the output file, which is created with its
+   final size, and report each write to the parent.  The parent
+   records how much of each range is done in a state file next to the
+   output file, so that an interrupted retrieval can pick up where
+   each range left off.  */
+
+/* Don't split a file into ranges smaller than this.  */
+#define SEGMENT_MIN_SIZE (1024 * 1024)
+
+/* Suffix of the state file.  */
+#define SEGMENTS_SFX ".wget-segments"
+
+/* Exit statuses of a segment process, besides 0 for success and 1 for
+   a failure worth retrying.  */
+#define SEGMENT_WRITE_ERROR 2
+#define SEGMENT_CHANGED 3
+
+struct segment {
+  wgint next;                   /* the next byte to retrieve */
+  wgint last;                   /* the last byte of the range */
+  pid_t pid;                    /* the process retrieving it, or 0 */
+  bool exiting;                 /* whether the process is about to exit */
+  int tries;                    /* how many times it was started */
+};
+
+/* What a segment process writes to the parent's pipe after writing
+   some bytes to the file, and with WRITTEN set to 0 just before it
+   exits.  This is small enough for the write to the pipe to be
+   atomic.  */
+struct segment_report {
+  int index;
+  wgint written;
+};
+
+/* Request bytes FIRST to LAST of U with REFERER, through PROXY if it
+   is non-NULL, and read the head of the response.  If the server
+   sends just these bytes, return the socket to read them from, and
+   store the length of the whole file to *TOTAL.  Otherwise, return
+   -1.  If TYPE and REMOTE_TIME are non-NULL, store there the
+   Content-Type and Last-Modified headers, if any.  */
+
+static int
+segment_open (struct url *u, struct url *proxy, const char *referer,
+              wgint first, wgint last, wgint *total,
+              char **type, char **remote_time)
+{
+  struct http_stat hs;
+  struct request *req;
+  struct response *resp;
+  struct url *conn = u;
+  char *user, *passwd, *head, *message = NULL, *proxyauth = NULL;
+  char hdrval[256];
+  bool basic_auth_finished = false, using_ssl = false, ok;
+  wgint body_data_size = 0, first_byte, last_byte, length;
+  int dt = opt.allow_cache ? 0 : SEND_NOCACHE;
+  int sock = -1, statcode;
+  uerr_t err;
+
+  timing_request_begin (u->url);
+  xzero (hs);
+  hs.referer = referer;
+  req = initialize_request (u, &hs, &dt, proxy, true, &basic_auth_finished,
+                            &body_data_size, &user, &passwd, &err);
+  if (!req)
+    return -1;
+  request_set_header (req, "Range",
+                      aprintf ("bytes=%s-%s", number_to_static_string (first),
+                               number_to_static_string (last)),
+                      rel_value);
+  request_set_header (req, "Accept-Encoding", "identity", rel_none);
+  request_set_cookie_and_user_headers (req, u);
+  if (proxy)
+    {
+      conn = proxy;
+      initialize_proxy_configuration (u, req, proxy, &proxyauth);
+    }
+
+  err = establish_connection (u, &conn, &hs, proxy, &proxyauth, &req,
+                              &using_ssl, true, &sock);
+  xfree (hs.message);
+  if (err != RETROK)
+    {
+      request_free (&req);
+      return -1;
+    }
+  timing_phase_begin (TIMING_FIRST_BYTE);
+  if (request_send (req, sock, NULL) < 0
+      || (head = read_http_response_head (sock)) == NULL)
+    {
+      request_free (&req);
+      fd_close (sock);
+      return -1;
+    }
+  timing_phase_end (TIMING_FIRST_BYTE);
+  request_free (&req);
+  DEBUGP (("\n---response begin---\n%s---response end---\n", head));
+
+  resp = resp_new (head);
+  statcode = resp_status (resp, &message);
+  timing_request_status (statcode);
+  ok = (statcode == HTTP_STATUS_PARTIAL_CONTENTS
+        && !resp_header_copy (resp, "Transfer-Encoding", NULL, 0)
+        && resp_header_copy (resp, "Content-Range", hdrval, sizeof (hdrval))
+        && parse_content_range (hdrval, &first_byte, &last_byte, &length)
+        && first_byte == first && last_byte == last && length > last);
+  if (ok)
+    {
+      *total = length;
+      if (type)
+        *type = resp_header_strdup (resp, "Content-Type");
+      if (remote_time)
+        *remote_time = resp_header_strdup (resp, "Last-Modified");
+    }
+  xfree (message);
+  resp_free (&resp);
+  xfree (head);
+  if (!ok)
+    {
+      fd_close (sock);
+      return -1;
+    }
+  return sock;
+}
+
+/* Retrieve bytes FIRST to LAST of U, which must be TOTAL bytes long,
+   and write them to FD at the same offset.  Metalink uses this to get
+   the pieces of a file from several mirrors.  */
+
+uerr_t
+http_retrieve_range (struct url *u, wgint first, wgint last, wgint total,
+                     int fd)
+{
+  char buf[16 * 1024];
+  wgint length;
+  uerr_t err = RETROK;
+  int sock;
+
+  if (opt.cookies)
+    load_cookies ();
+  sock = segment_open (u, NULL, NULL, first, last, &length, NULL, NULL);
+  if (sock < 0 || length != total)
+    {
+      if (sock >= 0)
+        fd_close (sock);
+      timing_request_end ();
+      return RANGEERR;
+    }
+  timing_phase_begin (TIMING_BODY);
+  while (first <= last)
+    {
+      int n = fd_read (sock, buf, MIN (sizeof (buf), last - first + 1), -1);
+      bool write_ok;
+
+      if (n <= 0)
+        {
+          err = READERR;
+          break;
+        }
+      timing_request_bytes (n);
+      timing_phase_begin (TIMING_WRITE);
+      write_ok = pwrite (fd, buf, n, first) == n;
+      timing_phase_end (TIMING_WRITE);
+      if (!write_ok)
+        {
+          err = FWRITEERR;
+          break;
+        }
+      first += n;
+    }
+  fd_close (sock);
+  timing_request_end ();
+  return err;
+}
+
+/* Retrieve SEG, the segment INDEX of the TOTAL bytes of U, and write
+   it to FD at offset BASE.  Report each write to REPORT.  HS is the
+   state of the whole retrieval.  This runs in a child process, and
+   does not return.  */
+
+static void
+segment_run (struct url *u, struct url *proxy, const struct http_stat *hs,
+             struct segment *seg, int index, wgint total,
+             int fd, wgint base, int report)
+{
+  char buf[16 * 1024];
+  struct segment_report r;
+  wgint length;
+  int sock, status = 1;
+
+  /* The persistent connections belong to the parent, and so does the
+     "Connecting to" chatter.  */
+  http_forget_persistent ();
+  opt.verbose = false;
+
+  r.index = index;
+  sock = segment_open (u, proxy, hs->referer, seg->next, seg->last,
+                       &length, NULL, NULL);
+  if (sock >= 0 && length != total)
+    status = SEGMENT_CHANGED;
+  else if (sock >= 0)
+    {
+      timing_phase_begin (TIMING_BODY);
+      while (seg->next <= seg->last)
+        {
+          int n = fd_read (sock, buf, MIN (sizeof (buf),
+                                           seg->last - seg->next + 1), -1);
+          bool write_ok;
+
+          if (n <= 0)
+            break;
+          timing_request_bytes (n);
+          timing_phase_begin (TIMING_WRITE);
+          write_ok = pwrite (fd, buf, n, base + seg->next) == n;
+          timing_phase_end (TIMING_WRITE);
+          if (!write_ok)
+            {
+              logprintf (LOG_NOTQUIET, _("Cannot write to %s (%s).\n"),
+                         quote (hs->local_file), strerror (errno));
+              logflush ();
+              status = SEGMENT_WRITE_ERROR;
+              break;
+            }
+          seg->next += n;
+          r.written = n;
+          if (write (report, &r, sizeof (r)) != sizeof (r))
+            break;
+        }
+      if (seg->next > seg->last)
+        status = 0;
+    }
+  if (sock >= 0)
+    fd_close (sock);
+  timing_request_end ();
+
+  r.written = 0;
+  if (write (report, &r, sizeof (r)) != sizeof (r))
+    status = 1;
+  _exit (status);
+}
+
+/* Return the first byte of range I of the COUNT ranges a file of TOTAL
+   bytes is split into, or TOTAL if I is COUNT.  */
+
+static wgint
+segment_start (int i, int count, wgint total)
+{
+  return i == count ? total : total / count * i;
+}
+
+/* Read the state file STATE, and return the COUNT segments it records
+   for a file of TOTAL bytes.  Return NULL if STATE can't be read, is
+   about another file, or records other ranges than the COUNT ones the
+   file is split into.  */
+
+static struct segment *
+segments_load (const char *state, wgint total, int count)
+{
+  struct segment *segs = NULL;
+  char line[128], *p;
+  int i = 0;
+  FILE *fp;
+
+  fp = fopen (state, "r");
+  if (!fp)
+    return NULL;
+  if (fgets (line, sizeof (line), fp)
+      && str_to_wgint (line, &p, 10) == total
+      && strtol (p, &p, 10) == count)
+    {
+      segs = xnew_array (struct segment, count);
+      for (i = 0; i < count && fgets (line, sizeof (line), fp); i++)
+        {
+          xzero (segs[i]);
+          segs[i].next = str_to_wgint (line, &p, 10);
+          segs[i].last = str_to_wgint (p, &p, 10);
+          if (segs[i].next < segment_start (i, count, total)
+              || segs[i].last != segment_start (i + 1, count, total) - 1
+              || segs[i].next > segs[i].last + 1)
+            break;
+        }
+    }
+  fclose (fp);
+  if (!segs || i < count)
+    {
+      xfree (segs);
+      return NULL;
+    }
+  return segs;
+}
+
+/* Write the COUNT segments SEGS of a file of TOTAL bytes to the state
+   file STATE.  */
+
+static void
+segments_save (const char *state, wgint total,
+               const struct segment *segs, int count)
+{
+  FILE *fp = fopen (state, "w");
+  int i;
+
+  if (!fp)
+    return;
+  fprintf (fp, "%s %d\n", number_to_static_string (total), count);
+  for (i = 0; i < count; i++)
+    fprintf (fp, "%s %s\n", number_to_static_string (segs[i].next),
+             number_to_static_string (segs[i].last));
+  fclose (fp);
+}
+
+/* Wait up to WAIT seconds for reports on FD, read those that have
+   arrived, and account for them in SEGS and *DONE.  */
+
+static void
+segments_read_reports (int fd, int wait, struct segment *segs, wgint *done)
+{
+  struct segment_report r[64];
+  struct timeval tv;
+  fd_set rfds;
+  int i, n;
+
+  tv.tv_sec = wait;
+  tv.tv_usec = 0;
+  for (;;)
+    {
+      FD_ZERO (&rfds);
+      FD_SET (fd, &rfds);
+      if (select (fd + 1, &rfds, NULL, NULL, &tv) <= 0)
+        break;
+      n = read (fd, r, sizeof (r));
+      if (n <= 0)
+        break;
+      for (i = 0; i < n / (int) sizeof (r[0]); i++)
+        {
+          segs[r[i].index].next += r[i].written;
+          segs[r[i].index].exiting |= r[i].written == 0;
+          *done += r[i].written;
+        }
+      tv.tv_sec = tv.tv_usec = 0;
+    }
+}
+
+/* Retrieve U in segments if --segments is given and U is worth it.
+   Return false if U is to be retrieved the usual way.  Otherwise, fill
+   HS and DT like gethttp would, and store the outcome to *RET.  */
+
+static bool
+segmented_retrieve (struct url *u, struct url *proxy,
+                    struct http_stat *hs, int *dt, uerr_t *ret)
+{
+  struct segment *segs = NULL;
+  struct ptimer *timer;
+  void *progress = NULL;
+  char *state = NULL, *type = NULL, *remote_time = NULL;
+  wgint total, base = 0, done = 0, start, shown;
+  double now, last_save = 0;
+  int count, running = 0, fd, fds[2], sock, i;
+  uerr_t err = RETROK;
+
+  if (opt.segments < 2 || opt.spider || opt.timestamping || opt.method
+      || opt.start_pos >= 0 || opt.content_disposition || opt.limit_rate
+      || opt.warc_filename)
+    return false;
+
+  if (opt.output_document)
+    {
+      /* Write at the current position of the output stream.  The
+         ranges can't be tracked across runs then.  */
+      if (!output_stream || !output_stream_regular)
+        return false;
+    }
+  else
+    {
+      state = concat_strings (hs->local_file, SEGMENTS_SFX, (char *) 0);
+      if (file_exists_p (hs->local_file)
+          && !(opt.always_rest && file_exists_p (state)))
+        {
+          /* Let the usual rules for existing files apply.  Only -c
+             picks up the ranges an earlier run left off.  */
+          xfree (state);
+          return false;
+        }
+    }
+
+  sock = segment_open (u, proxy, hs->referer, 0, 0, &total,
+                       &type, &remote_time);
+  if (sock >= 0)
+    fd_close (sock);
+  timing_request_end ();
+  if (sock < 0 || total < 2 * SEGMENT_MIN_SIZE
+      || (type && (0 == strncasecmp (type, TEXTHTML_S, strlen (TEXTHTML_S))
+                   || 0 == strncasecmp (type, TEXTCSS_S,
+                                        strlen (TEXTCSS_S)))))
+    {
+      /* The server doesn't do ranges, or the file is too small to be
+         split, or it is to be parsed for links.  */
+      xfree (state);
+      xfree (type);
+      xfree (remote_time);
+      return false;
+    }
+  xfree (type);
+
+  count = MIN (opt.segments, total / SEGMENT_MIN_SIZE);
+  if (state && file_exists_p (hs->local_file))
+    segs = segments_load (state, total, count);
+  if (segs)
+    {
+      for (i = 0; i < count; i++)
+        done -= segs[i].last + 1 - segs[i].next;
+      done += total;
+      logprintf (LOG_VERBOSE, _("Resuming from %s.\n"), quote (state));
+    }
+  else
+    {
+      segs = xnew0_array (struct segment, count);
+      for (i = 0; i < count; i++)
+        {
+          segs[i].next = segment_start (i, count, total);
+          segs[i].last = segment_start (i + 1, count, total) - 1;
+        }
+    }
+  start = shown = done;
+
+  if (opt.output_document)
+    {
+      fflush (output_stream);
+      fd = fileno (output_stream);
+      base = ftello (output_stream);
+    }
+  else
+    {
+      mkalldirs (hs->local_file);
+      fd = open (hs->local_file, O_WRONLY | O_CREAT, 0666);
+    }
+  /* Give the file its final size right away, so that the ranges can
+     be written in any order.  */
+  if (fd < 0 || ftruncate (fd, base + total) < 0 || pipe (fds) < 0)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot write to %s (%s).\n"),
+                 quote (hs->local_file), strerror (errno));
+      if (fd >= 0 && !opt.output_document)
+        close (fd);
+      xfree (segs);
+      xfree (state);
+      xfree (remote_time);
+      *ret = FOPENERR;
+      return true;
+    }
+
+  /* Record the segments before writing anything, so that an
+     interrupted retrieval is never mistaken for a complete file.  */
+  if (state)
+    segments_save (state, total, segs, count);
+
+  logprintf (LOG_VERBOSE, _("Length: %s, retrieving %d segments.\n"),
+             number_to_static_string (total), count);
+  logprintf (LOG_VERBOSE, _("Saving to: %s\n"), quote (hs->local_file));
+
+  timer = ptimer_new ();
+  if (opt.show_progress)
+    {
+      const char *name = hs->local_file;
+      if (opt.dir_prefix && !opt.output_document)
+        name += strlen (opt.dir_prefix) + 1;
+      progress = progress_create (name, done, total);
+    }
+
+  for (;;)
+    {
+      /* Start the segments that are neither done nor running.  */
+      for (i = 0; i < count && err == RETROK; i++)
+        if (!segs[i].pid && segs[i].next <= segs[i].last)
+          {
+            pid_t pid;
+
+            if (opt.ntry && segs[i].tries >= opt.ntry)
+              {
+                err = READERR;
+                break;
+              }
+            if (segs[i].tries)
+              {
+                DEBUGP (("Restarting segment %d at byte %s.\n", i,
+                         number_to_static_string (segs[i].next)));
+                sleep_between_retrievals (segs[i].tries + 1);
+              }
+            ++segs[i].tries;
+            logflush ();
+            pid = fork ();
+            if (pid == 0)
+              {
+                close (fds[0]);
+                segment_run (u, proxy, hs, &segs[i], i, total,
+                             fd, base, fds[1]);
+              }
+            if (pid < 0)
+              {
+                logprintf (LOG_NOTQUIET, "fork: %s\n", strerror (errno));
+                err = READERR;
+                break;
+              }
+            segs[i].pid = pid;
+            ++running;
+          }
+      if (err != RETROK)
+        for (i = 0; i < count; i++)
+          if (segs[i].pid)
+            kill (segs[i].pid, SIGTERM);
+      if (!running)
+        break;
+
+      /* Don't wait for reports when a process is known to exit.  */
+      for (i = 0; i < count && !segs[i].exiting; i++)
+        ;
+      segments_read_reports (fds[0], i == count, segs, &done);
+
+      for (i = 0; i < count; i++)
+        {
+          int status;
+
+          if (!segs[i].pid
+              || waitpid (segs[i].pid, &status,
+                          segs[i].exiting ? 0 : WNOHANG) <= 0)
+            continue;
+          /* Account for what it wrote before exiting.  */
+          segments_read_reports (fds[0], 0, segs, &done);
+          segs[i].pid = 0;
+          segs[i].exiting = false;
+          --running;
+          if (WIFEXITED (status)
+              && WEXITSTATUS (status) == SEGMENT_WRITE_ERROR)
+            err = FWRITEERR;
+          else if (WIFEXITED (status)
+                   && WEXITSTATUS (status) == SEGMENT_CHANGED)
+            {
+              logputs (LOG_NOTQUIET,
+                       _("The file changed on the server during the "
+                         "retrieval.\n"));
+              err = RANGEERR;
+            }
+        }
+
+      now = ptimer_measure (timer);
+      if (progress)
+        {
+          progress_update (progress, done - shown, now);
+          shown = done;
+        }
+      if (state && now - last_save >= 1)
+        {
+          segments_save (state, total, segs, count);
+          last_save = now;
+        }
+    }
+
+  close (fds[0]);
+  close (fds[1]);
+  if (!opt.output_document)
+    close (fd);
+  else
+    fseeko (output_stream, base + total, SEEK_SET);
+
+  hs->dltime = ptimer_measure (timer);
+  ptimer_destroy (timer);
+  if (progress)
+    progress_finish (progress, hs->dltime);
+  hs->rd_size = done - start;
+  total_downloaded_bytes += hs->rd_size;
+  total_download_time += hs->dltime;
+
+  if (done == total && err == RETROK)
+    {
+      if (state)
+        unlink (state);
+      hs->len = hs->contlen = total;
+      *dt |= RETROKF;
+      logprintf (LOG_VERBOSE, _("%s (%s) - %s saved [%s/%s]\n\n"),
+                 datetime_str (time (NULL)),
+                 retr_rate (hs->rd_size, hs->dltime),
+                 quote (hs->local_file), number_to_static_string (total),
+                 number_to_static_string (total));
+      logprintf (LOG_NONVERBOSE, "%s URL:%s [%s/%s] -> \"%s\" [%d]\n",
+                 datetime_str (time (NULL)), u->url,
+                 number_to_static_string (total),
+                 number_to_static_string (total), hs->local_file, 1);
+      ++numurls;
+      downloaded_file (FILE_DOWNLOADED_NORMALLY, hs->local_file);
+      if (!opt.output_document && opt.useservertimestamps && remote_time)
+        {
+          time_t tm = http_atotm (remote_time);
+          if (tm != (time_t) -1)
+            touch (hs->local_file, tm);
+        }
+    }
+  else
+    {
+      if (state)
+        segments_save (state, total, segs, count);
+      logputs (LOG_VERBOSE, _("Giving up.\n\n"));
+      if (err == RETROK)
+        err = READERR;
+    }
+  *ret = err;
+
+  xfree (segs);
+  xfree (state);
+  xfree (remote_time);
+  return true;
+}
+#endif /* SEGMENTED_RETRIEVAL */
+
 /* The genuine HTTP loop!  This is the part where the retrieval is
    retried, and retried, and retried, and...  */
 uerr_t
@@ -3928,6 +4919,14 @@ http_loop (struct url *u, struct url *original_url, char **newloc,
           xfree (hurl);
         }
 
+#ifdef SEGMENTED_RETRIEVAL
+      /* Large files may be retrieved as several ranges at once, which
+         does its own retries.  */
+      if (count == 1 && got_name && !send_head_first
+          && segmented_retrieve (u, proxy, &hstat, dt, &ret))
+        goto exit;
+#endif
+
       /* Default document type is empty.  However, if spider mode is
          on or time-stamping is employed, HEAD_ONLY commands is
          encoded within *dt.  */
@@ -3969,6 +4968,7 @@ http_loop (struct url *u, struct url *original_url, char **newloc,
 
       /* Try fetching the document, or at least its head.  */
       err = gethttp (u, &hstat, dt, proxy, iri, count);
+      timing_request_end ();
 
       /* Time?  */
       tms = datetime_str (time (NULL));
@@ -4818,12 +5818,15 @@ create_authorization_line (const char *au, const char *user,
 #endif
 #ifdef ENABLE_NTLM
     case 'N':                   /* NTLM */
-      if (!ntlm_input (&pconn.ntlm, au))
-        {
-          *finished = true;
-          return NULL;
-        }
-      return ntlm_output (&pconn.ntlm, user, passwd, finished);
+      {
+        struct ntlmdata *ntlm = pconn ? &pconn->ntlm : &ntlm_uncached;
+        if (!ntlm_input (ntlm, au))
+          {
+            *finished = true;
+            return NULL;
+          }
+        return ntlm_output (ntlm, user, passwd, finished);
+      }
 #endif
     default:
       /* We shouldn't get here -- this function should be only called
@@ -4851,10 +5854,22 @@ save_cookies (void)
     cookie_jar_save (wget_cookie_jar, opt.cookies_output);
 }
 
+/* Handle the Set-Cookie header SET_COOKIE as if it had been received
+   from HOST:PORT for PATH.  This is how the cookies received by
+   --parallel workers end up in our jar.  */
+
+void
+http_set_cookie (const char *host, int port, const char *path,
+                 const char *set_cookie)
+{
+  load_cookies ();
+  cookie_handle_set_cookie (wget_cookie_jar, host, port, path, set_cookie);
+}
+
 void
 http_cleanup (void)
 {
-  xfree (pconn.host);
+  http_forget_persistent ();
   if (wget_cookie_jar)
     cookie_jar_delete (wget_cookie_jar);
 }
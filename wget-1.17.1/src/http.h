@@ -38,6 +38,15 @@ struct url;
 uerr_t http_loop (struct url *, struct url *, char **, char **, const char *,
                   int *, struct url *, struct iri *);
 void save_cookies (void);
+void http_set_cookie (const char *, int, const char *, const char *);
+void http_forget_persistent (void);
+typedef const char *(*http_upcoming_fn) (int, const char **);
+void http_set_upcoming (http_upcoming_fn);
+#if !defined(WINDOWS) && !defined(MSDOS)
+/* Files can be retrieved as several byte ranges at a time.  */
+# define SEGMENTED_RETRIEVAL
+uerr_t http_retrieve_range (struct url *, wgint, wgint, wgint, int);
+#endif
 void http_cleanup (void);
 time_t http_atotm (const char *);
 
@@ -97,6 +97,9 @@ CMD_DECLARE (cmd_directory);
 CMD_DECLARE (cmd_time);
 CMD_DECLARE (cmd_vector);
 
+#ifdef HAVE_LIBZ
+CMD_DECLARE (cmd_spec_compression);
+#endif
 CMD_DECLARE (cmd_spec_dirstruct);
 CMD_DECLARE (cmd_spec_header);
 CMD_DECLARE (cmd_spec_warc_header);
@@ -156,6 +159,9 @@ static const struct {
   { "checkcertificate", &opt.check_cert,        cmd_check_cert },
 #endif
   { "chooseconfig",     &opt.choose_config,     cmd_file },
+#ifdef HAVE_LIBZ
+  { "compression",      NULL,                   cmd_spec_compression },
+#endif
   { "connecttimeout",   &opt.connect_timeout,   cmd_time },
   { "contentdisposition", &opt.content_disposition, cmd_boolean },
   { "contentonerror",   &opt.content_on_error,  cmd_boolean },
@@ -173,6 +179,9 @@ static const struct {
   { "dirprefix",        &opt.dir_prefix,        cmd_directory },
   { "dirstruct",        NULL,                   cmd_spec_dirstruct },
   { "dnscache",         &opt.dns_cache,         cmd_boolean },
+  { "dnscachefile",     &opt.dns_cache_file,    cmd_file },
+  { "dnscachettl",      &opt.dns_cache_ttl,     cmd_time },
+  { "dnsprefetch",      &opt.dns_prefetch,      cmd_number },
   { "dnstimeout",       &opt.dns_timeout,       cmd_time },
   { "domains",          &opt.domains,           cmd_vector },
   { "dotbytes",         &opt.dot_bytes,         cmd_bytes },
@@ -187,6 +196,8 @@ static const struct {
   { "followftp",        &opt.follow_ftp,        cmd_boolean },
   { "followtags",       &opt.follow_tags,       cmd_vector },
   { "forcehtml",        &opt.force_html,        cmd_boolean },
+  { "frontierfile",     &opt.frontier_file,     cmd_file },
+  { "frontiermemory",   &opt.frontier_memory,   cmd_bytes },
   { "ftppasswd",        &opt.ftp_passwd,        cmd_string }, /* deprecated */
   { "ftppassword",      &opt.ftp_passwd,        cmd_string },
   { "ftpproxy",         &opt.ftp_proxy,         cmd_string },
@@ -251,9 +262,12 @@ static const struct {
   { "numtries",         &opt.ntry,              cmd_number_inf },/* deprecated*/
   { "outputdocument",   &opt.output_document,   cmd_file },
   { "pagerequisites",   &opt.page_requisites,   cmd_boolean },
+  { "parallel",         &opt.parallel,          cmd_number },
+  { "parallelperhost",  &opt.parallel_per_host, cmd_number },
   { "passiveftp",       &opt.ftp_pasv,          cmd_boolean },
   { "passwd",           &opt.ftp_passwd,        cmd_string },/* deprecated*/
   { "password",         &opt.passwd,            cmd_string },
+  { "pipeline",         &opt.pipeline,          cmd_number },
   { "postdata",         &opt.post_data,         cmd_string },
   { "postfile",         &opt.post_file_name,    cmd_file },
   { "preferfamily",     NULL,                   cmd_spec_prefer_family },
@@ -297,6 +311,7 @@ static const struct {
 #ifdef HAVE_SSL
   { "secureprotocol",   &opt.secure_protocol,   cmd_spec_secure_protocol },
 #endif
+  { "segments",         &opt.segments,          cmd_number },
   { "serverresponse",   &opt.server_response,   cmd_boolean },
   { "showalldnsentries", &opt.show_all_dns_entries, cmd_boolean },
   { "showprogress",     &opt.show_progress,     cmd_spec_progressdisp },
@@ -306,6 +321,7 @@ static const struct {
   { "strictcomments",   &opt.strict_comments,   cmd_boolean },
   { "timeout",          NULL,                   cmd_spec_timeout },
   { "timestamping",     &opt.timestamping,      cmd_boolean },
+  { "timinglog",        &opt.timing_log,        cmd_file },
   { "tries",            &opt.ntry,              cmd_number_inf },
   { "trustservernames", &opt.trustservernames,  cmd_boolean },
   { "unlink",           &opt.unlink,            cmd_boolean },
@@ -318,6 +334,7 @@ static const struct {
   { "waitretry",        &opt.waitretry,         cmd_time },
   { "warccdx",          &opt.warc_cdx_enabled,  cmd_boolean },
   { "warccdxdedup",     &opt.warc_cdx_dedup_filename,  cmd_file },
+  { "warccdxdedupindex", &opt.warc_cdx_dedup_index, cmd_file },
 #ifdef HAVE_LIBZ
   { "warccompression",  &opt.warc_compression_enabled, cmd_boolean },
 #endif
@@ -384,6 +401,9 @@ defaults (void)
   if (tmp)
     opt.no_proxy = sepstring (tmp);
   opt.prefer_family = prefer_none;
+#ifdef HAVE_LIBZ
+  opt.compression = compression_none;
+#endif
   opt.allow_cache = true;
   opt.if_modified_since = true;
 
@@ -397,6 +417,7 @@ defaults (void)
   opt.dots_in_line = 50;
 
   opt.dns_cache = true;
+  opt.dns_cache_ttl = 300;
   opt.ftp_pasv = true;
   /* 2014-09-07  Darshit Shah  <darnir@gmail.com>
    * opt.retr_symlinks is set to true by default. Creating symbolic links on the
@@ -461,6 +482,7 @@ defaults (void)
   opt.warc_digests_enabled = true;
   opt.warc_cdx_enabled = false;
   opt.warc_cdx_dedup_filename = NULL;
+  opt.warc_cdx_dedup_index = NULL;
   opt.warc_tempdir = NULL;
   opt.warc_keep_log = true;
 
@@ -1383,6 +1405,26 @@ cmd_cert_type (const char *com, const char *val, void *place)
 
 static bool check_user_specified_header (const char *);
 
+#ifdef HAVE_LIBZ
+/* Validate --compression and set the choice.  Allowed values are
+   "auto" and "none".  */
+
+static bool
+cmd_spec_compression (const char *com, const char *val, void *place_ignored _GL_UNUSED)
+{
+  static const struct decode_item choices[] = {
+    { "auto", compression_auto },
+    { "none", compression_none },
+  };
+  int compression = compression_none;
+  int ok = decode_string (val, choices, countof (choices), &compression);
+  if (!ok)
+    fprintf (stderr, _("%s: %s: Invalid value %s.\n"), exec_name, com, quote (val));
+  opt.compression = compression;
+  return ok;
+}
+#endif
+
 static bool
 cmd_spec_dirstruct (const char *com, const char *val, void *place_ignored _GL_UNUSED)
 {
@@ -1873,6 +1915,7 @@ cleanup (void)
 
   xfree (opt.choose_config);
   xfree (opt.lfilename);
+  xfree (opt.timing_log);
   xfree (opt.dir_prefix);
   xfree (opt.input_filename);
 #ifdef HAVE_METALINK
@@ -1911,6 +1954,8 @@ cleanup (void)
 # endif
   xfree (opt.bind_address);
   xfree (opt.cookies_input);
+  xfree (opt.dns_cache_file);
+  xfree (opt.frontier_file);
   xfree (opt.cookies_output);
   xfree (opt.user);
   xfree (opt.passwd);
@@ -343,6 +343,17 @@ log_set_warc_log_fp (FILE * fp)
   warclogfp = fp;
 }
 
+/* Sends the log to FP from now on.  A --parallel worker uses this to
+   collect its messages for the main process, which copies them to
+   the real log.  */
+
+void
+log_set_fp (FILE *fp)
+{
+  logfp = fp;
+  save_context_p = false;
+}
+
 /* Log a literal string S.  The string is logged as-is, without a
    newline appended.  */
 
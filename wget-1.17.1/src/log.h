@@ -39,6 +39,7 @@ as that of the covered work.  */
 enum log_options { LOG_VERBOSE, LOG_NOTQUIET, LOG_NONVERBOSE, LOG_ALWAYS, LOG_PROGRESS };
 
 void log_set_warc_log_fp (FILE *);
+void log_set_fp (FILE *);
 
 void logprintf (enum log_options, const char *, ...)
      GCC_FORMAT_ATTR (2, 3);
@@ -53,6 +53,7 @@ as that of the covered work.  */
 #include "progress.h"           /* for progress_handle_sigwinch */
 #include "convert.h"
 #include "spider.h"
+#include "timing.h"
 #include "http.h"               /* for save_cookies */
 #include "hsts.h"               /* for initializing hsts_store to NULL */
 #include "ptimer.h"
@@ -261,6 +262,9 @@ static struct cmdline_option option_data[] =
     { IF_SSL ("certificate-type"), 0, OPT_VALUE, "certificatetype", -1 },
     { IF_SSL ("check-certificate"), 0, OPT_BOOLEAN, "checkcertificate", -1 },
     { "clobber", 0, OPT__CLOBBER, NULL, optional_argument },
+#ifdef HAVE_LIBZ
+    { "compression", 0, OPT_VALUE, "compression", -1 },
+#endif
     { "config", 0, OPT_VALUE, "chooseconfig", -1 },
     { "connect-timeout", 0, OPT_VALUE, "connecttimeout", -1 },
     { "continue", 'c', OPT_BOOLEAN, "continue", -1 },
@@ -277,6 +281,9 @@ static struct cmdline_option option_data[] =
     { "directories", 0, OPT_BOOLEAN, "dirstruct", -1 },
     { "directory-prefix", 'P', OPT_VALUE, "dirprefix", -1 },
     { "dns-cache", 0, OPT_BOOLEAN, "dnscache", -1 },
+    { "dns-cache-file", 0, OPT_VALUE, "dnscachefile", -1 },
+    { "dns-cache-ttl", 0, OPT_VALUE, "dnscachettl", -1 },
+    { "dns-prefetch", 0, OPT_VALUE, "dnsprefetch", -1 },
     { "dns-timeout", 0, OPT_VALUE, "dnstimeout", -1 },
     { "domains", 'D', OPT_VALUE, "domains", -1 },
     { "dont-remove-listing", 0, OPT__DONT_REMOVE_LISTING, NULL, no_argument },
@@ -289,6 +296,8 @@ static struct cmdline_option option_data[] =
     { "follow-tags", 0, OPT_VALUE, "followtags", -1 },
     { "force-directories", 'x', OPT_BOOLEAN, "dirstruct", -1 },
     { "force-html", 'F', OPT_BOOLEAN, "forcehtml", -1 },
+    { "frontier-file", 0, OPT_VALUE, "frontierfile", -1 },
+    { "frontier-memory", 0, OPT_VALUE, "frontiermemory", -1 },
     { "ftp-password", 0, OPT_VALUE, "ftppassword", -1 },
 #ifdef __VMS
     { "ftp-stmlf", 0, OPT_BOOLEAN, "ftpstmlf", -1 },
@@ -347,9 +356,12 @@ static struct cmdline_option option_data[] =
     { "output-document", 'O', OPT_VALUE, "outputdocument", -1 },
     { "output-file", 'o', OPT_VALUE, "logfile", -1 },
     { "page-requisites", 'p', OPT_BOOLEAN, "pagerequisites", -1 },
+    { "parallel", 0, OPT_VALUE, "parallel", -1 },
+    { "parallel-per-host", 0, OPT_VALUE, "parallelperhost", -1 },
     { "parent", 0, OPT__PARENT, NULL, optional_argument },
     { "passive-ftp", 0, OPT_BOOLEAN, "passiveftp", -1 },
     { "password", 0, OPT_VALUE, "password", -1 },
+    { "pipeline", 0, OPT_VALUE, "pipeline", -1 },
     { "post-data", 0, OPT_VALUE, "postdata", -1 },
     { "post-file", 0, OPT_VALUE, "postfile", -1 },
     { "prefer-family", 0, OPT_VALUE, "preferfamily", -1 },
@@ -387,6 +399,7 @@ static struct cmdline_option option_data[] =
     { "save-cookies", 0, OPT_VALUE, "savecookies", -1 },
     { "save-headers", 0, OPT_BOOLEAN, "saveheaders", -1 },
     { IF_SSL ("secure-protocol"), 0, OPT_VALUE, "secureprotocol", -1 },
+    { "segments", 0, OPT_VALUE, "segments", -1 },
     { "server-response", 'S', OPT_BOOLEAN, "serverresponse", -1 },
     { "span-hosts", 'H', OPT_BOOLEAN, "spanhosts", -1 },
     { "spider", 0, OPT_BOOLEAN, "spider", -1 },
@@ -394,6 +407,7 @@ static struct cmdline_option option_data[] =
     { "strict-comments", 0, OPT_BOOLEAN, "strictcomments", -1 },
     { "timeout", 'T', OPT_VALUE, "timeout", -1 },
     { "timestamping", 'N', OPT_BOOLEAN, "timestamping", -1 },
+    { "timing-log", 0, OPT_VALUE, "timinglog", -1 },
     { "if-modified-since", 0, OPT_BOOLEAN, "if-modified-since", -1 },
     { "tries", 't', OPT_VALUE, "tries", -1 },
     { "unlink", 0, OPT_BOOLEAN, "unlink", -1 },
@@ -411,6 +425,7 @@ static struct cmdline_option option_data[] =
     { "warc-compression", 0, OPT_BOOLEAN, "warccompression", -1 },
 #endif
     { "warc-dedup", 0, OPT_VALUE, "warccdxdedup", -1 },
+    { "warc-dedup-index", 0, OPT_VALUE, "warccdxdedupindex", -1 },
     { "warc-digests", 0, OPT_BOOLEAN, "warcdigests", -1 },
     { "warc-file", 0, OPT_VALUE, "warcfile", -1 },
     { "warc-header", 0, OPT_VALUE, "warcheader", -1 },
@@ -574,6 +589,8 @@ Logging and input file:\n"),
   -nv, --no-verbose                turn off verboseness, without being quiet\n"),
     N_("\
        --report-speed=TYPE         output bandwidth as TYPE.  TYPE can be bits\n"),
+    N_("\
+       --timing-log=FILE           log the phases of each HTTP request to FILE\n"),
     N_("\
   -i,  --input-file=FILE           download URLs found in local or external FILE\n"),
 #ifdef HAVE_METALINK
@@ -649,6 +666,12 @@ Download:\n"),
        --limit-rate=RATE           limit download rate to RATE\n"),
     N_("\
        --no-dns-cache              disable caching DNS lookups\n"),
+    N_("\
+       --dns-cache-file=FILE       keep DNS lookups in FILE between runs\n"),
+    N_("\
+       --dns-cache-ttl=SECS        keep DNS lookups in the file for SECS\n"),
+    N_("\
+       --dns-prefetch=N            look up queued hosts ahead with N processes\n"),
     N_("\
        --restrict-file-names=OS    restrict chars in file names to ones OS allows\n"),
     N_("\
@@ -731,6 +754,12 @@ HTTP options:\n"),
   -U,  --user-agent=AGENT          identify as AGENT instead of Wget/VERSION\n"),
     N_("\
        --no-http-keep-alive        disable HTTP keep-alive (persistent connections)\n"),
+    N_("\
+       --pipeline=N                send up to N requests ahead on persistent\n\
+                                     connections\n"),
+    N_("\
+       --segments=N                retrieve large files as N ranges at the\n\
+                                     same time\n"),
     N_("\
        --no-cookies                don't use cookies\n"),
     N_("\
@@ -754,6 +783,11 @@ HTTP options:\n"),
                                      choosing local file names (EXPERIMENTAL)\n"),
     N_("\
        --content-on-error          output the received content on server errors\n"),
+#ifdef HAVE_LIBZ
+    N_("\
+       --compression=TYPE          choose HTTP compression, one of auto and\n\
+                                     none (default)\n"),
+#endif
     N_("\
        --auth-no-challenge         send Basic HTTP authentication information\n\
                                      without first waiting for the server's\n\
@@ -853,6 +887,9 @@ WARC options:\n"),
        --warc-cdx                  write CDX index files\n"),
     N_("\
        --warc-dedup=FILENAME       do not store records listed in this CDX file\n"),
+    N_("\
+       --warc-dedup-index=FILE     look records up in this index of the CDX\n\
+                                   file, building it first if needed\n"),
 #ifdef HAVE_LIBZ
     N_("\
        --no-warc-compression       do not compress WARC files with GZIP\n"),
@@ -895,6 +932,15 @@ Recursive download:\n"),
   -p,  --page-requisites           get all images, etc. needed to display HTML page\n"),
     N_("\
        --strict-comments           turn on strict (SGML) handling of HTML comments\n"),
+    N_("\
+       --parallel=N                download up to N files at the same time\n"),
+    N_("\
+       --parallel-per-host=N       at most N of them from the same host\n"),
+    N_("\
+       --frontier-memory=SIZE      keep at most SIZE bytes of the queue in memory\n"),
+    N_("\
+       --frontier-file=FILE        keep the state of the crawl in FILE, to\n\
+                                     resume it if it is interrupted\n"),
     "\n",
 
     N_("\
@@ -1514,7 +1560,8 @@ for details.\n\n"));
           opt.always_rest = false;
           opt.start_pos = -1;
         }
-      if (opt.warc_cdx_dedup_filename != 0 && !opt.warc_digests_enabled)
+      if ((opt.warc_cdx_dedup_filename != 0 || opt.warc_cdx_dedup_index != 0)
+          && !opt.warc_digests_enabled)
         {
           fprintf (stderr,
                    _("Digests are disabled; WARC deduplication will "
@@ -1526,6 +1573,16 @@ for details.\n\n"));
         }
     }
 
+  if (opt.parallel > 1
+      && (opt.output_document || opt.warc_filename || opt.quota
+          || opt.wait || opt.random_wait))
+    {
+      fprintf (stderr,
+               _("--parallel does not work with -O, --warc-file, --quota,"
+                 " --wait or --random-wait, it will be disabled.\n"));
+      opt.parallel = 0;
+    }
+
   if (opt.ask_passwd && opt.passwd)
     {
       fprintf (stderr,
@@ -1713,6 +1770,9 @@ for details.\n\n"));
   if (opt.warc_filename != 0)
     warc_init ();
 
+  if (opt.timing_log)
+    timing_log_open ();
+
   DEBUGP (("DEBUG output created by Wget %s on %s.\n\n",
            version_string, OS_TYPE));
 
@@ -1818,6 +1878,18 @@ only if outputting to a regular file.\n"));
     load_hsts ();
 #endif
 
+  /* When a recursive retrieval is all there is to do, the links of
+     the files can be converted as soon as they are known to point to
+     downloaded files or not, instead of at the end.  */
+  if ((opt.convert_links || opt.convert_file_only) && !opt.delete_after
+      && (opt.recursive || opt.page_requisites)
+      && nurl == 1 && !opt.input_filename
+#ifdef HAVE_METALINK
+      && !opt.input_metalink
+#endif
+      )
+    convert_incremental = true;
+
   /* Retrieve the URLs from argument list.  */
   for (t = url; *t; t++)
     {
@@ -1985,6 +2057,12 @@ only if outputting to a regular file.\n"));
   if (opt.cookies_output)
     save_cookies ();
 
+  if (opt.dns_cache_file)
+    host_save_cache ();
+
+  if (opt.timing_log)
+    timing_log_summary ();
+
 #ifdef HAVE_HSTS
   if (opt.hsts && hsts_store)
     save_hsts ();
@@ -34,11 +34,21 @@ as that of the covered work.  */
 #include "retr.h"
 #include "exits.h"
 #include "utils.h"
+#include "http.h"
+#include "progress.h"
+#include "ptimer.h"
+#include "sha1.h"
 #include "sha256.h"
 #include "xstrndup.h"
 #include <errno.h>
 #include <unistd.h> /* For unlink.  */
 #include <metalink/metalink_parser.h>
+#ifdef SEGMENTED_RETRIEVAL
+# include <fcntl.h>
+# include <signal.h>
+# include <sys/select.h>
+# include <sys/wait.h>
+#endif
 #ifdef HAVE_GPGME
 #include <gpgme.h>
 #include <fcntl.h> /* For open and close.  */
@@ -48,6 +58,346 @@ as that of the covered work.  */
 #include "test.h"
 #endif
 
+#ifdef SEGMENTED_RETRIEVAL
+/* With --segments, a file whose Metalink gives a hash for each piece
+   is retrieved a piece at a time from several HTTP mirrors at once,
+   each piece by a child process.  The parent checks each piece as
+   soon as it is written, and a piece that doesn't match its hash is
+   retrieved again from another mirror, so that a bad mirror costs a
+   piece rather than the whole file.  */
+
+/* Stop asking a mirror for pieces after this many failures.  */
+#define MIRROR_MAX_FAILURES 3
+
+struct piece_mirror {
+  const char *name;             /* the URL as given in the Metalink */
+  struct url *url;
+  int failures;                 /* how many pieces it failed */
+};
+
+struct piece {
+  int mirror;                   /* the mirror to retrieve it from */
+  int tries;                    /* how many mirrors were tried */
+  pid_t pid;                    /* the process retrieving it, or 0 */
+  bool exiting;                 /* whether the process is about to exit */
+  bool done;                    /* whether it matches its hash */
+};
+
+static bool
+hash_type_sha1 (const char *type)
+{
+  return !strcasecmp (type, "sha1") || !strcasecmp (type, "sha-1");
+}
+
+static bool
+hash_type_sha256 (const char *type)
+{
+  return !strcasecmp (type, "sha256") || !strcasecmp (type, "sha-256");
+}
+
+/* Check that the LENGTH bytes of FD at OFFSET have the hash HASH of
+   TYPE.  */
+
+static bool
+piece_hash_ok (int fd, wgint offset, int length,
+               const char *type, const char *hash)
+{
+  char digest[SHA256_DIGEST_SIZE];
+  char digest_txt[2 * SHA256_DIGEST_SIZE + 1];
+  char *buf = xmalloc (length);
+  bool ok = false;
+
+  if (pread (fd, buf, length, offset) == length)
+    {
+      if (hash_type_sha1 (type))
+        {
+          sha1_buffer (buf, length, digest);
+          wg_hex_to_string (digest_txt, digest, SHA1_DIGEST_SIZE);
+        }
+      else
+        {
+          sha256_buffer (buf, length, digest);
+          wg_hex_to_string (digest_txt, digest, SHA256_DIGEST_SIZE);
+        }
+      DEBUGP (("Piece at %s: declared %s, computed %s\n",
+               number_to_static_string (offset), hash, digest_txt));
+      ok = !strcasecmp (digest_txt, hash);
+    }
+  xfree (buf);
+  return ok;
+}
+
+/* Read what the piece processes wrote to FD, the index of their piece
+   just before exiting, waiting up to WAIT seconds for it.  */
+
+static void
+pieces_read_exiting (int fd, int wait, struct piece *pieces)
+{
+  int index[64];
+  struct timeval tv;
+  fd_set set;
+  ssize_t n;
+  int i;
+
+  FD_ZERO (&set);
+  FD_SET (fd, &set);
+  tv.tv_sec = wait;
+  tv.tv_usec = 0;
+  if (select (fd + 1, &set, NULL, NULL, &tv) <= 0)
+    return;
+  n = read (fd, index, sizeof (index));
+  for (i = 0; i < n / (ssize_t) sizeof (index[0]); i++)
+    pieces[index[i]].exiting = true;
+}
+
+/* Retrieve MFILE a piece at a time to FILENAME, open as FP, from the
+   HTTP resources that need no proxy.  Return RETROK if every piece
+   matches its hash.  Otherwise, truncate FP and return an error, and
+   the caller may still retrieve the whole file from each resource in
+   turn.  */
+
+static uerr_t
+retrieve_pieces (metalink_file_t *mfile, FILE *fp, const char *filename)
+{
+  metalink_chunk_checksum_t *chunks = mfile->chunk_checksum;
+  metalink_piece_hash_t **hash_ptr;
+  metalink_resource_t **mres_ptr;
+  struct piece_mirror *mirrors;
+  struct piece *pieces;
+  struct ptimer *timer;
+  const char **hashes;
+  void *progress = NULL;
+  wgint done = 0;
+  int fd = fileno (fp), check_fd;
+  int nmirrors = 0, npieces, running = 0, left, i, fds[2];
+  uerr_t err = RETROK;
+
+  if (opt.segments < 2 || opt.limit_rate
+      || !chunks || !chunks->type || chunks->length <= 0
+      || !(hash_type_sha1 (chunks->type) || hash_type_sha256 (chunks->type))
+      || mfile->size <= chunks->length)
+    return METALINK_RETR_ERROR;
+
+  npieces = (mfile->size + chunks->length - 1) / chunks->length;
+  hashes = xnew0_array (const char *, npieces);
+  for (hash_ptr = chunks->piece_hashes; hash_ptr && *hash_ptr; hash_ptr++)
+    if ((*hash_ptr)->piece >= 0 && (*hash_ptr)->piece < npieces)
+      hashes[(*hash_ptr)->piece] = (*hash_ptr)->hash;
+  for (i = 0; i < npieces && hashes[i]; i++)
+    ;
+  if (i < npieces)
+    {
+      DEBUGP (("Metalink piece hashes of %s are incomplete.\n",
+               quote (mfile->name)));
+      xfree (hashes);
+      return METALINK_RETR_ERROR;
+    }
+
+  /* Resources are sorted by priority.  */
+  for (mres_ptr = mfile->resources; *mres_ptr; mres_ptr++)
+    ;
+  mirrors = xnew_array (struct piece_mirror, mres_ptr - mfile->resources);
+  for (mres_ptr = mfile->resources; *mres_ptr; mres_ptr++)
+    {
+      struct iri *iri;
+      struct url *url;
+      int url_err;
+
+      if (!RES_TYPE_SUPPORTED ((*mres_ptr)->type))
+        continue;
+      iri = iri_new ();
+      set_uri_encoding (iri, opt.locale, true);
+      url = url_parse ((*mres_ptr)->url, &url_err, iri, false);
+      iri_free (iri);
+      if (!url)
+        continue;
+      if ((url->scheme == SCHEME_HTTP
+#ifdef HAVE_SSL
+           || url->scheme == SCHEME_HTTPS
+#endif
+           ) && !url_uses_proxy (url))
+        {
+          mirrors[nmirrors].name = (*mres_ptr)->url;
+          mirrors[nmirrors].url = url;
+          mirrors[nmirrors].failures = 0;
+          ++nmirrors;
+        }
+      else
+        url_free (url);
+    }
+  if (!nmirrors)
+    {
+      xfree (mirrors);
+      xfree (hashes);
+      return METALINK_RETR_ERROR;
+    }
+
+  /* FP is open for writing only, so the pieces are read back through
+     a descriptor of their own.  */
+  check_fd = open (filename, O_RDONLY);
+  if (check_fd < 0 || ftruncate (fd, mfile->size) < 0 || pipe (fds) < 0)
+    {
+      logprintf (LOG_NOTQUIET, "%s: %s\n", filename, strerror (errno));
+      if (check_fd >= 0)
+        close (check_fd);
+      for (i = 0; i < nmirrors; i++)
+        url_free (mirrors[i].url);
+      xfree (mirrors);
+      xfree (hashes);
+      return FWRITEERR;
+    }
+
+  logprintf (LOG_VERBOSE,
+             _("Retrieving %s in %d pieces from %d mirrors.\n"),
+             quote (mfile->name), npieces, nmirrors);
+
+  /* Spread the first try of the pieces over the best-ranked mirrors,
+     one for each process.  */
+  pieces = xnew0_array (struct piece, npieces);
+  for (i = 0; i < npieces; i++)
+    pieces[i].mirror = i % MIN (nmirrors, opt.segments);
+  left = npieces;
+
+  timer = ptimer_new ();
+  if (opt.show_progress)
+    progress = progress_create (filename, 0, mfile->size);
+
+  for (;;)
+    {
+      /* Start the pieces that are neither done nor running.  */
+      for (i = 0; i < npieces && left && err == RETROK
+             && running < opt.segments; i++)
+        {
+          struct piece *p = &pieces[i];
+          wgint first = (wgint) i * chunks->length;
+          wgint last = MIN (first + chunks->length, mfile->size) - 1;
+          pid_t pid;
+
+          if (p->done || p->pid)
+            continue;
+          while (p->tries < nmirrors
+                 && mirrors[p->mirror].failures >= MIRROR_MAX_FAILURES)
+            {
+              p->mirror = (p->mirror + 1) % nmirrors;
+              ++p->tries;
+            }
+          if (p->tries >= nmirrors)
+            {
+              logprintf (LOG_NOTQUIET,
+                         _("No mirror has a good piece %d of %s.\n"),
+                         i, quote (mfile->name));
+              err = METALINK_RETR_ERROR;
+              break;
+            }
+
+          logflush ();
+          pid = fork ();
+          if (pid == 0)
+            {
+              uerr_t piece_err;
+
+              /* The persistent connections belong to the parent, and
+                 so does the "Connecting to" chatter.  */
+              close (fds[0]);
+              http_forget_persistent ();
+              opt.verbose = false;
+              piece_err = http_retrieve_range (mirrors[p->mirror].url,
+                                               first, last, mfile->size, fd);
+              if (write (fds[1], &i, sizeof (i)) != sizeof (i))
+                piece_err = WRITEFAILED;
+              _exit (piece_err == RETROK ? 0 : 1);
+            }
+          if (pid < 0)
+            {
+              logprintf (LOG_NOTQUIET, "fork: %s\n", strerror (errno));
+              err = METALINK_RETR_ERROR;
+              break;
+            }
+          p->pid = pid;
+          ++running;
+        }
+      if (err != RETROK)
+        for (i = 0; i < npieces; i++)
+          if (pieces[i].pid)
+            kill (pieces[i].pid, SIGTERM);
+      if (!running)
+        break;
+
+      /* Wait for a process to finish its piece, and check the pieces of
+         those that did.  */
+      pieces_read_exiting (fds[0], 1, pieces);
+      for (i = 0; i < npieces; i++)
+        {
+          struct piece *p = &pieces[i];
+          wgint first = (wgint) i * chunks->length;
+          int length = MIN (chunks->length, mfile->size - first);
+          int status;
+
+          if (!p->pid
+              || waitpid (p->pid, &status, p->exiting ? 0 : WNOHANG) <= 0)
+            continue;
+          p->pid = 0;
+          p->exiting = false;
+          --running;
+          if (err != RETROK)
+            continue;
+
+          if (WIFEXITED (status) && WEXITSTATUS (status) == 0
+              && piece_hash_ok (check_fd, first, length, chunks->type, hashes[i]))
+            {
+              p->done = true;
+              --left;
+              done += length;
+              if (progress)
+                progress_update (progress, length, ptimer_measure (timer));
+              continue;
+            }
+          if (WIFEXITED (status) && WEXITSTATUS (status) == 0)
+            logprintf (LOG_NOTQUIET,
+                       _("Piece %d of %s from %s does not match its "
+                         "checksum.\n"),
+                       i, quote_n (0, mfile->name),
+                       quote_n (1, mirrors[p->mirror].name));
+          else
+            logprintf (LOG_VERBOSE,
+                       _("Could not retrieve piece %d of %s from %s.\n"),
+                       i, quote_n (0, mfile->name),
+                       quote_n (1, mirrors[p->mirror].name));
+          ++mirrors[p->mirror].failures;
+          p->mirror = (p->mirror + 1) % nmirrors;
+          ++p->tries;
+        }
+    }
+
+  close (fds[0]);
+  close (fds[1]);
+  close (check_fd);
+  total_download_time += ptimer_measure (timer);
+  if (progress)
+    progress_finish (progress, ptimer_read (timer));
+  ptimer_destroy (timer);
+  total_downloaded_bytes += done;
+
+  if (left && err == RETROK)
+    err = METALINK_RETR_ERROR;
+  if (err != RETROK)
+    {
+      logprintf (LOG_VERBOSE,
+                 _("Retrieving %s in pieces failed.\n"),
+                 quote (mfile->name));
+      if (ftruncate (fd, 0) < 0)
+        err = FWRITEERR;
+    }
+
+  for (i = 0; i < nmirrors; i++)
+    url_free (mirrors[i].url);
+  xfree (mirrors);
+  xfree (pieces);
+  xfree (hashes);
+  return err;
+}
+#endif /* SEGMENTED_RETRIEVAL */
+
 /* Loop through all files in metalink structure and retrieve them.
    Returns RETROK if all files were downloaded.
    Returns last retrieval error (from retrieve_url) if some files
@@ -82,6 +432,9 @@ retrieve_from_metalink (const metalink_t* metalink)
       metalink_resource_t **mres_ptr;
       char *filename = NULL;
       bool hash_ok = false;
+#ifdef SEGMENTED_RETRIEVAL
+      bool pieces_tried = false;
+#endif
 
       uerr_t retr_err = METALINK_MISSING_RESOURCE;
 
@@ -156,8 +509,16 @@ retrieve_from_metalink (const metalink_t* metalink)
 
               opt.metalink_over_http = false;
               DEBUGP (("Storing to %s\n", filename));
-              retr_err = retrieve_url (url, mres->url, NULL, NULL,
-                                       NULL, NULL, opt.recursive, iri, false);
+#ifdef SEGMENTED_RETRIEVAL
+              if (!pieces_tried)
+                {
+                  pieces_tried = true;
+                  retr_err = retrieve_pieces (mfile, output_stream, filename);
+                }
+              if (retr_err != RETROK)
+#endif
+                retr_err = retrieve_url (url, mres->url, NULL, NULL, NULL,
+                                         NULL, opt.recursive, iri, false);
               opt.metalink_over_http = _metalink_http;
             }
           url_free (url);
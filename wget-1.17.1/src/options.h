@@ -54,6 +54,15 @@ struct options
   bool no_parent;               /* Restrict access to the parent
                                    directory.  */
   int reclevel;                 /* Maximum level of recursion */
+  int parallel;                 /* Number of simultaneous downloads
+                                   during recursion. */
+  int parallel_per_host;        /* How many of those may be from the
+                                   same host (0 means no limit). */
+  char *frontier_file;          /* File keeping the state of the crawl,
+                                   for resuming it. */
+  wgint frontier_memory;        /* Memory the queue of the crawl may
+                                   take before it goes to disk (0 means
+                                   no limit). */
   bool dirstruct;               /* Do we build the directory structure
                                    as we go along? */
   bool no_dirstruct;            /* Do we hate dirstruct? */
@@ -64,6 +73,7 @@ struct options
   bool unlink;                  /* remove file before clobbering */
   char *dir_prefix;             /* The top of directory tree */
   char *lfilename;              /* Log filename */
+  char *timing_log;             /* File to log request timings to */
   char *input_filename;         /* Input filename */
 #ifdef HAVE_METALINK
   char *input_metalink;         /* Input metalink file */
@@ -102,6 +112,10 @@ struct options
   char **domains;               /* See host.c */
   char **exclude_domains;
   bool dns_cache;               /* whether we cache DNS lookups. */
+  char *dns_cache_file;         /* file keeping DNS lookups between runs */
+  double dns_cache_ttl;         /* how long DNS lookups are kept there */
+  int dns_prefetch;             /* number of resolver processes looking
+                                   up queued hosts ahead of time */
 
   char **follow_tags;           /* List of HTML tags to recursively follow. */
   char **ignore_tags;           /* List of HTML tags to ignore if recursing. */
@@ -115,6 +129,7 @@ struct options
   char *warc_filename;          /* WARC output filename */
   char *warc_tempdir;           /* WARC temp dir */
   char *warc_cdx_dedup_filename;/* CDX file to be used for deduplication. */
+  char *warc_cdx_dedup_index;   /* Index of it, mapped into memory. */
   wgint warc_maxsize;           /* WARC max archive size */
   bool warc_compression_enabled;/* For GZIP compression. */
   bool warc_digests_enabled;    /* For SHA1 digests. */
@@ -138,6 +153,10 @@ struct options
   char *http_passwd;            /* HTTP password. */
   char **user_headers;          /* User-defined header(s). */
   bool http_keep_alive;         /* whether we use keep-alive */
+  int pipeline;                 /* How many requests to send ahead on
+                                   a persistent connection. */
+  int segments;                 /* How many ranges of a large file to
+                                   retrieve at the same time. */
 
   bool use_proxy;               /* Do we use proxy? */
   bool allow_cache;             /* Do we allow server-side caching? */
@@ -289,6 +308,13 @@ struct options
     prefer_none
   } prefer_family;              /* preferred address family when more
                                    than one type is available */
+#ifdef HAVE_LIBZ
+  enum {
+    compression_auto,
+    compression_none
+  } compression;                /* whether to ask for compressed HTTP
+                                   bodies and inflate them */
+#endif
 
   bool content_disposition;     /* Honor HTTP Content-Disposition header. */
   bool auth_without_challenge;  /* Issue Basic authentication creds without
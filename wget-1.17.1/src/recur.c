@@ -37,6 +37,13 @@ as that of the covered work.  */
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <stdarg.h>
+#if !defined(WINDOWS) && !defined(MSDOS)
+# define PARALLEL_RETRIEVAL
+# include <signal.h>
+# include <sys/select.h>
+# include <sys/wait.h>
+#endif
 
 #include "url.h"
 #include "recur.h"
@@ -51,6 +58,7 @@ as that of the covered work.  */
 #include "css-url.h"
 #include "spider.h"
 #include "exits.h"
+#include "http.h"
 
 /* Functions for maintaining the URL queue.  */
 
@@ -66,12 +74,41 @@ struct queue_element {
   struct queue_element *next;   /* next element in queue */
 };
 
+/* The queue keeps at most opt.frontier_memory bytes worth of elements
+   in memory (all of them if that is 0).  Once that is exceeded, the
+   elements that are enqueued are written to a log file instead, and
+   read back in order when the elements in memory run out.
+
+   With --frontier-file, the log is that file, and every element
+   enqueued is written to it, along with a line for each element that
+   has been processed.  A crawl that is interrupted can then be resumed
+   from where it stopped, see frontier_open.  The lines of the log are
+
+     S <start URL>
+     E <depth> <flags> <URL> <referer> <URI encoding> <content encoding>
+     B <URL>
+     D
+
+   with fields separated by tabs, an empty field standing for NULL.  E
+   is an enqueued element, B a URL that has been seen without being
+   enqueued, and D marks the processing of the oldest element as
+   done.  */
+
 struct url_queue {
   struct queue_element *head;
   struct queue_element *tail;
   int count, maxcount;
+  wgint memory;                 /* the size of the elements in memory */
+  FILE *log;                    /* the log, or NULL */
+  bool log_all;                 /* whether LOG is the frontier file */
+  int spilled;                  /* number of elements only in LOG */
+  off_t unread;                 /* where the first of those is in LOG */
 };
 
+/* The frontier file of the current crawl, if any, for
+   blacklist_record.  */
+static FILE *frontier_log;
+
 /* Create a URL queue. */
 
 static struct url_queue *
@@ -81,14 +118,157 @@ url_queue_new (void)
   return queue;
 }
 
-/* Delete a URL queue. */
+/* Delete a URL queue, along with the elements that are left in it. */
 
 static void
 url_queue_delete (struct url_queue *queue)
 {
+  struct queue_element *qel, *next;
+
+  for (qel = queue->head; qel; qel = next)
+    {
+      next = qel->next;
+      iri_free (qel->iri);
+      xfree (qel->url);
+      xfree (qel->referer);
+      xfree (qel);
+    }
+  if (queue->log)
+    fclose (queue->log);
+  if (frontier_log == queue->log)
+    frontier_log = NULL;
   xfree (queue);
 }
 
+/* Return the number of bytes QEL takes in memory.  */
+
+static wgint
+queue_element_size (const struct queue_element *qel)
+{
+  return (sizeof *qel + sizeof (struct iri) + strlen (qel->url) + 1
+          + (qel->referer ? strlen (qel->referer) + 1 : 0));
+}
+
+/* Write QEL to the log FP.  */
+
+static void
+queue_log_element (FILE *fp, const struct queue_element *qel)
+{
+  const struct iri *i = qel->iri;
+
+  fprintf (fp, "E\t%d\t%s%s%s\t%s\t%s\t%s\t%s\n", qel->depth,
+           qel->html_allowed ? "h" : "", qel->css_allowed ? "c" : "",
+           i && i->utf8_encode ? "u" : "", qel->url,
+           qel->referer ? qel->referer : "",
+           i && i->uri_encoding ? i->uri_encoding : "",
+           i && i->content_encoding ? i->content_encoding : "");
+}
+
+/* Split LINE, which must end with a newline, into at most N fields
+   separated by tabs, and store them to FIELDS.  Return the number of
+   fields, or 0 if LINE is incomplete.  */
+
+static int
+split_log_line (char *line, char **fields, int n)
+{
+  char *end = strchr (line, '\n');
+  int count = 0;
+
+  if (!end)
+    return 0;
+  *end = '\0';
+  while (count < n)
+    {
+      fields[count++] = line;
+      line = strchr (line, '\t');
+      if (!line)
+        break;
+      *line++ = '\0';
+    }
+  return count;
+}
+
+/* Parse LINE, an E line of the log, and return the element it
+   describes, or NULL if it is not one.  */
+
+static struct queue_element *
+queue_parse_element (char *line)
+{
+  struct queue_element *qel;
+  char *f[7];
+
+  if (split_log_line (line, f, 7) != 7 || strcmp (f[0], "E") != 0)
+    return NULL;
+
+  qel = xnew0 (struct queue_element);
+  qel->depth = atoi (f[1]);
+  qel->html_allowed = strchr (f[2], 'h') != NULL;
+  qel->css_allowed = strchr (f[2], 'c') != NULL;
+  qel->url = xstrdup (f[3]);
+  qel->referer = *f[4] ? xstrdup (f[4]) : NULL;
+  qel->iri = iri_new ();
+#ifdef ENABLE_IRI
+  qel->iri->utf8_encode = strchr (f[2], 'u') != NULL;
+  qel->iri->uri_encoding = *f[5] ? xstrdup (f[5]) : NULL;
+  qel->iri->content_encoding = *f[6] ? xstrdup (f[6]) : NULL;
+#endif
+  return qel;
+}
+
+/* Put QEL at the end of the elements of QUEUE in memory.  */
+
+static void
+queue_append (struct url_queue *queue, struct queue_element *qel)
+{
+  qel->next = NULL;
+  queue->memory += queue_element_size (qel);
+  if (queue->tail)
+    queue->tail->next = qel;
+  queue->tail = qel;
+  if (!queue->head)
+    queue->head = queue->tail;
+}
+
+/* Read elements of QUEUE back from its log into memory, as many as
+   opt.frontier_memory allows.  */
+
+static void
+queue_reload (struct url_queue *queue)
+{
+  char *line = NULL;
+  size_t len = 0;
+  struct queue_element *qel;
+
+  fflush (queue->log);
+  fseeko (queue->log, queue->unread, SEEK_SET);
+  while (queue->spilled
+         && (!opt.frontier_memory || queue->memory < opt.frontier_memory))
+    {
+      if (getline (&line, &len, queue->log) <= 0)
+        {
+          logprintf (LOG_NOTQUIET,
+                     _("Cannot read the queue back, %d URLs are lost.\n"),
+                     queue->spilled);
+          queue->count -= queue->spilled;
+          queue->spilled = 0;
+          break;
+        }
+      if (line[0] != 'E')
+        continue;
+      qel = queue_parse_element (line);
+      if (!qel)
+        continue;
+      queue_append (queue, qel);
+      --queue->spilled;
+    }
+  queue->unread = ftello (queue->log);
+  fseeko (queue->log, 0, SEEK_END);
+  xfree (line);
+
+  DEBUGP (("Read the queue back, %d URLs left in the log.\n",
+           queue->spilled));
+}
+
 /* Enqueue a URL in the queue.  The queue is FIFO: the items will be
    retrieved ("dequeued") from the queue in the order they were placed
    into it.  */
@@ -99,6 +279,8 @@ url_enqueue (struct url_queue *queue, struct iri *i,
              bool html_allowed, bool css_allowed)
 {
   struct queue_element *qel = xnew (struct queue_element);
+  bool spill;
+
   qel->iri = i;
   qel->url = url;
   qel->referer = referer;
@@ -119,12 +301,41 @@ url_enqueue (struct url_queue *queue, struct iri *i,
     DEBUGP (("[IRI Enqueuing %s with %s\n", quote_n (0, url),
              i->uri_encoding ? quote_n (1, i->uri_encoding) : "None"));
 
-  if (queue->tail)
-    queue->tail->next = qel;
-  queue->tail = qel;
+  /* Once an element has gone to the log, the ones after it must
+     follow, to keep the order.  */
+  spill = (queue->spilled
+           || (opt.frontier_memory && queue->head
+               && (queue->memory + queue_element_size (qel)
+                   > opt.frontier_memory)));
+  if (spill && !queue->log)
+    {
+      queue->log = tmpfile ();
+      if (!queue->log)
+        {
+          logprintf (LOG_NOTQUIET,
+                     _("Cannot create a file for the queue: %s\n"),
+                     strerror (errno));
+          spill = false;
+        }
+    }
+  if (spill && !queue->spilled)
+    {
+      fseeko (queue->log, 0, SEEK_END);
+      queue->unread = ftello (queue->log);
+    }
+  if (queue->log && (spill || queue->log_all))
+    queue_log_element (queue->log, qel);
 
-  if (!queue->head)
-    queue->head = queue->tail;
+  if (spill)
+    {
+      ++queue->spilled;
+      iri_free (qel->iri);
+      xfree (qel->url);
+      xfree (qel->referer);
+      xfree (qel);
+      return;
+    }
+  queue_append (queue, qel);
 }
 
 /* Take a URL out of the queue.  Return true if this operation
@@ -135,14 +346,19 @@ url_dequeue (struct url_queue *queue, struct iri **i,
              const char **url, const char **referer, int *depth,
              bool *html_allowed, bool *css_allowed)
 {
-  struct queue_element *qel = queue->head;
+  struct queue_element *qel;
+
+  if (!queue->head && queue->spilled)
+    queue_reload (queue);
 
+  qel = queue->head;
   if (!qel)
     return false;
 
   queue->head = queue->head->next;
   if (!queue->head)
     queue->tail = NULL;
+  queue->memory -= queue_element_size (qel);
 
   *i = qel->iri;
   *url = qel->url;
@@ -161,27 +377,1011 @@ url_dequeue (struct url_queue *queue, struct iri **i,
   return true;
 }
 
-static void blacklist_add (struct hash_table *blacklist, const char *url)
+/* Note in the frontier file that the URL last dequeued from QUEUE has
+   been processed.  */
+
+static void
+url_queue_done (struct url_queue *queue)
+{
+  if (queue->log_all)
+    {
+      fputs ("D\n", queue->log);
+      fflush (queue->log);
+    }
+}
+
+static void blacklist_add (struct fingerprint_set *blacklist, const char *url)
 {
   char *url_unescaped = xstrdup (url);
 
   url_unescape (url_unescaped);
-  string_set_add (blacklist, url_unescaped);
+  fingerprint_set_add (blacklist, url_unescaped);
   xfree (url_unescaped);
 }
 
-static int blacklist_contains (struct hash_table *blacklist, const char *url)
+static int blacklist_contains (struct fingerprint_set *blacklist,
+                               const char *url)
 {
   char *url_unescaped = xstrdup(url);
   int ret;
 
   url_unescape (url_unescaped);
-  ret = string_set_contains (blacklist, url_unescaped);
+  ret = fingerprint_set_contains (blacklist, url_unescaped);
   xfree (url_unescaped);
 
   return ret;
 }
 
+/* Like blacklist_add, for a URL that is not enqueued, and so must be
+   written to the frontier file separately.  */
+
+static void
+blacklist_record (struct fingerprint_set *blacklist, const char *url)
+{
+  blacklist_add (blacklist, url);
+  if (frontier_log)
+    fprintf (frontier_log, "B\t%s\n", url);
+}
+
+/* Open the frontier file for the crawl of START_URL, whose queue is
+   QUEUE and whose set of seen URLs is BLACKLIST.  If the file was left
+   by an earlier crawl of START_URL, restore the state of that crawl
+   and return true.  Otherwise, return false, and the caller starts
+   the crawl afresh.  */
+
+static bool
+frontier_open (struct url_queue *queue, struct fingerprint_set *blacklist,
+               const char *start_url)
+{
+  FILE *fp;
+  char *line = NULL, *f[4];
+  size_t len = 0;
+  ssize_t n;
+  off_t complete = 0;
+  int entries = 0, done = 0;
+
+  if (!opt.frontier_file)
+    return false;
+  fp = fopen (opt.frontier_file, "a+");
+  if (!fp)
+    {
+      logprintf (LOG_NOTQUIET, "%s: %s\n", opt.frontier_file,
+                 strerror (errno));
+      return false;
+    }
+
+  fseeko (fp, 0, SEEK_SET);
+  if (getline (&line, &len, fp) <= 0)
+    {
+      /* A new crawl.  */
+      fseeko (fp, 0, SEEK_END);
+      fprintf (fp, "S\t%s\n", start_url);
+      goto out;
+    }
+  if (split_log_line (line, f, 2) != 2 || strcmp (f[0], "S") != 0
+      || strcmp (f[1], start_url) != 0)
+    {
+      logprintf (LOG_NOTQUIET,
+                 _("%s is not the frontier file of %s, not using it.\n"),
+                 quote (opt.frontier_file), start_url);
+      fclose (fp);
+      xfree (line);
+      return false;
+    }
+
+  /* Take in the URLs seen so far, and count the elements done.  A
+     line that is cut short by a crash is dropped.  */
+  complete = ftello (fp);
+  while ((n = getline (&line, &len, fp)) > 0 && line[n - 1] == '\n')
+    {
+      complete += n;
+      if (line[0] == 'D')
+        ++done;
+      else if (split_log_line (line, f, 4) == 4 && !strcmp (f[0], "E"))
+        {
+          blacklist_add (blacklist, f[3]);
+          ++entries;
+        }
+      else if (split_log_line (line, f, 2) == 2 && !strcmp (f[0], "B"))
+        blacklist_add (blacklist, f[1]);
+    }
+  if (n > 0 && ftruncate (fileno (fp), complete) < 0)
+    logprintf (LOG_NOTQUIET, "%s: %s\n", opt.frontier_file, strerror (errno));
+
+  /* The elements that are not done are the last ones enqueued; find
+     the first of them.  */
+  fseeko (fp, 0, SEEK_SET);
+  queue->spilled = MAX (entries - done, 0);
+  queue->count = queue->maxcount = queue->spilled;
+  while (done >= 0 && ftello (fp) < complete)
+    {
+      queue->unread = ftello (fp);
+      if (getline (&line, &len, fp) > 0 && line[0] == 'E')
+        --done;
+    }
+  fseeko (fp, 0, SEEK_END);
+
+  logprintf (LOG_VERBOSE,
+             _("Resuming the crawl of %s: %d URLs seen, %d left.\n"),
+             start_url, entries, queue->spilled);
+
+ out:
+  xfree (line);
+  queue->log = frontier_log = fp;
+  queue->log_all = true;
+  return queue->spilled > 0 || entries > 0;
+}
+
+/* Support for --parallel.
+
+   Every download is done by a child process ("worker") forked off the
+   main process, with the state of the crawl as it was at that point.
+   The worker writes its log messages to a temporary file and journals
+   the changes it makes to the state (registered downloads, received
+   cookies, etc.) to a pipe.  The main process still handles the queue
+   in order: when it dequeues a URL, it waits for the worker that
+   downloads it, copies its log and replays its journal, and then goes
+   on exactly as if it had downloaded the URL itself.  Meanwhile it
+   starts workers for the URLs further down the queue.
+
+   A worker that is done does not exit but waits for another URL,
+   preferably on the same host, so that the persistent connection it
+   keeps is used again.  Along with the URL it is sent the changes the
+   main process has made since it last heard from it, so that it
+   starts from the same state as a newly forked worker would.  */
+
+/* In a worker, the journal pipe.  */
+static FILE *journal_fp;
+
+/* In the main process, during a crawl with --parallel, the changes
+   made to the crawl's state so far, to be sent to the workers.  */
+static FILE *sync_fp;
+
+/* Write a journal record of KIND with the COUNT strings of ARGS to
+   FP.  */
+
+static void
+journal_write (FILE *fp, int kind, const char **args, int count)
+{
+  int k;
+
+  putc (kind, fp);
+  putc (count, fp);
+  for (k = 0; k < count; k++)
+    fwrite (args[k], 1, strlen (args[k]) + 1, fp);
+}
+
+/* Journal a change of the crawl's state, described by KIND and the
+   strings following it, up to a NULL.  In a worker, the main process
+   repeats the change when it processes the worker's result, see
+   job_replay; in the main process, the change is kept for the workers
+   that were started before it.  This does nothing outside of
+   --parallel.  */
+
+void
+parallel_record (int kind, ...)
+{
+  FILE *fp = journal_fp ? journal_fp : sync_fp;
+  const char *args[5];
+  va_list ap;
+  int count = 0;
+
+  if (!fp)
+    return;
+
+  va_start (ap, kind);
+  while (count < 5 && (args[count] = va_arg (ap, const char *)) != NULL)
+    ++count;
+  va_end (ap);
+  assert (count <= 4);
+
+  journal_write (fp, kind, args, count);
+}
+
+#ifdef PARALLEL_RETRIEVAL
+
+/* A worker process.  */
+struct worker {
+  pid_t pid;
+  int fd;                       /* read end of the journal pipe */
+  FILE *cmd;                    /* write end of the pipe of URLs */
+  FILE *log;                    /* its log messages */
+  char *host;                   /* the host of its last URL */
+  off_t synced;                 /* how much of sync_fp it has seen */
+  struct job *job;              /* the URL it is downloading, or NULL */
+  struct worker *next;
+};
+
+/* A URL given to a worker.  */
+struct job {
+  const char *url;              /* the URL, as stored in the queue */
+  char *host;                   /* its host */
+  char *local_file;             /* the file it will probably be saved to */
+  bool done;                    /* whether the worker is done with it */
+  char *log;                    /* the worker's log messages, once done */
+  char *journal;                /* what has been read from the worker */
+  int journal_size, journal_alloc;
+  int parsed;                   /* how much of JOURNAL has been parsed */
+};
+
+/* The worker processes, and how many of them there are.  */
+static struct worker *workers;
+static int workers_alive;
+
+/* Jobs by URL.  The key is the URL pointer stored in the queue, so
+   each queue element has at most one job.  */
+static struct hash_table *jobs;
+
+/* Running jobs by host, and the file names they may write to.  */
+static struct hash_table *worker_hosts;
+static struct hash_table *worker_files;
+static int workers_running;
+
+/* Return a copy of S, or NULL if S is empty.  This undoes the
+   journaling of NULL strings as "".  */
+
+static char *
+journal_string (const char *s)
+{
+  return *s ? xstrdup (s) : NULL;
+}
+
+/* Parse the journal record at *P, which ends before END, into its
+   KIND and ARGS, and advance *P past it.  Return false at the end of
+   the journal, or if the record is incomplete.  */
+
+static bool
+journal_next (char **p, const char *end, int *kind, char *args[4])
+{
+  char *q = *p;
+  int count, k;
+
+  if (end - q < 2)
+    return false;
+  *kind = q[0];
+  count = q[1];
+  assert (count <= 4);
+  q += 2;
+  for (k = 0; k < count; k++)
+    {
+      char *nul = memchr (q, '\0', end - q);
+      if (!nul)
+        return false;
+      args[k] = q;
+      q = nul + 1;
+    }
+  *p = q;
+  return true;
+}
+
+/* Read a journal record from FP into its KIND and ARGS, which point
+   to storage that the next call reuses.  Return false at the end of
+   FP.  */
+
+static bool
+journal_read (FILE *fp, int *kind, char *args[4])
+{
+  static char *buf;
+  static int alloc;
+  int offsets[4];
+  int size = 0, count, k, c;
+
+  if ((*kind = getc (fp)) == EOF || (count = getc (fp)) == EOF)
+    return false;
+  assert (count <= 4);
+  for (k = 0; k < count; k++)
+    {
+      offsets[k] = size;
+      do
+        {
+          if ((c = getc (fp)) == EOF)
+            return false;
+          DO_REALLOC (buf, alloc, size + 1, char);
+          buf[size++] = c;
+        }
+      while (c);
+    }
+  for (k = 0; k < count; k++)
+    args[k] = buf + offsets[k];
+  return true;
+}
+
+/* Make the change to the crawl's state journaled as KIND with ARGS.
+   Return false if KIND is not such a change.  */
+
+static bool
+journal_apply (int kind, char *args[4])
+{
+  switch (kind)
+    {
+    case 'd':
+      register_download (args[0], args[1]);
+      break;
+    case 'r':
+      register_redirection (args[0], args[1]);
+      break;
+    case 'h':
+      register_html (args[0]);
+      break;
+    case 'c':
+      register_css (args[0]);
+      break;
+    case 'f':
+      downloaded_file (atoi (args[0]), args[1]);
+      break;
+    case 'k':
+      http_set_cookie (args[0], atoi (args[1]), args[2], args[3]);
+      /* Unlike gethttp, http_set_cookie journals nothing.  */
+      parallel_record ('k', args[0], args[1], args[2], args[3], NULL);
+      break;
+    case 'n':
+      nonexisting_url (args[0]);
+      break;
+    default:
+      return false;
+    }
+  return true;
+}
+
+#ifdef ENABLE_IRI
+/* Set I from the journal record 'I' with ARGS.  */
+
+static void
+journal_iri (struct iri *i, char *args[4])
+{
+  xfree (i->uri_encoding);
+  xfree (i->content_encoding);
+  xfree (i->orig_url);
+  i->uri_encoding = journal_string (args[0]);
+  i->content_encoding = journal_string (args[1]);
+  i->orig_url = journal_string (args[2]);
+  i->utf8_encode = *args[3] == '1';
+}
+#endif
+
+/* In a worker, download URL and journal the results.  */
+
+static void
+worker_job (char *url, const char *referer, struct iri *i)
+{
+  struct url *u;
+  char *file = NULL, *newloc = NULL;
+  int dt = 0;
+  int old_numurls = numurls;
+  SUM_SIZE_INT old_downloaded_bytes = total_downloaded_bytes;
+  double old_download_time = total_download_time;
+  char buf[32];
+
+  /* The main process has already checked that URL parses.  */
+  u = url_parse (url, NULL, i, true);
+  if (!u)
+    return;
+
+  {
+    uerr_t status = retrieve_url (u, url, &file, &newloc, referer, &dt,
+                                  false, i, true);
+
+    parallel_record ('R', number_to_static_string (status),
+                     number_to_static_string (dt),
+                     file ? file : "", newloc ? newloc : "", NULL);
+  }
+#ifdef ENABLE_IRI
+  parallel_record ('I', i->uri_encoding ? i->uri_encoding : "",
+                   i->content_encoding ? i->content_encoding : "",
+                   i->orig_url ? i->orig_url : "",
+                   i->utf8_encode ? "1" : "0", NULL);
+#endif
+  snprintf (buf, sizeof buf, "%.17g",
+            total_download_time - old_download_time);
+  parallel_record ('T', number_to_static_string (numurls - old_numurls),
+                   number_to_static_string (total_downloaded_bytes
+                                            - old_downloaded_bytes),
+                   buf, NULL);
+
+  url_free (u);
+  xfree (file);
+  xfree (newloc);
+}
+
+/* Download URL in a worker, then the URLs read from CMD_FD, writing
+   the journal to FD and the log to LOG.  The end of each job is
+   journaled as 'E'.  This never returns.  */
+
+static void
+worker_run (char *url, const char *referer, struct iri *i, int fd,
+            int cmd_fd, FILE *log)
+{
+  FILE *cmd;
+  char *url_copy = NULL, *referer_copy = NULL;
+  struct iri *iri_copy = NULL;
+  char *args[4];
+  int kind;
+
+  journal_fp = fdopen (fd, "w");
+  cmd = fdopen (cmd_fd, "r");
+  if (!journal_fp || !cmd)
+    _exit (WGET_EXIT_GENERIC_ERROR);
+  /* That is the main process's.  */
+  sync_fp = NULL;
+  log_set_fp (log);
+  /* Progress bars forced onto the terminal by --show-progress would
+     garble each other, leave them out.  */
+  if (opt.show_progress == true)
+    opt.show_progress = false;
+  http_forget_persistent ();
+  http_set_upcoming (NULL);
+
+  for (;;)
+    {
+      worker_job (url, referer, i);
+      fflush (log);
+      journal_write (journal_fp, 'E', NULL, 0);
+      if (fflush (journal_fp) != 0)
+        break;
+
+      /* Wait for the next URL.  The changes that come first are
+         already journaled by the worker that made them.  */
+      xfree (url_copy);
+      xfree (referer_copy);
+      iri_free (iri_copy);
+      i = iri_copy = iri_new ();
+      url = NULL;
+      while (!url && journal_read (cmd, &kind, args))
+        {
+          FILE *fp = journal_fp;
+
+          switch (kind)
+            {
+            case 'U':
+              url = url_copy = xstrdup (args[0]);
+              referer = referer_copy = journal_string (args[1]);
+              break;
+#ifdef ENABLE_IRI
+            case 'I':
+              journal_iri (i, args);
+              break;
+#endif
+            default:
+              journal_fp = NULL;
+              if (!journal_apply (kind, args))
+                abort ();
+              journal_fp = fp;
+            }
+        }
+      if (!url)
+        break;
+
+      /* The main process has read the log of the last URL.  */
+      rewind (log);
+      if (ftruncate (fileno (log), 0) < 0)
+        break;
+    }
+
+  fflush (log);
+  _exit (fclose (journal_fp) == 0 ? WGET_EXIT_SUCCESS
+         : WGET_EXIT_GENERIC_ERROR);
+}
+
+/* Start a worker for URL.  Return NULL if that fails.  */
+
+static struct worker *
+worker_fork (const char *url, const char *referer, struct iri *i)
+{
+  struct worker *w;
+  int fds[2], cmd_fds[2];
+  FILE *log, *cmd;
+  pid_t pid;
+
+  log = tmpfile ();
+  if (!log)
+    return NULL;
+  if (pipe (fds) < 0)
+    goto fail_log;
+  if (pipe (cmd_fds) < 0)
+    goto fail_fds;
+  cmd = fdopen (cmd_fds[1], "w");
+  if (!cmd)
+    {
+      close (cmd_fds[1]);
+      goto fail_cmd;
+    }
+
+  /* Flush what the worker must not write again.  */
+  logflush ();
+  fflush (sync_fp);
+  pid = fork ();
+  if (pid < 0)
+    {
+      fclose (cmd);
+      goto fail_cmd;
+    }
+  if (pid == 0)
+    {
+      close (fds[0]);
+      close (fileno (cmd));
+      /* Leave the pipes of the other workers to the main process, so
+         that they see it close them.  */
+      for (w = workers; w; w = w->next)
+        {
+          close (w->fd);
+          close (fileno (w->cmd));
+        }
+      worker_run ((char *) url, referer, i, fds[1], cmd_fds[0], log);
+    }
+  close (fds[1]);
+  close (cmd_fds[0]);
+
+  DEBUGP (("Started worker %ld for %s.\n", (long) pid, url));
+
+  w = xnew0 (struct worker);
+  w->pid = pid;
+  w->fd = fds[0];
+  w->cmd = cmd;
+  w->log = log;
+  w->synced = ftello (sync_fp);
+  w->next = workers;
+  workers = w;
+  ++workers_alive;
+  return w;
+
+ fail_cmd:
+  close (cmd_fds[0]);
+ fail_fds:
+  close (fds[0]);
+  close (fds[1]);
+ fail_log:
+  fclose (log);
+  return NULL;
+}
+
+/* Send URL to worker W, which is idle, along with the changes it has
+   not seen.  Return false if that fails.  */
+
+static bool
+worker_send (struct worker *w, const char *url, const char *referer,
+             struct iri *i)
+{
+  const char *args[4];
+  char buf[4096];
+  off_t end;
+
+  fflush (sync_fp);
+  end = ftello (sync_fp);
+  while (w->synced < end)
+    {
+      ssize_t n = pread (fileno (sync_fp), buf,
+                         MIN ((off_t) sizeof buf, end - w->synced),
+                         w->synced);
+      if (n <= 0)
+        return false;
+      fwrite (buf, 1, n, w->cmd);
+      w->synced += n;
+    }
+
+#ifdef ENABLE_IRI
+  args[0] = i->uri_encoding ? i->uri_encoding : "";
+  args[1] = i->content_encoding ? i->content_encoding : "";
+  args[2] = i->orig_url ? i->orig_url : "";
+  args[3] = i->utf8_encode ? "1" : "0";
+  journal_write (w->cmd, 'I', args, 4);
+#endif
+  args[0] = url;
+  args[1] = referer ? referer : "";
+  journal_write (w->cmd, 'U', args, 2);
+  if (fflush (w->cmd) != 0)
+    return false;
+
+  DEBUGP (("Sent %s to worker %ld.\n", url, (long) w->pid));
+  return true;
+}
+
+/* Reap worker W, which is idle or done, and free it.  */
+
+static void
+worker_reap (struct worker *w)
+{
+  struct worker **p;
+
+  close (w->fd);
+  fclose (w->cmd);
+  while (waitpid (w->pid, NULL, 0) < 0 && errno == EINTR)
+    ;
+  DEBUGP (("Worker %ld is done.\n", (long) w->pid));
+  fclose (w->log);
+  xfree (w->host);
+
+  for (p = &workers; *p != w; p = &(*p)->next)
+    ;
+  *p = w->next;
+  --workers_alive;
+  xfree (w);
+}
+
+/* Start a job for URL, if the --parallel limits allow it, and return
+   whether that happened.  BLOCKED, if non-NULL, holds the file names
+   of the URLs before this one in the queue that had to wait; URL
+   waits as well if it would use one of them, so that files are
+   numbered in queue order.  */
+
+static bool
+worker_start (const char *url, const char *referer, struct iri *i,
+              struct hash_table *blocked)
+{
+  struct worker *w, *idle = NULL;
+  struct job *j;
+  struct url *u;
+  struct iri *ci;
+  char *file;
+  int *count;
+
+  if (workers_running >= opt.parallel
+      || hash_table_contains (jobs, url)
+      || (dl_url_file_map && hash_table_contains (dl_url_file_map, url)))
+    return false;
+
+  /* Parse a copy of I, url_parse may change it.  */
+  ci = iri_dup (i);
+  u = url_parse (url, NULL, ci, true);
+  iri_free (ci);
+  if (!u)
+    return false;
+
+  file = url_file_name (u, NULL);
+  count = hash_table_get (worker_hosts, u->host);
+  if ((opt.parallel_per_host && count && *count >= opt.parallel_per_host)
+      || string_set_contains (worker_files, file)
+      || (blocked && string_set_contains (blocked, file)))
+    {
+      if (blocked)
+        string_set_add (blocked, file);
+      goto fail;
+    }
+
+  /* Prefer an idle worker that has been on the same host.  Start
+     another one rather than taking an idle worker away from its
+     host.  */
+  for (w = workers; w; w = w->next)
+    if (!w->job)
+      {
+        if (!strcmp (w->host, u->host))
+          break;
+        if (!idle)
+          idle = w;
+      }
+  if (!w && workers_alive >= opt.parallel)
+    w = idle;
+  if (w && !worker_send (w, url, referer, i))
+    {
+      worker_reap (w);
+      w = NULL;
+    }
+  if (!w)
+    w = worker_fork (url, referer, i);
+  if (!w)
+    goto fail;
+
+  j = xnew0 (struct job);
+  j->url = url;
+  j->host = xstrdup (u->host);
+  j->local_file = file;
+  hash_table_put (jobs, url, j);
+  w->job = j;
+  xfree (w->host);
+  w->host = xstrdup (u->host);
+
+  if (!count)
+    {
+      count = xnew0 (int);
+      hash_table_put (worker_hosts, xstrdup (u->host), count);
+    }
+  ++*count;
+  string_set_add (worker_files, file);
+  ++workers_running;
+
+  url_free (u);
+  return true;
+
+ fail:
+  xfree (file);
+  url_free (u);
+  return false;
+}
+
+/* Start workers for the URLs at the front of QUEUE, as far as the
+   --parallel limits allow.  */
+
+static void
+worker_start_queued (struct url_queue *queue)
+{
+  struct queue_element *qel;
+  struct hash_table *blocked;
+  int lookahead = 4 * opt.parallel;
+
+  if (workers_running >= opt.parallel)
+    return;
+
+  blocked = make_string_hash_table (0);
+  for (qel = queue->head;
+       qel && lookahead > 0 && workers_running < opt.parallel;
+       qel = qel->next, --lookahead)
+    worker_start (qel->url, qel->referer, qel->iri, blocked);
+  string_set_free (blocked);
+}
+
+/* Mark the job of worker W as done, taking its log, and leave W
+   idle.  */
+
+static void
+worker_done (struct worker *w)
+{
+  struct job *j = w->job;
+  int size = 0, alloc = 0;
+  ssize_t n;
+  char *key;
+  int *count;
+
+  do
+    {
+      DO_REALLOC (j->log, alloc, size + 4096 + 1, char);
+      n = pread (fileno (w->log), j->log + size, alloc - size - 1, size);
+      if (n > 0)
+        size += n;
+    }
+  while (n > 0 || (n < 0 && errno == EINTR));
+  j->log[size] = '\0';
+
+  DEBUGP (("Worker %ld is done with %s.\n", (long) w->pid, j->url));
+  j->done = true;
+  w->job = NULL;
+
+  count = hash_table_get (worker_hosts, j->host);
+  --*count;
+  if (hash_table_get_pair (worker_files, j->local_file, &key, NULL))
+    {
+      hash_table_remove (worker_files, key);
+      xfree (key);
+    }
+  --workers_running;
+}
+
+/* Read what worker W has written to its pipe.  If it is done with its
+   job, leave it idle, and if it has exited, reap it.  */
+
+static void
+worker_read (struct worker *w)
+{
+  struct job *j = w->job;
+  char *p, *record, *args[4];
+  int kind;
+  ssize_t n;
+
+  DO_REALLOC (j->journal, j->journal_alloc, j->journal_size + 4096, char);
+  n = read (w->fd, j->journal + j->journal_size,
+            j->journal_alloc - j->journal_size);
+  if (n > 0)
+    {
+      j->journal_size += n;
+      p = j->journal + j->parsed;
+      while (record = p,
+             journal_next (&p, j->journal + j->journal_size, &kind, args))
+        {
+          if (kind == 'E')
+            {
+              j->journal_size = record - j->journal;
+              worker_done (w);
+              return;
+            }
+          j->parsed = p - j->journal;
+        }
+      return;
+    }
+  if (n < 0 && errno == EINTR)
+    return;
+
+  worker_done (w);
+  worker_reap (w);
+}
+
+/* Read from the busy workers, waiting for at least one of them to
+   make progress if BLOCK is true.  */
+
+static void
+worker_poll (bool block)
+{
+  struct timeval zero = { 0, 0 };
+  struct worker *w, *next;
+  fd_set fds;
+  int maxfd = -1;
+
+  FD_ZERO (&fds);
+  for (w = workers; w; w = w->next)
+    if (w->job)
+      {
+        FD_SET (w->fd, &fds);
+        maxfd = MAX (maxfd, w->fd);
+      }
+  if (maxfd < 0
+      || select (maxfd + 1, &fds, NULL, NULL, block ? NULL : &zero) <= 0)
+    return;
+
+  for (w = workers; w; w = next)
+    {
+      next = w->next;
+      if (w->job && FD_ISSET (w->fd, &fds))
+        worker_read (w);
+    }
+}
+
+/* Forget job J, which must be done, and free it.  */
+
+static void
+job_free (struct job *j)
+{
+  hash_table_remove (jobs, j->url);
+  xfree (j->host);
+  xfree (j->local_file);
+  xfree (j->log);
+  xfree (j->journal);
+  xfree (j);
+}
+
+/* Copy the log of job J to ours, and make the changes it journaled.
+   Store the results of its retrieve_url call to STATUS, FILE, NEWLOC,
+   DT and I.  Return false if the worker did not finish the job.  */
+
+static bool
+job_replay (struct job *j, uerr_t *status, char **file,
+            char **newloc, int *dt, struct iri *i)
+{
+  char *p = j->journal, *end = j->journal + j->journal_size;
+  bool finished = false;
+  char *args[4];
+  int kind;
+
+  logputs (LOG_ALWAYS, j->log);
+
+  while (journal_next (&p, end, &kind, args))
+    switch (kind)
+      {
+      case 'R':
+        *status = atoi (args[0]);
+        *dt = atoi (args[1]);
+        *file = journal_string (args[2]);
+        *newloc = journal_string (args[3]);
+        finished = true;
+        break;
+#ifdef ENABLE_IRI
+      case 'I':
+        journal_iri (i, args);
+        break;
+#endif
+      case 'T':
+        numurls += atoi (args[0]);
+        total_downloaded_bytes += str_to_wgint (args[1], NULL, 10);
+        total_download_time += strtod (args[2], NULL);
+        break;
+      default:
+        if (!journal_apply (kind, args))
+          abort ();
+      }
+
+  return finished;
+}
+
+/* Retrieve URL, which is at the head of QUEUE, with a worker, as
+   retrieve_url would.  */
+
+static uerr_t
+parallel_retrieve_url (struct url_queue *queue, struct url *u,
+                       const char *url, char **file, char **newloc,
+                       const char *referer, int *dt, struct iri *i)
+{
+  struct job *j;
+  uerr_t status = RETROK;
+
+  worker_poll (false);
+  while (!(j = hash_table_get (jobs, url)))
+    {
+      if (worker_start (url, referer, i, NULL))
+        continue;
+      if (!workers_running)
+        /* Out of processes or files; do it ourselves.  */
+        return retrieve_url (u, url, file, newloc, referer, dt, false, i,
+                             true);
+      worker_poll (true);
+    }
+
+  worker_start_queued (queue);
+  while (!j->done)
+    {
+      worker_poll (true);
+      worker_start_queued (queue);
+    }
+
+  if (!job_replay (j, &status, file, newloc, dt, i))
+    {
+      logprintf (LOG_NOTQUIET, _("Worker for %s failed, retrying.\n"),
+                 quote (url));
+      job_free (j);
+      return retrieve_url (u, url, file, newloc, referer, dt, false, i,
+                           true);
+    }
+  job_free (j);
+  inform_exit_status (status);
+  return status;
+}
+
+/* Throw away the job for URL, if any.  This happens when URL turns
+   out to be downloaded already, under another name, by the time it is
+   dequeued.  */
+
+static void
+parallel_discard (const char *url)
+{
+  struct job *j = hash_table_get (jobs, url);
+  char *p, *args[4];
+  int kind;
+
+  if (!j)
+    return;
+  while (!j->done)
+    worker_poll (true);
+
+  /* Remove the file the worker downloaded, as it would not have been
+     downloaded without --parallel.  */
+  p = j->journal;
+  while (journal_next (&p, j->journal + j->journal_size, &kind, args))
+    if (kind == 'R' && (atoi (args[1]) & RETROKF) && *args[2]
+        && (downloaded_file (CHECK_FOR_FILE, args[2])
+            == FILE_NOT_ALREADY_DOWNLOADED))
+      {
+        DEBUGP (("Removing %s, already downloaded.\n", args[2]));
+        unlink (args[2]);
+      }
+  job_free (j);
+}
+
+/* Stop the workers, killing the busy ones, and free the jobs.  */
+
+static void
+parallel_cleanup (void)
+{
+  hash_table_iterator iter;
+
+  while (workers)
+    {
+      if (workers->job)
+        kill (workers->pid, SIGTERM);
+      worker_reap (workers);
+    }
+
+  for (hash_table_iterate (jobs, &iter); hash_table_iter_next (&iter); )
+    {
+      struct job *j = iter.value;
+      xfree (j->host);
+      xfree (j->local_file);
+      xfree (j->log);
+      xfree (j->journal);
+      xfree (j);
+    }
+  hash_table_destroy (jobs);
+  jobs = NULL;
+
+  for (hash_table_iterate (worker_hosts, &iter); hash_table_iter_next (&iter); )
+    {
+      xfree (iter.key);
+      xfree (iter.value);
+    }
+  hash_table_destroy (worker_hosts);
+  string_set_free (worker_files);
+  workers_running = 0;
+
+  fclose (sync_fp);
+  sync_fp = NULL;
+}
+
+#endif /* PARALLEL_RETRIEVAL */
+
 typedef enum
 {
   WG_RR_SUCCESS, WG_RR_BLACKLIST, WG_RR_NOTHTTPS, WG_RR_NONHTTP, WG_RR_ABSOLUTE,
@@ -190,9 +1390,11 @@ typedef enum
 } reject_reason;
 
 static reject_reason download_child (const struct urlpos *, struct url *, int,
-                              struct url *, struct hash_table *, struct iri *);
+                              struct url *, struct fingerprint_set *,
+                              struct iri *);
 static reject_reason descend_redirect (const char *, struct url *, int,
-                              struct url *, struct hash_table *, struct iri *);
+                              struct url *, struct fingerprint_set *,
+                              struct iri *);
 static void write_reject_log_header (FILE *);
 static void write_reject_log_reason (FILE *, reject_reason,
                               const struct url *, const struct url *);
@@ -218,6 +1420,99 @@ static void write_reject_log_reason (FILE *, reject_reason,
           satisfies the criteria specified by the various command-line
           options, add it to the queue. */
 
+/* The queue of retrieve_tree, for upcoming_from_queue.  */
+static struct url_queue *upcoming_queue;
+
+/* With incremental link conversion, the URLs that will not be
+   downloaded later in the crawl than they are now: those that have
+   been processed, and those that robots.txt forbids.  */
+static struct fingerprint_set *decided_urls;
+
+/* For incremental link conversion, tell whether the fate of CHILD, a
+   link found in PARENT that download_child has judged as R, is known
+   now or once the URLs in the string set WAITS have been processed.
+   If it is, add its URL to WAITS if needed and return true.  */
+
+static bool
+link_fate_known (const struct urlpos *child, reject_reason r,
+                 const struct url *parent, const struct url *start_url_parsed,
+                 struct hash_table *waits)
+{
+  const char *url = child->url->url;
+
+  switch (r)
+    {
+    case WG_RR_SUCCESS:
+      string_set_add (waits, url);
+      return true;
+    case WG_RR_BLACKLIST:
+      /* Enqueued before, unless it has been downloaded or decided
+         already.  */
+      if (!(dl_url_file_map && hash_table_contains (dl_url_file_map, url))
+          && !fingerprint_set_contains (decided_urls, url))
+        string_set_add (waits, url);
+      return true;
+    case WG_RR_NOTHTTPS:
+    case WG_RR_NONHTTP:
+    case WG_RR_DOMAIN:
+    case WG_RR_LIST:
+    case WG_RR_REGEX:
+    case WG_RR_ROBOTS:
+      /* These only depend on the URL.  */
+      return true;
+    case WG_RR_PARENT:
+      /* With -p, the same URL may be followed as an inline link.  */
+      return !opt.page_requisites;
+    case WG_RR_RULES:
+      /* The rules of an HTML file depend on the depth.  */
+      return !has_html_suffix_p (child->url->file);
+    case WG_RR_SPANNEDHOST:
+      /* Without -H, only the pages of the start host are parsed, so
+         the URL is spanned from them all.  */
+      return !strcasecmp (parent->host, start_url_parsed->host);
+    default:
+      /* Whether a link is absolute depends on the link.  */
+      return false;
+    }
+}
+
+/* Return the Nth URL in the queue that will actually be retrieved,
+   and set *REFERER to its referer.  Used by --pipeline.  */
+
+static const char *
+upcoming_from_queue (int n, const char **referer)
+{
+  struct queue_element *qel;
+
+  for (qel = upcoming_queue->head; qel; qel = qel->next)
+    if (!(dl_url_file_map && hash_table_contains (dl_url_file_map, qel->url))
+        && n-- == 0)
+      {
+        *referer = qel->referer;
+        return qel->url;
+      }
+  return NULL;
+}
+
+/* Have the hosts that the links in CHILDREN, found in PARENT, may lead
+   to looked up in the background.  Used by --dns-prefetch.  */
+
+static void
+prefetch_hosts (const struct urlpos *children, const struct url *parent)
+{
+  for (; children; children = children->next)
+    {
+      struct url *u = children->url;
+
+      if (children->ignore_when_downloading
+          || (!opt.spanhost && 0 != strcasecmp (u->host, parent->host))
+          || ((opt.domains || opt.exclude_domains) && !accept_domain (u))
+          || url_uses_proxy (u))
+        continue;
+      host_prefetch (u->host);
+    }
+}
+
 uerr_t
 retrieve_tree (struct url *start_url_parsed, struct iri *pi)
 {
@@ -228,7 +1523,7 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
 
   /* The URLs we do not wish to enqueue, because they are already in
      the queue, but haven't been downloaded yet.  */
-  struct hash_table *blacklist;
+  struct fingerprint_set *blacklist;
 
   struct iri *i = iri_new ();
 
@@ -247,13 +1542,21 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
 #undef COPYSTR
 
   queue = url_queue_new ();
-  blacklist = make_string_hash_table (0);
+  blacklist = fingerprint_set_new ();
+
+  if (frontier_open (queue, blacklist, start_url_parsed->url))
+    iri_free (i);
+  else
+    {
+      /* Enqueue the starting URL.  Use start_url_parsed->url rather
+         than just URL so we enqueue the canonical form of the URL.  */
+      url_enqueue (queue, i, xstrdup (start_url_parsed->url), NULL, 0, true,
+                   false);
+      blacklist_add (blacklist, start_url_parsed->url);
+    }
 
-  /* Enqueue the starting URL.  Use start_url_parsed->url rather than
-     just URL so we enqueue the canonical form of the URL.  */
-  url_enqueue (queue, i, xstrdup (start_url_parsed->url), NULL, 0, true,
-               false);
-  blacklist_add (blacklist, start_url_parsed->url);
+  if (convert_incremental)
+    decided_urls = fingerprint_set_new ();
 
   if (opt.rejected_log)
     {
@@ -263,10 +1566,19 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
         logprintf (LOG_NOTQUIET, "%s: %s\n", opt.rejected_log, strerror (errno));
     }
 
+#ifdef PARALLEL_RETRIEVAL
+  if (opt.parallel > 1 && (sync_fp = tmpfile ()) != NULL)
+    {
+      jobs = hash_table_new (0, NULL, NULL);
+      worker_hosts = make_string_hash_table (0);
+      worker_files = make_string_hash_table (0);
+    }
+#endif
+
   while (1)
     {
       bool descend = false;
-      char *url, *referer, *file = NULL;
+      char *url, *referer, *file = NULL, *dequeued_url = NULL;
       int depth;
       bool html_allowed, css_allowed;
       bool is_css = false;
@@ -283,6 +1595,8 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
                         (const char **)&url, (const char **)&referer,
                         &depth, &html_allowed, &css_allowed))
         break;
+      if (decided_urls)
+        dequeued_url = xstrdup (url);
 
       /* ...and download it.  Note that this download is in most cases
          unconditional, as download_child already makes sure a file
@@ -301,6 +1615,11 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
           DEBUGP (("Already downloaded \"%s\", reusing it from \"%s\".\n",
                    url, file));
 
+#ifdef PARALLEL_RETRIEVAL
+          if (jobs)
+            parallel_discard (url);
+#endif
+
           if ((is_css_bool = (css_allowed
                   && downloaded_css_set
                   && string_set_contains (downloaded_css_set, file)))
@@ -311,6 +1630,12 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
               descend = true;
               is_css = is_css_bool;
             }
+
+          /* The links of a file that have been converted already are
+             not those it was retrieved with, which have been followed
+             then.  */
+          if (convert_done_p (file))
+            descend = false;
         }
       else
         {
@@ -327,9 +1652,19 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
             }
           else
             {
-
-              status = retrieve_url (url_parsed, url, &file, &redirected, referer,
-                                     &dt, false, i, true);
+#ifdef PARALLEL_RETRIEVAL
+              if (jobs)
+                status = parallel_retrieve_url (queue, url_parsed, url, &file,
+                                                &redirected, referer, &dt, i);
+              else
+#endif
+              {
+                upcoming_queue = queue;
+                http_set_upcoming (upcoming_from_queue);
+                status = retrieve_url (url_parsed, url, &file, &redirected,
+                                       referer, &dt, false, i, true);
+                http_set_upcoming (NULL);
+              }
 
               if (html_allowed && file && status == RETROK
                   && (dt & RETROKF) && (dt & TEXTHTML))
@@ -438,12 +1773,22 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
               char *referer_url = url;
               bool strip_auth = (url_parsed != NULL
                                  && url_parsed->user != NULL);
+              /* The URLs the conversion of the links of FILE waits
+                 for, if it can be done before the end.  */
+              struct hash_table *waits = (decided_urls
+                                          ? make_string_hash_table (0)
+                                          : NULL);
               assert (url_parsed != NULL);
 
               /* Strip auth info if present */
               if (strip_auth)
                 referer_url = url_string (url_parsed, URL_AUTH_HIDE);
 
+              /* Deciding whether to follow a link can take its host's
+                 robots.txt, so look the hosts up all at once first.  */
+              if (opt.dns_prefetch)
+                prefetch_hosts (children, url_parsed);
+
               for (; child; child = child->next)
                 {
                   reject_reason r;
@@ -451,7 +1796,14 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
                   if (child->ignore_when_downloading)
                     continue;
                   if (dash_p_leaf_HTML && !child->link_inline_p)
-                    continue;
+                    {
+                      if (waits)
+                        {
+                          string_set_free (waits);
+                          waits = NULL;
+                        }
+                      continue;
+                    }
 
                   r = download_child (child, url_parsed, depth,
                                       start_url_parsed, blacklist, i);
@@ -472,12 +1824,24 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
                     {
                       write_reject_log_reason (rejectedlog, r, child->url, url_parsed);
                     }
+                  if (waits && !link_fate_known (child, r, url_parsed,
+                                                 start_url_parsed, waits))
+                    {
+                      string_set_free (waits);
+                      waits = NULL;
+                    }
                 }
 
               if (strip_auth)
                 xfree (referer_url);
               url_free (url_parsed);
-              free_urlpos (children);
+              if (waits)
+                {
+                  convert_hold (file, is_css, children, waits);
+                  string_set_free (waits);
+                }
+              else
+                free_urlpos (children);
             }
         }
 
@@ -505,33 +1869,55 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
           register_delete_file (file);
         }
 
+      if (decided_urls)
+        {
+          fingerprint_set_add (decided_urls, dequeued_url);
+          convert_url_done (dequeued_url);
+          if (strcmp (url, dequeued_url))
+            {
+              fingerprint_set_add (decided_urls, url);
+              convert_url_done (url);
+            }
+          xfree (dequeued_url);
+        }
+
       xfree (url);
       xfree (referer);
       xfree (file);
       iri_free (i);
+      url_queue_done (queue);
     }
 
   if (rejectedlog)
     fclose (rejectedlog);
 
-  /* If anything is left of the queue due to a premature exit, free it
-     now.  */
-  {
-    char *d1, *d2;
-    int d3;
-    bool d4, d5;
-    struct iri *d6;
-    while (url_dequeue (queue, (struct iri **)&d6,
-                        (const char **)&d1, (const char **)&d2, &d3, &d4, &d5))
-      {
-        iri_free (d6);
-        xfree (d1);
-        xfree (d2);
-      }
-  }
+#ifdef PARALLEL_RETRIEVAL
+  if (jobs)
+    parallel_cleanup ();
+#endif
+
+  DEBUGP (("Saw %d URLs, at most %d of them in the queue.\n",
+           fingerprint_set_count (blacklist), queue->maxcount));
+
+  /* The frontier file is only needed to resume a crawl that stopped
+     short.  */
+  if (queue->log_all && !queue->head && !queue->spilled)
+    {
+      if (unlink (opt.frontier_file) < 0)
+        logprintf (LOG_NOTQUIET, "%s: %s\n", opt.frontier_file,
+                   strerror (errno));
+    }
+
+  /* If anything is left of the queue due to a premature exit, it is
+     freed along with it.  */
   url_queue_delete (queue);
 
-  string_set_free (blacklist);
+  fingerprint_set_free (blacklist);
+  if (decided_urls)
+    {
+      fingerprint_set_free (decided_urls);
+      decided_urls = NULL;
+    }
 
   if (opt.quota && total_downloaded_bytes > opt.quota)
     return QUOTEXC;
@@ -551,7 +1937,8 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
 
 static reject_reason
 download_child (const struct urlpos *upos, struct url *parent, int depth,
-                  struct url *start_url_parsed, struct hash_table *blacklist,
+                  struct url *start_url_parsed,
+                  struct fingerprint_set *blacklist,
                   struct iri *iri)
 {
   struct url *u = upos->url;
@@ -755,6 +2142,8 @@ download_child (const struct urlpos *upos, struct url *parent, int depth,
         {
           DEBUGP (("Not following %s because robots.txt forbids it.\n", url));
           blacklist_add (blacklist, url);
+          if (decided_urls)
+            fingerprint_set_add (decided_urls, url);
           reason = WG_RR_ROBOTS;
           goto out;
         }
@@ -779,7 +2168,8 @@ download_child (const struct urlpos *upos, struct url *parent, int depth,
 
 static reject_reason
 descend_redirect (const char *redirected, struct url *orig_parsed, int depth,
-                    struct url *start_url_parsed, struct hash_table *blacklist,
+                    struct url *start_url_parsed,
+                  struct fingerprint_set *blacklist,
                     struct iri *iri)
 {
   struct url *new_parsed;
@@ -798,7 +2188,7 @@ descend_redirect (const char *redirected, struct url *orig_parsed, int depth,
                               start_url_parsed, blacklist, iri);
 
   if (reason == WG_RR_SUCCESS)
-    blacklist_add (blacklist, upos->url->url);
+    blacklist_record (blacklist, upos->url->url);
   else
     DEBUGP (("Redirection \"%s\" failed the test.\n", redirected));
 
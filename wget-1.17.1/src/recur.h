@@ -46,5 +46,6 @@ struct urlpos;
 
 void recursive_cleanup (void);
 uerr_t retrieve_tree (struct url *, struct iri *);
+void parallel_record (int, ...);
 
 #endif /* RECUR_H */
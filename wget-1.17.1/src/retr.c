@@ -40,6 +40,13 @@ as that of the covered work.  */
 #ifdef VMS
 # include <unixio.h>            /* For delete(). */
 #endif
+#ifdef HAVE_SPLICE
+# include <fcntl.h>
+# include <sys/stat.h>
+#endif
+#ifdef HAVE_LIBZ
+# include <zlib.h>
+#endif
 
 #include "exits.h"
 #include "utils.h"
@@ -57,6 +64,8 @@ as that of the covered work.  */
 #include "html-url.h"
 #include "iri.h"
 #include "hsts.h"
+#include "timing.h"
+#include "warc.h"
 
 /* Total size of downloaded files.  Used to enforce quota.  */
 SUM_SIZE_INT total_downloaded_bytes;
@@ -167,7 +176,7 @@ write_data (FILE *out, FILE *out2, const char *buf, int bufsize,
   if (out != NULL)
     fwrite (buf, 1, bufsize, out);
   if (out2 != NULL)
-    fwrite (buf, 1, bufsize, out2);
+    warc_tempfile_write (out2, buf, bufsize);
   *written += bufsize;
 
   /* Immediately flush the downloaded data.  This should not hinder
@@ -197,10 +206,137 @@ write_data (FILE *out, FILE *out2, const char *buf, int bufsize,
     return 0;
 }
 
+#ifdef HAVE_SPLICE
+/* Move the BUFSIZE bytes that fd_splice put in the pipe PIPE_FD to
+   OUT, which must have been flushed, and increment *WRITTEN by their
+   amount.  Should OUT not take spliced data, copy them through BUF,
+   of BUFMAX bytes, instead.  Return -1 in case of error writing to
+   OUT, 0 otherwise.  */
+
+static int
+splice_data (int pipe_fd, FILE *out, int bufsize, char *buf, int bufmax,
+             wgint *written)
+{
+  int fd = fileno (out);
+
+  while (bufsize > 0)
+    {
+      ssize_t res = splice (pipe_fd, NULL, fd, NULL, bufsize, SPLICE_F_MOVE);
+      if (res < 0 && errno == EINVAL)
+        {
+          res = read (pipe_fd, buf, MIN (bufsize, bufmax));
+          if (res > 0 && write (fd, buf, res) != res)
+            res = -1;
+        }
+      if (res < 0 && errno == EINTR)
+        continue;
+      if (res <= 0)
+        return -1;
+      bufsize -= res;
+      *written += res;
+    }
+  return 0;
+}
+
+/* Close SPLICE_PIPE, the pipe a body was spliced through to OUT, and
+   tell stdio where the spliced data left the file offset, so that
+   later writes to OUT go after them.  */
+
+static void
+splice_end (int splice_pipe[2], FILE *out)
+{
+  close (splice_pipe[0]);
+  close (splice_pipe[1]);
+  splice_pipe[0] = splice_pipe[1] = -1;
+  fseeko (out, lseek (fileno (out), 0, SEEK_CUR), SEEK_SET);
+}
+#endif /* HAVE_SPLICE */
+
+#ifdef HAVE_LIBZ
+/* The state of a body being inflated for rb_decompress.  */
+struct body_inflate {
+  z_stream zs;
+  bool begun;                   /* whether ZS was initialized */
+  bool ended;                   /* whether the compressed stream ended */
+};
+
+/* Inflate the BUFSIZE bytes of BUF, the next portion of a body
+   compressed with gzip or deflate, write the data they decompress to
+   to OUT and increment *WRITTEN by their amount.  With COLLECT, pass
+   the data to html_stream_feed too.  Return -1 in case of error
+   writing to OUT, -4 if BUF doesn't decompress, 0 otherwise.  */
+
+static int
+inflate_data (struct body_inflate *zi, FILE *out, const char *buf,
+              int bufsize, bool collect, wgint *written)
+{
+  z_stream *zs = &zi->zs;
+  char zbuf[16 * 1024];
+
+  if (bufsize == 0)
+    return 0;
+  if (!zi->begun)
+    {
+      /* Many servers send raw deflate data as "deflate", instead of
+         the zlib stream RFC 2616 asks for.  The first byte of a zlib
+         or a gzip stream tells them apart.  */
+      int bits = ((buf[0] & 0x0f) == 8 || (unsigned char) buf[0] == 0x1f
+                  ? 32 + MAX_WBITS : -MAX_WBITS);
+      if (inflateInit2 (zs, bits) != Z_OK)
+        return -4;
+      zi->begun = true;
+    }
+
+  zs->next_in = (Bytef *) buf;
+  zs->avail_in = bufsize;
+  do
+    {
+      int res, size;
+      wgint skip = 0;
+
+      if (zi->ended)
+        {
+          /* Several gzip members may follow each other; anything
+             else after the stream is ignored, like browsers do.  */
+          if (*zs->next_in != 0x1f || inflateReset (zs) != Z_OK)
+            return 0;
+          zi->ended = false;
+        }
+      zs->next_out = (Bytef *) zbuf;
+      zs->avail_out = sizeof zbuf;
+      res = inflate (zs, Z_NO_FLUSH);
+      if (res == Z_STREAM_END)
+        zi->ended = true;
+      else if (res != Z_OK && res != Z_BUF_ERROR)
+        return -4;
+
+      size = sizeof zbuf - zs->avail_out;
+      if (size > 0)
+        {
+          if (write_data (out, NULL, zbuf, size, &skip, written) < 0)
+            return -1;
+          if (collect)
+            html_stream_feed (zbuf, size);
+        }
+    }
+  while (zs->avail_in > 0 || (zs->avail_out == 0 && !zi->ended));
+  return 0;
+}
+#endif /* HAVE_LIBZ */
+
+/* fd_read_body reads in portions of DLBUF_MIN bytes at first.  When a
+   read fills the buffer, the data arrives faster than it is read, so
+   the buffer is doubled, up to DLBUF_MAX bytes, which makes for fewer
+   system calls on fast links.  */
+#define DLBUF_MIN MAX (BUFSIZ, 8 * 1024)
+#define DLBUF_MAX (1024 * 1024)
+
 /* Read the contents of file descriptor FD until it the connection
-   terminates or a read error occurs.  The data is read in portions of
-   up to 16K and written to OUT as it arrives.  If opt.verbose is set,
-   the progress is shown.
+   terminates or a read error occurs.  The data is read in portions
+   that grow with the transfer rate, and written to OUT as it arrives.
+   A plain body bound for a regular file is spliced to it instead,
+   where the system supports that.  If opt.verbose is set, the
+   progress is shown.
 
    TOREAD is the amount of data expected to arrive, normally only used
    by the progress gauge.
@@ -212,15 +348,27 @@ write_data (FILE *out, FILE *out2, const char *buf, int bufsize,
    the amount of data written to disk.  The time it took to download
    the data is stored to ELAPSED.
 
+   With rb_collect_links in FLAGS, the data is also passed to
+   html_stream_feed, so that the links of an HTML document are found
+   while it arrives.
+
+   With rb_decompress in FLAGS, the body is compressed with gzip or
+   deflate, and it is inflated as it arrives: OUT, QTYWRITTEN and
+   html_stream_feed get the decompressed data.
+
    If OUT2 is non-NULL, the contents is also written to OUT2.
    OUT2 will get an exact copy of the response: if this is a chunked
    response, everything -- including the chunk headers -- is written
-   to OUT2.  (OUT will only get the unchunked response.)
+   to OUT2.  (OUT will only get the unchunked, decompressed response.)
+   OUT2 is a WARC temporary file, written with warc_tempfile_write so
+   that the digests of the WARC record are computed as the data
+   arrives.
 
    The function exits and returns the amount of data read.  In case of
    error while reading data, -1 is returned.  In case of error while
    writing data to OUT, -2 is returned.  In case of error while writing
-   data to OUT2, -3 is returned.  */
+   data to OUT2, -3 is returned.  If a compressed body doesn't
+   decompress, -4 is returned.  */
 
 int
 fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread, wgint startpos,
@@ -229,10 +377,15 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
               FILE *out2)
 {
   int ret = 0;
-#undef max
-#define max(a,b) ((a) > (b) ? (a) : (b))
-  int dlbufsize = max (BUFSIZ, 8 * 1024);
+  int dlbufsize = DLBUF_MIN;
   char *dlbuf = xmalloc (dlbufsize);
+#ifdef HAVE_SPLICE
+  /* The pipe the body is spliced through, if any.  */
+  int splice_pipe[2] = { -1, -1 };
+#endif
+#ifdef HAVE_LIBZ
+  struct body_inflate zi;
+#endif
 
   struct ptimer *timer = NULL;
   double last_successful_read_tm = 0;
@@ -259,6 +412,9 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
 
   if (flags & rb_skip_startpos)
     skip = startpos;
+#ifdef HAVE_LIBZ
+  xzero (zi);
+#endif
 
   if (opt.show_progress)
     {
@@ -294,6 +450,30 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
   if (opt.limit_rate && opt.limit_rate < dlbufsize)
     dlbufsize = opt.limit_rate;
 
+#ifdef HAVE_SPLICE
+  /* A body that needs no decoding, bound for a regular file only, can
+     go from FD to OUT through a pipe without being copied to user
+     space.  Files opened for appending don't take spliced data.  */
+  if (out && !out2 && !chunked && !skip
+      && !(flags & (rb_collect_links | rb_decompress)))
+    {
+      struct_stat st;
+      if (fstat (fileno (out), &st) == 0 && S_ISREG (st.st_mode)
+          && !(fcntl (fileno (out), F_GETFL) & O_APPEND)
+          && fflush (out) == 0 && pipe (splice_pipe) == 0)
+        {
+#ifdef F_SETPIPE_SZ
+          /* Let the pipe hold the largest portion.  */
+          fcntl (splice_pipe[1], F_SETPIPE_SZ, DLBUF_MAX);
+#endif
+        }
+      else
+        splice_pipe[0] = splice_pipe[1] = -1;
+    }
+#endif
+
+  timing_phase_begin (TIMING_BODY);
+
   /* Read from FD while there is data to read.  Normally toread==0
      means that it is unknown how much data is to arrive.  However, if
      EXACT is set, then toread==0 means what it says: that no data
@@ -315,7 +495,7 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
                   break;
                 }
               else if (out2 != NULL)
-                fwrite (line, 1, strlen (line), out2);
+                warc_tempfile_write (out2, line, strlen (line));
 
               remaining_chunk_size = strtol (line, &endl, 16);
               xfree (line);
@@ -329,7 +509,7 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
                   else
                     {
                       if (out2 != NULL)
-                        fwrite (line, 1, strlen (line), out2);
+                        warc_tempfile_write (out2, line, strlen (line));
                       xfree (line);
                     }
                   break;
@@ -364,7 +544,20 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
                 }
             }
         }
-      ret = fd_read (fd, dlbuf, rdsize, tmout);
+#ifdef HAVE_SPLICE
+      if (splice_pipe[0] != -1)
+        {
+          ret = fd_splice (fd, splice_pipe[1], rdsize, tmout);
+          if (ret < 0 && errno == EINVAL)
+            {
+              /* FD has a transport of its own; read it instead.  */
+              splice_end (splice_pipe, out);
+              ret = fd_read (fd, dlbuf, rdsize, tmout);
+            }
+        }
+      else
+#endif
+        ret = fd_read (fd, dlbuf, rdsize, tmout);
 
       if (progress_interactive && ret < 0 && errno == ETIMEDOUT)
         ret = 0;                /* interactive timeout, handled above */
@@ -383,12 +576,38 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
           int write_res;
 
           sum_read += ret;
-          write_res = write_data (out, out2, dlbuf, ret, &skip, &sum_written);
+          timing_phase_begin (TIMING_WRITE);
+#ifdef HAVE_SPLICE
+          if (splice_pipe[0] != -1)
+            write_res = splice_data (splice_pipe[0], out, ret,
+                                     dlbuf, dlbufsize, &sum_written);
+          else
+#endif
+#ifdef HAVE_LIBZ
+          if (flags & rb_decompress)
+            {
+              /* The WARC record holds the body as it came.  */
+              wgint raw_written = 0;
+              if (write_data (NULL, out2, dlbuf, ret, &skip,
+                              &raw_written) < 0)
+                write_res = -3;
+              else
+                write_res = inflate_data (&zi, out, dlbuf, ret,
+                                          flags & rb_collect_links,
+                                          &sum_written);
+            }
+          else
+#endif
+            write_res = write_data (out, out2, dlbuf, ret, &skip,
+                                    &sum_written);
+          timing_phase_end (TIMING_WRITE);
           if (write_res < 0)
             {
-              ret = (write_res == -3) ? -3 : -2;
+              ret = (write_res == -3 || write_res == -4) ? write_res : -2;
               goto out;
             }
+          if ((flags & rb_collect_links) && !(flags & rb_decompress))
+            html_stream_feed (dlbuf, ret);
           if (chunked)
             {
               remaining_chunk_size -= ret;
@@ -403,13 +622,19 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
                   else
                     {
                       if (out2 != NULL)
-                        fwrite (line, 1, strlen (line), out2);
+                        warc_tempfile_write (out2, line, strlen (line));
                       xfree (line);
                     }
                 }
             }
         }
 
+      if (ret == dlbufsize && dlbufsize < DLBUF_MAX && !opt.limit_rate)
+        {
+          dlbufsize *= 2;
+          dlbuf = xrealloc (dlbuf, dlbufsize);
+        }
+
       if (opt.limit_rate)
         limit_bandwidth (ret, timer);
 
@@ -423,8 +648,25 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
     }
   if (ret < -1)
     ret = -1;
+#ifdef HAVE_LIBZ
+  /* A compressed body cut short didn't arrive whole, whatever its
+     length.  */
+  if (ret >= 0 && zi.begun && !zi.ended)
+    ret = -4;
+#endif
 
  out:
+#ifdef HAVE_SPLICE
+  if (splice_pipe[0] != -1)
+    splice_end (splice_pipe, out);
+#endif
+#ifdef HAVE_LIBZ
+  if (zi.begun)
+    inflateEnd (&zi.zs);
+#endif
+  timing_phase_end (TIMING_BODY);
+  timing_request_bytes (sum_read);
+
   if (progress)
     progress_finish (progress, ptimer_read (timer));
 
@@ -1015,6 +1257,27 @@ bail:
   return result;
 }
 
+/* The URLs of retrieve_from_file following the one being retrieved,
+   for upcoming_from_file.  */
+static struct urlpos *upcoming_urls;
+
+/* Return the Nth of UPCOMING_URLS that will actually be retrieved.
+   Used by --pipeline.  */
+
+static const char *
+upcoming_from_file (int n, const char **referer)
+{
+  struct urlpos *cur;
+
+  for (cur = upcoming_urls; cur; cur = cur->next)
+    if (!cur->ignore_when_downloading && n-- == 0)
+      {
+        *referer = NULL;
+        return cur->url->url;
+      }
+  return NULL;
+}
+
 /* Find the URLs in the file and call retrieve_url() for each of them.
    If HTML is true, treat the file as HTML, and construct the URLs
    accordingly.
@@ -1125,10 +1388,15 @@ retrieve_from_file (const char *file, bool html, int *count)
           opt.follow_ftp = old_follow_ftp;
         }
       else
-        status = retrieve_url (parsed_url ? parsed_url : cur_url->url,
-                               cur_url->url->url, &filename,
-                               &new_file, NULL, &dt, opt.recursive, tmpiri,
-                               true);
+        {
+          upcoming_urls = cur_url->next;
+          http_set_upcoming (upcoming_from_file);
+          status = retrieve_url (parsed_url ? parsed_url : cur_url->url,
+                                 cur_url->url->url, &filename,
+                                 &new_file, NULL, &dt, opt.recursive, tmpiri,
+                                 true);
+          http_set_upcoming (NULL);
+        }
       xfree (proxy);
 
       if (parsed_url)
@@ -49,7 +49,14 @@ enum {
   rb_skip_startpos = 2,
 
   /* Used by HTTP/HTTPS*/
-  rb_chunked_transfer_encoding = 4
+  rb_chunked_transfer_encoding = 4,
+
+  /* Pass the body to html_stream_feed; not with rb_skip_startpos.  */
+  rb_collect_links = 8,
+
+  /* Inflate a body compressed with gzip or deflate before writing it
+     out; not with rb_skip_startpos.  */
+  rb_decompress = 16
 };
 
 int fd_read_body (const char *, int, FILE *, wgint, wgint, wgint *, wgint *, double *, int, FILE *);
@@ -39,6 +39,7 @@ as that of the covered work.  */
 #include "utils.h"
 #include "hash.h"
 #include "res.h"
+#include "recur.h"
 
 
 static struct hash_table *nonexisting_urls_set;
@@ -59,6 +60,7 @@ nonexisting_url (const char *url)
   /* Ignore robots.txt URLs */
   if (is_robots_txt_url (url))
     return;
+  parallel_record ('n', url, NULL);
   if (!nonexisting_urls_set)
     nonexisting_urls_set = make_string_hash_table (0);
   string_set_add (nonexisting_urls_set, url);
@@ -0,0 +1,468 @@
+/* Timing of the phases of HTTP requests.
+   Copyright (C) 2016 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+/* With --timing-log=FILE, a line like this one is written to FILE
+   for every HTTP request:
+
+     {"start":"2016-01-31T12:00:00Z","status":200,"reused":false,
+      "bytes":1234,"dns":0.000210,"connect":0.000105,"tls":null,
+      "first_byte":0.012000,"body":0.000820,"write":0.000040,
+      "url":"http://example.com/"}
+
+   (on one line).  The times are in seconds, and null for the phases
+   the request did without.  STATUS is null when no response came.
+   When Wget is done, a last line sums the requests up, with a
+   histogram of the time taken by each phase.
+
+   The processes forked by --parallel and --segments write their own
+   lines, each with a single write to a file opened for appending, so
+   that the lines don't mix.  The summary is then made from the file
+   itself, and only counts the requests of the main process when the
+   file can't be read back.  */
+
+#include "wget.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "timing.h"
+#include "ptimer.h"
+#include "utils.h"
+#include "exits.h"
+
+/* What is known of a request.  */
+struct timing_record {
+  time_t start;
+  int status;                   /* 0 if there was no response */
+  bool reused;                  /* whether the connection was reused */
+  wgint bytes;                  /* bytes of body read */
+  double phase[TIMING_PHASES];  /* -1 for phases that didn't happen */
+};
+
+static const char *timing_phase_names[TIMING_PHASES] = {
+  "dns", "connect", "tls", "first_byte", "body", "write"
+};
+
+/* The upper bounds of the histogram buckets, in seconds.  The last
+   bucket has none.  */
+static const double timing_bounds[] = {
+  0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1, 2, 5, 10
+};
+#define TIMING_BUCKETS (countof (timing_bounds) + 1)
+
+struct timing_stats {
+  wgint requests, failed, reused, bytes;
+  wgint status[600];
+  wgint count[TIMING_PHASES];
+  double sum[TIMING_PHASES];
+  wgint buckets[TIMING_PHASES][TIMING_BUCKETS];
+};
+
+static int timing_fd = -1;
+static struct ptimer *timing_timer;
+static struct timing_stats timing_stats;
+
+/* The request being timed, if TIMING_ACTIVE.  */
+static bool timing_active;
+static struct timing_record timing_current;
+static char *timing_url;
+static double timing_started[TIMING_PHASES];
+
+/* Open the file of --timing-log.  */
+
+void
+timing_log_open (void)
+{
+  timing_fd = open (opt.timing_log,
+                    O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+  if (timing_fd < 0)
+    {
+      logprintf (LOG_NOTQUIET, "%s: %s\n", opt.timing_log, strerror (errno));
+      exit (WGET_EXIT_GENERIC_ERROR);
+    }
+  timing_timer = ptimer_new ();
+}
+
+/* Start timing a request for URL.  A request inherited from the
+   parent of a forked process is forgotten.  */
+
+void
+timing_request_begin (const char *url)
+{
+  int i;
+
+  if (timing_fd < 0)
+    return;
+  xzero (timing_current);
+  timing_current.start = time (NULL);
+  for (i = 0; i < TIMING_PHASES; i++)
+    {
+      timing_current.phase[i] = -1;
+      timing_started[i] = -1;
+    }
+  xfree (timing_url);
+  timing_url = xstrdup (url);
+  timing_active = true;
+}
+
+void
+timing_phase_begin (enum timing_phase phase)
+{
+  if (!timing_active)
+    return;
+  timing_started[phase] = ptimer_measure (timing_timer);
+}
+
+/* Add the time elapsed since the matching timing_phase_begin to
+   PHASE.  Phases may take place several times in a request, e.g. a
+   connection attempt per address of the host.  */
+
+void
+timing_phase_end (enum timing_phase phase)
+{
+  double elapsed;
+
+  if (!timing_active || timing_started[phase] < 0)
+    return;
+  elapsed = ptimer_measure (timing_timer) - timing_started[phase];
+  if (timing_current.phase[phase] < 0)
+    timing_current.phase[phase] = 0;
+  timing_current.phase[phase] += elapsed;
+  timing_started[phase] = -1;
+}
+
+void
+timing_request_status (int status)
+{
+  if (timing_active)
+    timing_current.status = status;
+}
+
+void
+timing_request_reused (void)
+{
+  if (timing_active)
+    timing_current.reused = true;
+}
+
+void
+timing_request_bytes (wgint bytes)
+{
+  if (timing_active)
+    timing_current.bytes += bytes;
+}
+
+/* Add REC to STATS.  */
+
+static void
+timing_count (const struct timing_record *rec, struct timing_stats *stats)
+{
+  int i;
+
+  stats->requests++;
+  if (rec->status <= 0 || rec->status >= countof (stats->status))
+    stats->failed++;
+  else
+    stats->status[rec->status]++;
+  if (rec->reused)
+    stats->reused++;
+  stats->bytes += rec->bytes;
+  for (i = 0; i < TIMING_PHASES; i++)
+    if (rec->phase[i] >= 0)
+      {
+        size_t b = 0;
+
+        while (b < countof (timing_bounds) && rec->phase[i] > timing_bounds[b])
+          b++;
+        stats->count[i]++;
+        stats->sum[i] += rec->phase[i];
+        stats->buckets[i][b]++;
+      }
+}
+
+/* Print SECS to BUF in the C locale, with microseconds, and return
+   BUF.  */
+
+static char *
+timing_seconds (char *buf, double secs)
+{
+  wgint us = secs * 1000000 + 0.5;
+  sprintf (buf, "%s.%06d", number_to_static_string (us / 1000000),
+           (int) (us % 1000000));
+  return buf;
+}
+
+/* Parse what timing_seconds printed at P.  Return -1 for null.  */
+
+static double
+timing_parse_seconds (const char *p)
+{
+  char *end;
+  double secs, unit = 0.1;
+
+  if (*p == 'n')
+    return -1;
+  secs = str_to_wgint (p, &end, 10);
+  if (*end == '.')
+    for (p = end + 1; c_isdigit (*p); p++, unit /= 10)
+      secs += (*p - '0') * unit;
+  return secs;
+}
+
+/* Return the value of KEY in the JSON object LINE, which must be one
+   written by timing_request_end, or NULL if there is none.  */
+
+static const char *
+timing_field (const char *line, const char *key)
+{
+  size_t len = strlen (key);
+  const char *p = line;
+
+  while ((p = strstr (p, key)) != NULL)
+    {
+      if (p > line && p[-1] == '"' && p[len] == '"' && p[len + 1] == ':')
+        return p + len + 2;
+      p += len;
+    }
+  return NULL;
+}
+
+/* Parse LINE, written by timing_request_end, into REC.  */
+
+static bool
+timing_parse (char *line, struct timing_record *rec)
+{
+  const char *p;
+  char *url;
+  int i;
+
+  if (strncmp (line, "{\"start\":", 9) != 0)
+    return false;
+  /* Don't look into the url.  */
+  url = strstr (line, ",\"url\":");
+  if (url)
+    *url = '\0';
+
+  xzero (*rec);
+  if ((p = timing_field (line, "status")) != NULL && *p != 'n')
+    rec->status = atoi (p);
+  if ((p = timing_field (line, "reused")) != NULL)
+    rec->reused = *p == 't';
+  if ((p = timing_field (line, "bytes")) != NULL)
+    rec->bytes = str_to_wgint (p, NULL, 10);
+  for (i = 0; i < TIMING_PHASES; i++)
+    {
+      p = timing_field (line, timing_phase_names[i]);
+      rec->phase[i] = p ? timing_parse_seconds (p) : -1;
+    }
+  return true;
+}
+
+/* Write the NUL-terminated LINE to the log in one go.  */
+
+static void
+timing_write (const char *line)
+{
+  size_t len = strlen (line);
+
+  while (len > 0)
+    {
+      ssize_t n = write (timing_fd, line, len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        {
+          logprintf (LOG_NOTQUIET, "%s: %s\n", opt.timing_log,
+                     strerror (errno));
+          return;
+        }
+      line += n;
+      len -= n;
+    }
+}
+
+/* Return S quoted as a JSON string, without the quotes.  */
+
+static char *
+timing_json_string (const char *s)
+{
+  char *res = xmalloc (6 * strlen (s) + 1), *p = res;
+
+  for (; *s; s++)
+    {
+      unsigned char c = *s;
+      if (c == '"' || c == '\\')
+        {
+          *p++ = '\\';
+          *p++ = c;
+        }
+      else if (c < 0x20)
+        p += sprintf (p, "\\u%04x", c);
+      else
+        *p++ = c;
+    }
+  *p = '\0';
+  return res;
+}
+
+/* Log the request being timed, if any.  */
+
+void
+timing_request_end (void)
+{
+  char stamp[32], phases[TIMING_PHASES * 48], status[16], secs[32];
+  char *p = phases, *url, *line;
+  int i;
+
+  if (!timing_active)
+    return;
+  for (i = 0; i < TIMING_PHASES; i++)
+    timing_phase_end (i);
+  timing_active = false;
+
+  strftime (stamp, sizeof stamp, "%Y-%m-%dT%H:%M:%SZ",
+            gmtime (&timing_current.start));
+  if (timing_current.status > 0)
+    sprintf (status, "%d", timing_current.status);
+  else
+    strcpy (status, "null");
+  for (i = 0; i < TIMING_PHASES; i++)
+    p += sprintf (p, ",\"%s\":%s", timing_phase_names[i],
+                  timing_current.phase[i] < 0 ? "null"
+                  : timing_seconds (secs, timing_current.phase[i]));
+  url = timing_json_string (timing_url);
+  line = aprintf ("{\"start\":\"%s\",\"status\":%s,\"reused\":%s,"
+                  "\"bytes\":%s%s,\"url\":\"%s\"}\n",
+                  stamp, status, timing_current.reused ? "true" : "false",
+                  number_to_static_string (timing_current.bytes),
+                  phases, url);
+  timing_write (line);
+  xfree (line);
+  xfree (url);
+
+  timing_count (&timing_current, &timing_stats);
+}
+
+/* Recount the requests logged by all processes from the log, if it
+   can be read back.  */
+
+static void
+timing_recount (void)
+{
+  struct file_memory *fm;
+  struct_stat st;
+  const char *p, *end;
+
+  if (fstat (timing_fd, &st) != 0 || !S_ISREG (st.st_mode))
+    return;
+  fm = wget_read_file (opt.timing_log);
+  if (fm == NULL)
+    return;
+
+  xzero (timing_stats);
+  for (p = fm->content, end = p + fm->length; p < end; )
+    {
+      struct timing_record rec;
+      const char *eol = memchr (p, '\n', end - p);
+      char *line;
+
+      if (eol == NULL)
+        eol = end;
+      line = strdupdelim (p, eol);
+      if (timing_parse (line, &rec))
+        timing_count (&rec, &timing_stats);
+      xfree (line);
+      p = eol + 1;
+    }
+  wget_read_file_free (fm);
+}
+
+/* Write the summary of the requests at the end of the log.  */
+
+void
+timing_log_summary (void)
+{
+  struct timing_stats *stats = &timing_stats;
+  char secs[32];
+  char *summary, *p;
+  const char *sep = "";
+  size_t i, b;
+
+  if (timing_fd < 0)
+    return;
+  timing_request_end ();
+  timing_recount ();
+
+  /* Room for every status code and every bucket.  */
+  p = summary = xmalloc (256 + countof (stats->status) * 32
+                         + TIMING_PHASES * (128 + TIMING_BUCKETS * 24)
+                         + countof (timing_bounds) * 24);
+  p += sprintf (p, "{\"summary\":{\"requests\":%s,\"failed\":%s,\"reused\":%s,",
+                number_to_static_string (stats->requests),
+                number_to_static_string (stats->failed),
+                number_to_static_string (stats->reused));
+  p += sprintf (p, "\"bytes\":%s,\"status\":{",
+                number_to_static_string (stats->bytes));
+  for (i = 0; i < countof (stats->status); i++)
+    if (stats->status[i])
+      {
+        p += sprintf (p, "%s\"%d\":%s", sep, (int) i,
+                      number_to_static_string (stats->status[i]));
+        sep = ",";
+      }
+  p += sprintf (p, "},\"bounds\":[");
+  for (b = 0; b < countof (timing_bounds); b++)
+    p += sprintf (p, "%s%s", b ? "," : "",
+                  timing_seconds (secs, timing_bounds[b]));
+  p += sprintf (p, "]");
+  for (i = 0; i < TIMING_PHASES; i++)
+    {
+      p += sprintf (p, ",\"%s\":{\"count\":%s,\"sum\":%s,\"buckets\":[",
+                    timing_phase_names[i],
+                    number_to_static_string (stats->count[i]),
+                    timing_seconds (secs, stats->sum[i]));
+      for (b = 0; b < TIMING_BUCKETS; b++)
+        p += sprintf (p, "%s%s", b ? "," : "",
+                      number_to_static_string (stats->buckets[i][b]));
+      p += sprintf (p, "]}");
+    }
+  strcpy (p, "}}\n");
+  timing_write (summary);
+  xfree (summary);
+
+  close (timing_fd);
+  timing_fd = -1;
+  ptimer_destroy (timing_timer);
+  xfree (timing_url);
+}
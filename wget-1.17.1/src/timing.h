@@ -0,0 +1,56 @@
+/* Declarations for timing.c.
+   Copyright (C) 2016 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+/* The phases of a request timed for --timing-log.  */
+enum timing_phase {
+  TIMING_DNS,                   /* looking up the host */
+  TIMING_CONNECT,               /* connecting to it */
+  TIMING_TLS,                   /* the TLS handshake */
+  TIMING_FIRST_BYTE,            /* sending the request until the
+                                   response head is read */
+  TIMING_BODY,                  /* reading the body */
+  TIMING_WRITE,                 /* writing it to disk, within the above */
+  TIMING_PHASES
+};
+
+void timing_log_open (void);
+void timing_log_summary (void);
+
+void timing_request_begin (const char *);
+void timing_request_end (void);
+void timing_phase_begin (enum timing_phase);
+void timing_phase_end (enum timing_phase);
+void timing_request_status (int);
+void timing_request_reused (void);
+void timing_request_bytes (wgint);
+
+#endif /* TIMING_H */
@@ -53,6 +53,16 @@ as that of the covered work.  */
 
 #include "warc.h"
 #include "exits.h"
+#include "connect.h"
+
+#if defined HAVE_LIBZ && !defined WINDOWS && !defined MSDOS && !defined __VMS
+/* The records are compressed by a separate process, so that the
+   compression of a record overlaps the retrieval of the next.  */
+# define WARC_COMPRESSOR
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/wait.h>
+#endif
 
 #ifdef WINDOWS
 /* we need this on Windows to have O_TEMPORARY defined */
@@ -91,6 +101,43 @@ static off_t warc_current_gzfile_offset;
 static off_t warc_current_gzfile_uncompressed_size;
 # endif
 
+#ifdef WARC_COMPRESSOR
+/* The process that compresses the records of the current WARC file,
+   or 0 if this process compresses them.  */
+static pid_t warc_compressor_pid;
+
+/* The pipe the records are sent to the compressor through, and the
+   pipe it tells through where each record ended up in the file.  */
+static int warc_compressor_fd = -1;
+static int warc_compressor_ack_fd = -1;
+
+/* The records sent to the compressor, and those it has written.  */
+static int warc_compressor_sent;
+static int warc_compressor_done;
+
+/* The offset in the WARC file at which the last record written by
+   the compressor ends.  */
+static off_t warc_compressor_end;
+
+/* The part of the current record not sent to the compressor yet,
+   after the length of the portion that it will be sent as.  */
+#define WARC_COMPRESSOR_BUFSIZE (64 * 1024)
+static char warc_compressor_buf[sizeof (int) + WARC_COMPRESSOR_BUFSIZE];
+static int warc_compressor_buflen;
+
+/* The CDX lines of the records whose offset the compressor has yet
+   to tell, in the order of the records.  */
+struct warc_cdx_pending
+{
+  int record;                   /* the number of the record */
+  char *head, *tail;            /* the line before and after the offset */
+  struct warc_cdx_pending *next;
+};
+static struct warc_cdx_pending *warc_cdx_pending_head;
+static struct warc_cdx_pending **warc_cdx_pending_tail =
+  &warc_cdx_pending_head;
+#endif /* WARC_COMPRESSOR */
+
 /* This is true until a warc_write_* method fails. */
 static bool warc_write_ok;
 
@@ -108,10 +155,27 @@ static char *warc_current_filename;
    WARC file's filename. */
 static int warc_current_file_number;
 
+/* The temporary file last opened by warc_tempfile, and the number of
+   bytes written to it by warc_tempfile_write.  If
+   opt.warc_digests_enabled, these bytes are digested as they are
+   written, so that the digests of the record are known when the file
+   is copied to the WARC file.  The payload digest starts at
+   warc_digest_payload_offset, or is not computed if that is -1; the
+   digest of what comes before is kept in warc_digest_head_ctx.  */
+static FILE *warc_digest_file;
+static off_t warc_digest_size;
+static off_t warc_digest_payload_offset;
+static struct sha1_ctx warc_digest_block_ctx;
+static struct sha1_ctx warc_digest_payload_ctx;
+static struct sha1_ctx warc_digest_head_ctx;
+
 /* The table of CDX records, if deduplication is enabled. */
 static struct hash_table * warc_cdx_dedup_table;
 
 static bool warc_start_new_file (bool meta);
+#ifdef WARC_COMPRESSOR
+static size_t warc_compressor_write (const char *buffer, size_t size);
+#endif
 
 
 struct warc_cdx_record
@@ -144,6 +208,10 @@ warc_cmp_sha1_digest (const void *digest1, const void *digest2)
 static size_t
 warc_write_buffer (const char *buffer, size_t size)
 {
+#ifdef WARC_COMPRESSOR
+  if (warc_compressor_pid > 0)
+    return warc_compressor_write (buffer, size);
+#endif
 #ifdef HAVE_LIBZ
   if (warc_current_gzfile)
     {
@@ -174,11 +242,416 @@ warc_write_string (const char *str)
 }
 
 
+#ifdef HAVE_LIBZ
 #define EXTRA_GZIP_HEADER_SIZE 14
 #define GZIP_STATIC_HEADER_SIZE  10
 #define FLG_FEXTRA          0x04
 #define OFF_FLG             3
 
+/* Starts a new GZIP stream at the end of the current WARC file.
+   Returns false and set warc_write_ok to false if there
+   is an error.  */
+static bool
+warc_gzip_start (void)
+{
+  /* Record the starting offset of the new record. */
+  warc_current_gzfile_offset = ftello (warc_current_file);
+
+  /* Reserve space for the extra GZIP header field.
+     In warc_gzip_end we will fill this space
+     with information about the uncompressed and
+     compressed size of the record. */
+  fseek (warc_current_file, EXTRA_GZIP_HEADER_SIZE, SEEK_CUR);
+  fflush (warc_current_file);
+
+  /* Start a new GZIP stream. */
+  warc_current_gzfile = gzdopen (dup (fileno (warc_current_file)), "wb9");
+  warc_current_gzfile_uncompressed_size = 0;
+
+  if (warc_current_gzfile == NULL)
+    {
+      logprintf (LOG_NOTQUIET,
+_("Error opening GZIP stream to WARC file.\n"));
+      warc_write_ok = false;
+      return false;
+    }
+  return true;
+}
+
+/* Closes the current GZIP stream and fills the extra GZIP
+   header with the uncompressed and compressed length of the
+   record.  */
+static bool
+warc_gzip_end (void)
+{
+  char extra_header[EXTRA_GZIP_HEADER_SIZE];
+  char static_header[GZIP_STATIC_HEADER_SIZE];
+  off_t current_offset, uncompressed_size, compressed_size;
+  size_t result;
+
+  if (gzclose (warc_current_gzfile) != Z_OK)
+    {
+      warc_current_gzfile = NULL;
+      warc_write_ok = false;
+      return false;
+    }
+  warc_current_gzfile = NULL;
+
+  fflush (warc_current_file);
+  fseeko (warc_current_file, 0, SEEK_END);
+
+  /* The WARC standard suggests that we add 'skip length' data in the
+     extra header field of the GZIP stream.
+
+     In warc_gzip_start we reserved space for this extra header.
+     This extra space starts at warc_current_gzfile_offset and fills
+     EXTRA_GZIP_HEADER_SIZE bytes.  The static GZIP header starts at
+     warc_current_gzfile_offset + EXTRA_GZIP_HEADER_SIZE.
+
+     We need to do three things:
+     1. Move the static GZIP header to warc_current_gzfile_offset;
+     2. Set the FEXTRA flag in the GZIP header;
+     3. Write the extra GZIP header after the static header, that is,
+        starting at warc_current_gzfile_offset + GZIP_STATIC_HEADER_SIZE.
+  */
+
+  /* Calculate the uncompressed and compressed sizes. */
+  current_offset = ftello (warc_current_file);
+  uncompressed_size = current_offset - warc_current_gzfile_offset;
+  compressed_size = warc_current_gzfile_uncompressed_size;
+
+  /* Go back to the static GZIP header. */
+  fseeko (warc_current_file, warc_current_gzfile_offset
+          + EXTRA_GZIP_HEADER_SIZE, SEEK_SET);
+
+  /* Read the header. */
+  result = fread (static_header, 1, GZIP_STATIC_HEADER_SIZE,
+                         warc_current_file);
+  if (result != GZIP_STATIC_HEADER_SIZE)
+    {
+      warc_write_ok = false;
+      return false;
+    }
+
+  /* Set the FEXTRA flag in the flags byte of the header. */
+  static_header[OFF_FLG] = static_header[OFF_FLG] | FLG_FEXTRA;
+
+  /* Write the header back to the file, but starting at
+     warc_current_gzfile_offset. */
+  fseeko (warc_current_file, warc_current_gzfile_offset, SEEK_SET);
+  fwrite (static_header, 1, GZIP_STATIC_HEADER_SIZE, warc_current_file);
+
+  /* Prepare the extra GZIP header. */
+  /* XLEN, the length of the extra header fields.  */
+  extra_header[0]  = ((EXTRA_GZIP_HEADER_SIZE - 2) & 255);
+  extra_header[1]  = ((EXTRA_GZIP_HEADER_SIZE - 2) >> 8) & 255;
+  /* The extra header field identifier for the WARC skip length. */
+  extra_header[2]  = 's';
+  extra_header[3]  = 'l';
+  /* The size of the field value (8 bytes).  */
+  extra_header[4]  = (8 & 255);
+  extra_header[5]  = ((8 >> 8) & 255);
+  /* The size of the uncompressed record.  */
+  extra_header[6]  = (uncompressed_size & 255);
+  extra_header[7]  = (uncompressed_size >> 8) & 255;
+  extra_header[8]  = (uncompressed_size >> 16) & 255;
+  extra_header[9]  = (uncompressed_size >> 24) & 255;
+  /* The size of the compressed record.  */
+  extra_header[10] = (compressed_size & 255);
+  extra_header[11] = (compressed_size >> 8) & 255;
+  extra_header[12] = (compressed_size >> 16) & 255;
+  extra_header[13] = (compressed_size >> 24) & 255;
+
+  /* Write the extra header after the static header. */
+  fseeko (warc_current_file, warc_current_gzfile_offset
+          + GZIP_STATIC_HEADER_SIZE, SEEK_SET);
+  fwrite (extra_header, 1, EXTRA_GZIP_HEADER_SIZE, warc_current_file);
+
+  /* Done, move back to the end of the file. */
+  fflush (warc_current_file);
+  fseeko (warc_current_file, 0, SEEK_END);
+
+  return warc_write_ok;
+}
+#endif /* HAVE_LIBZ */
+
+
+#ifdef WARC_COMPRESSOR
+/* Support for the compressor process.
+
+   The records of the WARC file are sent to it through a pipe, in
+   portions of up to WARC_COMPRESSOR_BUFSIZE bytes that are each
+   preceded by their length.  A portion of length 0 ends the record.
+   The compressor writes each record to the WARC file as a GZIP
+   stream, and then tells at which offsets it starts and ends.  As
+   the pipe holds a whole record of usual size, compressing it does
+   not hold up the retrieval of the next one.  */
+
+/* Reads SIZE bytes from FD into BUF.  Returns false at the end of
+   the file or on error.  */
+static bool
+warc_read_fully (int fd, void *buf, size_t size)
+{
+  char *p = buf;
+
+  while (size > 0)
+    {
+      ssize_t n = read (fd, p, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      p += n;
+      size -= n;
+    }
+  return true;
+}
+
+/* Writes SIZE bytes from BUF to FD.  Returns false on error.  */
+static bool
+warc_write_fully (int fd, const void *buf, size_t size)
+{
+  const char *p = buf;
+
+  while (size > 0)
+    {
+      ssize_t n = write (fd, p, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return false;
+      p += n;
+      size -= n;
+    }
+  return true;
+}
+
+/* The compressor process: reads the records from IN, writes them to
+   the current WARC file, and their offsets to OUT.  Does not
+   return.  */
+static void
+warc_compressor_run (int in, int out)
+{
+  static char buf[WARC_COMPRESSOR_BUFSIZE];
+  int size;
+
+  /* Open the file anew, for our file offset to be our own.  */
+  warc_current_file = fopen (warc_current_filename, "rb+");
+  if (warc_current_file == NULL
+      || fseeko (warc_current_file, 0, SEEK_END) != 0)
+    _exit (WGET_EXIT_IO_FAIL);
+
+  while (warc_read_fully (in, &size, sizeof size))
+    {
+      if (size < 0 || size > WARC_COMPRESSOR_BUFSIZE
+          || !warc_read_fully (in, buf, size)
+          || (warc_current_gzfile == NULL && !warc_gzip_start ())
+          || warc_write_buffer (buf, size) != (size_t) size)
+        _exit (WGET_EXIT_IO_FAIL);
+
+      if (size == 0)
+        {
+          off_t offsets[2];
+
+          if (!warc_gzip_end ())
+            _exit (WGET_EXIT_IO_FAIL);
+          offsets[0] = warc_current_gzfile_offset;
+          offsets[1] = ftello (warc_current_file);
+          if (!warc_write_fully (out, offsets, sizeof offsets))
+            _exit (WGET_EXIT_IO_FAIL);
+        }
+    }
+  _exit (warc_current_gzfile == NULL ? WGET_EXIT_SUCCESS : WGET_EXIT_IO_FAIL);
+}
+
+/* Starts the compressor for the current WARC file.  If that fails,
+   this process compresses the records itself.  */
+static void
+warc_compressor_start (void)
+{
+  int data_pipe[2], ack_pipe[2];
+
+  if (pipe (data_pipe) < 0)
+    return;
+  if (pipe (ack_pipe) < 0)
+    {
+      close (data_pipe[0]);
+      close (data_pipe[1]);
+      return;
+    }
+
+  fflush (warc_current_file);
+  logflush ();
+  warc_compressor_pid = fork ();
+  if (warc_compressor_pid == 0)
+    {
+      close (data_pipe[1]);
+      close (ack_pipe[0]);
+      warc_compressor_run (data_pipe[0], ack_pipe[1]);
+    }
+  close (data_pipe[0]);
+  close (ack_pipe[1]);
+  if (warc_compressor_pid < 0)
+    {
+      close (data_pipe[1]);
+      close (ack_pipe[0]);
+      warc_compressor_pid = 0;
+      return;
+    }
+
+  DEBUGP (("Started process %ld to compress the WARC records.\n",
+           (long) warc_compressor_pid));
+#ifdef F_SETPIPE_SZ
+  /* Let the pipe hold a larger record.  */
+  fcntl (data_pipe[1], F_SETPIPE_SZ, 1024 * 1024);
+#endif
+  warc_compressor_fd = data_pipe[1];
+  warc_compressor_ack_fd = ack_pipe[0];
+  warc_compressor_sent = warc_compressor_done = 0;
+  warc_compressor_end = 0;
+  warc_compressor_buflen = 0;
+}
+
+/* Sends the buffered part of the current record to the compressor,
+   and the end of the record if END.  */
+static bool
+warc_compressor_flush (bool end)
+{
+  int len = 0;
+
+  if (warc_compressor_buflen > 0)
+    {
+      memcpy (warc_compressor_buf, &warc_compressor_buflen, sizeof (int));
+      if (!warc_write_fully (warc_compressor_fd, warc_compressor_buf,
+                             sizeof (int) + warc_compressor_buflen))
+        warc_write_ok = false;
+      warc_compressor_buflen = 0;
+    }
+  if (end && warc_write_ok)
+    {
+      if (!warc_write_fully (warc_compressor_fd, &len, sizeof len))
+        warc_write_ok = false;
+    }
+  return warc_write_ok;
+}
+
+/* Adds SIZE bytes from BUFFER to the current record.
+   Returns the number of bytes taken.  */
+static size_t
+warc_compressor_write (const char *buffer, size_t size)
+{
+  size_t left = size;
+
+  while (left > 0)
+    {
+      size_t n = MIN (left, (size_t) (WARC_COMPRESSOR_BUFSIZE
+                                      - warc_compressor_buflen));
+      memcpy (warc_compressor_buf + sizeof (int) + warc_compressor_buflen,
+              buffer, n);
+      warc_compressor_buflen += n;
+      buffer += n;
+      left -= n;
+      if (warc_compressor_buflen == WARC_COMPRESSOR_BUFSIZE
+          && !warc_compressor_flush (false))
+        return 0;
+    }
+  return size;
+}
+
+/* Reads what the compressor has told about the records it has
+   written, and prints the CDX lines that waited for it.  If WAIT,
+   waits until it has written all the records sent to it.  */
+static void
+warc_compressor_collect (bool wait)
+{
+  while (warc_compressor_done < warc_compressor_sent)
+    {
+      off_t offsets[2];
+      char offset_string[MAX_INT_TO_STRING_LEN(off_t)];
+
+      if (!wait && select_fd (warc_compressor_ack_fd, 0, WAIT_FOR_READ) <= 0)
+        break;
+      if (!warc_read_fully (warc_compressor_ack_fd, offsets, sizeof offsets))
+        {
+          warc_write_ok = false;
+          break;
+        }
+      warc_compressor_end = offsets[1];
+      number_to_string (offset_string, offsets[0]);
+      while (warc_cdx_pending_head
+             && warc_cdx_pending_head->record == warc_compressor_done)
+        {
+          struct warc_cdx_pending *p = warc_cdx_pending_head;
+          fprintf (warc_current_cdx_file, "%s%s%s", p->head, offset_string,
+                   p->tail);
+          fflush (warc_current_cdx_file);
+          warc_cdx_pending_head = p->next;
+          xfree (p->head);
+          xfree (p->tail);
+          xfree (p);
+        }
+      warc_compressor_done++;
+    }
+  if (!warc_cdx_pending_head)
+    warc_cdx_pending_tail = &warc_cdx_pending_head;
+}
+
+/* Ends the current record.  What the compressor tells about it is
+   read when the next record starts, after the caller has had its CDX
+   line wait for it.  */
+static bool
+warc_compressor_end_record (void)
+{
+  if (warc_compressor_flush (true))
+    warc_compressor_sent++;
+  return warc_write_ok;
+}
+
+/* Has the CDX line made of HEAD, the offset of the last record sent
+   to the compressor and TAIL printed once that offset is known.  */
+static void
+warc_compressor_defer_cdx (char *head, char *tail)
+{
+  struct warc_cdx_pending *p = xnew (struct warc_cdx_pending);
+
+  p->record = warc_compressor_sent - 1;
+  p->head = head;
+  p->tail = tail;
+  p->next = NULL;
+  *warc_cdx_pending_tail = p;
+  warc_cdx_pending_tail = &p->next;
+}
+
+/* Waits for the compressor to write all the records, and stops it.  */
+static void
+warc_compressor_stop (void)
+{
+  int status;
+
+  close (warc_compressor_fd);
+  warc_compressor_collect (true);
+  close (warc_compressor_ack_fd);
+  warc_compressor_fd = warc_compressor_ack_fd = -1;
+
+  while (waitpid (warc_compressor_pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  if (!WIFEXITED (status) || WEXITSTATUS (status) != WGET_EXIT_SUCCESS)
+    warc_write_ok = false;
+  warc_compressor_pid = 0;
+
+  /* Records whose offset never came are not in the file.  */
+  while (warc_cdx_pending_head)
+    {
+      struct warc_cdx_pending *p = warc_cdx_pending_head;
+      warc_cdx_pending_head = p->next;
+      xfree (p->head);
+      xfree (p->tail);
+      xfree (p);
+    }
+  warc_cdx_pending_tail = &warc_cdx_pending_head;
+}
+#endif /* WARC_COMPRESSOR */
+
 /* Starts a new WARC record.  Writes the version header.
    If opt.warc_maxsize is set and the current file is becoming
    too large, this will open a new WARC file.
@@ -194,36 +667,39 @@ warc_write_start_record (void)
   if (!warc_write_ok)
     return false;
 
-  fflush (warc_current_file);
-  if (opt.warc_maxsize > 0 && ftello (warc_current_file) >= opt.warc_maxsize)
-    warc_start_new_file (false);
-
-#ifdef HAVE_LIBZ
-  /* Start a GZIP stream, if required. */
-  if (opt.warc_compression_enabled)
+  if (opt.warc_maxsize > 0)
     {
-      /* Record the starting offset of the new record. */
-      warc_current_gzfile_offset = ftello (warc_current_file);
-
-      /* Reserve space for the extra GZIP header field.
-         In warc_write_end_record we will fill this space
-         with information about the uncompressed and
-         compressed size of the record. */
-      fseek (warc_current_file, EXTRA_GZIP_HEADER_SIZE, SEEK_CUR);
-      fflush (warc_current_file);
-
-      /* Start a new GZIP stream. */
-      warc_current_gzfile = gzdopen (dup (fileno (warc_current_file)), "wb9");
-      warc_current_gzfile_uncompressed_size = 0;
+      off_t size;
 
-      if (warc_current_gzfile == NULL)
+#ifdef WARC_COMPRESSOR
+      if (warc_compressor_pid > 0)
         {
-          logprintf (LOG_NOTQUIET,
-_("Error opening GZIP stream to WARC file.\n"));
-          warc_write_ok = false;
-          return false;
+          warc_compressor_collect (true);
+          size = warc_compressor_end;
         }
+      else
+#endif
+        {
+          fflush (warc_current_file);
+          size = ftello (warc_current_file);
+        }
+      if (size >= opt.warc_maxsize)
+        warc_start_new_file (false);
     }
+#ifdef WARC_COMPRESSOR
+  else if (warc_compressor_pid > 0)
+    warc_compressor_collect (false);
+#endif
+
+#ifdef HAVE_LIBZ
+  /* Start a GZIP stream, if required.  The compressor starts
+     its own.  */
+  if (opt.warc_compression_enabled
+# ifdef WARC_COMPRESSOR
+      && warc_compressor_pid == 0
+# endif
+      && !warc_gzip_start ())
+    return false;
 #endif
 
   warc_write_string ("WARC/1.0\r\n");
@@ -281,103 +757,20 @@ warc_write_block_from_file (FILE *data_in)
 /* Run this method to close the current WARC record.
 
    If compression is enabled, this method closes the
-   current GZIP stream and fills the extra GZIP header
-   with the uncompressed and compressed length of the
-   record. */
+   current GZIP stream, or has the compressor close it.  */
 static bool
 warc_write_end_record (void)
 {
   warc_write_buffer ("\r\n\r\n", 4);
 
+#ifdef WARC_COMPRESSOR
+  if (warc_write_ok && warc_compressor_pid > 0)
+    return warc_compressor_end_record ();
+#endif
 #ifdef HAVE_LIBZ
   /* We start a new gzip stream for each record.  */
   if (warc_write_ok && warc_current_gzfile)
-    {
-      char extra_header[EXTRA_GZIP_HEADER_SIZE];
-      char static_header[GZIP_STATIC_HEADER_SIZE];
-      off_t current_offset, uncompressed_size, compressed_size;
-      size_t result;
-
-      if (gzclose (warc_current_gzfile) != Z_OK)
-        {
-          warc_write_ok = false;
-          return false;
-        }
-
-      fflush (warc_current_file);
-      fseeko (warc_current_file, 0, SEEK_END);
-
-      /* The WARC standard suggests that we add 'skip length' data in the
-         extra header field of the GZIP stream.
-
-         In warc_write_start_record we reserved space for this extra header.
-         This extra space starts at warc_current_gzfile_offset and fills
-         EXTRA_GZIP_HEADER_SIZE bytes.  The static GZIP header starts at
-         warc_current_gzfile_offset + EXTRA_GZIP_HEADER_SIZE.
-
-         We need to do three things:
-         1. Move the static GZIP header to warc_current_gzfile_offset;
-         2. Set the FEXTRA flag in the GZIP header;
-         3. Write the extra GZIP header after the static header, that is,
-            starting at warc_current_gzfile_offset + GZIP_STATIC_HEADER_SIZE.
-      */
-
-      /* Calculate the uncompressed and compressed sizes. */
-      current_offset = ftello (warc_current_file);
-      uncompressed_size = current_offset - warc_current_gzfile_offset;
-      compressed_size = warc_current_gzfile_uncompressed_size;
-
-      /* Go back to the static GZIP header. */
-      fseeko (warc_current_file, warc_current_gzfile_offset
-              + EXTRA_GZIP_HEADER_SIZE, SEEK_SET);
-
-      /* Read the header. */
-      result = fread (static_header, 1, GZIP_STATIC_HEADER_SIZE,
-                             warc_current_file);
-      if (result != GZIP_STATIC_HEADER_SIZE)
-        {
-          warc_write_ok = false;
-          return false;
-        }
-
-      /* Set the FEXTRA flag in the flags byte of the header. */
-      static_header[OFF_FLG] = static_header[OFF_FLG] | FLG_FEXTRA;
-
-      /* Write the header back to the file, but starting at
-         warc_current_gzfile_offset. */
-      fseeko (warc_current_file, warc_current_gzfile_offset, SEEK_SET);
-      fwrite (static_header, 1, GZIP_STATIC_HEADER_SIZE, warc_current_file);
-
-      /* Prepare the extra GZIP header. */
-      /* XLEN, the length of the extra header fields.  */
-      extra_header[0]  = ((EXTRA_GZIP_HEADER_SIZE - 2) & 255);
-      extra_header[1]  = ((EXTRA_GZIP_HEADER_SIZE - 2) >> 8) & 255;
-      /* The extra header field identifier for the WARC skip length. */
-      extra_header[2]  = 's';
-      extra_header[3]  = 'l';
-      /* The size of the field value (8 bytes).  */
-      extra_header[4]  = (8 & 255);
-      extra_header[5]  = ((8 >> 8) & 255);
-      /* The size of the uncompressed record.  */
-      extra_header[6]  = (uncompressed_size & 255);
-      extra_header[7]  = (uncompressed_size >> 8) & 255;
-      extra_header[8]  = (uncompressed_size >> 16) & 255;
-      extra_header[9]  = (uncompressed_size >> 24) & 255;
-      /* The size of the compressed record.  */
-      extra_header[10] = (compressed_size & 255);
-      extra_header[11] = (compressed_size >> 8) & 255;
-      extra_header[12] = (compressed_size >> 16) & 255;
-      extra_header[13] = (compressed_size >> 24) & 255;
-
-      /* Write the extra header after the static header. */
-      fseeko (warc_current_file, warc_current_gzfile_offset
-              + GZIP_STATIC_HEADER_SIZE, SEEK_SET);
-      fwrite (extra_header, 1, EXTRA_GZIP_HEADER_SIZE, warc_current_file);
-
-      /* Done, move back to the end of the file. */
-      fflush (warc_current_file);
-      fseeko (warc_current_file, 0, SEEK_END);
-    }
+    return warc_gzip_end ();
 #endif /* HAVE_LIBZ */
 
   return warc_write_ok;
@@ -533,6 +926,57 @@ warc_sha1_stream_with_payload (FILE *stream, void *res_block, void *res_payload,
 #undef BLOCKSIZE
 }
 
+/* Computes the block digest of FILE into RES_BLOCK and, if
+   PAYLOAD_OFFSET >= 0, the digest of the payload that starts there
+   into RES_PAYLOAD, and that of what comes before it into RES_HEAD
+   unless that is NULL.  If FILE was written with warc_tempfile_write
+   only, the digests are known already; otherwise they are computed
+   by reading FILE.  Returns 0 on success.  */
+static int
+warc_sha1_digests (FILE *file, void *res_block, void *res_payload,
+                   void *res_head, off_t payload_offset)
+{
+  char buffer[BUFSIZ];
+  off_t left = payload_offset;
+  struct sha1_ctx ctx;
+
+  if (file == warc_digest_file
+      && payload_offset == warc_digest_payload_offset
+      && fseeko (file, 0, SEEK_END) == 0
+      && ftello (file) == warc_digest_size)
+    {
+      warc_digest_file = NULL;
+      sha1_finish_ctx (&warc_digest_block_ctx, res_block);
+      if (payload_offset >= 0)
+        {
+          sha1_finish_ctx (&warc_digest_payload_ctx, res_payload);
+          if (res_head)
+            sha1_finish_ctx (&warc_digest_head_ctx, res_head);
+        }
+      return 0;
+    }
+
+  rewind (file);
+  if (warc_sha1_stream_with_payload (file, res_block, res_payload,
+                                     payload_offset) != 0)
+    return 1;
+  if (payload_offset < 0 || !res_head)
+    return 0;
+
+  rewind (file);
+  sha1_init_ctx (&ctx);
+  while (left > 0)
+    {
+      size_t n = fread (buffer, 1, MIN (left, (off_t) sizeof buffer), file);
+      if (n == 0)
+        return 1;
+      sha1_process_bytes (buffer, n, &ctx);
+      left -= n;
+    }
+  sha1_finish_ctx (&ctx, res_head);
+  return 0;
+}
+
 /* Converts the SHA1 digest to a base32-encoded string.
    "sha1:DIGEST\0"  (Allocates a new string for the response.)  */
 static char *
@@ -564,9 +1008,8 @@ warc_write_digest_headers (FILE *file, long payload_offset)
       char sha1_res_block[SHA1_DIGEST_SIZE];
       char sha1_res_payload[SHA1_DIGEST_SIZE];
 
-      rewind (file);
-      if (warc_sha1_stream_with_payload (file, sha1_res_block,
-          sha1_res_payload, payload_offset) == 0)
+      if (warc_sha1_digests (file, sha1_res_block,
+          sha1_res_payload, NULL, payload_offset) == 0)
         {
           char digest[BASE32_LENGTH(SHA1_DIGEST_SIZE) + 1 + 5];
 
@@ -817,7 +1260,13 @@ warc_start_new_file (bool meta)
     return false;
 
   if (warc_current_file != NULL)
-    fclose (warc_current_file);
+    {
+#ifdef WARC_COMPRESSOR
+      if (warc_compressor_pid > 0)
+        warc_compressor_stop ();
+#endif
+      fclose (warc_current_file);
+    }
 
   *warc_current_warcinfo_uuid_str = 0;
   xfree (warc_current_filename);
@@ -852,6 +1301,11 @@ warc_start_new_file (bool meta)
       return false;
     }
 
+#ifdef WARC_COMPRESSOR
+  if (opt.warc_compression_enabled)
+    warc_compressor_start ();
+#endif
+
   if (! warc_write_warcinfo_record (new_filename))
     return false;
 
@@ -940,11 +1394,13 @@ warc_parse_cdx_header (char *lineptr, int *field_num_original_url,
          && *field_num_record_id != -1;
 }
 
-/* Parse the CDX record and add it to the warc_cdx_dedup_table hash table. */
-static void
-warc_process_cdx_line (char *lineptr, int field_num_original_url,
-                       int field_num_checksum, int field_num_record_id)
+/* Parse the CDX record in LINEPTR.  Returns a new record, or NULL if
+   the line lacks a field or has an invalid checksum.  */
+static struct warc_cdx_record *
+warc_parse_cdx_line (char *lineptr, int field_num_original_url,
+                     int field_num_checksum, int field_num_record_id)
 {
+  struct warc_cdx_record *rec = NULL;
   char *original_url = NULL;
   char *checksum = NULL;
   char *record_id = NULL;
@@ -987,12 +1443,10 @@ warc_process_cdx_line (char *lineptr, int field_num_original_url,
       if (checksum_v != NULL && checksum_l == SHA1_DIGEST_SIZE)
         {
           /* This is a valid line with a valid checksum. */
-          struct warc_cdx_record *rec;
           rec = xmalloc (sizeof (struct warc_cdx_record));
           rec->url = original_url;
           rec->uuid = record_id;
           memcpy (rec->digest, checksum_v, SHA1_DIGEST_SIZE);
-          hash_table_put (warc_cdx_dedup_table, rec->digest, rec);
           xfree (checksum_v);
         }
       else
@@ -1008,24 +1462,42 @@ warc_process_cdx_line (char *lineptr, int field_num_original_url,
       xfree(original_url);
       xfree(record_id);
     }
+  return rec;
 }
 
-/* Loads the CDX file from opt.warc_cdx_dedup_filename and fills
-   the warc_cdx_dedup_table. */
-static bool
-warc_load_cdx_dedup_file (void)
+/* Parse the CDX record and add it to the warc_cdx_dedup_table hash table. */
+static void
+warc_process_cdx_line (char *lineptr, int field_num_original_url,
+                       int field_num_checksum, int field_num_record_id)
+{
+  struct warc_cdx_record *rec;
+
+  rec = warc_parse_cdx_line (lineptr, field_num_original_url,
+                             field_num_checksum, field_num_record_id);
+  if (rec != NULL)
+    hash_table_put (warc_cdx_dedup_table, rec->digest, rec);
+}
+
+/* Opens the CDX file opt.warc_cdx_dedup_filename and reads its
+   header.  Sets the field numbers of the original url, the checksum
+   and the record id, after complaining about those that are missing.
+   Returns NULL if the file cannot be opened.  */
+static FILE *
+warc_open_cdx_dedup_file (int *field_num_original_url,
+                          int *field_num_checksum, int *field_num_record_id)
 {
   FILE *f;
   char *lineptr = NULL;
   size_t n = 0;
   ssize_t line_length;
-  int field_num_original_url = -1;
-  int field_num_checksum = -1;
-  int field_num_record_id = -1;
+
+  *field_num_original_url = -1;
+  *field_num_checksum = -1;
+  *field_num_record_id = -1;
 
   f = fopen (opt.warc_cdx_dedup_filename, "r");
   if (f == NULL)
-    return false;
+    return NULL;
 
   /* The first line should contain the CDX header.
      Format:  " CDX x x x x x"
@@ -1034,25 +1506,45 @@ warc_load_cdx_dedup_file (void)
      'u' (the WARC record id). */
   line_length = getline (&lineptr, &n, f);
   if (line_length != -1)
-    warc_parse_cdx_header (lineptr, &field_num_original_url,
-                           &field_num_checksum, &field_num_record_id);
+    warc_parse_cdx_header (lineptr, field_num_original_url,
+                           field_num_checksum, field_num_record_id);
+  xfree (lineptr);
 
-  /* If the file contains all three fields, read the complete file. */
-  if (field_num_original_url == -1
-      || field_num_checksum == -1
-      || field_num_record_id == -1)
-    {
-      if (field_num_original_url == -1)
-        logprintf (LOG_NOTQUIET,
+  if (*field_num_original_url == -1)
+    logprintf (LOG_NOTQUIET,
 _("CDX file does not list original urls. (Missing column 'a'.)\n"));
-      if (field_num_checksum == -1)
-        logprintf (LOG_NOTQUIET,
+  if (*field_num_checksum == -1)
+    logprintf (LOG_NOTQUIET,
 _("CDX file does not list checksums. (Missing column 'k'.)\n"));
-      if (field_num_record_id == -1)
-        logprintf (LOG_NOTQUIET,
+  if (*field_num_record_id == -1)
+    logprintf (LOG_NOTQUIET,
 _("CDX file does not list record ids. (Missing column 'u'.)\n"));
-    }
-  else
+
+  return f;
+}
+
+/* Loads the CDX file from opt.warc_cdx_dedup_filename and fills
+   the warc_cdx_dedup_table. */
+static bool
+warc_load_cdx_dedup_file (void)
+{
+  FILE *f;
+  char *lineptr = NULL;
+  size_t n = 0;
+  ssize_t line_length;
+  int field_num_original_url;
+  int field_num_checksum;
+  int field_num_record_id;
+
+  f = warc_open_cdx_dedup_file (&field_num_original_url, &field_num_checksum,
+                                &field_num_record_id);
+  if (f == NULL)
+    return false;
+
+  /* If the file contains all three fields, read the complete file. */
+  if (field_num_original_url != -1
+      && field_num_checksum != -1
+      && field_num_record_id != -1)
     {
       int nrecords;
 
@@ -1085,6 +1577,266 @@ _("CDX file does not list record ids. (Missing column 'u'.)\n"));
 
   return true;
 }
+
+/* Support for --warc-dedup-index.
+
+   The index of a CDX file holds what deduplication needs of it in a
+   form that can be used as is, so that it is mapped into memory
+   rather than loaded.  It starts with this header, whose numbers are
+   64 bits, least significant byte first:
+
+     "WgetCDXi"         the magic string
+     count              the number of records
+     cdx_size           the size of the CDX file it was built from
+     cdx_mtime          and its modification time
+     entries            the offset of the entries
+
+   Then come the original url and the record id of each record, each
+   ended by a null byte, and then the entries of the records, sorted
+   by their payload digest.  An entry is made of the payload digest
+   and the offset of the url of the record.  Of several records with
+   the same digest, the last one of the CDX file is kept, as the hash
+   table does.  */
+
+#define CDX_INDEX_MAGIC "WgetCDXi"
+#define CDX_INDEX_HEADER_SIZE (8 + 4 * 8)
+#define CDX_INDEX_ENTRY_SIZE (SHA1_DIGEST_SIZE + 8)
+
+/* The mapped index, or NULL.  */
+static struct file_memory *warc_cdx_dedup_index;
+static wgint warc_cdx_dedup_index_count;
+static const char *warc_cdx_dedup_index_entries;
+
+static void
+warc_cdx_index_put (char *p, wgint value)
+{
+  int i;
+  for (i = 0; i < 8; i++)
+    p[i] = (value >> (8 * i)) & 255;
+}
+
+static wgint
+warc_cdx_index_get (const char *p)
+{
+  wgint value = 0;
+  int i;
+  for (i = 7; i >= 0; i--)
+    value = (value << 8) | (unsigned char) p[i];
+  return value;
+}
+
+struct warc_cdx_index_entry
+{
+  char digest[SHA1_DIGEST_SIZE];
+  wgint url_offset;
+};
+
+static int
+warc_cdx_index_entry_cmp (const void *a, const void *b)
+{
+  const struct warc_cdx_index_entry *ea = a, *eb = b;
+  int cmp = memcmp (ea->digest, eb->digest, SHA1_DIGEST_SIZE);
+  if (cmp)
+    return cmp;
+  return ea->url_offset < eb->url_offset ? -1
+         : ea->url_offset > eb->url_offset;
+}
+
+/* Writes the index of opt.warc_cdx_dedup_filename, described by CDX,
+   to opt.warc_cdx_dedup_index.  Returns false on error.  */
+static bool
+warc_build_cdx_dedup_index (const struct_stat *cdx)
+{
+  FILE *f, *out;
+  char *lineptr = NULL;
+  size_t n = 0;
+  int field_num_original_url;
+  int field_num_checksum;
+  int field_num_record_id;
+  struct warc_cdx_index_entry *entries = NULL;
+  wgint count = 0, size = 0, kept = 0, i;
+  char header[CDX_INDEX_HEADER_SIZE];
+  char *tmpname;
+  bool ok;
+
+  f = warc_open_cdx_dedup_file (&field_num_original_url, &field_num_checksum,
+                                &field_num_record_id);
+  if (f == NULL)
+    return false;
+  if (field_num_original_url == -1
+      || field_num_checksum == -1
+      || field_num_record_id == -1)
+    {
+      fclose (f);
+      return false;
+    }
+
+  tmpname = aprintf ("%s.tmp", opt.warc_cdx_dedup_index);
+  out = fopen (tmpname, "wb");
+  if (out == NULL)
+    {
+      logprintf (LOG_NOTQUIET, "%s: %s\n", tmpname, strerror (errno));
+      xfree (tmpname);
+      fclose (f);
+      return false;
+    }
+
+  logprintf (LOG_VERBOSE, _("Indexing CDX file %s.\n"),
+             quote (opt.warc_cdx_dedup_filename));
+
+  /* The strings go first, while the entries are gathered.  */
+  memset (header, 0, sizeof header);
+  fwrite (header, 1, sizeof header, out);
+  while (getline (&lineptr, &n, f) != -1)
+    {
+      struct warc_cdx_record *rec;
+      wgint url_offset = CDX_INDEX_HEADER_SIZE + size;
+
+      rec = warc_parse_cdx_line (lineptr, field_num_original_url,
+                                 field_num_checksum, field_num_record_id);
+      if (rec == NULL)
+        continue;
+      fputs (rec->url, out);
+      putc ('\0', out);
+      fputs (rec->uuid, out);
+      putc ('\0', out);
+      size += strlen (rec->url) + strlen (rec->uuid) + 2;
+
+      if (count % 1024 == 0)
+        entries = xrealloc (entries, (count + 1024) * sizeof *entries);
+      memcpy (entries[count].digest, rec->digest, SHA1_DIGEST_SIZE);
+      entries[count].url_offset = url_offset;
+      count++;
+
+      xfree (rec->url);
+      xfree (rec->uuid);
+      xfree (rec);
+    }
+  xfree (lineptr);
+  fclose (f);
+
+  if (count > 0)
+    qsort (entries, count, sizeof *entries, warc_cdx_index_entry_cmp);
+  for (i = 0; i < count; i++)
+    {
+      char entry[CDX_INDEX_ENTRY_SIZE];
+
+      if (i + 1 < count
+          && !memcmp (entries[i].digest, entries[i + 1].digest,
+                      SHA1_DIGEST_SIZE))
+        continue;
+      memcpy (entry, entries[i].digest, SHA1_DIGEST_SIZE);
+      warc_cdx_index_put (entry + SHA1_DIGEST_SIZE, entries[i].url_offset);
+      fwrite (entry, 1, sizeof entry, out);
+      kept++;
+    }
+  xfree (entries);
+
+  memcpy (header, CDX_INDEX_MAGIC, 8);
+  warc_cdx_index_put (header + 8, kept);
+  warc_cdx_index_put (header + 16, cdx->st_size);
+  warc_cdx_index_put (header + 24, cdx->st_mtime);
+  warc_cdx_index_put (header + 32, CDX_INDEX_HEADER_SIZE + size);
+  ok = fseeko (out, 0, SEEK_SET) == 0
+       && fwrite (header, 1, sizeof header, out) == sizeof header;
+  ok = fclose (out) == 0 && ok;
+  if (ok && rename (tmpname, opt.warc_cdx_dedup_index) != 0)
+    ok = false;
+  if (!ok)
+    {
+      logprintf (LOG_NOTQUIET, "%s: %s\n", tmpname, strerror (errno));
+      unlink (tmpname);
+    }
+  xfree (tmpname);
+  return ok;
+}
+
+/* Maps opt.warc_cdx_dedup_index into memory, if it is an index of
+   the CDX file described by CDX, or of any CDX file if that is NULL.
+   Returns false otherwise.  */
+static bool
+warc_map_cdx_dedup_index (const struct_stat *cdx)
+{
+  struct file_memory *fm = wget_read_file (opt.warc_cdx_dedup_index);
+  wgint count, entries;
+
+  if (fm == NULL)
+    return false;
+  if (fm->length < CDX_INDEX_HEADER_SIZE
+      || memcmp (fm->content, CDX_INDEX_MAGIC, 8) != 0)
+    goto invalid;
+  count = warc_cdx_index_get (fm->content + 8);
+  entries = warc_cdx_index_get (fm->content + 32);
+  if (entries < CDX_INDEX_HEADER_SIZE || count < 0
+      || entries + count * CDX_INDEX_ENTRY_SIZE != fm->length)
+    goto invalid;
+  if (cdx != NULL
+      && (warc_cdx_index_get (fm->content + 16) != cdx->st_size
+          || warc_cdx_index_get (fm->content + 24) != cdx->st_mtime))
+    goto invalid;
+
+  warc_cdx_dedup_index = fm;
+  warc_cdx_dedup_index_count = count;
+  warc_cdx_dedup_index_entries = fm->content + entries;
+  return true;
+
+ invalid:
+  wget_read_file_free (fm);
+  return false;
+}
+
+/* Maps the index opt.warc_cdx_dedup_index into memory.  If
+   opt.warc_cdx_dedup_filename is set, the index is built from it
+   first, unless it has been already.  */
+static bool
+warc_load_cdx_dedup_index (void)
+{
+  struct_stat st;
+  const struct_stat *cdx = NULL;
+
+  if (opt.warc_cdx_dedup_filename != NULL)
+    {
+      if (stat (opt.warc_cdx_dedup_filename, &st) != 0)
+        return false;
+      cdx = &st;
+    }
+
+  if (!warc_map_cdx_dedup_index (cdx)
+      && (cdx == NULL
+          || !warc_build_cdx_dedup_index (cdx)
+          || !warc_map_cdx_dedup_index (cdx)))
+    return false;
+
+  logprintf (LOG_VERBOSE, ngettext ("Mapped %s record from CDX index.\n\n",
+                                    "Mapped %s records from CDX index.\n\n",
+                                    warc_cdx_dedup_index_count),
+             number_to_static_string (warc_cdx_dedup_index_count));
+  return true;
+}
+
+/* Looks up the record with payload digest SHA1_DIGEST in the mapped
+   index.  Returns a pointer into the index, or NULL.  */
+static const char *
+warc_find_cdx_index_entry (const char *sha1_digest)
+{
+  wgint lo = 0, hi = warc_cdx_dedup_index_count;
+
+  while (lo < hi)
+    {
+      wgint mid = lo + (hi - lo) / 2;
+      const char *entry = warc_cdx_dedup_index_entries
+                          + mid * CDX_INDEX_ENTRY_SIZE;
+      int cmp = memcmp (entry, sha1_digest, SHA1_DIGEST_SIZE);
+
+      if (cmp == 0)
+        return entry;
+      if (cmp < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return NULL;
+}
 #undef CDX_FIELDSEP
 
 /* Returns the existing duplicate CDX record for the given url and payload
@@ -1095,11 +1847,38 @@ warc_find_duplicate_cdx_record (const char *url, char *sha1_digest_payload)
 {
   struct warc_cdx_record *rec_existing;
 
-  if (warc_cdx_dedup_table == NULL)
+  if (warc_cdx_dedup_index != NULL)
+    {
+      static struct warc_cdx_record rec_mapped;
+      const char *entry = warc_find_cdx_index_entry (sha1_digest_payload);
+      wgint url_offset;
+
+      if (entry == NULL)
+        return NULL;
+      url_offset = warc_cdx_index_get (entry + SHA1_DIGEST_SIZE);
+      if (url_offset < CDX_INDEX_HEADER_SIZE
+          || url_offset >= warc_cdx_dedup_index_entries
+                           - warc_cdx_dedup_index->content)
+        return NULL;
+      /* The index was written by us, but make sure the strings end
+         within it.  */
+      rec_mapped.url = warc_cdx_dedup_index->content + url_offset;
+      rec_mapped.uuid = memchr (rec_mapped.url, '\0',
+                                warc_cdx_dedup_index_entries - rec_mapped.url);
+      if (rec_mapped.uuid == NULL)
+        return NULL;
+      rec_mapped.uuid++;
+      if (memchr (rec_mapped.uuid, '\0',
+                  warc_cdx_dedup_index_entries - rec_mapped.uuid) == NULL)
+        return NULL;
+      memcpy (rec_mapped.digest, entry, SHA1_DIGEST_SIZE);
+      rec_existing = &rec_mapped;
+    }
+  else if (warc_cdx_dedup_table != NULL)
+    rec_existing = hash_table_get (warc_cdx_dedup_table, sha1_digest_payload);
+  else
     return NULL;
 
-  rec_existing = hash_table_get (warc_cdx_dedup_table, sha1_digest_payload);
-
   if (rec_existing && strcmp (rec_existing->url, url) == 0)
     return rec_existing;
   else
@@ -1115,7 +1894,17 @@ warc_init (void)
 
   if (opt.warc_filename != NULL)
     {
-      if (opt.warc_cdx_dedup_filename != NULL)
+      if (opt.warc_cdx_dedup_index != NULL)
+        {
+          if (! warc_load_cdx_dedup_index ())
+            {
+              logprintf (LOG_NOTQUIET,
+                         _("Could not read CDX index %s for deduplication.\n"),
+                         quote (opt.warc_cdx_dedup_index));
+              exit (WGET_EXIT_GENERIC_ERROR);
+            }
+        }
+      else if (opt.warc_cdx_dedup_filename != NULL)
         {
           if (! warc_load_cdx_dedup_file ())
             {
@@ -1222,6 +2011,10 @@ warc_close (void)
     {
       warc_write_metadata ();
       *warc_current_warcinfo_uuid_str = 0;
+#ifdef WARC_COMPRESSOR
+      if (warc_compressor_pid > 0)
+        warc_compressor_stop ();
+#endif
       fclose (warc_current_file);
     }
   if (warc_current_cdx_file != NULL)
@@ -1233,6 +2026,18 @@ warc_close (void)
     }
 }
 
+/* Starts the digests of the new WARC temporary file TMP, and returns
+   TMP.  */
+static FILE *
+warc_tempfile_digest (FILE *tmp)
+{
+  warc_digest_file = tmp;
+  warc_digest_size = 0;
+  warc_digest_payload_offset = -1;
+  sha1_init_ctx (&warc_digest_block_ctx);
+  return tmp;
+}
+
 /* Creates a temporary file for writing WARC output.
    The temporary file will be created in opt.warc_tempdir.
    Returns the pointer to the temporary file, or NULL. */
@@ -1257,7 +2062,8 @@ warc_tempfile (void)
     tfn = mktemp (filename);            /* Get unique name from template. */
     if (tfn == NULL)
       return NULL;
-    return fopen (tfn, "w+", "fop=tmd");    /* Create auto-delete temp file. */
+    /* Create auto-delete temp file. */
+    return warc_tempfile_digest (fopen (tfn, "w+", "fop=tmd"));
   }
 #else /* def __VMS */
   fd = mkostemp (filename, O_TEMPORARY);
@@ -1272,10 +2078,45 @@ warc_tempfile (void)
     }
 #endif
 
-  return fdopen (fd, "wb+");
+  return warc_tempfile_digest (fdopen (fd, "wb+"));
 #endif /* def __VMS [else] */
 }
 
+/* Writes SIZE bytes from BUF to the WARC temporary file TMP, and adds
+   them to the digests of TMP.  Returns the number of bytes written.  */
+size_t
+warc_tempfile_write (FILE *tmp, const char *buf, size_t size)
+{
+  size_t written = fwrite (buf, 1, size, tmp);
+
+  if (tmp == warc_digest_file && opt.warc_digests_enabled)
+    {
+      sha1_process_bytes (buf, written, &warc_digest_block_ctx);
+      if (warc_digest_payload_offset >= 0)
+        sha1_process_bytes (buf, written, &warc_digest_payload_ctx);
+      warc_digest_size += written;
+    }
+  return written;
+}
+
+/* Marks the end of the WARC temporary file TMP as the start of the
+   payload of its record, and returns its offset.  */
+off_t
+warc_tempfile_payload (FILE *tmp)
+{
+  off_t offset = ftello (tmp);
+
+  if (tmp == warc_digest_file && offset == warc_digest_size)
+    {
+      warc_digest_payload_offset = offset;
+      warc_digest_head_ctx = warc_digest_block_ctx;
+      sha1_init_ctx (&warc_digest_payload_ctx);
+    }
+  else
+    warc_digest_file = NULL;
+  return offset;
+}
+
 
 /* Writes a request record to the WARC file.
    url  is the target uri of the request,
@@ -1350,6 +2191,19 @@ warc_write_cdx_record (const char *url, const char *timestamp_str,
   if (redirect_location == NULL || strlen(redirect_location) == 0)
     redirect_location = "-";
 
+#ifdef WARC_COMPRESSOR
+  if (offset < 0)
+    {
+      warc_compressor_defer_cdx (aprintf ("%s %s %s %s %d %s %s - ", url,
+                                          timestamp_str_cdx, url, mime_type,
+                                          response_code, checksum,
+                                          redirect_location),
+                                 aprintf (" %s %s\n", warc_current_filename,
+                                          response_uuid));
+      return true;
+    }
+#endif
+
   number_to_string (offset_string, offset);
 
   /* Print the CDX line. */
@@ -1373,22 +2227,19 @@ warc_write_cdx_record (const char *url, const char *timestamp_str,
    payload_digest  is the sha1 digest of the payload,
    ip  is the ip address of the server (or NULL),
    body  is a pointer to a file containing the response headers (without payload).
+   block_digest  is the sha1 digest of body.
    Calling this function will close body.
    Returns true on success, false on error. */
 static bool
 warc_write_revisit_record (const char *url, const char *timestamp_str,
                            const char *concurrent_to_uuid, const char *payload_digest,
-                           const char *refers_to, const ip_address *ip, FILE *body)
+                           const char *refers_to, const ip_address *ip, FILE *body,
+                           const char *block_digest)
 {
   char revisit_uuid [48];
-  char block_digest[BASE32_LENGTH(SHA1_DIGEST_SIZE) + 1 + 5];
-  char sha1_res_block[SHA1_DIGEST_SIZE];
 
   warc_uuid_str (revisit_uuid);
 
-  sha1_stream (body, sha1_res_block);
-  warc_base32_sha1_digest (sha1_res_block, block_digest, sizeof(block_digest));
-
   warc_write_start_record ();
   warc_write_header ("WARC-Type", "revisit");
   warc_write_header ("WARC-Record-ID", revisit_uuid);
@@ -1434,15 +2285,15 @@ warc_write_response_record (const char *url, const char *timestamp_str,
   char payload_digest[BASE32_LENGTH(SHA1_DIGEST_SIZE) + 1 + 5];
   char sha1_res_block[SHA1_DIGEST_SIZE];
   char sha1_res_payload[SHA1_DIGEST_SIZE];
+  char sha1_res_head[SHA1_DIGEST_SIZE];
   char response_uuid [48];
   off_t offset;
 
   if (opt.warc_digests_enabled)
     {
       /* Calculate the block and payload digests. */
-      rewind (body);
-      if (warc_sha1_stream_with_payload (body, sha1_res_block, sha1_res_payload,
-          payload_offset) == 0)
+      if (warc_sha1_digests (body, sha1_res_block, sha1_res_payload,
+          sha1_res_head, payload_offset) == 0)
         {
           /* Decide (based on url + payload digest) if we have seen this
              data before. */
@@ -1456,18 +2307,23 @@ warc_write_response_record (const char *url, const char *timestamp_str,
               logprintf (LOG_VERBOSE,
           _("Found exact match in CDX file. Saving revisit record to WARC.\n"));
 
-              /* Remove the payload from the file. */
+              /* Remove the payload from the file.  Have stdio drop
+                 what it has buffered of the file first.  */
               if (payload_offset > 0)
                 {
-                  if (ftruncate (fileno (body), payload_offset) == -1)
+                  if (fflush (body) != 0
+                      || ftruncate (fileno (body), payload_offset) == -1)
                     return false;
                 }
 
               /* Send the original payload digest. */
               warc_base32_sha1_digest (sha1_res_payload, payload_digest, sizeof(payload_digest));
+              warc_base32_sha1_digest (payload_offset > 0 ? sha1_res_head
+                                       : sha1_res_block,
+                                       block_digest, sizeof(block_digest));
               result = warc_write_revisit_record (url, timestamp_str,
                          concurrent_to_uuid, payload_digest, rec_existing->uuid,
-                         ip, body);
+                         ip, body, block_digest);
 
               return result;
             }
@@ -1481,8 +2337,16 @@ warc_write_response_record (const char *url, const char *timestamp_str,
 
   warc_uuid_str (response_uuid);
 
-  fseeko (warc_current_file, 0L, SEEK_END);
-  offset = ftello (warc_current_file);
+#ifdef WARC_COMPRESSOR
+  if (warc_compressor_pid > 0)
+    /* Known once the compressor has written the record.  */
+    offset = -1;
+  else
+#endif
+    {
+      fseeko (warc_current_file, 0L, SEEK_END);
+      offset = ftello (warc_current_file);
+    }
 
   warc_write_start_record ();
   warc_write_header ("WARC-Type", "response");
@@ -11,6 +11,8 @@ void warc_uuid_str (char *id_str);
 char * warc_timestamp (char *timestamp, size_t timestamp_size);
 
 FILE * warc_tempfile (void);
+size_t warc_tempfile_write (FILE *tmp, const char *buf, size_t size);
+off_t warc_tempfile_payload (FILE *tmp);
 
 bool warc_write_request_record (const char *url, const char *timestamp_str,
   const char *concurrent_to_uuid, const ip_address *ip, FILE *body, off_t payload_offset);
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+from sys import exit
+from random import Random
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test ensures that when a gzip compressed body is cut short, Wget
+    keeps what it inflated and fetches the rest of the file uncompressed,
+    with a Range request.
+"""
+TEST_NAME = "Compression Resume"
+############# File Definitions ###############################################
+rand = Random (0)
+Content = "".join (rand.choice ("abcdefghij \n") for _ in range (100000))
+
+Gzip_File = WgetFile ("gzip.txt", Content,
+                      rules={"ContentEncoding" : "gzip",
+                             "Truncate" : 20000})
+
+WGET_OPTIONS = "--compression=auto --waitretry=0"
+WGET_URLS = [["gzip.txt"]]
+
+Files = [[Gzip_File]]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [Gzip_File]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+from sys import exit
+from random import Random
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test ensures that Wget with --compression=auto inflates the bodies
+    it receives gzip, deflate or raw deflate compressed, also when they come
+    in chunks, and saves the files decompressed.
+"""
+TEST_NAME = "Compression"
+############# File Definitions ###############################################
+rand = Random (0)
+Content = "".join (rand.choice ("abcdefghij \n") for _ in range (100000))
+
+Gzip_File = WgetFile ("gzip.txt", Content,
+                      rules={"ContentEncoding" : "gzip"})
+Zlib_File = WgetFile ("zlib.txt", Content,
+                      rules={"ContentEncoding" : "deflate"})
+Raw_File = WgetFile ("raw.txt", Content,
+                     rules={"ContentEncoding" : "raw"})
+Chunked_File = WgetFile ("chunked.txt", Content,
+                         rules={"ContentEncoding" : "gzip",
+                                "TransferEncoding" : 1000})
+
+WGET_OPTIONS = "--compression=auto"
+WGET_URLS = [["gzip.txt", "zlib.txt", "raw.txt", "chunked.txt"]]
+
+Files = [[Gzip_File, Zlib_File, Raw_File, Chunked_File]]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [Gzip_File, Zlib_File, Raw_File, Chunked_File]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+import time
+
+"""
+    This test executes Wget with --dns-cache-file on a host name that is
+    known only from the cache file, and checks that the entry which had
+    expired is dropped when the file is saved again.
+"""
+TEST_NAME = "DNS Cache File"
+############# File Definitions ###############################################
+File1 = "Would you like some Tea?"
+
+expires = int (time.time ()) + 3600
+cache = "cached.wget.test\t%d\t127.0.0.1\n" \
+        "expired.wget.test\t1\t127.0.0.2\n" % expires
+saved_cache = "# DNS cache for GNU Wget.\n" \
+              "# <hostname>\t<expires>\t<address>[,<address>...]\n" \
+              "cached.wget.test\t%d\t127.0.0.1\n" % expires
+
+A_File = WgetFile ("File1", File1)
+Cache_File = WgetFile ("dns.cache", cache)
+Saved_Cache_File = WgetFile ("dns.cache", saved_cache)
+
+WGET_OPTIONS = "--dns-cache-file=dns.cache " \
+               "http://cached.wget.test:{{port}}/File1"
+WGET_URLS = [[]]
+
+Files = [[A_File]]
+Existing_Files = [Cache_File]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [A_File, Saved_Cache_File]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files,
+    "LocalFiles"        : Existing_Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget in recursive mode with --dns-prefetch on a
+    page whose links span to another host name, which the resolver
+    processes look up before the links are followed.
+"""
+TEST_NAME = "DNS Prefetch"
+############# File Definitions ###############################################
+names = ["a.txt", "b.txt", "c.txt"]
+
+txt_files = [WgetFile (name, "File " + name) for name in names]
+
+WGET_OPTIONS = "-nd -r -l1 -H -4 -e robots=off --dns-prefetch=2"
+WGET_URLS = [["index.html"]]
+
+ExpectedReturnCode = 0
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ThreadedServer"    : True
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+http_test = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+)
+
+# The links are filled in once the port of the server is known.
+http_test.setup()
+links = "\n".join ('    <a href="http://localhost:%s/%s">%s</a>'
+                   % (http_test.port, name, name) for name in names)
+mainpage = """
+<html>
+<head>
+  <title>Main Page</title>
+</head>
+<body>
+  <p>
+%s
+  </p>
+</body>
+</html>
+""" % links
+index_html = WgetFile ("index.html", mainpage)
+
+pre_test["ServerFiles"] = [[index_html] + txt_files]
+post_test["ExpectedFiles"] = [index_html] + txt_files
+
+err = http_test.begin ()
+
+exit (err)
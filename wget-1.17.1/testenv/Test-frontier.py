@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget in recursive mode with a queue that goes to
+    disk as soon as it holds more than one URL.  Files with the same name
+    must still be numbered in queue order, the blacklisted page must not
+    be downloaded again, and the frontier file must be removed once the
+    crawl is complete.
+"""
+TEST_NAME = "Recursion with the Queue on Disk"
+############# File Definitions ###############################################
+mainpage = """
+<html>
+<head>
+  <title>Main Page</title>
+</head>
+<body>
+  <p>
+    Get <a href="http://127.0.0.1:{{port}}/a/file.txt">a</a>,
+    <a href="http://127.0.0.1:{{port}}/b/file.txt">b</a>,
+    <a href="http://127.0.0.1:{{port}}/c/file.txt">c</a> and
+    a <a href="http://127.0.0.1:{{port}}/secondpage.html">second page</a>.
+  </p>
+</body>
+</html>
+"""
+
+secondpage = """
+<html>
+<head>
+  <title>Second Page</title>
+</head>
+<body>
+  <p>
+    Get <a href="http://127.0.0.1:{{port}}/d/file.txt">d</a>.
+    Try the blacklisted <a href="http://127.0.0.1:{{port}}/index.html">main page</a>.
+  </p>
+</body>
+</html>
+"""
+
+log = """\
+REASON	U_URL	U_SCHEME	U_HOST	U_PORT	U_PATH	U_PARAMS	U_QUERY	U_FRAGMENT	P_URL	P_SCHEME	P_HOST	P_PORT	P_PATH	P_PARAMS	P_QUERY	P_FRAGMENT
+BLACKLIST	http%3A//127.0.0.1%3A{{port}}/index.html	SCHEME_HTTP	127.0.0.1	{{port}}	index.html				http%3A//127.0.0.1%3A{{port}}/secondpage.html	SCHEME_HTTP	127.0.0.1	{{port}}	secondpage.html\t\t\t
+"""
+
+index_html = WgetFile ("index.html", mainpage)
+secondpage_html = WgetFile ("secondpage.html", secondpage)
+a_txt = WgetFile ("a/file.txt", "File A")
+b_txt = WgetFile ("b/file.txt", "File B")
+c_txt = WgetFile ("c/file.txt", "File C")
+d_txt = WgetFile ("d/file.txt", "File D")
+
+file_txt = WgetFile ("file.txt", "File A")
+file_txt_1 = WgetFile ("file.txt.1", "File B")
+file_txt_2 = WgetFile ("file.txt.2", "File C")
+file_txt_3 = WgetFile ("file.txt.3", "File D")
+log_csv = WgetFile ("log.csv", log)
+
+WGET_OPTIONS = "-nd -r --frontier-memory=1 --frontier-file=frontier " \
+               "--rejected-log log.csv"
+WGET_URLS = [["index.html"]]
+
+Files = [[index_html, secondpage_html, a_txt, b_txt, c_txt, d_txt]]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [index_html, secondpage_html, file_txt, file_txt_1,
+                           file_txt_2, file_txt_3, log_csv]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test ensures that the links converted during a recursive
+    retrieval are the same as those converted at the end: links to
+    pages queued by another page, to a page that is not found, to
+    another host, and in a page at the maximum depth.
+"""
+TEST_NAME = "Incremental Link Conversion"
+############# File Definitions ###############################################
+page = """<html>
+<body>
+%s
+</body>
+</html>
+"""
+
+index_links = """<a href="a.html">a</a> <a href="b.html">b</a>
+<a href="http://127.0.0.1:%s/a.html">a again</a>
+<a href="missing.html">missing</a>
+<a href="http://example.invalid/x.html">elsewhere</a>"""
+a_links = """<a href="b.html">b</a> <a href="c.html">c</a>
+<a href="missing.html">missing</a> <a href="index.html">back</a>"""
+b_links = """<img src="/b.png"> <a href="a.html">a</a>"""
+c_links = """<a href="d.html">d</a> <a href="a.html">a</a>"""
+
+local_index_links = """<a href="a.html">a</a> <a href="b.html">b</a>
+<a href="a.html">a again</a>
+<a href="http://127.0.0.1:%s/missing.html">missing</a>
+<a href="http://example.invalid/x.html">elsewhere</a>"""
+local_a_links = """<a href="b.html">b</a> <a href="c.html">c</a>
+<a href="http://127.0.0.1:%s/missing.html">missing</a> <a href="index.html">back</a>"""
+local_b_links = """<img src="b.png"> <a href="a.html">a</a>"""
+local_c_links = """<a href="http://127.0.0.1:%s/d.html">d</a> <a href="a.html">a</a>"""
+
+index_html = WgetFile ("index.html", page % (index_links % "{{port}}"))
+a_html = WgetFile ("a.html", page % a_links)
+b_html = WgetFile ("b.html", page % b_links)
+c_html = WgetFile ("c.html", page % c_links)
+d_html = WgetFile ("d.html", page % "")
+b_png = WgetFile ("b.png", "Picture")
+
+local_index_html = WgetFile ("index.html",
+                             page % (local_index_links % "{{port}}"))
+local_a_html = WgetFile ("a.html", page % (local_a_links % "{{port}}"))
+local_b_html = WgetFile ("b.html", page % local_b_links)
+local_c_html = WgetFile ("c.html", page % (local_c_links % "{{port}}"))
+
+WGET_OPTIONS = "-nd -r -l 2 -k"
+WGET_URLS = [["index.html"]]
+
+Files = [[index_html, a_html, b_html, c_html, d_html, b_png]]
+
+ExpectedReturnCode = 8
+ExpectedDownloadedFiles = [local_index_html, local_a_html, local_b_html,
+                           local_c_html, b_png]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+import re
+import hashlib
+
+"""
+    This is to test that Wget retrieves a Metalink file with piece hashes
+    from several mirrors at a time with --segments, and retrieves a piece
+    that doesn't match its hash again from another mirror.
+"""
+TEST_NAME = "Metalink Pieces"
+############# File Definitions ###############################################
+File1 = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ+-"
+File1_bad = File1[:40] + "!" + File1[41:]
+File1_sha256 = hashlib.sha256 (File1.encode ('UTF-8')).hexdigest ()
+Piece_hashes = "".join ("        <hash>%s</hash>\n"
+                        % hashlib.sha256 (File1[i:i+16].encode ('UTF-8')).hexdigest ()
+                        for i in range (0, len (File1), 16))
+MetaXml = \
+"""<?xml version="1.0" encoding="utf-8"?>
+<metalink xmlns="urn:ietf:params:xml:ns:metalink">
+  <file name="File1">
+    <size>64</size>
+    <hash type="sha-256">{{FILE1_HASH}}</hash>
+    <pieces length="16" type="sha-256">
+{{PIECE_HASHES}}    </pieces>
+    <url priority="1">http://{{SRV_HOST}}:{{SRV_PORT}}/File1_bad</url>
+    <url priority="2">http://{{SRV_HOST}}:{{SRV_PORT}}/File1</url>
+  </file>
+</metalink>
+"""
+
+A_File = WgetFile ("File1", File1)
+B_File = WgetFile ("File1_bad", File1_bad)
+MetaFile = WgetFile ("test.meta4", MetaXml)
+
+WGET_OPTIONS = "--segments=2 --input-metalink test.meta4"
+WGET_URLS = [[]]
+
+Files = [[A_File, B_File]]
+Existing_Files = [MetaFile]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [A_File, MetaFile]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files,
+    "LocalFiles"        : Existing_Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+http_test = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test,
+)
+
+http_test.server_setup()
+### Get and use dynamic server sockname
+srv_host, srv_port = http_test.servers[0].server_inst.socket.getsockname ()
+
+MetaXml = re.sub (r'{{FILE1_HASH}}', File1_sha256, MetaXml)
+MetaXml = re.sub (r'{{PIECE_HASHES}}', Piece_hashes, MetaXml)
+MetaXml = re.sub (r'{{SRV_HOST}}', srv_host, MetaXml)
+MetaXml = re.sub (r'{{SRV_PORT}}', str (srv_port), MetaXml)
+MetaFile.content = MetaXml
+
+err = http_test.begin ()
+
+exit (err)
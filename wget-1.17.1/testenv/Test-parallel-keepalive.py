@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget in recursive mode with two downloads at a
+    time.  A worker that is done must wait for the next file on the same
+    host and download it on the connection it kept alive, rather than
+    each file being downloaded on a new connection.
+"""
+TEST_NAME = "Parallel Recursion with Keep-Alive"
+############# File Definitions ###############################################
+names = ["%d.txt" % n for n in range(1, 9)]
+links = "\n".join('    <a href="http://127.0.0.1:{{port}}/%s">%s</a>'
+                  % (name, name) for name in names)
+mainpage = """
+<html>
+<head>
+  <title>Main Page</title>
+</head>
+<body>
+  <p>
+%s
+  </p>
+</body>
+</html>
+""" % links
+
+index_html = WgetFile ("index.html", mainpage)
+txt_files = [WgetFile (name, "File " + name) for name in names]
+
+WGET_OPTIONS = "-nd -r --parallel=2"
+WGET_URLS = [["index.html"]]
+
+Files = [[index_html] + txt_files]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [index_html] + txt_files
+
+# Two workers, and the main process for robots.txt.
+MaxConnections = [3]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files,
+    "ThreadedServer"    : True
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode,
+    "MaxConnections"    : MaxConnections
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from test.base_test import HTTP
+from misc.wget_file import WgetFile
+
+"""
+    This test downloads files alternately from two servers.  Wget must keep
+    the connection to each server alive while it talks to the other one,
+    and open only one connection to each.
+"""
+TEST_NAME = "Persistent Connections to Two Hosts"
+############# File Definitions ###############################################
+A_Files = [WgetFile ("A%d.txt" % n, "File A%d on the first server" % n)
+           for n in range(1, 4)]
+B_Files = [WgetFile ("B%d.txt" % n, "File B%d on the second server" % n)
+           for n in range(1, 4)]
+
+# The URLs are filled in once the ports of the servers are known, so
+# that Wget switches host between each download.
+WGET_URLS = [[], []]
+
+Files = [A_Files, B_Files]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = A_Files + B_Files
+
+MaxConnections = [1, 1]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode,
+    "MaxConnections"    : MaxConnections
+}
+
+http_test = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test,
+                protocols=[HTTP, HTTP]
+)
+
+http_test.setup()
+urls = []
+for a_file, b_file in zip(A_Files, B_Files):
+    for server, file_obj in ((0, a_file), (1, b_file)):
+        urls.append("http://%s:%s/%s" % (http_test.domains[server],
+                                          http_test.ports[server],
+                                          file_obj.name))
+test_options["WgetCommands"] = " ".join(urls)
+
+err = http_test.begin ()
+
+exit (err)
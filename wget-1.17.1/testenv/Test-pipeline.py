@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget in recursive mode with requests sent ahead
+    on the persistent connection.  A missing file in the middle of the
+    queue must not disturb the responses that follow it.
+"""
+TEST_NAME = "Pipelined Recursion"
+############# File Definitions ###############################################
+mainpage = """
+<html>
+<head>
+  <title>Main Page</title>
+</head>
+<body>
+  <p>
+    Get <a href="http://127.0.0.1:{{port}}/a.txt">a</a>,
+    <a href="http://127.0.0.1:{{port}}/missing.txt">a missing file</a>,
+    <a href="http://127.0.0.1:{{port}}/b.txt">b</a>,
+    <a href="http://127.0.0.1:{{port}}/c.txt">c</a> and
+    <a href="http://127.0.0.1:{{port}}/d.txt">d</a>.
+  </p>
+</body>
+</html>
+"""
+
+index_html = WgetFile ("index.html", mainpage)
+a_txt = WgetFile ("a.txt", "File A")
+b_txt = WgetFile ("b.txt", "File B")
+c_txt = WgetFile ("c.txt", "File C")
+d_txt = WgetFile ("d.txt", "File D")
+
+WGET_OPTIONS = "-r -nd --pipeline=3"
+WGET_URLS = [["index.html"]]
+
+Files = [[index_html, a_txt, b_txt, c_txt, d_txt]]
+
+ExpectedReturnCode = 8
+ExpectedDownloadedFiles = [index_html, a_txt, b_txt, c_txt, d_txt]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget in recursive mode on a page that arrives in
+    several portions, whose links are collected while it is downloaded.
+    Links, a <style> element and a comment that span the portions must
+    be handled as if the page had been read in one piece.
+"""
+TEST_NAME = "Recursion on a Large Page"
+############# File Definitions ###############################################
+rows = []
+for i in range (40):
+    rows.append ("""<tr><td><a href="http://127.0.0.1:{{port}}/file%d.txt">file
+%d</a></td><td>%s</td></tr>
+""" % (i, i, "padding " * 500))
+    if i == 10:
+        rows.append ("<style>\n" + "p { margin: 0 }\n" * 3000
+                     + "body { background: url(bg.png) }\n</style>\n")
+    if i == 20:
+        rows.append ("<!-- " + "old entries " * 3000
+                     + '<a href="hidden.txt">hidden</a> -->\n')
+
+mainpage = """
+<html>
+<head>
+  <title>Main Page</title>
+</head>
+<body>
+<table>
+%s</table>
+</body>
+</html>
+""" % "".join (rows)
+
+index_html = WgetFile ("index.html", mainpage)
+bg_png = WgetFile ("bg.png", "Background")
+hidden_txt = WgetFile ("hidden.txt", "Hidden")
+files = [WgetFile ("file%d.txt" % i, "File %d" % i) for i in range (40)]
+
+WGET_OPTIONS = "-nd -r"
+WGET_URLS = [["index.html"]]
+
+Files = [[index_html, bg_png, hidden_txt] + files]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [index_html, bg_png] + files
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget with --segments and -P, and checks that the
+    directory the file goes to is created before the ranges are written
+    to it.
+"""
+TEST_NAME = "Segmented Retrieval into a Directory"
+############# File Definitions ###############################################
+big = "".join (str (i) + "\n" for i in range (400000))
+
+big_file = WgetFile ("big.txt", big)
+big_local = WgetFile ("dir/sub/big.txt", big)
+
+WGET_OPTIONS = "--segments=3 -P dir/sub"
+WGET_URLS = [["big.txt"]]
+
+Files = [[big_file]]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [big_local]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget with --segments and -c on two files left off
+    by an earlier run.  The state file of the first one records the
+    ranges --segments=3 splits it into, so only what is missing from each
+    range is retrieved.  The state file of the second one records two
+    ranges, so it is retrieved again as a whole.
+"""
+TEST_NAME = "Segmented Retrieval Resumed"
+############# File Definitions ###############################################
+big = "".join (str (i) + "\n" for i in range (600000))
+total = len (big)
+
+# The ranges --segments=COUNT splits BIG into, as in src/http.c.
+def ranges (count):
+    starts = [total // count * i for i in range (count)] + [total]
+    return [(starts[i], starts[i + 1] - 1) for i in range (count)]
+
+# Return an interrupted download of BIG split in COUNT ranges, where the
+# first half of each range has been written, and its state file.  The
+# bytes written are 'x's, so that the test sees which ranges were
+# retrieved again.
+def left_off (count):
+    content = ""
+    state = "%d %d\n" % (total, count)
+    for first, last in ranges (count):
+        half = (last + 1 - first) // 2
+        content += "x" * half + "-" * (last + 1 - first - half)
+        state += "%d %d\n" % (first + half, last)
+    return content, state
+
+partial, state = left_off (3)
+resumed = "".join ("x" * ((last + 1 - first) // 2)
+                   + big[first + (last + 1 - first) // 2:last + 1]
+                   for first, last in ranges (3))
+stale, stale_state = left_off (2)
+
+good_file = WgetFile ("good.txt", big)
+stale_file = WgetFile ("stale.txt", big)
+
+good_partial = WgetFile ("good.txt", partial)
+good_state = WgetFile ("good.txt.wget-segments", state)
+stale_partial = WgetFile ("stale.txt", stale)
+stale_state_file = WgetFile ("stale.txt.wget-segments", stale_state)
+
+good_resumed = WgetFile ("good.txt", resumed)
+
+WGET_OPTIONS = "-c --segments=3"
+WGET_URLS = [["good.txt", "stale.txt"]]
+
+Files = [[good_file, stale_file]]
+Existing_Files = [good_partial, good_state, stale_partial, stale_state_file]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [good_resumed, stale_file]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files,
+    "LocalFiles"        : Existing_Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget with --segments on a file large enough to
+    be split into byte ranges, and checks that the ranges are put
+    together in the right order.  A small file is retrieved the usual
+    way.
+"""
+TEST_NAME = "Segmented Retrieval"
+############# File Definitions ###############################################
+big = "".join (str (i) + "\n" for i in range (400000))
+small = "Small file"
+
+big_file = WgetFile ("big.txt", big)
+small_file = WgetFile ("small.txt", small)
+
+WGET_OPTIONS = "--segments=3"
+WGET_URLS = [["big.txt", "small.txt"]]
+
+Files = [[big_file, small_file]]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [big_file, small_file]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
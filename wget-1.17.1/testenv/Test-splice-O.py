@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test ensures that Wget keeps the bodies it writes to one file with
+    -O in order when it splices some of them and writes the others through
+    stdio, which must pick up where the spliced data left the file.  The
+    ranges of a body large enough for --segments are written from the
+    position stdio gives.
+"""
+TEST_NAME = "Splice Body with -O"
+############# File Definitions ###############################################
+Content1 = "".join ("a%06d\n" % i for i in range (200000))
+Content2 = "".join ("b%06d\n" % i for i in range (200000))
+Big = "".join ("c%06d\n" % i for i in range (450000))
+
+Plain1_File = WgetFile ("plain1.txt", Content1)
+Big_File = WgetFile ("big.txt", Big)
+Chunked_File = WgetFile ("chunked.txt", Content2,
+                         rules={"TransferEncoding" : 65536})
+Plain2_File = WgetFile ("plain2.txt", Content1)
+
+WGET_OPTIONS = "-O all.txt --segments=2"
+WGET_URLS = [["plain1.txt", "big.txt", "chunked.txt", "plain2.txt"]]
+
+Files = [[Plain1_File, Big_File, Chunked_File, Plain2_File]]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [WgetFile ("all.txt", Content1 + Big + Content2
+                                     + Content1)]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files,
+    "ThreadedServer"    : True
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test ensures that Wget saves a large body whole whichever way it
+    writes it: spliced from the socket when it is plain and the file is new,
+    copied when the file is opened for appending by -c, and copied when it
+    comes in chunks.
+"""
+TEST_NAME = "Splice Body"
+############# File Definitions ###############################################
+Content = "".join ("%07d\n" % i for i in range (400000))
+
+Plain_File = WgetFile ("plain.txt", Content)
+Resumed_File = WgetFile ("resumed.txt", Content)
+Partial_File = WgetFile ("resumed.txt", Content[:1000000])
+Chunked_File = WgetFile ("chunked.txt", Content,
+                         rules={"TransferEncoding" : 65536})
+
+WGET_OPTIONS = "-c"
+WGET_URLS = [["plain.txt", "resumed.txt", "chunked.txt"]]
+
+Files = [[Plain_File, Resumed_File, Chunked_File]]
+Existing_Files = [Partial_File]
+
+ExpectedReturnCode = 0
+ExpectedDownloadedFiles = [Plain_File, Resumed_File, Chunked_File]
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files,
+    "LocalFiles"        : Existing_Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedFiles"     : ExpectedDownloadedFiles,
+    "ExpectedRetcode"   : ExpectedReturnCode
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
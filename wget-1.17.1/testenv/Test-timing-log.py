@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget with --timing-log, and checks the line logged
+    for each request and the summary at the end of the log.
+"""
+TEST_NAME = "Timing Log"
+############# File Definitions ###############################################
+File1 = "Would you like some Tea?"
+File2 = "Would you like some Coffee?"
+
+A_File = WgetFile ("File1", File1)
+B_File = WgetFile ("File2", File2)
+
+WGET_OPTIONS = "--timing-log=timing.log"
+WGET_URLS = [["File1", "File2", "File3"]]
+
+Files = [[A_File, B_File]]
+
+ExpectedReturnCode = 8
+
+Timing_Log = {
+    "File"              : "timing.log",
+    "Requests"          : [
+        ("/File1", 200),
+        ("/File2", 200),
+        ("/File3", 404),
+    ]
+}
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedRetcode"   : ExpectedReturnCode,
+    "TimingLog"         : Timing_Log
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
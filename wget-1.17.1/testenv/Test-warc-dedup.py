@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+from base64 import b32encode
+from hashlib import sha1
+
+"""
+    This test executes Wget with --warc-dedup on a CDX file listing two
+    earlier captures of File1, and checks that it is stored as a revisit
+    record referring to the later one, while File2, whose payload changed
+    since it was captured, is stored in full.
+"""
+TEST_NAME = "WARC Deduplication"
+############# File Definitions ###############################################
+File1 = "Would you like some Tea?"
+File2 = "Would you like some Coffee?"
+
+A_File = WgetFile ("File1", File1)
+B_File = WgetFile ("File2", File2)
+
+def digest (content):
+    return b32encode (sha1 (content.encode ('UTF-8')).digest ()).decode ()
+
+# The CDX file is written once the port of the server is known.
+cdx_lines = [
+    " CDX a b a m s k r M V g u",
+    "{url}File1 20160101000000 {url}File1 text/plain 200 %s - - 0 "
+    "old.warc.gz <urn:uuid:11111111-1111-1111-1111-111111111111>"
+    % digest (File1),
+    "{url}File2 20160101000000 {url}File2 text/plain 200 %s - - 900 "
+    "old.warc.gz <urn:uuid:33333333-3333-3333-3333-333333333333>"
+    % digest ("Would you like some Milk?"),
+    "{url}File1 20160102000000 {url}File1 text/plain 200 %s - - 1800 "
+    "old.warc.gz <urn:uuid:22222222-2222-2222-2222-222222222222>"
+    % digest (File1),
+]
+
+WGET_OPTIONS = "--warc-file=test --warc-cdx --warc-dedup=dedup.cdx"
+WGET_URLS = [["File1", "File2"]]
+
+Files = [[A_File, B_File]]
+
+ExpectedReturnCode = 0
+
+Warc = {
+    "WarcFile"          : "test.warc.gz",
+    "CdxFile"           : "test.cdx",
+    "Records"           : [
+        ("request", "/File1"),
+        ("revisit", "/File1", {
+            "WARC-Refers-To"    :
+                "<urn:uuid:22222222-2222-2222-2222-222222222222>",
+            "WARC-Payload-Digest"   : "sha1:" + digest (File1)
+        }),
+        ("request", "/File2"),
+        ("response", "/File2"),
+    ]
+}
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedRetcode"   : ExpectedReturnCode,
+    "WarcRecords"       : Warc
+}
+
+http_test = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+)
+
+http_test.setup()
+url = "http://%s:%s/" % (http_test.domains[0], http_test.ports[0])
+cdx = "".join (line.format (url=url) + "\n" for line in cdx_lines)
+pre_test["LocalFiles"] = [WgetFile ("dedup.cdx", cdx)]
+
+err = http_test.begin ()
+
+exit (err)
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+from sys import exit
+from test.http_test import HTTPTest
+from misc.wget_file import WgetFile
+
+"""
+    This test executes Wget with --warc-file and --warc-cdx, and checks
+    the digests of the compressed records, whose payload is digested as
+    it is downloaded, and the offsets of the records in the CDX file.
+"""
+TEST_NAME = "WARC and CDX Files"
+############# File Definitions ###############################################
+File1 = "Would you like some Tea?"
+# Large enough not to fit in the pipe to the compressing process.
+File2 = "".join (str (i) + "\n" for i in range (100000))
+
+A_File = WgetFile ("File1", File1)
+B_File = WgetFile ("File2", File2)
+
+WGET_OPTIONS = "--warc-file=test --warc-cdx"
+WGET_URLS = [["File1", "File2"]]
+
+Files = [[A_File, B_File]]
+
+ExpectedReturnCode = 0
+
+Warc = {
+    "WarcFile"          : "test.warc.gz",
+    "CdxFile"           : "test.cdx",
+    "Records"           : [
+        ("request", "/File1"),
+        ("response", "/File1"),
+        ("request", "/File2"),
+        ("response", "/File2"),
+    ]
+}
+
+################ Pre and Post Test Hooks #####################################
+pre_test = {
+    "ServerFiles"       : Files
+}
+test_options = {
+    "WgetCommands"      : WGET_OPTIONS,
+    "Urls"              : WGET_URLS
+}
+post_test = {
+    "ExpectedRetcode"   : ExpectedReturnCode,
+    "WarcRecords"       : Warc
+}
+
+err = HTTPTest (
+                name=TEST_NAME,
+                pre_hook=pre_test,
+                test_params=test_options,
+                post_hook=post_test
+).begin ()
+
+exit (err)
@@ -0,0 +1,24 @@
+import gzip
+import zlib
+from conf import rule
+
+""" Rule: ContentEncoding
+Have the server compress the file it sends with the given Content-Encoding,
+when the request accepts that encoding. The value is "gzip", "deflate", or
+"raw" for a bare deflate stream without the zlib wrapper, which some servers
+send as "deflate". """
+
+
+@rule()
+class ContentEncoding:
+    def __init__(self, encoding):
+        self.raw = encoding == "raw"
+        self.encoding = "deflate" if self.raw else encoding
+
+    def compress(self, data):
+        if self.encoding == "gzip":
+            return gzip.compress(data)
+        if self.raw:
+            compressor = zlib.compressobj(wbits=-zlib.MAX_WBITS)
+            return compressor.compress(data) + compressor.flush()
+        return zlib.compress(data)
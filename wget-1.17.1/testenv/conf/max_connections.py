@@ -0,0 +1,22 @@
+from exc.test_failed import TestFailed
+from conf import hook
+
+""" Post-Test Hook: MaxConnections
+This is a post-test hook which checks that Wget reused its connections. It
+expects a list with, for each server, the largest number of connections that
+Wget may have opened to it. Raises a TestFailed exception if Wget opened more
+connections than that to a server.
+"""
+
+
+@hook()
+class MaxConnections:
+    def __init__(self, max_connections):
+        self.max_connections = max_connections
+
+    def __call__(self, test_obj):
+        for server, limit in zip(test_obj.servers, self.max_connections):
+            connections = server.server_inst.connections
+            if connections > limit:
+                raise TestFailed("%d connections were opened, expected at "
+                                 "most %d" % (connections, limit))
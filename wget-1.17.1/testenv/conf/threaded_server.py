@@ -0,0 +1,18 @@
+from conf import hook
+
+""" Pre-Test Hook: ThreadedServer
+This is a pre-test hook which makes the servers serve each connection in a
+thread of their own, when set to True. Otherwise a server handles one
+connection at a time, and a connection that Wget keeps alive holds up the
+others. Tests in which Wget keeps several connections open at once need it.
+"""
+
+
+@hook()
+class ThreadedServer:
+    def __init__(self, threaded):
+        self.threaded = threaded
+
+    def __call__(self, test_obj):
+        for server in test_obj.servers:
+            server.server_inst.threaded = self.threaded
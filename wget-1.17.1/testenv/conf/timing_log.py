@@ -0,0 +1,64 @@
+from collections import Counter
+import json
+from conf import hook
+from exc.test_failed import TestFailed
+
+""" Post-Test Hook: TimingLog
+This is a post-test hook which checks the log written by Wget with
+--timing-log. It expects a dictionary with the name of the log as File, and
+as Requests the list of the requests Wget must have logged, in order, each
+a tuple of the path the url must end with and the status, None if no
+response came. Every line must be a JSON object, and the last one must sum
+the others up. Raises a TestFailed exception otherwise.
+"""
+
+PHASES = ("dns", "connect", "tls", "first_byte", "body", "write")
+
+
+@hook()
+class TimingLog:
+    def __init__(self, timing_log):
+        self.timing_log = timing_log
+
+    def __call__(self, test_obj):
+        with open(self.timing_log['File']) as fp:
+            try:
+                lines = [json.loads(line) for line in fp]
+            except ValueError as err:
+                raise TestFailed('Timing log is not JSON: %s' % err)
+        if not lines or 'summary' not in lines[-1]:
+            raise TestFailed('Timing log has no summary.')
+        requests, summary = lines[:-1], lines[-1]['summary']
+
+        expected = self.timing_log['Requests']
+        if len(requests) != len(expected):
+            raise TestFailed('%d requests were logged, expected %d.'
+                             % (len(requests), len(expected)))
+        for request, (path, status) in zip(requests, expected):
+            if not request['url'].endswith(path) \
+                    or request['status'] != status:
+                raise TestFailed('Logged status %s for %s, expected %s for '
+                                 '%s.' % (request['status'], request['url'],
+                                          status, path))
+
+        statuses = Counter(str(request['status']) for request in requests
+                           if request['status'] is not None)
+        totals = {
+            'requests': len(requests),
+            'failed': sum(request['status'] is None for request in requests),
+            'reused': sum(request['reused'] for request in requests),
+            'bytes': sum(request['bytes'] for request in requests),
+        }
+        for name, total in totals.items():
+            if summary[name] != total:
+                raise TestFailed('Summary gives %s %s, expected %s.'
+                                 % (summary[name], name, total))
+        if summary['status'] != dict(statuses):
+            raise TestFailed('Summary gives status counts %s, expected %s.'
+                             % (summary['status'], dict(statuses)))
+        for phase in PHASES:
+            count = sum(request[phase] is not None for request in requests)
+            if summary[phase]['count'] != count \
+                    or sum(summary[phase]['buckets']) != count:
+                raise TestFailed('Summary counts %d %s phases, expected %d.'
+                                 % (summary[phase]['count'], phase, count))
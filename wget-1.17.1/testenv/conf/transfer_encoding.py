@@ -0,0 +1,17 @@
+from conf import rule
+
+""" Rule: TransferEncoding
+Have the server send the file it sends in chunks of the given size, with
+"Transfer-Encoding: chunked" instead of a Content-Length. """
+
+
+@rule()
+class TransferEncoding:
+    def __init__(self, chunk_size):
+        self.chunk_size = chunk_size
+
+    def chunks(self, data):
+        for start in range(0, len(data), self.chunk_size):
+            chunk = data[start:start + self.chunk_size]
+            yield b"%x\r\n" % len(chunk) + chunk + b"\r\n"
+        yield b"0\r\n\r\n"
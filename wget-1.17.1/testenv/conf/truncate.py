@@ -0,0 +1,12 @@
+from conf import rule
+
+""" Rule: Truncate
+Have the server send only the first given number of bytes of the file when
+it sends it whole, and then close the connection, as if it had gone down
+midway. A request for a range of the file is served in full. """
+
+
+@rule()
+class Truncate:
+    def __init__(self, length):
+        self.length = length
@@ -0,0 +1,129 @@
+from base64 import b32encode
+from hashlib import sha1
+import zlib
+from conf import hook
+from exc.test_failed import TestFailed
+
+""" Post-Test Hook: WarcRecords
+This is a post-test hook which checks the WARC file written by Wget. It
+expects a dictionary with the following keys:
+    * WarcFile  : The name of the WARC file, compressed or not.
+    * Records   : A list of the request, response and revisit records the
+    file must contain, in order. Each is a tuple of the WARC-Type, the path
+    the WARC-Target-URI must end with and, optionally, a dictionary of
+    other headers the record must have.
+    * CdxFile   : Optionally, the name of the CDX file written along.
+The block digest of every record and the payload digest of every response
+record must match their contents. Every line of the CDX file must give the
+offset of the response record it describes, and its payload digest.
+Raises a TestFailed exception if any of these doesn't hold.
+"""
+
+
+def sha1_digest(data):
+    return "sha1:" + b32encode(sha1(data).digest()).decode('ascii')
+
+
+@hook()
+class WarcRecords:
+    def __init__(self, warc):
+        self.warc = warc
+
+    @staticmethod
+    def read_members(data):
+        """ Split the WARC file into its GZIP members, and return them with
+        their offsets. An uncompressed file is a single member. """
+        if not data.startswith(b'\x1f\x8b'):
+            return [(0, data)]
+        members = []
+        offset = 0
+        while offset < len(data):
+            inflater = zlib.decompressobj(16 + zlib.MAX_WBITS)
+            member = inflater.decompress(data[offset:])
+            if not inflater.eof:
+                raise TestFailed('Truncated GZIP member at offset %d.'
+                                 % offset)
+            members.append((offset, member))
+            offset = len(data) - len(inflater.unused_data)
+        return members
+
+    @staticmethod
+    def read_records(data):
+        """ Parse the records in DATA, and return them as a list of their
+        offsets in DATA, header dictionaries and blocks. """
+        records = []
+        offset = 0
+        while offset < len(data):
+            head, sep, rest = data[offset:].partition(b'\r\n\r\n')
+            lines = head.decode('utf-8').split('\r\n')
+            if not sep or lines[0] != 'WARC/1.0':
+                raise TestFailed('Malformed WARC record header.')
+            headers = dict(line.split(': ', 1) for line in lines[1:])
+            length = int(headers['Content-Length'])
+            block = rest[:length]
+            if rest[length:length + 4] != b'\r\n\r\n':
+                raise TestFailed('WARC record not terminated.')
+            records.append((offset, headers, block))
+            offset += len(head) + 4 + length + 4
+        return records
+
+    def __call__(self, test_obj):
+        with open(self.warc['WarcFile'], 'rb') as fp:
+            members = self.read_members(fp.read())
+
+        records = []
+        offsets = {}
+        for offset, member in members:
+            for start, headers, block in self.read_records(member):
+                records.append((headers, block))
+                offsets[headers['WARC-Record-ID']] = offset + start
+
+        for headers, block in records:
+            if headers.get('WARC-Block-Digest') != sha1_digest(block):
+                raise TestFailed('Wrong block digest in record %s.'
+                                 % headers['WARC-Record-ID'])
+            if headers['WARC-Type'] == 'response':
+                payload = block.partition(b'\r\n\r\n')[2]
+                if headers.get('WARC-Payload-Digest') != sha1_digest(payload):
+                    raise TestFailed('Wrong payload digest in record %s.'
+                                     % headers['WARC-Record-ID'])
+
+        http_records = [headers for headers, block in records
+                        if headers['WARC-Type'] in ('request', 'response',
+                                                    'revisit')]
+        if len(http_records) != len(self.warc['Records']):
+            raise TestFailed('%d records were written, expected %d.'
+                             % (len(http_records), len(self.warc['Records'])))
+        for headers, expected in zip(http_records, self.warc['Records']):
+            if headers['WARC-Type'] != expected[0] \
+                    or not headers['WARC-Target-URI'].endswith(expected[1]):
+                raise TestFailed('Found a %s record for %s, expected a %s '
+                                 'record for %s.'
+                                 % (headers['WARC-Type'],
+                                    headers['WARC-Target-URI'],
+                                    expected[0], expected[1]))
+            for name, value in (expected[2] if len(expected) > 2
+                                else {}).items():
+                if headers.get(name) != test_obj._replace_substring(value):
+                    raise TestFailed('Header %s of the %s record for %s is '
+                                     '%s.' % (name, expected[0], expected[1],
+                                              headers.get(name)))
+
+        if 'CdxFile' in self.warc:
+            by_id = dict((headers['WARC-Record-ID'], headers)
+                         for headers, block in records)
+            with open(self.warc['CdxFile']) as fp:
+                lines = fp.read().splitlines()
+            if lines[0] != ' CDX a b a m s k r M V g u':
+                raise TestFailed('Malformed CDX header.')
+            for line in lines[1:]:
+                fields = line.split(' ')
+                headers = by_id.get(fields[10])
+                if headers is None or offsets[fields[10]] != int(fields[8]):
+                    raise TestFailed('CDX line for %s does not give the '
+                                     'offset of its record.' % fields[0])
+                if headers['WARC-Target-URI'] != fields[0] \
+                        or headers['WARC-Payload-Digest'] != \
+                        'sha1:' + fields[5]:
+                    raise TestFailed('CDX line for %s does not match its '
+                                     'record.' % fields[0])
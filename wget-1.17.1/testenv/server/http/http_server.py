@@ -1,6 +1,6 @@
 from http.server import HTTPServer, BaseHTTPRequestHandler
 from exc.server_error import ServerError, AuthError, NoBodyServerError
-from socketserver import BaseServer
+from socketserver import BaseServer, ThreadingMixIn
 from posixpath import basename, splitext
 from base64 import b64encode
 from random import random
@@ -10,7 +10,7 @@ import socket
 import os
 
 
-class StoppableHTTPServer(HTTPServer):
+class StoppableHTTPServer(ThreadingMixIn, HTTPServer):
     """ This class extends the HTTPServer class from default http.server library
     in Python 3. The StoppableHTTPServer class is capable of starting an HTTP
     server that serves a virtual set of files made by the WgetFile class and
@@ -18,6 +18,15 @@ class StoppableHTTPServer(HTTPServer):
     method. """
 
     request_headers = list()
+    daemon_threads = True
+
+    """ The number of connections accepted so far. """
+    connections = 0
+
+    """ Whether to serve each connection in a thread of its own, so that a
+    connection kept alive by one Wget process does not hold up the others
+    when Wget downloads in parallel. See the ThreadedServer hook. """
+    threaded = False
 
     """ Define methods for configuring the Server. """
 
@@ -29,6 +38,13 @@ class StoppableHTTPServer(HTTPServer):
     def get_req_headers(self):
         return self.request_headers
 
+    def process_request(self, request, client_address):
+        self.connections += 1
+        if self.threaded:
+            ThreadingMixIn.process_request(self, request, client_address)
+        else:
+            HTTPServer.process_request(self, request, client_address)
+
 
 class HTTPSServer(StoppableHTTPServer):
     """ The HTTPSServer class extends the StoppableHTTPServer class with
@@ -82,14 +98,27 @@ class _Handler(BaseHTTPRequestHandler):
         """ Process HTTP GET requests. This is the same as processing HEAD
         requests and then actually transmitting the data to the client. If
         send_head() does not specify any "start" offset, we send the complete
-        data, else transmit only partial data. """
+        data, else transmit only partial data. The data is sent in chunks or
+        cut short if the TransferEncoding or Truncate rule asks so. """
 
         content, start = self.send_head("GET")
         if content:
             if start is None:
-                self.wfile.write(content.encode('utf-8'))
+                body = content
+            elif self.range_end is None:
+                body = content[start:]
+            else:
+                body = content[start:self.range_end + 1]
+            transfer_obj = self.get_rule_list('TransferEncoding')
+            truncate_obj = self.get_rule_list('Truncate')
+            if transfer_obj:
+                for chunk in transfer_obj.chunks(body):
+                    self.wfile.write(chunk)
+            elif truncate_obj and start is None:
+                self.wfile.write(body[:truncate_obj.length])
+                self.close_connection = True
             else:
-                self.wfile.write(content.encode('utf-8')[start:])
+                self.wfile.write(body)
 
     def do_POST(self):
         """ According to RFC 7231 sec 4.3.3, if the resource requested in a POST
@@ -141,15 +170,18 @@ class _Handler(BaseHTTPRequestHandler):
 
     def parse_range_header(self, header_line, length):
         import re
+        self.range_end = None
         if header_line is None:
             return None
         if not header_line.startswith("bytes="):
             raise ServerError("Cannot parse header Range: %s" %
                               (header_line))
-        regex = re.match(r"^bytes=(\d*)\-$", header_line)
+        regex = re.match(r"^bytes=(\d*)\-(\d*)$", header_line)
         range_start = int(regex.group(1))
         if range_start >= length:
             raise ServerError("Range Overflow")
+        if regex.group(2):
+            self.range_end = min(int(regex.group(2)), length - 1)
         return range_start
 
     def get_body_data(self):
@@ -181,6 +213,31 @@ class _Handler(BaseHTTPRequestHandler):
     def SendHeader(self, header_obj):
         pass
 
+    """ Likewise, the ContentEncoding, TransferEncoding and Truncate rules
+    only change how the file is sent, once the response is known. They are
+    applied by send_head() and do_GET(). """
+    def ContentEncoding(self, encoding_obj):
+        pass
+
+    def TransferEncoding(self, transfer_obj):
+        pass
+
+    def Truncate(self, truncate_obj):
+        pass
+
+    def encode_content(self, content):
+        """ Compress content as the ContentEncoding rule asks, unless the
+        request does not accept that encoding. """
+        encoding_obj = self.get_rule_list('ContentEncoding')
+        if not encoding_obj:
+            return content
+        accepted = self.headers.get("Accept-Encoding", "")
+        if encoding_obj.encoding not in [coding.split(";")[0].strip()
+                                         for coding in accepted.split(",")]:
+            return content
+        self.add_header("Content-Encoding", encoding_obj.encoding)
+        return encoding_obj.compress(content)
+
     def send_cust_headers(self):
         header_obj = self.get_rule_list('SendHeader')
         if header_obj:
@@ -398,8 +455,7 @@ class _Handler(BaseHTTPRequestHandler):
         if path in self.server.fileSys:
             self.rules = self.server.server_configs.get(path)
 
-            content = self.server.fileSys.get(path)
-            content_length = len(content)
+            content = self.server.fileSys.get(path).encode('utf-8')
             for rule_name in self.rules:
                 try:
                     assert hasattr(self, rule_name)
@@ -418,6 +474,8 @@ class _Handler(BaseHTTPRequestHandler):
                     print(se.__str__())
                     return(content, None)
 
+            content = self.encode_content(content)
+            content_length = len(content)
             try:
                 self.range_begin = self.parse_range_header(
                     self.headers.get("Range"), content_length)
@@ -434,14 +492,20 @@ class _Handler(BaseHTTPRequestHandler):
             else:
                 self.send_response(206)
                 self.add_header("Accept-Ranges", "bytes")
+                range_end = self.range_end
+                if range_end is None:
+                    range_end = content_length - 1
                 self.add_header("Content-Range",
                                 "bytes %d-%d/%d" % (self.range_begin,
-                                                    content_length - 1,
+                                                    range_end,
                                                     content_length))
-                content_length -= self.range_begin
+                content_length = range_end + 1 - self.range_begin
             cont_type = self.guess_type(path)
             self.add_header("Content-Type", cont_type)
-            self.add_header("Content-Length", content_length)
+            if self.get_rule_list('TransferEncoding'):
+                self.add_header("Transfer-Encoding", "chunked")
+            else:
+                self.add_header("Content-Length", content_length)
             self.finish_headers()
             return(content, self.range_begin)
         else:
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# bench-body.py: Time how fast Wget retrieves a large body from a local
+#                HTTP server.
+#
+# Copyright (C) 2016 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.
+
+"""
+Usage: bench-body.py [-w WGET] [-s MEGABYTES] [-r RUNS] [-c] [-o FILE]
+
+Serve a body of MEGABYTES (default 1024) from 127.0.0.1, and retrieve it
+RUNS times (default 5) with WGET (default "wget") to FILE (default a
+temporary file).  With -c, the body is sent with chunked transfer
+encoding.  Print the best and the median time and rate.
+"""
+
+import getopt
+import http.server
+import os
+import socketserver
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+CHUNK = 1024 * 1024
+
+class Handler (http.server.BaseHTTPRequestHandler):
+    def log_message (self, *args):
+        pass
+
+    def do_GET (self):
+        size = self.server.body_size
+        self.send_response (200)
+        self.send_header ("Content-Type", "application/octet-stream")
+        if self.server.chunked:
+            self.send_header ("Transfer-Encoding", "chunked")
+        else:
+            self.send_header ("Content-Length", str (size))
+        self.send_header ("Connection", "close")
+        self.end_headers ()
+        with open (self.server.body_file, "rb") as body:
+            if not self.server.chunked:
+                self.wfile.flush ()
+                self.connection.sendfile (body)
+                return
+            while True:
+                data = body.read (CHUNK)
+                if not data:
+                    break
+                self.wfile.write (b"%x\r\n" % len (data) + data + b"\r\n")
+            self.wfile.write (b"0\r\n\r\n")
+
+class Server (socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+def main ():
+    wget, megabytes, runs, chunked, output = "wget", 1024, 5, False, None
+    try:
+        opts, args = getopt.getopt (sys.argv[1:], "w:s:r:co:h")
+    except getopt.GetoptError as err:
+        sys.exit ("bench-body.py: %s\n%s" % (err, __doc__.strip ()))
+    for opt, val in opts:
+        if opt == "-w":
+            wget = val
+        elif opt == "-s":
+            megabytes = int (val)
+        elif opt == "-r":
+            runs = int (val)
+        elif opt == "-c":
+            chunked = True
+        elif opt == "-o":
+            output = val
+        else:
+            print (__doc__.strip ())
+            return 0
+
+    workdir = tempfile.mkdtemp (prefix="bench-body.")
+    body_file = os.path.join (workdir, "body")
+    with open (body_file, "wb") as body:
+        block = os.urandom (CHUNK)
+        for i in range (megabytes):
+            body.write (block)
+    if output is None:
+        output = os.path.join (workdir, "out")
+
+    server = Server (("127.0.0.1", 0), Handler)
+    server.body_file = body_file
+    server.body_size = megabytes * CHUNK
+    server.chunked = chunked
+    threading.Thread (target=server.serve_forever, daemon=True).start ()
+    url = "http://127.0.0.1:%d/body" % server.server_address[1]
+
+    times = []
+    try:
+        for i in range (runs):
+            start = time.time ()
+            subprocess.check_call ([wget, "-q", "-O", output, url])
+            times.append (time.time () - start)
+            if os.path.getsize (output) != server.body_size:
+                sys.exit ("bench-body.py: %s has the wrong size" % output)
+    finally:
+        server.shutdown ()
+        for name in (body_file, os.path.join (workdir, "out")):
+            if os.path.exists (name):
+                os.unlink (name)
+        os.rmdir (workdir)
+
+    times.sort ()
+    for label, secs in (("best", times[0]), ("median", times[len (times) // 2])):
+        print ("%-6s %7.3fs %9.1f MB/s" % (label, secs, megabytes / secs))
+    return 0
+
+if __name__ == "__main__":
+    sys.exit (main ())
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+# bench-warc.py: Time how fast Wget writes a WARC file of many records,
+#                and check the records it wrote.
+#
+# Copyright (C) 2016 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.
+
+"""
+Usage: bench-warc.py [-w WGET] [-n RECORDS] [-s KILOBYTES] [-r RUNS] [-u]
+
+Serve RECORDS / 2 (default 5000) synthetic pages of about KILOBYTES
+(default 16) each from 127.0.0.1, and retrieve them RUNS times
+(default 3) with WGET (default "wget") into a WARC file, which then
+holds RECORDS request and response records.  With -u, the WARC file
+is not compressed.  Print the best and the median time and rate, and
+check that every record of the last WARC file is a GZIP member of its
+own with the right skip length, and has the right digests.
+"""
+
+import base64
+import getopt
+import hashlib
+import http.server
+import os
+import random
+import re
+import socketserver
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import zlib
+
+WORDS = ("archive", "crawl", "record", "payload", "digest", "member",
+         "request", "response", "header", "block", "index", "page")
+
+class Handler (http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True
+
+    def log_message (self, *args):
+        pass
+
+    def do_GET (self):
+        number = int (self.path.strip ("/").split (".")[0] or 0)
+        body = self.server.page (number)
+        self.send_response (200)
+        self.send_header ("Content-Type", "text/html")
+        self.send_header ("Content-Length", str (len (body)))
+        self.end_headers ()
+        self.wfile.write (body)
+
+class Server (socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+    def page (self, number):
+        rand = random.Random (number)
+        text = " ".join (rand.choice (WORDS)
+                         for i in range (self.page_size // 7))
+        return ("<html><body><p>Page %d</p><p>%s</p></body></html>\n"
+                % (number, text)).encode ()
+
+def sha1 (data):
+    return "sha1:" + base64.b32encode (hashlib.sha1 (data).digest ()).decode ()
+
+def check_record (record):
+    head, sep, block = record.partition (b"\r\n\r\n")
+    fields = dict (re.findall (rb"^([^:\r\n]+): (.*?)\r$", head + b"\r",
+                               re.M))
+    if not head.startswith (b"WARC/1.0\r\n") or not block.endswith (b"\r\n\r\n"):
+        return "malformed record"
+    block = block[:-4]
+    if int (fields[b"Content-Length"]) != len (block):
+        return "wrong Content-Length"
+    if b"WARC-Block-Digest" in fields \
+       and fields[b"WARC-Block-Digest"].decode () != sha1 (block):
+        return "wrong WARC-Block-Digest"
+    # A revisit record gives the digest of a payload it does not hold.
+    if b"WARC-Payload-Digest" in fields \
+       and fields[b"WARC-Type"] in (b"request", b"response"):
+        payload = block.partition (b"\r\n\r\n")[2]
+        if fields[b"WARC-Payload-Digest"].decode () != sha1 (payload):
+            return "wrong WARC-Payload-Digest"
+    return None
+
+def check_warc (name, compressed):
+    """Return the number of records in the WARC file NAME, or exit if
+       one of them is wrong."""
+    with open (name, "rb") as f:
+        data = f.read ()
+    records = []
+    if compressed:
+        while data:
+            # The "sl" extra field holds the length of the member.
+            if data[3] & 4 == 0 or data[12:14] != b"sl":
+                sys.exit ("bench-warc.py: record %d has no skip length"
+                          % len (records))
+            length = int.from_bytes (data[16:20], "little")
+            d = zlib.decompressobj (31)
+            records.append (d.decompress (data[:length]))
+            if not d.eof or d.unused_data:
+                sys.exit ("bench-warc.py: record %d has a wrong skip length"
+                          % len (records))
+            data = data[length:]
+    else:
+        records = [b"WARC/1.0\r\n" + r for r in data.split (b"WARC/1.0\r\n")[1:]]
+    for i, record in enumerate (records):
+        error = check_record (record)
+        if error:
+            sys.exit ("bench-warc.py: record %d: %s" % (i, error))
+    return len (records)
+
+def main ():
+    wget, records, kilobytes, runs, compressed = "wget", 10000, 16, 3, True
+    try:
+        opts, args = getopt.getopt (sys.argv[1:], "w:n:s:r:uh")
+    except getopt.GetoptError as err:
+        sys.exit ("bench-warc.py: %s\n%s" % (err, __doc__.strip ()))
+    for opt, val in opts:
+        if opt == "-w":
+            wget = val
+        elif opt == "-n":
+            records = int (val)
+        elif opt == "-s":
+            kilobytes = int (val)
+        elif opt == "-r":
+            runs = int (val)
+        elif opt == "-u":
+            compressed = False
+        else:
+            print (__doc__.strip ())
+            return 0
+
+    workdir = tempfile.mkdtemp (prefix="bench-warc.")
+    server = Server (("127.0.0.1", 0), Handler)
+    server.page_size = kilobytes * 1024
+    threading.Thread (target=server.serve_forever, daemon=True).start ()
+    urls = os.path.join (workdir, "urls")
+    with open (urls, "w") as f:
+        for i in range (records // 2):
+            f.write ("http://127.0.0.1:%d/%d.html\n"
+                     % (server.server_address[1], i))
+    warc = os.path.join (workdir, "out")
+    warc_file = warc + (".warc.gz" if compressed else ".warc")
+    command = [wget, "-q", "-O", os.devnull, "-i", urls, "--warc-file", warc]
+    if not compressed:
+        command.append ("--no-warc-compression")
+
+    times = []
+    try:
+        for i in range (runs):
+            start = time.time ()
+            subprocess.check_call (command, cwd=workdir)
+            times.append (time.time () - start)
+        found = check_warc (warc_file, compressed)
+        size = os.path.getsize (warc_file)
+    finally:
+        server.shutdown ()
+        for name in os.listdir (workdir):
+            os.unlink (os.path.join (workdir, name))
+        os.rmdir (workdir)
+
+    times.sort ()
+    for label, secs in (("best", times[0]), ("median", times[len (times) // 2])):
+        print ("%-6s %7.3fs %9.1f records/s" % (label, secs, records / secs))
+    print ("%d records, %d bytes, all correct" % (found, size))
+    return 0
+
+if __name__ == "__main__":
+    sys.exit (main ())